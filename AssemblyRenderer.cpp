@@ -0,0 +1,585 @@
+/*--------------------------------------------------------------------------
+    AssemblyRenderer.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "AssemblyRenderer.h"
+#include "Profiler.h"
+#include "UniformBlocks.h"
+#include <algorithm>
+#include <cfloat>
+
+// The render shader's instance matrix occupies four consecutive attribute locations.
+static const GLuint INSTANCE_MATRIX_LOCATION = 4;
+
+AssemblyRenderer::AssemblyRenderer(BufferRing* pUniformRing)
+    : uploaded(false), flattened(false), front(0), cullPending(false), culling(false), pCullPool(NULL),
+      vao(0), vertexBuffer(0), indexBuffer(0), instanceBuffer(0), commandBuffer(0), pUniformRing(pUniformRing), variants("render")
+{
+    results[0].visibleInstances = results[1].visibleInstances = 0;
+    statistics.visibleInstances = 0;
+    statistics.commands = 0;
+    statistics.apiCalls = 0;
+    statistics.streamedBytes = 0;
+}
+
+AssemblyRenderer::~AssemblyRenderer()
+{
+    // A pool task may still be writing into this object.
+    FinishCull();
+
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+    glDeleteBuffers(1, &instanceBuffer);
+    glDeleteBuffers(1, &commandBuffer);
+}
+
+bool AssemblyRenderer::Initialize()
+{
+    if (!GLEW_ARB_multi_draw_indirect || !GLEW_ARB_base_instance)
+    {
+        std::cout << "Multi-draw indirect rendering needs ARB_multi_draw_indirect and ARB_base_instance!" << std::endl;
+        return false;
+    }
+
+    variants.Request(SHADER_INSTANCED);
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(colorVertex), (GLvoid*)offsetof(colorVertex, x));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(colorVertex), (GLvoid*)offsetof(colorVertex, r));
+    glEnableVertexAttribArray(1);
+
+    // Commands set baseInstance to their first matrix, so instances of a part read consecutive matrices.
+    glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    for (GLuint column = 0; column < 4; column++)
+    {
+        glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (GLvoid*)(column * 4 * sizeof(float)));
+        glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + column, 1);
+        glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + column);
+    }
+
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBindVertexArray(0);
+
+    glGenBuffers(1, &commandBuffer);
+    return true;
+}
+
+int AssemblyRenderer::AddPart(const Mesh& mesh)
+{
+    Part part;
+    part.firstIndex = (GLuint)indices.size();
+    part.indexCount = (GLuint)mesh.indices.size();
+    part.baseVertex = (GLint)vertices.size();
+
+    // Sphere around the box center; looser than a minimal sphere but enough for culling.
+    float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        const float position[3] = { mesh.vertices[i].x, mesh.vertices[i].y, mesh.vertices[i].z };
+        for (int j = 0; j < 3; j++)
+        {
+            min[j] = std::min(min[j], position[j]);
+            max[j] = std::max(max[j], position[j]);
+        }
+    }
+
+    float radiusSquared = 0.0f;
+    for (int j = 0; j < 3; j++)
+    {
+        part.center[j] = mesh.vertices.empty() ? 0.0f : 0.5f * (min[j] + max[j]);
+    }
+
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        float dx = mesh.vertices[i].x - part.center[0], dy = mesh.vertices[i].y - part.center[1], dz = mesh.vertices[i].z - part.center[2];
+        radiusSquared = std::max(radiusSquared, dx*dx + dy*dy + dz*dz);
+    }
+
+    part.radius = sqrtf(radiusSquared);
+    part.coarser = -1;
+    part.coarserDistance = FLT_MAX;
+
+    vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+    parts.push_back(part);
+    uploaded = false;
+    return (int)parts.size() - 1;
+}
+
+void AssemblyRenderer::SetLod(int part, int coarserPart, float distance)
+{
+    parts[part].coarser = coarserPart;
+    parts[part].coarserDistance = distance;
+}
+
+int AssemblyRenderer::AddGroup(const float transform[16], int parent)
+{
+    return AddInstance(-1, transform, parent);
+}
+
+int AssemblyRenderer::AddInstance(int part, const float transform[16], int parent)
+{
+    Node node;
+    node.parent = parent;
+    node.part = part;
+    std::copy(transform, transform + 16, node.transform);
+    nodes.push_back(node);
+    flattened = false;
+    return (int)nodes.size() - 1;
+}
+
+void AssemblyRenderer::Clear()
+{
+    vertices.clear();
+    indices.clear();
+    parts.clear();
+    nodes.clear();
+    uploaded = false;
+    flattened = false;
+}
+
+void AssemblyRenderer::Upload()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(colorVertex), vertices.empty() ? NULL : &vertices[0], GL_STATIC_DRAW);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int), indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    uploaded = true;
+}
+
+// Column-major 4x4 product, result = a * b.
+static void MultiplyMatrices(const float a[16], const float b[16], float result[16])
+{
+    for (int column = 0; column < 4; column++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++)
+            {
+                sum += a[k*4 + row] * b[column*4 + k];
+            }
+
+            result[column*4 + row] = sum;
+        }
+    }
+}
+
+// Grows a sphere to also enclose another.
+static void EncloseSphere(float center[3], float& radius, const float otherCenter[3], float otherRadius)
+{
+    float offset[3] = { otherCenter[0] - center[0], otherCenter[1] - center[1], otherCenter[2] - center[2] };
+    float distance = sqrtf(offset[0]*offset[0] + offset[1]*offset[1] + offset[2]*offset[2]);
+    if (radius < 0.0f)
+    {
+        std::copy(otherCenter, otherCenter + 3, center);
+        radius = otherRadius;
+    }
+    else if (distance + otherRadius > radius)
+    {
+        if (distance + radius <= otherRadius)
+        {
+            std::copy(otherCenter, otherCenter + 3, center);
+            radius = otherRadius;
+            return;
+        }
+
+        float newRadius = 0.5f * (radius + distance + otherRadius);
+        float shift = (newRadius - radius) / distance;
+        for (int i = 0; i < 3; i++)
+        {
+            center[i] += offset[i] * shift;
+        }
+
+        radius = newRadius;
+    }
+}
+
+void AssemblyRenderer::Flatten(ThreadPool* pPool)
+{
+    ProfileScope scope("Flatten");
+    // Parents always precede their children, as nodes can only be added below existing ones.
+    std::vector<std::vector<int>> children(nodes.size());
+    std::vector<int> roots;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        (nodes[i].parent < 0 ? roots : children[nodes[i].parent]).push_back((int)i);
+    }
+
+    flatNodes.resize(nodes.size());
+    size_t next = 0;
+    std::vector<std::pair<int, size_t>> stack; // Node and its next child to visit.
+    std::vector<size_t> flatIndices(nodes.size());
+    for (size_t r = 0; r < roots.size(); r++)
+    {
+        stack.push_back(std::make_pair(roots[r], (size_t)0));
+        while (!stack.empty())
+        {
+            int nodeId = stack.back().first;
+            size_t child = stack.back().second;
+            if (child == 0)
+            {
+                // First visit: place the node and compute its world transform.
+                size_t index = next++;
+                flatIndices[nodeId] = index;
+                FlatNode& flat = flatNodes[index];
+                flat.part = nodes[nodeId].part;
+                if (nodes[nodeId].parent < 0)
+                {
+                    std::copy(nodes[nodeId].transform, nodes[nodeId].transform + 16, flat.world);
+                }
+                else
+                {
+                    MultiplyMatrices(flatNodes[flatIndices[nodes[nodeId].parent]].world, nodes[nodeId].transform, flat.world);
+                }
+            }
+
+            if (child < children[nodeId].size())
+            {
+                stack.back().second++;
+                stack.push_back(std::make_pair(children[nodeId][child], (size_t)0));
+            }
+            else
+            {
+                flatNodes[flatIndices[nodeId]].subtreeEnd = (unsigned int)next;
+                stack.pop_back();
+            }
+        }
+    }
+
+    // Bounds bottom-up: each node's own part, then its direct children.
+    for (size_t i = flatNodes.size(); i-- > 0;)
+    {
+        FlatNode& flat = flatNodes[i];
+        flat.radius = -1.0f;
+        if (flat.part >= 0)
+        {
+            const Part& part = parts[flat.part];
+            const float* m = flat.world;
+            float scaleSquared = 0.0f;
+            for (int j = 0; j < 3; j++)
+            {
+                flat.center[j] = m[j] * part.center[0] + m[4 + j] * part.center[1] + m[8 + j] * part.center[2] + m[12 + j];
+                scaleSquared = std::max(scaleSquared, m[j*4]*m[j*4] + m[j*4 + 1]*m[j*4 + 1] + m[j*4 + 2]*m[j*4 + 2]);
+            }
+
+            flat.radius = part.radius * sqrtf(scaleSquared);
+        }
+
+        for (size_t child = i + 1; child < flat.subtreeEnd; child = flatNodes[child].subtreeEnd)
+        {
+            if (flatNodes[child].radius >= 0.0f)
+            {
+                EncloseSphere(flat.center, flat.radius, flatNodes[child].center, flatNodes[child].radius);
+            }
+        }
+    }
+
+    // Jobs are runs of whole subtrees of about equal size. Groups too big for one job are split into their
+    // children, giving up only the cull test of that group itself.
+    size_t threads = pPool != NULL ? pPool->ThreadCount() + 1 : 1;
+    size_t jobSize = std::max((size_t)256, flatNodes.size() / (threads * 4));
+    jobRanges.clear();
+    size_t i = 0;
+    while (i < flatNodes.size())
+    {
+        size_t end = flatNodes[i].subtreeEnd;
+        if (end - i > jobSize && end - i > 1 && flatNodes[i].part < 0)
+        {
+            i++;
+            continue;
+        }
+
+        if (!jobRanges.empty() && jobRanges.back().second == i && end - jobRanges.back().first <= jobSize)
+        {
+            jobRanges.back().second = end;
+        }
+        else
+        {
+            jobRanges.push_back(std::make_pair(i, end));
+        }
+
+        i = end;
+    }
+
+    jobOutputs.resize(jobRanges.size());
+    flattened = true;
+}
+
+void AssemblyRenderer::CullRange(size_t begin, size_t end, JobOutput& output) const
+{
+    // Sized for everything being visible, which costs nothing extra in an arena.
+    output.pArena = FrameArena::GetArena();
+    output.pVisible = FrameAllocator<Visible>(output.pArena).allocate(end - begin);
+    output.count = 0;
+    size_t i = begin;
+    while (i < end)
+    {
+        const FlatNode& flat = flatNodes[i];
+        bool inside = flat.radius >= 0.0f;
+        for (int j = 0; j < 6 && inside; j++)
+        {
+            inside = planes[j][0]*flat.center[0] + planes[j][1]*flat.center[1] + planes[j][2]*flat.center[2] + planes[j][3] >= -flat.radius;
+        }
+
+        if (!inside)
+        {
+            i = flat.subtreeEnd;
+            continue;
+        }
+
+        if (flat.part >= 0)
+        {
+            // The subtree sphere is a good enough stand-in for the part's own position here.
+            float depth = depthRow[0]*flat.center[0] + depthRow[1]*flat.center[1] + depthRow[2]*flat.center[2] + depthRow[3];
+            int part = flat.part;
+            while (parts[part].coarser >= 0 && depth > parts[part].coarserDistance)
+            {
+                part = parts[part].coarser;
+            }
+
+            Visible& entry = output.pVisible[output.count++];
+            entry.node = (unsigned int)i;
+            entry.part = part;
+        }
+
+        i++;
+    }
+}
+
+void AssemblyRenderer::CullInto(ThreadPool* pPool, CullResult& result)
+{
+    ProfileScope scope("Cull");
+    ThreadPool::RunChunks(pPool, jobRanges.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t job = begin; job < end; job++)
+        {
+            CullRange(jobRanges[job].first, jobRanges[job].second, jobOutputs[job]);
+        }
+    });
+
+    // Lay the matrices out part by part, in job order so the result doesn't depend on timing.
+    FrameAllocator<GLuint> allocator(FrameArena::GetArena());
+    std::vector<GLuint, FrameAllocator<GLuint>> partCounts(parts.size(), 0, allocator);
+    size_t visibleCount = 0;
+    for (size_t job = 0; job < jobOutputs.size(); job++)
+    {
+        for (size_t i = 0; i < jobOutputs[job].count; i++)
+        {
+            partCounts[jobOutputs[job].pVisible[i].part]++;
+        }
+
+        visibleCount += jobOutputs[job].count;
+    }
+
+    result.commands.clear();
+    std::vector<GLuint, FrameAllocator<GLuint>> partOffsets(parts.size(), 0, allocator);
+    GLuint offset = 0;
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        partOffsets[i] = offset;
+        if (partCounts[i] != 0)
+        {
+            DrawCommand command;
+            command.count = parts[i].indexCount;
+            command.instanceCount = partCounts[i];
+            command.firstIndex = parts[i].firstIndex;
+            command.baseVertex = parts[i].baseVertex;
+            command.baseInstance = offset;
+            result.commands.push_back(command);
+        }
+
+        offset += partCounts[i];
+    }
+
+    result.matrices.resize(visibleCount * 16);
+    for (size_t job = 0; job < jobOutputs.size(); job++)
+    {
+        JobOutput& output = jobOutputs[job];
+        for (size_t i = 0; i < output.count; i++)
+        {
+            const Visible& entry = output.pVisible[i];
+            const float* pWorld = flatNodes[entry.node].world;
+            std::copy(pWorld, pWorld + 16, &result.matrices[partOffsets[entry.part]++ * 16]);
+        }
+
+        FrameAllocator<Visible>(output.pArena).deallocate(output.pVisible, jobRanges[job].second - jobRanges[job].first);
+    }
+
+    result.visibleInstances = visibleCount;
+}
+
+void AssemblyRenderer::BeginCull(ThreadPool* pPool, const float projection[16], const float view[16])
+{
+    FinishCull();
+    if (!flattened)
+    {
+        Flatten(pPool);
+    }
+
+    // Frustum planes straight from the rows of the view-projection matrix, as (a, b, c, d) with a*x + b*y + c*z + d >= 0 inside.
+    float clip[16];
+    MultiplyMatrices(projection, view, clip);
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            planes[i*2][j] = clip[j*4 + 3] + clip[j*4 + i];
+            planes[i*2 + 1][j] = clip[j*4 + 3] - clip[j*4 + i];
+        }
+    }
+
+    for (int i = 0; i < 6; i++)
+    {
+        float length = sqrtf(planes[i][0]*planes[i][0] + planes[i][1]*planes[i][1] + planes[i][2]*planes[i][2]);
+        for (int j = 0; j < 4; j++)
+        {
+            planes[i][j] /= length;
+        }
+    }
+
+    // Clip w is the view depth for perspective projections.
+    for (int j = 0; j < 4; j++)
+    {
+        depthRow[j] = clip[j*4 + 3];
+    }
+
+    cullPending = true;
+    pCullPool = pPool;
+    if (pPool == NULL)
+    {
+        CullInto(NULL, results[1 - front]);
+        return;
+    }
+
+    // The queue is shared with long jobs such as fine meshing, so the task may not start before the frame needs it.
+    culling = true;
+    pPool->Enqueue(&AssemblyRenderer::RunCullTask, this);
+}
+
+void AssemblyRenderer::RunCullTask(void* pRenderer)
+{
+    AssemblyRenderer *pThis = (AssemblyRenderer*)pRenderer;
+    pThis->CullInto(pThis->pCullPool, pThis->results[1 - pThis->front]);
+
+    std::lock_guard<std::mutex> lock(pThis->cullMutex);
+    pThis->culling = false;
+    pThis->cullDone.notify_all();
+}
+
+void AssemblyRenderer::FinishCull()
+{
+    if (!cullPending)
+    {
+        return;
+    }
+
+    if (pCullPool != NULL && pCullPool->Cancel(&AssemblyRenderer::RunCullTask, this) != 0)
+    {
+        // Not started yet: run it here. Its chunks still go to any idle workers.
+        CullInto(pCullPool, results[1 - front]);
+        culling = false;
+    }
+    else
+    {
+        std::unique_lock<std::mutex> lock(cullMutex);
+        while (culling)
+        {
+            cullDone.wait(lock);
+        }
+    }
+
+    front = 1 - front;
+    cullPending = false;
+    statistics.visibleInstances = results[front].visibleInstances;
+    statistics.commands = results[front].commands.size();
+}
+
+void AssemblyRenderer::Cull(ThreadPool* pPool, const float projection[16], const float view[16])
+{
+    BeginCull(pPool, projection, view);
+    FinishCull();
+}
+
+void AssemblyRenderer::Draw(const float projection[16], const float view[16])
+{
+    statistics.apiCalls = 0;
+    statistics.streamedBytes = 0;
+    if (!uploaded)
+    {
+        Upload();
+    }
+
+    const CullResult& result = results[front];
+    if (result.commands.empty())
+    {
+        return;
+    }
+
+    // The instance matrices take the place of the model part of mv_matrix.
+    FrameBlock frameBlock;
+    ObjectBlock objectBlock;
+    std::copy(projection, projection + 16, frameBlock.projection);
+    objectBlock.Set(view, 0);
+    GLintptr frameOffset = pUniformRing->Write(&frameBlock, sizeof(frameBlock));
+    GLintptr objectOffset = pUniformRing->Write(&objectBlock, sizeof(objectBlock));
+    if (frameOffset < 0 || objectOffset < 0)
+    {
+        return;
+    }
+
+    // Orphaned every frame so the driver never waits for the previous frame's draws.
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, result.matrices.size()*sizeof(float), &result.matrices[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, result.commands.size()*sizeof(DrawCommand), &result.commands[0], GL_STREAM_DRAW);
+
+    glUseProgram(variants.Get(SHADER_INSTANCED));
+    pUniformRing->Bind(FRAME_BLOCK_BINDING, frameOffset, sizeof(frameBlock));
+    pUniformRing->Bind(OBJECT_BLOCK_BINDING, objectOffset, sizeof(objectBlock));
+    glBindVertexArray(vao);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLsizei)result.commands.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    statistics.apiCalls = 3;
+    statistics.streamedBytes = result.matrices.size()*sizeof(float) + result.commands.size()*sizeof(DrawCommand);
+}
+
+size_t AssemblyRenderer::NodeCount() const
+{
+    return nodes.size();
+}
+
+size_t AssemblyRenderer::GeometryBytes() const
+{
+    return vertices.size()*sizeof(colorVertex) + indices.size()*sizeof(unsigned int);
+}
+
+const AssemblyRenderer::Statistics& AssemblyRenderer::GetStatistics() const
+{
+    return statistics;
+}
@@ -0,0 +1,178 @@
+/*--------------------------------------------------------------------------
+    AssemblyRenderer.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "BufferRing.h"
+#include "FrameArena.h"
+#include "Mesh.h"
+#include "ShaderCache.h"
+#include "ThreadPool.h"
+
+// Draws large assemblies (nested groups of placed part meshes) with a handful of API calls.
+// All part meshes share one vertex and one index buffer. Each frame, the assembly is frustum culled and
+// LOD-selected on the thread pool, one job per block of subtrees, and the survivors are grouped per part into
+// indirect commands issued by a single glMultiDrawElementsIndirect. Only Draw touches OpenGL.
+// Instance transforms are streamed as a per-instance attribute for the INSTANCED variant of the render shader,
+// and the view and projection through the uniform ring.
+class AssemblyRenderer
+{
+public:
+    struct Statistics
+    {
+        size_t visibleInstances;
+        size_t commands;
+        size_t apiCalls; // Draw calls plus buffer uploads issued by the last Draw.
+        size_t streamedBytes; // Instance and command data uploaded by the last Draw.
+    };
+
+private:
+    struct Part
+    {
+        GLuint firstIndex, indexCount;
+        GLint baseVertex;
+        float center[3], radius; // Bounding sphere in part coordinates.
+        int coarser;             // Part drawn instead beyond coarserDistance, or -1.
+        float coarserDistance;
+    };
+
+    // A group, or a placed part (which may have children of its own), as added.
+    struct Node
+    {
+        int parent;
+        int part;
+        float transform[16];
+    };
+
+    // Nodes in depth-first order with world transforms and bounds, so a culled subtree is skipped by one jump.
+    struct FlatNode
+    {
+        int part;
+        unsigned int subtreeEnd; // One past the last descendant.
+        float world[16];
+        float center[3], radius; // World bounding sphere of the whole subtree.
+    };
+
+    struct Visible
+    {
+        unsigned int node;
+        int part; // After LOD selection.
+    };
+
+    // What one cull job found, in the frame arena of the thread that ran it.
+    struct JobOutput
+    {
+        Visible *pVisible;
+        size_t count;
+        FrameArena *pArena;
+    };
+
+    // Layout fixed by the indirect draw specification.
+    struct DrawCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Everything Draw needs from a cull. Double buffered so the next frame is culled while this one is drawn.
+    struct CullResult
+    {
+        std::vector<DrawCommand> commands;
+        std::vector<float> matrices;
+        size_t visibleInstances;
+    };
+
+    std::vector<colorVertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<Part> parts;
+    std::vector<Node> nodes;
+    bool uploaded;
+
+    // Rebuilt from nodes after edits.
+    std::vector<FlatNode> flatNodes;
+    std::vector<std::pair<size_t, size_t>> jobRanges;
+    bool flattened;
+
+    // Per-job output and the frame being culled.
+    std::vector<JobOutput> jobOutputs;
+    float planes[6][4];
+    float depthRow[4]; // View depth of a point, for LOD selection.
+
+    CullResult results[2];
+    int front;
+    bool cullPending, culling;
+    std::mutex cullMutex;
+    std::condition_variable cullDone;
+
+    ThreadPool *pCullPool; // Where the cull task is queued, or NULL for an inline cull.
+    Statistics statistics;
+
+    GLuint vao, vertexBuffer, indexBuffer, instanceBuffer, commandBuffer;
+    BufferRing *pUniformRing;
+    ShaderVariants variants;
+
+    void Flatten(ThreadPool* pPool);
+    void CullRange(size_t begin, size_t end, JobOutput& output) const;
+    void CullInto(ThreadPool* pPool, CullResult& result);
+    static void RunCullTask(void* pRenderer);
+    void Upload();
+
+public:
+    AssemblyRenderer(BufferRing* pUniformRing);
+    ~AssemblyRenderer();
+
+    bool Initialize();
+
+    // Adds a part mesh to the shared buffers, returning its id.
+    int AddPart(const Mesh& mesh);
+
+    // Draws coarserPart in place of part when further than distance from the camera. LODs can be chained.
+    void SetLod(int part, int coarserPart, float distance);
+
+    // Adds a group or a placed part, with a column-major transform relative to the parent (-1 for the root).
+    // Returns the node id, usable as a parent. The assembly must not be edited while a cull is in flight.
+    int AddGroup(const float transform[16], int parent = -1);
+    int AddInstance(int part, const float transform[16], int parent = -1);
+
+    // Removes every part and node.
+    void Clear();
+
+    // Starts culling a frame on the pool (inline if pPool is NULL). Matrices are column-major, as everywhere else.
+    void BeginCull(ThreadPool* pPool, const float projection[16], const float view[16]);
+
+    // Waits for the cull started by BeginCull, whose results the following Draws use. If no worker has picked the
+    // cull up yet, as when the pool is busy with long jobs, it runs on the calling thread instead.
+    void FinishCull();
+
+    // BeginCull and FinishCull.
+    void Cull(ThreadPool* pPool, const float projection[16], const float view[16]);
+
+    // Draws the results of the last finished cull.
+    void Draw(const float projection[16], const float view[16]);
+
+    size_t NodeCount() const;
+
+    // Bytes of part geometry in the shared vertex and index buffers.
+    size_t GeometryBytes() const;
+
+    const Statistics& GetStatistics() const;
+};
@@ -0,0 +1,135 @@
+/*--------------------------------------------------------------------------
+    Benchmark.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "Benchmark.h"
+#include <algorithm>
+#include <iomanip>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi")
+#else
+#include <sys/resource.h>
+#endif
+
+Benchmark::Summary Benchmark::Summarize(std::vector<double> samples)
+{
+    Summary summary;
+    summary.count = samples.size();
+    summary.mean = summary.p50 = summary.p90 = summary.p99 = summary.max = 0.0;
+    if (samples.empty())
+    {
+        return summary;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double total = 0.0;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        total += samples[i];
+    }
+
+    // Nearest-rank percentiles.
+    size_t last = samples.size() - 1;
+    summary.mean = total / (double)samples.size();
+    summary.p50 = samples[last * 50 / 100];
+    summary.p90 = samples[last * 90 / 100];
+    summary.p99 = samples[last * 99 / 100];
+    summary.max = samples[last];
+    return summary;
+}
+
+double Benchmark::Now()
+{
+#ifdef _WIN32
+    // The VS2012 standard clocks only tick once a millisecond.
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+size_t Benchmark::PeakMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
+    }
+
+    return counters.PeakWorkingSetSize;
+#else
+    // Linux reports kilobytes.
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+std::string Benchmark::JsonString(const std::string& text)
+{
+    std::string result = "\"";
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '"' || text[i] == '\\')
+        {
+            result += '\\';
+        }
+
+        result += text[i];
+    }
+
+    return result + "\"";
+}
+
+void Benchmark::WriteSummary(std::ostream& output, const char* pName, const Summary& summary, double scale)
+{
+    output << "\"" << pName << "\": {\"count\": " << summary.count << std::fixed << std::setprecision(4)
+        << ", \"mean\": " << summary.mean * scale << ", \"p50\": " << summary.p50 * scale << ", \"p90\": " << summary.p90 * scale
+        << ", \"p99\": " << summary.p99 * scale << ", \"max\": " << summary.max * scale << "}";
+    output.unsetf(std::ios::floatfield);
+}
+
+BenchmarkRandom::BenchmarkRandom(unsigned int seed)
+    : state(seed)
+{
+}
+
+unsigned int BenchmarkRandom::Next()
+{
+    // Numerical Recipes constants; the high bits are the most random.
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+float BenchmarkRandom::Range(float min, float max)
+{
+    return min + (max - min) * (float)Next() / (float)(1u << 24);
+}
@@ -0,0 +1,62 @@
+/*--------------------------------------------------------------------------
+    Benchmark.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+
+// Timing, memory and reporting helpers shared by the benchmark executables.
+// Benchmarks must be reproducible, so inputs come from BenchmarkRandom rather than rand().
+class Benchmark
+{
+public:
+    // Distribution of a set of samples, in the samples' unit.
+    struct Summary
+    {
+        size_t count;
+        double mean, p50, p90, p99, max;
+    };
+
+    static Summary Summarize(std::vector<double> samples);
+
+    // High-resolution seconds from an arbitrary start.
+    static double Now();
+
+    // Peak resident memory of the process so far, in bytes. It never goes down, so it covers all earlier work too.
+    static size_t PeakMemory();
+
+    // Quotes and escapes text as a JSON string.
+    static std::string JsonString(const std::string& text);
+
+    // Writes "name": {...} for a summary, scaling samples by scale (e.g. 1000 for seconds to milliseconds).
+    static void WriteSummary(std::ostream& output, const char* pName, const Summary& summary, double scale);
+};
+
+// Small linear congruential generator, so generated scenes are identical on every platform and run.
+class BenchmarkRandom
+{
+    unsigned int state;
+
+public:
+    BenchmarkRandom(unsigned int seed);
+
+    unsigned int Next();
+
+    // Uniform in [min, max).
+    float Range(float min, float max);
+};
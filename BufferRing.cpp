@@ -0,0 +1,143 @@
+/*--------------------------------------------------------------------------
+    BufferRing.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "BufferRing.h"
+#include <cstring>
+
+BufferRing::BufferRing(GLenum target, GLsizeiptr frameSize)
+    : target(target), buffer(0), frameSize(frameSize), alignment(16), pMapped(NULL), frame(0), used(0), overflowReported(false)
+{
+    for (int i = 0; i < FRAME_COUNT; i++)
+    {
+        fences[i] = NULL;
+    }
+}
+
+BufferRing::~BufferRing()
+{
+    for (int i = 0; i < FRAME_COUNT; i++)
+    {
+        glDeleteSync(fences[i]);
+    }
+
+    if (pMapped != NULL)
+    {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+    }
+
+    glDeleteBuffers(1, &buffer);
+}
+
+bool BufferRing::Initialize()
+{
+    if (target == GL_UNIFORM_BUFFER)
+    {
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    }
+    else if (target == GL_SHADER_STORAGE_BUFFER)
+    {
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    }
+
+    // Regions start aligned too, so offsets only need rounding within a region.
+    frameSize = (frameSize + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    if (GLEW_ARB_buffer_storage)
+    {
+        // Coherent, so writes are visible to commands issued after them without flushing.
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, frameSize * FRAME_COUNT, NULL, flags);
+        pMapped = (char*)glMapBufferRange(target, 0, frameSize * FRAME_COUNT, flags);
+        if (pMapped == NULL)
+        {
+            std::cout << "Could not persistently map a streaming buffer!" << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        glBufferData(target, frameSize * FRAME_COUNT, NULL, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(target, 0);
+    return true;
+}
+
+void BufferRing::BeginFrame()
+{
+    used = 0;
+    if (fences[frame] == NULL)
+    {
+        return;
+    }
+
+    // Usually already signaled, since the region was last used FRAME_COUNT frames ago.
+    const GLuint64 TIMEOUT = 1000000000; // 1 second, in nanoseconds.
+    GLenum result = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, TIMEOUT);
+    while (result == GL_TIMEOUT_EXPIRED)
+    {
+        result = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, TIMEOUT);
+    }
+
+    glDeleteSync(fences[frame]);
+    fences[frame] = NULL;
+}
+
+GLintptr BufferRing::Write(const void* pData, GLsizeiptr size)
+{
+    GLsizeiptr start = (used + alignment - 1) / alignment * alignment;
+    if (start + size > frameSize)
+    {
+        if (!overflowReported)
+        {
+            std::cout << "Streaming buffer overflow, some data is not drawn this frame!" << std::endl;
+            overflowReported = true;
+        }
+
+        return -1;
+    }
+
+    used = start + size;
+    GLintptr offset = frame * frameSize + start;
+    if (pMapped != NULL)
+    {
+        memcpy(pMapped + offset, pData, size);
+    }
+    else
+    {
+        glBindBuffer(target, buffer);
+        glBufferSubData(target, offset, size, pData);
+    }
+
+    return offset;
+}
+
+void BufferRing::Bind(GLuint index, GLintptr offset, GLsizeiptr size)
+{
+    glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void BufferRing::EndFrame()
+{
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame = (frame + 1) % FRAME_COUNT;
+}
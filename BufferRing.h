@@ -0,0 +1,60 @@
+/*--------------------------------------------------------------------------
+    BufferRing.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+
+// Streams per-frame data (uniform blocks, instance data) through one buffer split into a region per frame in flight.
+// With ARB_buffer_storage the buffer stays persistently mapped and writes are plain copies; otherwise they
+// become glBufferSubData calls. A fence per region makes the CPU wait, rarely, instead of the driver
+// synchronizing on every update.
+class BufferRing
+{
+    static const int FRAME_COUNT = 3;
+
+    GLenum target;
+    GLuint buffer;
+    GLsizeiptr frameSize;
+    GLint alignment;
+    char *pMapped; // NULL without persistent mapping.
+    GLsync fences[FRAME_COUNT];
+    int frame;
+    GLsizeiptr used;
+    bool overflowReported;
+
+public:
+    // frameSize is the most data a single frame can write.
+    BufferRing(GLenum target, GLsizeiptr frameSize);
+    ~BufferRing();
+
+    bool Initialize();
+
+    // Waits until the GPU is done with the region this frame is going to overwrite.
+    void BeginFrame();
+
+    // Copies data into this frame's region, returning its offset in the buffer, or -1 if the region is full.
+    // Offsets are aligned for binding ranges of the target.
+    GLintptr Write(const void* pData, GLsizeiptr size);
+
+    // Binds a written range to an indexed binding point of the target.
+    void Bind(GLuint index, GLintptr offset, GLsizeiptr size);
+
+    // Fences the commands that read this frame's region.
+    void EndFrame();
+};
@@ -0,0 +1,365 @@
+/*--------------------------------------------------------------------------
+    CsgBenchmark.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "CsgTree.h"
+#include "MeshRepair.h"
+#include "Predicates.h"
+#include "SdfEvaluator.h"
+#include "SdfMesher.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+
+// CSG benchmark. Meshes standard stress models through the distance field pipeline and reports throughput,
+// memory and whether the output is a valid closed solid, before and after repair, as JSON. The operating system
+// only tracks the peak memory of the whole process, so each case reports the peak up to its end, including every
+// case before it; run a single --case to measure it on its own.
+//
+//   Rcsg-csgbench [--depth N] [--repeat N] [--threads N] [--case name]... [--output file.json]
+//
+// Nothing here uses OpenGL, so it also builds and runs headless on Linux:
+//   g++ -O2 -std=c++11 -Iinclude -DRCSG_PREDICATE_STATISTICS CsgBenchmark.cpp Benchmark.cpp CsgTree.cpp gm.cpp MeshRepair.cpp
+//       Predicates.cpp SdfEvaluator.cpp SdfMesher.cpp ThreadPool.cpp -lpthread -o csg-bench
+// Models are generated without randomness and every repeat is checksummed, so a run also checks determinism.
+
+static const int DEFAULT_DEPTH = 8;
+static const int DEFAULT_REPEATS = 3;
+
+typedef std::vector<std::unique_ptr<CsgNode>> NodeList;
+
+// Combines nodes[begin, end) pairwise, so large unions stay shallow.
+static std::unique_ptr<CsgNode> UnionAll(NodeList& nodes, size_t begin, size_t end)
+{
+    if (end - begin == 1)
+    {
+        return std::move(nodes[begin]);
+    }
+
+    size_t middle = begin + (end - begin) / 2;
+    std::unique_ptr<CsgNode> pLeft = UnionAll(nodes, begin, middle);
+    std::unique_ptr<CsgNode> pRight = UnionAll(nodes, middle, end);
+    return CsgNode::Combine(CSG_UNION, std::move(pLeft), std::move(pRight), 0.0f);
+}
+
+// A plate with a dense grid of through holes: many thin subtracted cylinders.
+static std::unique_ptr<CsgNode> DrilledPlate()
+{
+    NodeList holes;
+    for (int i = 0; i < 16; i++)
+    {
+        for (int j = 0; j < 12; j++)
+        {
+            holes.push_back(CsgNode::Cylinder(gm::vec3(-3.75f + 0.5f * i, 0.0f, -2.75f + 0.5f * j), 0.12f, 0.5f, gm::vec3(0.0f, 0.0f, 0.0f)));
+        }
+    }
+
+    std::unique_ptr<CsgNode> pPlate = CsgNode::Box(gm::vec3(0.0f, 0.0f, 0.0f), gm::vec3(4.0f, 0.25f, 3.0f), gm::vec3(0.6f, 0.6f, 0.65f));
+    return CsgNode::Combine(CSG_DIFFERENCE, std::move(pPlate), UnionAll(holes, 0, holes.size()), 0.0f);
+}
+
+// A lattice of overlapping spheres: many curved intersection seams.
+static std::unique_ptr<CsgNode> SphereGrid()
+{
+    NodeList spheres;
+    for (int i = 0; i < 8; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            for (int k = 0; k < 8; k++)
+            {
+                spheres.push_back(CsgNode::Sphere(gm::vec3(0.5f * i - 1.75f, 0.5f * j - 1.75f, 0.5f * k - 1.75f), 0.32f,
+                    gm::vec3(i / 8.0f, j / 8.0f, k / 8.0f)));
+            }
+        }
+    }
+
+    return UnionAll(spheres, 0, spheres.size());
+}
+
+// Columns of varying height sharing their side faces, with pockets cut flush to the lowest tops:
+// coplanar faces everywhere.
+static std::unique_ptr<CsgNode> CoplanarBoxes()
+{
+    NodeList columns, pockets;
+    for (int i = 0; i < 10; i++)
+    {
+        for (int j = 0; j < 10; j++)
+        {
+            float height = 1.0f + 0.5f * ((i + j) % 3);
+            columns.push_back(CsgNode::Box(gm::vec3(i - 4.5f, 0.5f * height, j - 4.5f), gm::vec3(0.5f, 0.5f * height, 0.5f), gm::vec3(0.5f, 0.6f, 0.7f)));
+            if ((i + j) % 2 == 0)
+            {
+                pockets.push_back(CsgNode::Box(gm::vec3(i - 4.5f, 0.75f, j - 4.5f), gm::vec3(0.25f, 0.25f, 0.5f), gm::vec3(0.0f, 0.0f, 0.0f)));
+            }
+        }
+    }
+
+    std::unique_ptr<CsgNode> pColumns = UnionAll(columns, 0, columns.size());
+    return CsgNode::Combine(CSG_DIFFERENCE, std::move(pColumns), UnionAll(pockets, 0, pockets.size()), 0.0f);
+}
+
+// A drilled bracket with a filleted boss, then rings of smaller copies of the previous level around a hub,
+// the way assemblies are built from parts.
+static std::unique_ptr<CsgNode> NestedLevel(int level, gm::vec3 center, float scale)
+{
+    if (level == 0)
+    {
+        std::unique_ptr<CsgNode> pBracket = CsgNode::Combine(CSG_UNION,
+            CsgNode::Box(center, gm::vec3(scale, 0.1f * scale, 0.6f * scale), gm::vec3(0.6f, 0.6f, 0.65f)),
+            CsgNode::Cylinder(center + gm::vec3(0.0f, 0.3f * scale, 0.0f), 0.3f * scale, 0.3f * scale, gm::vec3(0.8f, 0.5f, 0.2f)), 0.1f * scale);
+        for (int side = -1; side <= 1; side += 2)
+        {
+            pBracket = CsgNode::Combine(CSG_DIFFERENCE, std::move(pBracket),
+                CsgNode::Cylinder(center + gm::vec3(0.7f * scale * side, 0.0f, 0.0f), 0.15f * scale, 0.5f * scale, gm::vec3(0.0f, 0.0f, 0.0f)), 0.0f);
+        }
+
+        return pBracket;
+    }
+
+    const int COPIES = 6;
+    const float PI = 3.141592653589f;
+    NodeList children;
+    children.push_back(CsgNode::Box(center, gm::vec3(0.8f * scale, 0.2f * scale, 0.8f * scale), gm::vec3(0.4f, 0.4f, 0.45f)));
+    for (int i = 0; i < COPIES; i++)
+    {
+        float angle = 2.0f * PI * i / COPIES;
+        gm::vec3 offset(2.0f * scale * cosf(angle), 0.0f, 2.0f * scale * sinf(angle));
+        children.push_back(NestedLevel(level - 1, center + offset, 0.4f * scale));
+    }
+
+    return UnionAll(children, 0, children.size());
+}
+
+static std::unique_ptr<CsgNode> NestedAssembly()
+{
+    return NestedLevel(3, gm::vec3(0.0f, 0.0f, 0.0f), 1.0f);
+}
+
+struct BenchmarkModel
+{
+    const char *pName;
+    std::unique_ptr<CsgNode> (*pBuild)();
+};
+
+static const int MODEL_COUNT = 4;
+static const BenchmarkModel MODELS[MODEL_COUNT] =
+{
+    { "drilledPlate", DrilledPlate },
+    { "sphereGrid", SphereGrid },
+    { "coplanarBoxes", CoplanarBoxes },
+    { "nestedAssembly", NestedAssembly }
+};
+
+static int CountPrimitives(const CsgNode& node)
+{
+    return node.isPrimitive ? 1 : CountPrimitives(*node.pLeft) + CountPrimitives(*node.pRight);
+}
+
+// FNV-1a over the exact vertex bits and indices, to compare runs.
+static unsigned long long Checksum(const Mesh& mesh)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    const unsigned char *pBytes = mesh.vertices.empty() ? NULL : (const unsigned char*)&mesh.vertices[0];
+    for (size_t i = 0; i < mesh.vertices.size() * sizeof(colorVertex); i++)
+    {
+        hash = (hash ^ pBytes[i]) * 1099511628211ull;
+    }
+
+    pBytes = mesh.indices.empty() ? NULL : (const unsigned char*)&mesh.indices[0];
+    for (size_t i = 0; i < mesh.indices.size() * sizeof(unsigned int); i++)
+    {
+        hash = (hash ^ pBytes[i]) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static void WriteValidity(std::ostream& output, const char* pName, const MeshRepair::Validity& validity)
+{
+    output << "\"" << pName << "\": {\"manifold\": " << (validity.IsManifold() ? "true" : "false")
+        << ", \"watertight\": " << (validity.IsWatertight() ? "true" : "false")
+        << ", \"boundarySides\": " << validity.boundarySides << ", \"nonManifoldSides\": " << validity.nonManifoldSides
+        << ", \"misorientedSides\": " << validity.misorientedSides << ", \"degenerateTriangles\": " << validity.degenerateTriangles << "}";
+}
+
+// Meshes and repairs one model repeatedly, writing its JSON object.
+static void RunModel(std::ostream& output, const BenchmarkModel& model, int depth, int repeats, ThreadPool* pPool)
+{
+    std::unique_ptr<CsgNode> pRoot = model.pBuild();
+    MeshRepair repair(pPool);
+
+    std::vector<double> meshTimes, repairTimes;
+    Mesh mesh;
+    MeshRepair::Validity meshValidity, repairedValidity;
+    MeshRepair::Report report;
+    Predicates::Statistics predicates;
+    size_t meshTriangles = 0;
+    unsigned long long checksum = 0;
+    bool deterministic = true;
+    for (int run = 0; run < repeats; run++)
+    {
+        Predicates::ResetStatistics();
+        double start = Benchmark::Now();
+        SdfEvaluator sdf(*pRoot);
+        SdfMesher mesher(depth, pPool);
+        mesher.Contour(sdf, mesh);
+        double meshed = Benchmark::Now();
+
+        meshTriangles = mesh.TriangleCount();
+        repair.Validate(mesh, meshValidity);
+        double validated = Benchmark::Now();
+        repair.Repair(mesh, report);
+        double repaired = Benchmark::Now();
+        predicates = Predicates::GetStatistics();
+
+        meshTimes.push_back(meshed - start);
+        repairTimes.push_back(repaired - validated);
+        repair.Validate(mesh, repairedValidity);
+
+        unsigned long long runChecksum = Checksum(mesh);
+        deterministic = deterministic && (run == 0 || runChecksum == checksum);
+        checksum = runChecksum;
+    }
+
+    Benchmark::Summary meshSummary = Benchmark::Summarize(meshTimes);
+    Benchmark::Summary repairSummary = Benchmark::Summarize(repairTimes);
+    output << "    {\"name\": \"" << model.pName << "\", \"primitives\": " << CountPrimitives(*pRoot) << ", \"treeDepth\": " << pRoot->Depth()
+        << ", \"triangles\": " << meshTriangles << ", \"repairedTriangles\": " << mesh.TriangleCount() << "," << std::endl << "     ";
+    Benchmark::WriteSummary(output, "meshMs", meshSummary, 1000.0);
+    output << "," << std::endl << "     ";
+    Benchmark::WriteSummary(output, "repairMs", repairSummary, 1000.0);
+    output << "," << std::endl;
+    output << "     \"trianglesPerSecond\": " << (size_t)(meshSummary.p50 > 0.0 ? meshTriangles / meshSummary.p50 : 0.0)
+        << ", \"processPeakMemoryBytes\": " << Benchmark::PeakMemory() << "," << std::endl << "     ";
+    WriteValidity(output, "mesh", meshValidity);
+    output << "," << std::endl << "     ";
+    WriteValidity(output, "repaired", repairedValidity);
+    output << "," << std::endl;
+    output << "     \"repair\": {\"weldedVertices\": " << report.weldedVertices << ", \"removedTriangles\": " << report.removedTriangles
+        << ", \"splitVertices\": " << report.splitVertices << ", \"filledHoles\": " << report.filledHoles << ", \"flippedTriangles\": " << report.flippedTriangles << "}," << std::endl;
+    output << "     \"predicates\": {\"calls\": " << predicates.calls << ", \"exactEvaluations\": " << predicates.exactEvaluations << "}," << std::endl;
+    output << "     \"checksum\": \"" << std::hex << checksum << std::dec << "\", \"deterministic\": " << (deterministic ? "true" : "false") << "}";
+}
+
+int main(int argc, char* argv [])
+{
+    int depth = DEFAULT_DEPTH, repeats = DEFAULT_REPEATS, threads = -1;
+    std::string outputFile = "csg-benchmark.json";
+    std::vector<const BenchmarkModel*> models;
+    for (int i = 1; i < argc; i++)
+    {
+        const BenchmarkModel *pModel = NULL;
+        for (int m = 0; m < MODEL_COUNT && i + 1 < argc; m++)
+        {
+            if (strcmp(argv[i + 1], MODELS[m].pName) == 0)
+            {
+                pModel = &MODELS[m];
+            }
+        }
+
+        if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+        {
+            depth = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+        {
+            repeats = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            outputFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--case") == 0 && pModel != NULL)
+        {
+            models.push_back(pModel);
+            i++;
+        }
+        else
+        {
+            std::cout << "Usage: " << argv[0] << " [--depth N] [--repeat N] [--threads N] [--case name]... [--output file.json]" << std::endl;
+            std::cout << "Cases:";
+            for (int m = 0; m < MODEL_COUNT; m++)
+            {
+                std::cout << " " << MODELS[m].pName;
+            }
+
+            std::cout << std::endl;
+            return 1;
+        }
+    }
+
+    if (models.empty())
+    {
+        for (int m = 0; m < MODEL_COUNT; m++)
+        {
+            models.push_back(&MODELS[m]);
+        }
+    }
+
+    // The shared pool by default, a pool of the requested size, or everything on this thread for --threads 0.
+    std::unique_ptr<ThreadPool> pOwnPool;
+    ThreadPool *pPool = NULL;
+    if (threads < 0)
+    {
+        ThreadPool::Initialize();
+        pPool = ThreadPool::GetPool();
+    }
+    else if (threads > 0)
+    {
+        pOwnPool.reset(new ThreadPool((unsigned int)threads));
+        pPool = pOwnPool.get();
+    }
+
+    std::stringstream output;
+    output << "{" << std::endl;
+    output << "  \"benchmark\": \"csg\", \"octreeDepth\": " << depth << ", \"repeats\": " << repeats
+        << ", \"threads\": " << (pPool != NULL ? pPool->ThreadCount() : 0) << "," << std::endl;
+    output << "  \"cases\": [" << std::endl;
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        std::cout << "Meshing " << models[i]->pName << "..." << std::endl;
+        RunModel(output, *models[i], depth, repeats, pPool);
+        output << (i + 1 < models.size() ? "," : "") << std::endl;
+    }
+
+    output << "  ]" << std::endl << "}" << std::endl;
+    std::cout << output.str();
+
+    int status = 0;
+    std::ofstream file(outputFile.c_str());
+    file << output.str();
+    if (!file)
+    {
+        std::cout << "Could not write the results to " << outputFile << std::endl;
+        status = 1;
+    }
+
+    pOwnPool.reset();
+    if (threads < 0)
+    {
+        ThreadPool::Deinitialize();
+    }
+
+    return status;
+}
@@ -0,0 +1,244 @@
+/*--------------------------------------------------------------------------
+    CsgTree.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "CsgTree.h"
+#include <algorithm>
+
+CsgNode::CsgNode()
+    : isPrimitive(false), primitive(CSG_SPHERE), operation(CSG_UNION), blendRadius(0.0f)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        center[i] = 0.0f;
+        size[i] = 0.0f;
+        color[i] = 1.0f;
+    }
+}
+
+static std::unique_ptr<CsgNode> CreatePrimitive(CsgPrimitive primitive, gm::vec3& center, gm::vec3& color)
+{
+    std::unique_ptr<CsgNode> pNode(new CsgNode());
+    pNode->isPrimitive = true;
+    pNode->primitive = primitive;
+    for (int i = 0; i < 3; i++)
+    {
+        pNode->center[i] = center[i];
+        pNode->color[i] = color[i];
+    }
+
+    return pNode;
+}
+
+std::unique_ptr<CsgNode> CsgNode::Sphere(gm::vec3 center, float radius, gm::vec3 color)
+{
+    std::unique_ptr<CsgNode> pNode = CreatePrimitive(CSG_SPHERE, center, color);
+    pNode->size[0] = radius;
+    return pNode;
+}
+
+std::unique_ptr<CsgNode> CsgNode::Box(gm::vec3 center, gm::vec3 halfExtents, gm::vec3 color)
+{
+    std::unique_ptr<CsgNode> pNode = CreatePrimitive(CSG_BOX, center, color);
+    for (int i = 0; i < 3; i++)
+    {
+        pNode->size[i] = halfExtents[i];
+    }
+
+    return pNode;
+}
+
+std::unique_ptr<CsgNode> CsgNode::Cylinder(gm::vec3 center, float radius, float halfHeight, gm::vec3 color)
+{
+    std::unique_ptr<CsgNode> pNode = CreatePrimitive(CSG_CYLINDER, center, color);
+    pNode->size[0] = radius;
+    pNode->size[1] = halfHeight;
+    return pNode;
+}
+
+std::unique_ptr<CsgNode> CsgNode::Combine(CsgOperation operation, std::unique_ptr<CsgNode> pLeft, std::unique_ptr<CsgNode> pRight, float blendRadius)
+{
+    std::unique_ptr<CsgNode> pNode(new CsgNode());
+    pNode->operation = operation;
+    pNode->blendRadius = blendRadius;
+    pNode->pLeft = std::move(pLeft);
+    pNode->pRight = std::move(pRight);
+    return pNode;
+}
+
+void CsgNode::Bounds(float min[3], float max[3]) const
+{
+    if (isPrimitive)
+    {
+        float extents[3] = { size[0], size[1], size[2] };
+        if (primitive == CSG_SPHERE)
+        {
+            extents[1] = extents[2] = size[0];
+        }
+        else if (primitive == CSG_CYLINDER)
+        {
+            extents[1] = size[1];
+            extents[2] = size[0];
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            min[i] = center[i] - extents[i];
+            max[i] = center[i] + extents[i];
+        }
+
+        return;
+    }
+
+    float rightMin[3], rightMax[3];
+    pLeft->Bounds(min, max);
+    pRight->Bounds(rightMin, rightMax);
+    for (int i = 0; i < 3; i++)
+    {
+        switch (operation)
+        {
+        case CSG_UNION:
+            // Smooth unions bulge out by at most a quarter of the blend radius.
+            min[i] = std::min(min[i], rightMin[i]) - 0.25f * blendRadius;
+            max[i] = std::max(max[i], rightMax[i]) + 0.25f * blendRadius;
+            break;
+        case CSG_INTERSECTION:
+            min[i] = std::max(min[i], rightMin[i]);
+            max[i] = std::min(max[i], rightMax[i]);
+            break;
+        case CSG_DIFFERENCE:
+            // Subtracting can only shrink the left side.
+            break;
+        }
+    }
+}
+
+int CsgNode::Depth() const
+{
+    if (isPrimitive)
+    {
+        return 1;
+    }
+
+    return 1 + std::max(pLeft->Depth(), pRight->Depth());
+}
+
+void CsgNode::Tessellate(int segments, Mesh& result) const
+{
+    result.Clear();
+    if (!isPrimitive)
+    {
+        return;
+    }
+
+    const float PI = 3.141592653589f;
+    segments = std::max(segments, 3);
+    colorVertex vertex;
+    switch (primitive)
+    {
+    case CSG_SPHERE:
+    {
+        // Latitude rings from the top pole down, each with a duplicated seam vertex.
+        int rings = std::max(segments / 2, 2);
+        for (int i = 0; i <= rings; i++)
+        {
+            float theta = PI * (float)i / (float)rings;
+            for (int j = 0; j <= segments; j++)
+            {
+                float phi = 2.0f * PI * (float)j / (float)segments;
+                vertex.Set(center[0] + size[0]*sinf(theta)*cosf(phi), center[1] + size[0]*cosf(theta), center[2] + size[0]*sinf(theta)*sinf(phi),
+                    color[0], color[1], color[2]);
+                result.vertices.push_back(vertex);
+            }
+        }
+
+        for (int i = 0; i < rings; i++)
+        {
+            for (int j = 0; j < segments; j++)
+            {
+                // Triangles touching a pole collapse to a point, so they are skipped.
+                unsigned int a = i*(segments + 1) + j, b = a + segments + 1;
+                unsigned int quad[6] = { a, a + 1, b + 1, a, b + 1, b };
+                result.indices.insert(result.indices.end(), quad + (i == 0 ? 3 : 0), quad + (i == rings - 1 ? 3 : 6));
+            }
+        }
+
+        break;
+    }
+    case CSG_BOX:
+    {
+        for (int corner = 0; corner < 8; corner++)
+        {
+            vertex.Set(center[0] + ((corner & 1) ? size[0] : -size[0]), center[1] + ((corner & 2) ? size[1] : -size[1]),
+                center[2] + ((corner & 4) ? size[2] : -size[2]), color[0], color[1], color[2]);
+            result.vertices.push_back(vertex);
+        }
+
+        // Corners use x in bit 0, y in bit 1 and z in bit 2. Two counter-clockwise triangles per face.
+        static const unsigned int BOX_INDICES[36] =
+        {
+            0, 2, 3, 0, 3, 1, // -Z
+            4, 5, 7, 4, 7, 6, // +Z
+            0, 4, 6, 0, 6, 2, // -X
+            1, 3, 7, 1, 7, 5, // +X
+            0, 1, 5, 0, 5, 4, // -Y
+            2, 6, 7, 2, 7, 3  // +Y
+        };
+
+        result.indices.insert(result.indices.end(), BOX_INDICES, BOX_INDICES + 36);
+        break;
+    }
+    case CSG_CYLINDER:
+    default:
+    {
+        // Bottom and top rings followed by the two cap centers.
+        for (int end = 0; end < 2; end++)
+        {
+            float y = center[1] + (end ? size[1] : -size[1]);
+            for (int j = 0; j < segments; j++)
+            {
+                float phi = 2.0f * PI * (float)j / (float)segments;
+                vertex.Set(center[0] + size[0]*cosf(phi), y, center[2] + size[0]*sinf(phi), color[0], color[1], color[2]);
+                result.vertices.push_back(vertex);
+            }
+        }
+
+        unsigned int bottomCenter = (unsigned int)result.vertices.size();
+        vertex.Set(center[0], center[1] - size[1], center[2], color[0], color[1], color[2]);
+        result.vertices.push_back(vertex);
+        vertex.Set(center[0], center[1] + size[1], center[2], color[0], color[1], color[2]);
+        result.vertices.push_back(vertex);
+
+        for (int j = 0; j < segments; j++)
+        {
+            unsigned int next = (j + 1) % segments;
+            unsigned int triangles[12] =
+            {
+                (unsigned int)j, segments + (unsigned int)j, segments + next, // Side
+                (unsigned int)j, segments + next, next,
+                bottomCenter, (unsigned int)j, next, // Bottom cap
+                bottomCenter + 1, segments + next, segments + (unsigned int)j // Top cap
+            };
+
+            result.indices.insert(result.indices.end(), triangles, triangles + 12);
+        }
+
+        break;
+    }
+    }
+}
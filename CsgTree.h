@@ -0,0 +1,71 @@
+/*--------------------------------------------------------------------------
+    CsgTree.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "Mesh.h"
+
+enum CsgOperation
+{
+    CSG_UNION,
+    CSG_INTERSECTION,
+    CSG_DIFFERENCE
+};
+
+enum CsgPrimitive
+{
+    CSG_SPHERE,
+    CSG_BOX,
+    CSG_CYLINDER
+};
+
+// A node in a CSG tree: either an analytic primitive (leaf) or a boolean operation on two children.
+class CsgNode
+{
+public:
+    bool isPrimitive;
+
+    // Primitive data.
+    CsgPrimitive primitive;
+    float center[3];
+    float size[3]; // Sphere: radius in [0]. Box: half-extents. Cylinder (along Y): radius in [0], half-height in [1].
+    float color[3];
+
+    // Operation data.
+    CsgOperation operation;
+    float blendRadius; // Fillet radius for smooth booleans, 0 for a sharp edge.
+    std::unique_ptr<CsgNode> pLeft, pRight;
+
+    CsgNode();
+
+    // Primitive and operation creation.
+    static std::unique_ptr<CsgNode> Sphere(gm::vec3 center, float radius, gm::vec3 color);
+    static std::unique_ptr<CsgNode> Box(gm::vec3 center, gm::vec3 halfExtents, gm::vec3 color);
+    static std::unique_ptr<CsgNode> Cylinder(gm::vec3 center, float radius, float halfHeight, gm::vec3 color);
+    static std::unique_ptr<CsgNode> Combine(CsgOperation operation, std::unique_ptr<CsgNode> pLeft, std::unique_ptr<CsgNode> pRight, float blendRadius);
+
+    // Conservative axis-aligned bounds of the solid this node represents.
+    void Bounds(float min[3], float max[3]) const;
+
+    // Maximum depth of the tree below (and including) this node.
+    int Depth() const;
+
+    // Triangulates a primitive node, in its own color, with about 'segments' divisions around curved surfaces.
+    void Tessellate(int segments, Mesh& result) const;
+};
@@ -0,0 +1,128 @@
+/*--------------------------------------------------------------------------
+    DirectoryWatcher.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "DirectoryWatcher.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// How often the watch thread checks whether it should stop.
+static const int POLL_INTERVAL_MS = 100;
+
+DirectoryWatcher::DirectoryWatcher()
+    : stopping(false), changed(false),
+#ifdef _WIN32
+      pChangeHandle(INVALID_HANDLE_VALUE)
+#else
+      inotifyHandle(-1)
+#endif
+{
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    Stop();
+}
+
+bool DirectoryWatcher::Start(const std::string& directory)
+{
+    Stop();
+
+#ifdef _WIN32
+    pChangeHandle = FindFirstChangeNotificationA(directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (pChangeHandle == INVALID_HANDLE_VALUE)
+    {
+        std::cout << "Could not watch " << directory << " for changes!" << std::endl;
+        return false;
+    }
+#else
+    inotifyHandle = inotify_init();
+    if (inotifyHandle < 0 || inotify_add_watch(inotifyHandle, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        std::cout << "Could not watch " << directory << " for changes!" << std::endl;
+        Stop();
+        return false;
+    }
+#endif
+
+    stopping = false;
+    watchThread = std::thread(&DirectoryWatcher::WatchLoop, this);
+    return true;
+}
+
+void DirectoryWatcher::Stop()
+{
+    stopping = true;
+    if (watchThread.joinable())
+    {
+        watchThread.join();
+    }
+
+#ifdef _WIN32
+    if (pChangeHandle != INVALID_HANDLE_VALUE)
+    {
+        FindCloseChangeNotification(pChangeHandle);
+        pChangeHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (inotifyHandle >= 0)
+    {
+        close(inotifyHandle);
+        inotifyHandle = -1;
+    }
+#endif
+}
+
+void DirectoryWatcher::WatchLoop()
+{
+    while (!stopping)
+    {
+#ifdef _WIN32
+        if (WaitForSingleObject(pChangeHandle, POLL_INTERVAL_MS) == WAIT_OBJECT_0)
+        {
+            changed = true;
+            FindNextChangeNotification(pChangeHandle);
+        }
+#else
+        pollfd descriptor;
+        descriptor.fd = inotifyHandle;
+        descriptor.events = POLLIN;
+        if (poll(&descriptor, 1, POLL_INTERVAL_MS) > 0)
+        {
+            // Only the fact that something changed matters, so the events themselves are discarded.
+            char events[4096];
+            if (read(inotifyHandle, events, sizeof(events)) > 0)
+            {
+                changed = true;
+            }
+        }
+#endif
+    }
+}
+
+bool DirectoryWatcher::TakeChanged()
+{
+    return changed.exchange(false);
+}
@@ -0,0 +1,49 @@
+/*--------------------------------------------------------------------------
+    DirectoryWatcher.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include <atomic>
+
+// Watches a directory on a background thread and reports when any file in it is created or modified.
+class DirectoryWatcher
+{
+    std::thread watchThread;
+    std::atomic<bool> stopping;
+    std::atomic<bool> changed;
+
+    // Platform change handle: a Win32 change notification, or an inotify descriptor elsewhere.
+#ifdef _WIN32
+    void *pChangeHandle;
+#else
+    int inotifyHandle;
+#endif
+
+    void WatchLoop();
+
+public:
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+
+    bool Start(const std::string& directory);
+    void Stop();
+
+    // True if anything changed since the last call.
+    bool TakeChanged();
+};
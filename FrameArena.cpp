@@ -0,0 +1,150 @@
+/*--------------------------------------------------------------------------
+    FrameArena.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "FrameArena.h"
+#include <algorithm>
+
+std::vector<FrameArena*> FrameArena::m_arenas;
+std::thread::id FrameArena::m_mainThread;
+
+FrameArena::FrameArena(size_t capacity)
+    : pBlock(NULL), capacity(capacity), used(0), highWater(0)
+{
+    // operator new returns memory aligned to at least ALIGNMENT on the 64-bit targets we build for.
+    pBlock = (char*)::operator new(capacity);
+}
+
+FrameArena::~FrameArena()
+{
+    Reset();
+    ::operator delete(pBlock);
+}
+
+void* FrameArena::Allocate(size_t size)
+{
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    used += size;
+    highWater = std::max(highWater, used);
+    if (used <= capacity)
+    {
+        return pBlock + used - size;
+    }
+
+    // Counted in used too, so the high-water mark says how big the block should have been.
+    void* pMemory = ::operator new(size);
+    overflow.push_back(pMemory);
+    return pMemory;
+}
+
+void FrameArena::Reset()
+{
+    for (size_t i = 0; i < overflow.size(); i++)
+    {
+        ::operator delete(overflow[i]);
+    }
+
+    if (!overflow.empty())
+    {
+        overflow.clear();
+        ::operator delete(pBlock);
+        while (capacity < highWater)
+        {
+            capacity *= 2;
+        }
+
+        pBlock = (char*)::operator new(capacity);
+    }
+
+    used = 0;
+}
+
+size_t FrameArena::Capacity() const
+{
+    return capacity;
+}
+
+size_t FrameArena::Used() const
+{
+    return used;
+}
+
+size_t FrameArena::HighWater() const
+{
+    return highWater;
+}
+
+bool FrameArena::Initialize(size_t capacity)
+{
+    ThreadPool *pPool = ThreadPool::GetPool();
+    unsigned int workerCount = pPool != NULL ? pPool->ThreadCount() : 0;
+    for (unsigned int i = 0; i <= workerCount; i++)
+    {
+        m_arenas.push_back(new FrameArena(capacity));
+    }
+
+    m_mainThread = std::this_thread::get_id();
+    return true;
+}
+
+FrameArena* FrameArena::GetArena()
+{
+    if (m_arenas.empty())
+    {
+        return NULL;
+    }
+
+    if (std::this_thread::get_id() == m_mainThread)
+    {
+        return m_arenas[0];
+    }
+
+    ThreadPool *pPool = ThreadPool::GetPool();
+    int worker = pPool != NULL ? pPool->WorkerIndex() : -1;
+    return worker >= 0 && worker + 1 < (int)m_arenas.size() ? m_arenas[worker + 1] : NULL;
+}
+
+void FrameArena::ResetAll()
+{
+    for (size_t i = 0; i < m_arenas.size(); i++)
+    {
+        m_arenas[i]->Reset();
+    }
+}
+
+size_t FrameArena::TotalHighWater()
+{
+    size_t total = 0;
+    for (size_t i = 0; i < m_arenas.size(); i++)
+    {
+        total += m_arenas[i]->HighWater();
+    }
+
+    return total;
+}
+
+bool FrameArena::Deinitialize()
+{
+    for (size_t i = 0; i < m_arenas.size(); i++)
+    {
+        delete m_arenas[i];
+    }
+
+    m_arenas.clear();
+    return true;
+}
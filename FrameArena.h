@@ -0,0 +1,158 @@
+/*--------------------------------------------------------------------------
+    FrameArena.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+// Bump allocator for data that only lives until the end of the frame (culling lists, staging, scratch vectors).
+// Allocating is a pointer increment and freeing is a no-op; everything is released at once by Reset.
+// Allocations past the block's capacity fall back to the heap, and the next Reset grows the block to the
+// high-water mark, so a steady-state frame does no heap allocation at all.
+//
+// There is one arena per worker of the shared thread pool plus one for the main thread, reset together between
+// frames. Work using them must finish within the frame; long-running pool tasks (such as background meshing) must not.
+class FrameArena
+{
+    static std::vector<FrameArena*> m_arenas;
+    static std::thread::id m_mainThread;
+
+    char *pBlock;
+    size_t capacity, used, highWater;
+    std::vector<void*> overflow;
+
+public:
+    // Alignment of every allocation, enough for any scalar or SIMD type used here.
+    static const size_t ALIGNMENT = 16;
+
+    FrameArena(size_t capacity);
+    ~FrameArena();
+
+    void* Allocate(size_t size);
+
+    // Releases everything allocated since the last reset.
+    void Reset();
+
+    size_t Capacity() const;
+    size_t Used() const;
+    size_t HighWater() const; // Most used in any frame so far, including overflow.
+
+    // Creates the arenas, for the calling (main) thread and each worker of the shared pool.
+    static bool Initialize(size_t capacity);
+
+    // The calling thread's arena, or NULL for threads without one.
+    static FrameArena* GetArena();
+
+    // Resets every arena. No frame work may be running.
+    static void ResetAll();
+
+    // Summed high-water marks of all arenas.
+    static size_t TotalHighWater();
+
+    static bool Deinitialize();
+};
+
+// Standard allocator over a frame arena, for containers that only live within a frame.
+// With a NULL arena (a thread without one) it falls back to the heap.
+template <typename T>
+class FrameAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef FrameAllocator<U> other;
+    };
+
+    FrameArena *pArena;
+
+    FrameAllocator(FrameArena* pArena)
+        : pArena(pArena)
+    {
+    }
+
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other)
+        : pArena(other.pArena)
+    {
+    }
+
+    T* allocate(size_t count, const void* = NULL)
+    {
+        if (pArena == NULL)
+        {
+            return (T*)::operator new(count * sizeof(T));
+        }
+
+        return (T*)pArena->Allocate(count * sizeof(T));
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        if (pArena == NULL)
+        {
+            ::operator delete(p);
+        }
+    }
+
+    void construct(T* p, const T& value)
+    {
+        new ((void*)p) T(value);
+    }
+
+    void destroy(T* p)
+    {
+        p->~T();
+    }
+
+    T* address(T& value) const
+    {
+        return &value;
+    }
+
+    const T* address(const T& value) const
+    {
+        return &value;
+    }
+
+    size_t max_size() const
+    {
+        return ((size_t)-1) / sizeof(T);
+    }
+};
+
+template <typename T, typename U>
+bool operator == (const FrameAllocator<T>& left, const FrameAllocator<U>& right)
+{
+    return left.pArena == right.pArena;
+}
+
+template <typename T, typename U>
+bool operator != (const FrameAllocator<T>& left, const FrameAllocator<U>& right)
+{
+    return left.pArena != right.pArena;
+}
@@ -40,71 +40,61 @@ bool GLManager::LoadString(const std::string& filename, std::string& result) con
     return true;
 }
 
-// Compiles a combination vertex and fragment shader into a single shader program.
-GLuint GLManager::CompileShaderProgram(const char rootName [])
+GLuint GLManager::CompileShader(GLenum type, const std::string& source, const std::string& name)
 {
-    GLuint program;
-    GLuint vertexShader;
-    GLuint fragmentShader;
-
-    std::string vsShader, fsShader;
-    std::stringstream vsFilenameStream, fsFilenameStream;
-    vsFilenameStream << "shaders/" << rootName << ".vs";
-    fsFilenameStream << "shaders/" << rootName << ".fs";
-
-    if (!LoadString(vsFilenameStream.str().c_str(), vsShader))
-    {
-        std::cout << "Could not load " << vsShader << "!" << std::endl;
-    }
-
-    if (!LoadString(fsFilenameStream.str().c_str(), fsShader))
-    {
-        std::cout << "Could not load fragment shader" << fsShader << "!" << std::endl;
-    }
-
-    const char* vss = vsShader.c_str();
-    const char* fss = fsShader.c_str();
-
-    char buffer[1024];
-    GLint len;
+    const char* pSource = source.c_str();
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &pSource, NULL);
+    glCompileShader(shader);
 
     GLint compileStatus;
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vss, NULL);
-    glCompileShader(vertexShader);
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &compileStatus);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compileStatus);
     if (!compileStatus)
     {
-        glGetShaderInfoLog(vertexShader, 1024, &len, buffer);
-        std::cout << std::endl << "Error: " << glewGetErrorString(glGetError()) << " " << buffer << std::endl;
+        char buffer[1024];
+        GLint len;
+        glGetShaderInfoLog(shader, 1024, &len, buffer);
+        std::cout << std::endl << "Error compiling " << name << ": " << buffer << std::endl;
+        glDeleteShader(shader);
+        return 0;
     }
 
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fss, NULL);
-    glCompileShader(fragmentShader);
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &compileStatus);
-    if (!compileStatus)
+    return shader;
+}
+
+bool GLManager::LinkShaderProgram(GLuint program, const std::string& vsSource, const std::string& fsSource, const std::string& name)
+{
+    GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vsSource, name + ".vs");
+    GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fsSource, name + ".fs");
+    if (vertexShader == 0 || fragmentShader == 0)
     {
-        glGetShaderInfoLog(fragmentShader, 1024, &len, buffer);
-        std::cout << "Error: " << glewGetErrorString(glGetError()) << " " << buffer << std::endl;
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return false;
     }
 
-    // Create program
-    program = glCreateProgram();
     glAttachShader(program, vertexShader);
     glAttachShader(program, fragmentShader);
     glLinkProgram(program);
-    glGetProgramiv(program, GL_LINK_STATUS, &compileStatus);
-    if (!compileStatus)
+
+    // Detached so the program can later be relinked with different stages.
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint linkStatus;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+    if (!linkStatus)
     {
+        char buffer[1024];
+        GLint len;
         glGetProgramInfoLog(program, 1024, &len, buffer);
-        std::cout << "Error: " << glewGetErrorString(glGetError()) << " " << buffer << std::endl;
+        std::cout << "Error linking " << name << ": " << buffer << std::endl;
+        return false;
     }
-    
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
 
-    return program;
+    return true;
 }
 
 bool GLManager::Initialize(float yFov, float nearPlane, float farPlane, bool fullscreen, int width, int height, std::string title)
@@ -26,8 +26,6 @@ class GLManager
     // Using a pointer instead of a STL unique_pointer to more delicately handle OpenGL memory.
     static GLManager *m_pManager;
 
-    // Loads a file as a really big string.
-    bool LoadString(const std::string& filename, std::string& result) const;
 public:
     // General constants.
     static const int OPENGL_MAJOR = 4, OPENGL_MINOR = 0;
@@ -42,7 +40,15 @@ public:
     int width, height;
     std::string title;
 
-    GLuint CompileShaderProgram(const char rootName []);
+    // Loads a file as a really big string.
+    bool LoadString(const std::string& filename, std::string& result) const;
+
+    // Compiles a single shader stage, printing its log on failure. Returns 0 if compilation failed.
+    GLuint CompileShader(GLenum type, const std::string& source, const std::string& name);
+
+    // Compiles both stages and links them into program, which may already hold a linked executable.
+    // The program is left untouched if either stage fails to compile.
+    bool LinkShaderProgram(GLuint program, const std::string& vsSource, const std::string& fsSource, const std::string& name);
 
     // Manager initialization.
     static bool Initialize(float yFov, float nearPlane, float farPlane, bool fullscreen, int width, int height, std::string title);
@@ -0,0 +1,427 @@
+/*--------------------------------------------------------------------------
+    ImageCsgRenderer.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "ImageCsgRenderer.h"
+#include "ShaderCache.h"
+#include "UniformBlocks.h"
+
+// Divisions around curved primitives.
+static const int PRIMITIVE_SEGMENTS = 48;
+
+ImageCsgRenderer::ImageCsgRenderer(BufferRing* pUniformRing)
+    : candidateFramebuffer(0), candidateDepthStencil(0), accumulationFramebuffer(0), accumulationColor(0), accumulationDepth(0),
+      width(0), height(0), pUniformRing(pUniformRing), surfaceProgram(0), clipProgram(0), mergeProgram(0), programsReady(false), emptyVao(0)
+{
+}
+
+ImageCsgRenderer::~ImageCsgRenderer()
+{
+    ReleasePrimitives();
+    ReleaseTargets();
+    glDeleteVertexArrays(1, &emptyVao);
+}
+
+bool ImageCsgRenderer::Initialize(int width, int height)
+{
+    // Compiled in the background; the first Render waits for them.
+    ShaderCache *pCache = ShaderCache::GetCache();
+    surfaceProgram = pCache->Request("render");
+    clipProgram = pCache->Request("csgClip");
+    mergeProgram = pCache->Request("csgMerge");
+
+    // Full-screen passes generate their vertices, but core profiles still need a bound VAO.
+    glGenVertexArrays(1, &emptyVao);
+
+    return Resize(width, height);
+}
+
+void ImageCsgRenderer::PreparePrograms()
+{
+    ShaderCache *pCache = ShaderCache::GetCache();
+    surfaceProgram = pCache->GetProgram("render");
+    clipProgram = pCache->GetProgram("csgClip");
+    mergeProgram = pCache->GetProgram("csgMerge");
+    programsReady = true;
+}
+
+void ImageCsgRenderer::ReleaseTargets()
+{
+    glDeleteFramebuffers(1, &candidateFramebuffer);
+    glDeleteTextures(1, &candidateDepthStencil);
+    glDeleteFramebuffers(1, &accumulationFramebuffer);
+    glDeleteRenderbuffers(1, &accumulationColor);
+    glDeleteRenderbuffers(1, &accumulationDepth);
+    candidateFramebuffer = candidateDepthStencil = accumulationFramebuffer = accumulationColor = accumulationDepth = 0;
+}
+
+bool ImageCsgRenderer::Resize(int width, int height)
+{
+    ReleaseTargets();
+    this->width = width;
+    this->height = height;
+
+    // Candidate depths are sampled when merging, so they live in a texture. Float depth keeps the merge exact.
+    glGenTextures(1, &candidateDepthStencil);
+    glBindTexture(GL_TEXTURE_2D, candidateDepthStencil);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH32F_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_FLOAT_32_UNSIGNED_INT_24_8_REV, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &candidateFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, candidateFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, candidateDepthStencil, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    glGenRenderbuffers(1, &accumulationColor);
+    glBindRenderbuffer(GL_RENDERBUFFER, accumulationColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &accumulationDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, accumulationDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &accumulationFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, accumulationFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, accumulationColor);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, accumulationDepth);
+
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!complete)
+    {
+        std::cout << "Image-space CSG framebuffer is incomplete!" << std::endl;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return complete;
+}
+
+// Intersects two sums of products, dropping products that contain a primitive and its complement.
+static bool AndProducts(const std::vector<ImageCsgRenderer::Product>& left, const std::vector<ImageCsgRenderer::Product>& right,
+    std::vector<ImageCsgRenderer::Product>& result)
+{
+    result.clear();
+    for (size_t i = 0; i < left.size(); i++)
+    {
+        for (size_t j = 0; j < right.size(); j++)
+        {
+            ImageCsgRenderer::Product product = left[i];
+            bool empty = false;
+            for (size_t k = 0; k < right[j].size() && !empty; k++)
+            {
+                const ImageCsgRenderer::Literal& literal = right[j][k];
+                bool duplicate = false;
+                for (size_t m = 0; m < product.size(); m++)
+                {
+                    if (product[m].primitive == literal.primitive)
+                    {
+                        duplicate = true;
+                        empty = (product[m].complemented != literal.complemented);
+                        break;
+                    }
+                }
+
+                if (!duplicate)
+                {
+                    product.push_back(literal);
+                }
+            }
+
+            if (!empty)
+            {
+                result.push_back(product);
+                if (result.size() > ImageCsgRenderer::MAX_PRODUCTS)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool NormalizeNode(const CsgNode& node, std::vector<const CsgNode*>& primitiveNodes, std::vector<ImageCsgRenderer::Product>& products)
+{
+    products.clear();
+    if (node.isPrimitive)
+    {
+        ImageCsgRenderer::Literal literal;
+        literal.primitive = (int)primitiveNodes.size();
+        literal.complemented = false;
+        primitiveNodes.push_back(&node);
+        products.push_back(ImageCsgRenderer::Product(1, literal));
+        return true;
+    }
+
+    std::vector<ImageCsgRenderer::Product> left, right;
+    if (!NormalizeNode(*node.pLeft, primitiveNodes, left) || !NormalizeNode(*node.pRight, primitiveNodes, right))
+    {
+        return false;
+    }
+
+    switch (node.operation)
+    {
+    case CSG_UNION:
+        products = left;
+        products.insert(products.end(), right.begin(), right.end());
+        return products.size() <= ImageCsgRenderer::MAX_PRODUCTS;
+    case CSG_INTERSECTION:
+        return AndProducts(left, right, products);
+    case CSG_DIFFERENCE:
+    default:
+    {
+        // By De Morgan, the complement of a sum of products is a product of sums of complemented literals.
+        std::vector<ImageCsgRenderer::Product> complement(1), next, sum;
+        for (size_t i = 0; i < right.size(); i++)
+        {
+            sum.clear();
+            for (size_t j = 0; j < right[i].size(); j++)
+            {
+                ImageCsgRenderer::Literal literal = right[i][j];
+                literal.complemented = !literal.complemented;
+                sum.push_back(ImageCsgRenderer::Product(1, literal));
+            }
+
+            if (!AndProducts(complement, sum, next))
+            {
+                return false;
+            }
+
+            complement.swap(next);
+        }
+
+        return AndProducts(left, complement, products);
+    }
+    }
+}
+
+bool ImageCsgRenderer::Normalize(const CsgNode& root, std::vector<const CsgNode*>& primitiveNodes, std::vector<Product>& products)
+{
+    primitiveNodes.clear();
+    return NormalizeNode(root, primitiveNodes, products);
+}
+
+void ImageCsgRenderer::ReleasePrimitives()
+{
+    for (size_t i = 0; i < primitives.size(); i++)
+    {
+        glDeleteVertexArrays(1, &primitives[i].vao);
+        glDeleteBuffers(1, &primitives[i].vertexBuffer);
+        glDeleteBuffers(1, &primitives[i].indexBuffer);
+    }
+
+    primitives.clear();
+}
+
+bool ImageCsgRenderer::SetTree(const CsgNode& root)
+{
+    ReleasePrimitives();
+
+    std::vector<const CsgNode*> primitiveNodes;
+    if (!Normalize(root, primitiveNodes, products))
+    {
+        std::cout << "CSG tree is too complex for image-space rendering." << std::endl;
+        products.clear();
+        return false;
+    }
+
+    Mesh mesh;
+    for (size_t i = 0; i < primitiveNodes.size(); i++)
+    {
+        primitiveNodes[i]->Tessellate(PRIMITIVE_SEGMENTS, mesh);
+
+        PrimitiveBuffer buffer;
+        glGenVertexArrays(1, &buffer.vao);
+        glBindVertexArray(buffer.vao);
+
+        glGenBuffers(1, &buffer.vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size()*sizeof(colorVertex), &mesh.vertices[0], GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(colorVertex), (GLvoid*)offsetof(colorVertex, x));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(colorVertex), (GLvoid*)offsetof(colorVertex, r));
+        glEnableVertexAttribArray(1);
+
+        glGenBuffers(1, &buffer.indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size()*sizeof(unsigned int), &mesh.indices[0], GL_STATIC_DRAW);
+        buffer.indexCount = (GLsizei)mesh.indices.size();
+        for (int j = 0; j < 3; j++)
+        {
+            buffer.color[j] = primitiveNodes[i]->color[j];
+        }
+
+        primitives.push_back(buffer);
+    }
+
+    glBindVertexArray(0);
+    return true;
+}
+
+void ImageCsgRenderer::DrawPrimitive(int primitive)
+{
+    glBindVertexArray(primitives[primitive].vao);
+    glDrawElements(GL_TRIANGLES, primitives[primitive].indexCount, GL_UNSIGNED_INT, 0);
+}
+
+void ImageCsgRenderer::DrawFullscreen(GLuint program)
+{
+    glUseProgram(program);
+    glBindVertexArray(emptyVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void ImageCsgRenderer::Render(gm::mat4& projection, gm::mat4& modelView)
+{
+    // Waits for the shaders the first time.
+    if (!programsReady)
+    {
+        PreparePrograms();
+    }
+
+    // Surfaces are drawn either in their own colors, or one per cut face in the color of the part being cut.
+    FrameBlock frameBlock;
+    ObjectBlock objectBlock;
+    std::copy((const float*)projection, (const float*)projection + 16, frameBlock.projection);
+    objectBlock.Set(modelView, 0);
+    GLintptr frameOffset = pUniformRing->Write(&frameBlock, sizeof(frameBlock));
+    GLintptr plainOffset = pUniformRing->Write(&objectBlock, sizeof(objectBlock));
+    if (frameOffset < 0 || plainOffset < 0)
+    {
+        return;
+    }
+
+    pUniformRing->Bind(FRAME_BLOCK_BINDING, frameOffset, sizeof(frameBlock));
+    pUniformRing->Bind(OBJECT_BLOCK_BINDING, plainOffset, sizeof(objectBlock));
+
+    glBindFramebuffer(GL_FRAMEBUFFER, accumulationFramebuffer);
+    const GLfloat background[] = { 0, 0, 0, 1 };
+    const GLfloat farDepth = 1.0f;
+    glClearBufferfv(GL_COLOR, 0, background);
+    glClearBufferfv(GL_DEPTH, 0, &farDepth);
+
+    glEnable(GL_CULL_FACE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glStencilMask(1);
+
+    for (size_t p = 0; p < products.size(); p++)
+    {
+        const Product& product = products[p];
+        for (size_t i = 0; i < product.size(); i++)
+        {
+            // Visible surface of the candidate: front faces, or back faces for a complemented primitive.
+            glBindFramebuffer(GL_FRAMEBUFFER, candidateFramebuffer);
+            glDepthMask(GL_TRUE);
+            glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+            glDepthFunc(GL_LESS);
+            glEnable(GL_CULL_FACE);
+            glCullFace(product[i].complemented ? GL_FRONT : GL_BACK);
+
+            glUseProgram(surfaceProgram);
+            DrawPrimitive(product[i].primitive);
+
+            // Clip against every other literal: an odd number of surfaces in front of a pixel means it is inside.
+            glEnable(GL_STENCIL_TEST);
+            glDisable(GL_CULL_FACE);
+            for (size_t j = 0; j < product.size(); j++)
+            {
+                if (j == i)
+                {
+                    continue;
+                }
+
+                glUseProgram(surfaceProgram);
+                glDepthMask(GL_FALSE);
+                glDepthFunc(GL_LESS);
+                glStencilFunc(GL_ALWAYS, 0, 1);
+                glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+                DrawPrimitive(product[j].primitive);
+
+                // Push rejected pixels to the far plane, clearing the parity bit everywhere for the next literal.
+                glDepthMask(GL_TRUE);
+                glDepthFunc(GL_ALWAYS);
+                glStencilFunc(GL_EQUAL, product[j].complemented ? 1 : 0, 1);
+                glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
+                DrawFullscreen(clipProgram);
+            }
+
+            glDisable(GL_STENCIL_TEST);
+
+            // Keep the nearest surviving surface.
+            glBindFramebuffer(GL_FRAMEBUFFER, accumulationFramebuffer);
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, candidateDepthStencil);
+            DrawFullscreen(mergeProgram);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+    }
+
+    // Shade the surfaces that won. Cut faces take the color of the part being cut.
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(GL_EQUAL);
+    glEnable(GL_CULL_FACE);
+    glUseProgram(surfaceProgram);
+    for (size_t p = 0; p < products.size(); p++)
+    {
+        const Product& product = products[p];
+        int basePrimitive = -1;
+        for (size_t i = 0; i < product.size() && basePrimitive < 0; i++)
+        {
+            basePrimitive = product[i].complemented ? -1 : product[i].primitive;
+        }
+
+        for (size_t i = 0; i < product.size(); i++)
+        {
+            glCullFace(product[i].complemented ? GL_FRONT : GL_BACK);
+            GLintptr objectOffset = plainOffset;
+            if (product[i].complemented)
+            {
+                const float *pColor = primitives[basePrimitive].color;
+                std::copy(pColor, pColor + 3, objectBlock.colorOverride);
+                objectBlock.colorOverride[3] = 1.0f;
+                objectOffset = pUniformRing->Write(&objectBlock, sizeof(objectBlock));
+                if (objectOffset < 0)
+                {
+                    continue;
+                }
+            }
+
+            pUniformRing->Bind(OBJECT_BLOCK_BINDING, objectOffset, sizeof(objectBlock));
+
+            DrawPrimitive(product[i].primitive);
+        }
+    }
+
+    // Restore the state the rest of the editor expects and show the result.
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LEQUAL);
+    glCullFace(GL_BACK);
+    glBindVertexArray(0);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, accumulationFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
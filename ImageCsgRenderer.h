@@ -0,0 +1,90 @@
+/*--------------------------------------------------------------------------
+    ImageCsgRenderer.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "BufferRing.h"
+#include "CsgTree.h"
+
+// Draws a CSG tree directly from its primitive meshes with the Goldfeather algorithm, so the result can be
+// seen at full frame rate before any boolean mesh exists.
+// The tree is normalized into a union of products (intersections of primitives and complemented primitives).
+// For each primitive of a product, its visible surface is clipped against the rest of the product with stencil
+// parity counts, and the surviving depths are merged into an accumulation buffer that is finally shaded.
+// Blend radii are ignored (edges are sharp), and the camera must be outside every primitive.
+class ImageCsgRenderer
+{
+public:
+    struct Literal
+    {
+        int primitive;
+        bool complemented;
+    };
+
+    typedef std::vector<Literal> Product;
+
+private:
+    struct PrimitiveBuffer
+    {
+        GLuint vao;
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+        GLsizei indexCount;
+        float color[3];
+    };
+
+    std::vector<PrimitiveBuffer> primitives;
+    std::vector<Product> products;
+
+    // Candidate surface depth and parity stencil, and the accumulated result.
+    GLuint candidateFramebuffer, candidateDepthStencil;
+    GLuint accumulationFramebuffer, accumulationColor, accumulationDepth;
+    int width, height;
+
+    BufferRing *pUniformRing;
+    GLuint surfaceProgram, clipProgram, mergeProgram;
+    bool programsReady;
+    GLuint emptyVao;
+
+    void PreparePrograms();
+    void ReleasePrimitives();
+    void ReleaseTargets();
+    void DrawPrimitive(int primitive);
+    void DrawFullscreen(GLuint program);
+
+public:
+    // Products are capped to keep the normalized form of deeply nested differences bounded.
+    static const size_t MAX_PRODUCTS = 1024;
+
+    ImageCsgRenderer(BufferRing* pUniformRing);
+    ~ImageCsgRenderer();
+
+    bool Initialize(int width, int height);
+    bool Resize(int width, int height);
+
+    // Normalizes the tree into products of literals over the returned primitive list.
+    // Returns false if the normalized form would exceed MAX_PRODUCTS.
+    static bool Normalize(const CsgNode& root, std::vector<const CsgNode*>& primitiveNodes, std::vector<Product>& products);
+
+    // Rebuilds the primitive meshes and products for a new or edited tree.
+    bool SetTree(const CsgNode& root);
+
+    // Renders the tree into the default framebuffer's color buffer.
+    void Render(gm::mat4& projection, gm::mat4& modelView);
+};
@@ -0,0 +1,147 @@
+/*--------------------------------------------------------------------------
+    MappedFile.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    :
+#ifdef _WIN32
+      pFileHandle(INVALID_HANDLE_VALUE), pMappingHandle(NULL),
+#else
+      fileHandle(-1),
+#endif
+      pData(NULL), size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const std::string& filename)
+{
+    Close();
+
+#ifdef _WIN32
+    pFileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (pFileHandle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(pFileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    pMappingHandle = CreateFileMappingA(pFileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (pMappingHandle == NULL)
+    {
+        Close();
+        return false;
+    }
+
+    pData = (const unsigned char*)MapViewOfFile(pMappingHandle, FILE_MAP_READ, 0, 0, 0);
+    size = (size_t)fileSize.QuadPart;
+#else
+    fileHandle = open(filename.c_str(), O_RDONLY);
+    if (fileHandle < 0)
+    {
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(fileHandle, &status) != 0 || status.st_size == 0)
+    {
+        Close();
+        return false;
+    }
+
+    void* pMapping = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fileHandle, 0);
+    pData = pMapping == MAP_FAILED ? NULL : (const unsigned char*)pMapping;
+    size = (size_t)status.st_size;
+#endif
+
+    if (pData == NULL)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if (pData != NULL)
+    {
+        UnmapViewOfFile(pData);
+    }
+
+    if (pMappingHandle != NULL)
+    {
+        CloseHandle(pMappingHandle);
+        pMappingHandle = NULL;
+    }
+
+    if (pFileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(pFileHandle);
+        pFileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (pData != NULL)
+    {
+        munmap((void*)pData, size);
+    }
+
+    if (fileHandle >= 0)
+    {
+        close(fileHandle);
+        fileHandle = -1;
+    }
+#endif
+
+    pData = NULL;
+    size = 0;
+}
+
+const unsigned char* MappedFile::Data() const
+{
+    return pData;
+}
+
+size_t MappedFile::Size() const
+{
+    return size;
+}
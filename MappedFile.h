@@ -0,0 +1,50 @@
+/*--------------------------------------------------------------------------
+    MappedFile.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+
+// Read-only view of a whole file mapped into memory, so its contents can be used in place without reading them
+// into a buffer first. Pages are only loaded as they are touched.
+class MappedFile
+{
+    // Platform handles: the file and its mapping on Win32, a descriptor elsewhere.
+#ifdef _WIN32
+    void *pFileHandle, *pMappingHandle;
+#else
+    int fileHandle;
+#endif
+    const unsigned char *pData;
+    size_t size;
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Maps a file, closing any previously mapped one. Empty files cannot be mapped.
+    bool Open(const std::string& filename);
+    void Close();
+
+    // NULL while nothing is mapped.
+    const unsigned char* Data() const;
+    size_t Size() const;
+};
@@ -0,0 +1,366 @@
+/*--------------------------------------------------------------------------
+    MaterialGraph.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "MaterialGraph.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define MATERIAL_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+MaterialGraph::MaterialGraph()
+{
+}
+
+int MaterialGraph::AddNode(MaterialOp op, int a, int b, int c, float p0, float p1, float p2)
+{
+    MaterialNode node;
+    node.op = op;
+    node.inputs[0] = a;
+    node.inputs[1] = b;
+    node.inputs[2] = c;
+    node.params[0] = p0;
+    node.params[1] = p1;
+    node.params[2] = p2;
+    node.seed = 0;
+    nodes.push_back(node);
+    return (int)nodes.size() - 1;
+}
+
+int MaterialGraph::U()
+{
+    return AddNode(MATERIAL_U, 0, 0, 0, 0.0f, 0.0f, 0.0f);
+}
+
+int MaterialGraph::V()
+{
+    return AddNode(MATERIAL_V, 0, 0, 0, 0.0f, 0.0f, 0.0f);
+}
+
+int MaterialGraph::Constant(float value)
+{
+    return AddNode(MATERIAL_CONSTANT, 0, 0, 0, value, 0.0f, 0.0f);
+}
+
+int MaterialGraph::Add(int a, int b)
+{
+    return AddNode(MATERIAL_ADD, a, b, 0, 0.0f, 0.0f, 0.0f);
+}
+
+int MaterialGraph::Multiply(int a, int b)
+{
+    return AddNode(MATERIAL_MULTIPLY, a, b, 0, 0.0f, 0.0f, 0.0f);
+}
+
+int MaterialGraph::Mix(int a, int b, int t)
+{
+    return AddNode(MATERIAL_MIX, a, b, t, 0.0f, 0.0f, 0.0f);
+}
+
+int MaterialGraph::Distance(int a, int b, float centerA, float centerB)
+{
+    return AddNode(MATERIAL_DISTANCE, a, b, 0, centerA, centerB, 0.0f);
+}
+
+int MaterialGraph::Wave(int a)
+{
+    return AddNode(MATERIAL_WAVE, a, 0, 0, 0.0f, 0.0f, 0.0f);
+}
+
+int MaterialGraph::Noise(int a, int b, float periodA, float periodB, int octaves, unsigned int seed)
+{
+    int node = AddNode(MATERIAL_NOISE, a, b, 0, std::max(floorf(periodA + 0.5f), 1.0f), std::max(floorf(periodB + 0.5f), 1.0f),
+        (float)std::max(octaves, 1));
+    nodes[node].seed = seed;
+    return node;
+}
+
+void MaterialGraph::AddColorStop(float position, float r, float g, float b, float a)
+{
+    MaterialColorStop stop;
+    stop.position = position;
+    stop.color[0] = r;
+    stop.color[1] = g;
+    stop.color[2] = b;
+    stop.color[3] = a;
+    ramp.push_back(stop);
+}
+
+// 64-bit FNV-1a over the nodes and the ramp.
+unsigned long long MaterialGraph::Hash() const
+{
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const MaterialNode& node = nodes[i];
+        int fields[5] = { (int)node.op, node.inputs[0], node.inputs[1], node.inputs[2], (int)node.seed };
+        for (size_t j = 0; j < sizeof(fields); j++)
+        {
+            hash = (hash ^ ((const unsigned char*)fields)[j]) * 1099511628211ull;
+        }
+
+        for (size_t j = 0; j < sizeof(node.params); j++)
+        {
+            hash = (hash ^ ((const unsigned char*)node.params)[j]) * 1099511628211ull;
+        }
+    }
+
+    for (size_t i = 0; i < ramp.size(); i++)
+    {
+        for (size_t j = 0; j < sizeof(MaterialColorStop); j++)
+        {
+            hash = (hash ^ ((const unsigned char*)&ramp[i])[j]) * 1099511628211ull;
+        }
+    }
+
+    return hash;
+}
+
+// Uniform value in [0, 1] for a lattice point.
+static inline float LatticeValue(int x, int y, unsigned int seed)
+{
+    unsigned int h = (unsigned int)x * 0x27d4eb2du ^ (unsigned int)y * 0x165667b1u ^ seed * 0x9e3779b9u;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    h *= 0x297a2d39u;
+    h ^= h >> 15;
+    return (float)(h & 0xFFFFFF) / 16777215.0f;
+}
+
+// Smoothly interpolated lattice values, wrapping at the periods so the result tiles.
+static float ValueNoise(float a, float b, int periodA, int periodB, unsigned int seed)
+{
+    float x = a * (float)periodA, y = b * (float)periodB;
+    float floorX = floorf(x), floorY = floorf(y);
+    float fx = x - floorX, fy = y - floorY;
+    int x0 = ((int)floorX % periodA + periodA) % periodA, y0 = ((int)floorY % periodB + periodB) % periodB;
+    int x1 = (x0 + 1) % periodA, y1 = (y0 + 1) % periodB;
+
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fy = fy * fy * (3.0f - 2.0f * fy);
+    float bottom = LatticeValue(x0, y0, seed) + (LatticeValue(x1, y0, seed) - LatticeValue(x0, y0, seed)) * fx;
+    float top = LatticeValue(x0, y1, seed) + (LatticeValue(x1, y1, seed) - LatticeValue(x0, y1, seed)) * fx;
+    return bottom + (top - bottom) * fy;
+}
+
+#ifdef MATERIAL_USE_SSE
+// Rounds towards negative infinity; inputs stay well within int range.
+static inline __m128 Floor4(__m128 v)
+{
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, v), _mm_set1_ps(1.0f)));
+}
+#endif
+
+void MaterialGraph::EvaluateBatch(const float* us, const float* vs, unsigned char* pRgba, size_t count, float* pRows) const
+{
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        const MaterialNode& node = nodes[i];
+        float *pOut = &pRows[i*BATCH_SIZE];
+        const float *pA = &pRows[node.inputs[0]*BATCH_SIZE];
+        const float *pB = &pRows[node.inputs[1]*BATCH_SIZE];
+        const float *pT = &pRows[node.inputs[2]*BATCH_SIZE];
+        switch (node.op)
+        {
+        case MATERIAL_U:
+            std::copy(us, us + count, pOut);
+            break;
+        case MATERIAL_V:
+            std::copy(vs, vs + count, pOut);
+            break;
+        case MATERIAL_CONSTANT:
+            std::fill(pOut, pOut + count, node.params[0]);
+            break;
+        case MATERIAL_NOISE:
+        {
+            // Lattice lookups don't vectorize with SSE2, so noise is evaluated per pixel.
+            int periodA = (int)node.params[0], periodB = (int)node.params[1], octaves = (int)node.params[2];
+            unsigned int seed = node.seed;
+            for (size_t j = 0; j < count; j++)
+            {
+                float sum = 0.0f, amplitude = 1.0f, total = 0.0f;
+                for (int octave = 0; octave < octaves; octave++)
+                {
+                    sum += amplitude * ValueNoise(pA[j], pB[j], periodA << octave, periodB << octave, seed + (unsigned int)octave);
+                    total += amplitude;
+                    amplitude *= 0.5f;
+                }
+
+                pOut[j] = sum / total;
+            }
+
+            break;
+        }
+        default:
+#ifdef MATERIAL_USE_SSE
+            for (size_t j = 0; j < count; j += 4)
+            {
+                __m128 a = _mm_loadu_ps(&pA[j]);
+                __m128 b = _mm_loadu_ps(&pB[j]);
+                __m128 result;
+                switch (node.op)
+                {
+                case MATERIAL_ADD:
+                    result = _mm_add_ps(a, b);
+                    break;
+                case MATERIAL_MULTIPLY:
+                    result = _mm_mul_ps(a, b);
+                    break;
+                case MATERIAL_MIX:
+                    result = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_loadu_ps(&pT[j])));
+                    break;
+                case MATERIAL_DISTANCE:
+                {
+                    __m128 da = _mm_sub_ps(a, _mm_set1_ps(node.params[0]));
+                    __m128 db = _mm_sub_ps(b, _mm_set1_ps(node.params[1]));
+                    result = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(da, da), _mm_mul_ps(db, db)));
+                    break;
+                }
+                case MATERIAL_WAVE:
+                default:
+                {
+                    // A smoothstepped triangle wave: C1 continuous and much cheaper than a sine.
+                    __m128 t = _mm_sub_ps(a, Floor4(a));
+                    __m128 triangle = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_andnot_ps(_mm_set1_ps(-0.0f),
+                        _mm_sub_ps(_mm_add_ps(t, t), _mm_set1_ps(1.0f))));
+                    result = _mm_mul_ps(_mm_mul_ps(triangle, triangle), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_add_ps(triangle, triangle)));
+                    break;
+                }
+                }
+
+                _mm_storeu_ps(&pOut[j], result);
+            }
+#else
+            for (size_t j = 0; j < count; j++)
+            {
+                switch (node.op)
+                {
+                case MATERIAL_ADD:
+                    pOut[j] = pA[j] + pB[j];
+                    break;
+                case MATERIAL_MULTIPLY:
+                    pOut[j] = pA[j] * pB[j];
+                    break;
+                case MATERIAL_MIX:
+                    pOut[j] = pA[j] + (pB[j] - pA[j]) * pT[j];
+                    break;
+                case MATERIAL_DISTANCE:
+                    pOut[j] = sqrtf((pA[j] - node.params[0]) * (pA[j] - node.params[0]) + (pB[j] - node.params[1]) * (pB[j] - node.params[1]));
+                    break;
+                case MATERIAL_WAVE:
+                default:
+                {
+                    float triangle = 1.0f - fabsf(2.0f * (pA[j] - floorf(pA[j])) - 1.0f);
+                    pOut[j] = triangle * triangle * (3.0f - 2.0f * triangle);
+                    break;
+                }
+                }
+            }
+#endif
+            break;
+        }
+    }
+
+    // Walks the ramp, blending towards each stop as the output passes the previous one.
+    const float *pValues = &pRows[(nodes.size() - 1)*BATCH_SIZE];
+    for (size_t j = 0; j < count; j++)
+    {
+        float value = std::min(std::max(pValues[j], 0.0f), 1.0f);
+        float color[4] = { ramp[0].color[0], ramp[0].color[1], ramp[0].color[2], ramp[0].color[3] };
+        for (size_t s = 1; s < ramp.size(); s++)
+        {
+            float span = ramp[s].position - ramp[s - 1].position;
+            float w = span > 0.0f ? std::min(std::max((value - ramp[s - 1].position) / span, 0.0f), 1.0f) : (value >= ramp[s].position ? 1.0f : 0.0f);
+            for (int c = 0; c < 4; c++)
+            {
+                color[c] += (ramp[s].color[c] - color[c]) * w;
+            }
+        }
+
+        for (int c = 0; c < 4; c++)
+        {
+            pRgba[j * 4 + c] = (unsigned char)(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+    }
+}
+
+void MaterialGraph::Bake(int size, std::vector<unsigned char>& rgba, ThreadPool* pPool) const
+{
+    rgba.resize((size_t)size * size * 4);
+    if (nodes.empty() || ramp.empty())
+    {
+        std::fill(rgba.begin(), rgba.end(), (unsigned char)255);
+        return;
+    }
+
+    ThreadPool::RunChunks(pPool, (size_t)size, 4, [&](size_t begin, size_t end)
+    {
+        std::vector<float> rows(nodes.size() * BATCH_SIZE);
+        float us[BATCH_SIZE], vs[BATCH_SIZE];
+        unsigned char batchRgba[BATCH_SIZE * 4];
+        for (size_t y = begin; y < end; y++)
+        {
+            for (int x = 0; x < size; x += BATCH_SIZE)
+            {
+                // Short rows are padded to the SIMD width by repeating their last pixel.
+                size_t count = (size_t)std::min(BATCH_SIZE, size - x);
+                size_t padded = (count + 3) & ~(size_t)3;
+                for (size_t j = 0; j < padded; j++)
+                {
+                    us[j] = ((float)(x + (int)std::min(j, count - 1)) + 0.5f) / (float)size;
+                    vs[j] = ((float)y + 0.5f) / (float)size;
+                }
+
+                EvaluateBatch(us, vs, batchRgba, padded, &rows[0]);
+                std::copy(batchRgba, batchRgba + count * 4, &rgba[((size_t)y * size + x) * 4]);
+            }
+        }
+    });
+}
+
+MaterialGraph MaterialGraph::Wood(const float light[3], const float dark[3], float rings, unsigned int seed)
+{
+    // Grain lines across v, bent by coarse noise, with fine streaks along them. A whole number of rings keeps the tile seamless.
+    MaterialGraph graph;
+    int u = graph.U(), v = graph.V();
+    int warp = graph.Noise(u, v, 2.0f, 3.0f, 3, seed);
+    int grain = graph.Add(graph.Multiply(v, graph.Constant(floorf(rings + 0.5f))), graph.Multiply(warp, graph.Constant(1.5f)));
+    int streaks = graph.Noise(u, v, 3.0f, 64.0f, 2, seed + 17);
+    graph.Mix(graph.Wave(grain), streaks, graph.Constant(0.3f));
+    graph.AddColorStop(0.0f, dark[0], dark[1], dark[2], 1.0f);
+    graph.AddColorStop(1.0f, light[0], light[1], light[2], 1.0f);
+    return graph;
+}
+
+MaterialGraph MaterialGraph::BrushedMetal(const float color[3], unsigned int seed)
+{
+    // Long scratches along u over a faint mottling.
+    MaterialGraph graph;
+    int u = graph.U(), v = graph.V();
+    int scratches = graph.Noise(u, v, 2.0f, 256.0f, 2, seed);
+    int mottling = graph.Noise(u, v, 4.0f, 4.0f, 2, seed + 17);
+    graph.Mix(scratches, mottling, graph.Constant(0.3f));
+    graph.AddColorStop(0.0f, color[0] * 0.7f, color[1] * 0.7f, color[2] * 0.7f, 1.0f);
+    graph.AddColorStop(1.0f, std::min(color[0] * 1.15f, 1.0f), std::min(color[1] * 1.15f, 1.0f), std::min(color[2] * 1.15f, 1.0f), 1.0f);
+    return graph;
+}
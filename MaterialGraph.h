@@ -0,0 +1,99 @@
+/*--------------------------------------------------------------------------
+    MaterialGraph.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+enum MaterialOp
+{
+    MATERIAL_U,        // Texture coordinates across the tile, in [0, 1).
+    MATERIAL_V,
+    MATERIAL_CONSTANT,
+    MATERIAL_ADD,      // a + b
+    MATERIAL_MULTIPLY, // a * b
+    MATERIAL_MIX,      // a + (b - a) * t
+    MATERIAL_DISTANCE, // Distance of (a, b) from a fixed point.
+    MATERIAL_WAVE,     // Smooth periodic wave of a: 0 at integers, 1 halfway between them.
+    MATERIAL_NOISE     // Fractal value noise of (a, b), tiling across [0, 1).
+};
+
+// A node of a material graph. Inputs always refer to earlier nodes, so nodes are evaluated in order.
+struct MaterialNode
+{
+    MaterialOp op;
+    int inputs[3];
+    float params[3]; // Constant: value. Distance: center x, y. Noise: periods along a and b, octaves.
+    unsigned int seed; // Noise only. Kept as an integer, as floats would merge seeds above 2^24.
+};
+
+// Maps the graph's output to a color.
+struct MaterialColorStop
+{
+    float position;
+    float color[4];
+};
+
+// Procedural material: a graph of scalar nodes whose last output picks a color from a ramp. Materials are small enough to
+// describe a texture in a few dozen bytes, and are baked into textures only at the resolution they are drawn at.
+// Like SdfEvaluator, nodes are evaluated a row of BATCH_SIZE pixels at a time, so arithmetic nodes are SIMD loops
+// rather than a graph walk per pixel.
+class MaterialGraph
+{
+    std::vector<MaterialNode> nodes;
+    std::vector<MaterialColorStop> ramp;
+
+    int AddNode(MaterialOp op, int a, int b, int c, float p0, float p1, float p2);
+
+    // Evaluates up to BATCH_SIZE pixels into RGBA8, using a row of BATCH_SIZE values per node.
+    // With SIMD, count must be padded to a multiple of 4.
+    void EvaluateBatch(const float* us, const float* vs, unsigned char* pRgba, size_t count, float* pRows) const;
+
+public:
+    // Pixels are evaluated in groups of this size; a multiple of the SIMD width.
+    static const int BATCH_SIZE = 64;
+
+    MaterialGraph();
+
+    // Node creation. Each returns the index of the new node, for use as an input of later ones.
+    int U();
+    int V();
+    int Constant(float value);
+    int Add(int a, int b);
+    int Multiply(int a, int b);
+    int Mix(int a, int b, int t);
+    int Distance(int a, int b, float centerA, float centerB);
+    int Wave(int a);
+
+    // Periods are rounded to whole numbers so the noise tiles. Each octave doubles them and halves the amplitude.
+    int Noise(int a, int b, float periodA, float periodB, int octaves, unsigned int seed);
+
+    // The last node's output, clamped to [0, 1], is mapped through the ramp. Stops go in increasing position.
+    void AddColorStop(float position, float r, float g, float b, float a);
+
+    // Identifies the material's appearance, for caching its bakes.
+    unsigned long long Hash() const;
+
+    // Renders a size by size RGBA8 tile, bottom row first, splitting rows across pPool, which may be NULL.
+    void Bake(int size, std::vector<unsigned char>& rgba, ThreadPool* pPool) const;
+
+    // Example materials.
+    static MaterialGraph Wood(const float light[3], const float dark[3], float rings, unsigned int seed);
+    static MaterialGraph BrushedMetal(const float color[3], unsigned int seed);
+};
@@ -0,0 +1,55 @@
+/*--------------------------------------------------------------------------
+    Mesh.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "Vertex.h"
+
+// Indexed triangle mesh, laid out so it can be uploaded to OpenGL as-is.
+struct Mesh
+{
+    std::vector<colorVertex> vertices;
+    std::vector<unsigned int> indices; // Three per triangle, counter-clockwise front faces.
+
+    size_t TriangleCount() const
+    {
+        return indices.size() / 3;
+    }
+
+    void Clear()
+    {
+        vertices.clear();
+        indices.clear();
+    }
+
+    // Parts are modeled Y-up, while printers and mills work Z-up: machine (x, y, z) is part (x, -z, y), in millimeters.
+    static void MachinePosition(const colorVertex& vertex, float position[3])
+    {
+        position[0] = vertex.x;
+        position[1] = -vertex.z;
+        position[2] = vertex.y;
+    }
+
+    static void PartPosition(const float position[3], colorVertex& vertex)
+    {
+        vertex.x = position[0];
+        vertex.y = position[2];
+        vertex.z = -position[1];
+    }
+};
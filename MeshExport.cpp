@@ -0,0 +1,608 @@
+/*--------------------------------------------------------------------------
+    MeshExport.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "MeshExport.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+// Reflected CRC-32 (polynomial 0xEDB88320) lookup tables, filled in at startup. Table k advances a byte through k
+// further zero bytes, so Crc32 can fold in eight bytes per step.
+static unsigned int crcTables[8][256];
+static struct CrcTableInitializer
+{
+    CrcTableInitializer()
+    {
+        for (unsigned int i = 0; i < 256; i++)
+        {
+            unsigned int crc = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+            }
+
+            crcTables[0][i] = crc;
+        }
+
+        for (unsigned int i = 0; i < 256; i++)
+        {
+            for (int k = 1; k < 8; k++)
+            {
+                crcTables[k][i] = crcTables[0][crcTables[k - 1][i] & 0xFF] ^ (crcTables[k - 1][i] >> 8);
+            }
+        }
+    }
+} crcTableInitializer;
+
+// 32x32 bit matrices over GF(2) that advance a CRC over runs of zero bytes, for Crc32Combine.
+static unsigned int Gf2MatrixTimes(const unsigned int* pMatrix, unsigned int vector)
+{
+    unsigned int sum = 0;
+    for (; vector != 0; vector >>= 1, pMatrix++)
+    {
+        if (vector & 1)
+        {
+            sum ^= *pMatrix;
+        }
+    }
+
+    return sum;
+}
+
+static void Gf2MatrixSquare(unsigned int* pSquare, const unsigned int* pMatrix)
+{
+    for (int i = 0; i < 32; i++)
+    {
+        pSquare[i] = Gf2MatrixTimes(pMatrix, pMatrix[i]);
+    }
+}
+
+unsigned int MeshExporter::Crc32(unsigned int crc, const char* pData, size_t length)
+{
+    crc = ~crc;
+    const unsigned char *pBytes = (const unsigned char*)pData;
+    for (; length >= 8; length -= 8, pBytes += 8)
+    {
+        unsigned int low = crc ^ (pBytes[0] | (pBytes[1] << 8) | (pBytes[2] << 16) | ((unsigned int)pBytes[3] << 24));
+        crc = crcTables[7][low & 0xFF] ^ crcTables[6][(low >> 8) & 0xFF] ^ crcTables[5][(low >> 16) & 0xFF] ^ crcTables[4][low >> 24] ^
+            crcTables[3][pBytes[4]] ^ crcTables[2][pBytes[5]] ^ crcTables[1][pBytes[6]] ^ crcTables[0][pBytes[7]];
+    }
+
+    for (; length > 0; length--, pBytes++)
+    {
+        crc = crcTables[0][(crc ^ *pBytes) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+unsigned int MeshExporter::Crc32Combine(unsigned int firstCrc, unsigned int secondCrc, unsigned long long secondLength)
+{
+    if (secondLength == 0)
+    {
+        return firstCrc;
+    }
+
+    // Operator for one zero bit, squared up to one zero byte.
+    unsigned int even[32], odd[32];
+    odd[0] = 0xEDB88320;
+    for (int i = 1; i < 32; i++)
+    {
+        odd[i] = 1u << (i - 1);
+    }
+
+    Gf2MatrixSquare(even, odd);
+    Gf2MatrixSquare(odd, even);
+
+    // Runs the first CRC through secondLength zero bytes, one bit of the length at a time.
+    do
+    {
+        Gf2MatrixSquare(even, odd);
+        if (secondLength & 1)
+        {
+            firstCrc = Gf2MatrixTimes(even, firstCrc);
+        }
+
+        secondLength >>= 1;
+        if (secondLength == 0)
+        {
+            break;
+        }
+
+        Gf2MatrixSquare(odd, even);
+        if (secondLength & 1)
+        {
+            firstCrc = Gf2MatrixTimes(odd, firstCrc);
+        }
+
+        secondLength >>= 1;
+    } while (secondLength != 0);
+
+    return firstCrc ^ secondCrc;
+}
+
+MeshExporter::MeshExporter(ThreadPool* pPool)
+    : pPool(pPool)
+{
+}
+
+bool MeshExporter::StreamBatches(std::ofstream& file, size_t count, const BatchFormatter& format, unsigned int* pCrc, unsigned long long& bytes) const
+{
+    size_t batchCount = (count + BATCH_SIZE - 1) / BATCH_SIZE;
+    if (batchCount == 0)
+    {
+        return true;
+    }
+
+    // Two windows of batches: the pool fills one while the other is written. Buffers keep their capacity between windows.
+    size_t windowSize = pPool ? 2 * (size_t)pPool->ThreadCount() + 2 : 1;
+    std::vector<Batch> windows[2];
+    windows[0].resize(windowSize);
+    windows[1].resize(windowSize);
+
+    auto formatWindow = [&](int side, size_t firstBatch)
+    {
+        size_t batches = std::min(windowSize, batchCount - firstBatch);
+        ThreadPool::RunChunks(pPool, batches, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                Batch& batch = windows[side][i];
+                size_t first = (firstBatch + i) * BATCH_SIZE;
+                batch.data.clear();
+                format(first, std::min(first + BATCH_SIZE, count), batch.data);
+                batch.crc = pCrc ? Crc32(0, batch.data.empty() ? NULL : &batch.data[0], batch.data.size()) : 0;
+            }
+        });
+    };
+
+    std::mutex formatMutex;
+    std::condition_variable formatDone;
+    bool formatting = false;
+
+    bool failed = false;
+    int side = 0;
+    formatWindow(side, 0);
+    for (size_t firstBatch = 0; firstBatch < batchCount; firstBatch += windowSize)
+    {
+        size_t nextBatch = firstBatch + windowSize;
+        int nextSide = 1 - side;
+        if (pPool && nextBatch < batchCount)
+        {
+            formatting = true;
+            pPool->Enqueue([&, nextSide, nextBatch]()
+            {
+                formatWindow(nextSide, nextBatch);
+                std::lock_guard<std::mutex> lock(formatMutex);
+                formatting = false;
+                formatDone.notify_all();
+            });
+        }
+
+        size_t batches = std::min(windowSize, batchCount - firstBatch);
+        for (size_t i = 0; i < batches && !failed; i++)
+        {
+            const Batch& batch = windows[side][i];
+            if (batch.data.empty())
+            {
+                continue;
+            }
+
+            failed = !file.write(&batch.data[0], batch.data.size());
+            bytes += batch.data.size();
+            if (pCrc)
+            {
+                *pCrc = Crc32Combine(*pCrc, batch.crc, batch.data.size());
+            }
+        }
+
+        // The queued window references these locals, so it has to finish even after a failed write.
+        {
+            std::unique_lock<std::mutex> lock(formatMutex);
+            while (formatting)
+            {
+                formatDone.wait(lock);
+            }
+        }
+
+        if (failed)
+        {
+            return false;
+        }
+
+        if (!pPool && nextBatch < batchCount)
+        {
+            formatWindow(nextSide, nextBatch);
+        }
+
+        side = nextSide;
+    }
+
+    return true;
+}
+
+// Binary STL records are little-endian, which matches every platform the editor builds for.
+static const size_t STL_HEADER_BYTES = 80;
+static const size_t STL_RECORD_BYTES = 50;
+
+bool MeshExporter::WriteStl(const Mesh& mesh, const std::string& filename) const
+{
+    size_t triangleCount = mesh.TriangleCount();
+    if ((unsigned long long)triangleCount > 0xFFFFFFFFull)
+    {
+        std::cout << "Too many triangles for an STL file: " << triangleCount << std::endl;
+        return false;
+    }
+
+    std::ofstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+    {
+        std::cout << "Could not open " << filename << " for writing!" << std::endl;
+        return false;
+    }
+
+    char header[STL_HEADER_BYTES + 4];
+    memset(header, 0, sizeof(header));
+    strcpy(header, "Rcsg-editor binary STL, millimeters");
+    unsigned int count = (unsigned int)triangleCount;
+    memcpy(header + STL_HEADER_BYTES, &count, 4);
+    file.write(header, sizeof(header));
+
+    unsigned long long bytes = sizeof(header);
+    bool written = StreamBatches(file, triangleCount, [&mesh](size_t begin, size_t end, std::vector<char>& output)
+    {
+        output.resize((end - begin) * STL_RECORD_BYTES);
+        char *pRecord = &output[0];
+        for (size_t i = begin; i < end; i++, pRecord += STL_RECORD_BYTES)
+        {
+            // Normal, three corners, then an unused attribute word.
+            float record[12];
+            for (int j = 0; j < 3; j++)
+            {
+                Mesh::MachinePosition(mesh.vertices[mesh.indices[i*3 + j]], record + 3 + j*3);
+            }
+
+            float u[3], v[3];
+            for (int k = 0; k < 3; k++)
+            {
+                u[k] = record[6 + k] - record[3 + k];
+                v[k] = record[9 + k] - record[3 + k];
+            }
+
+            record[0] = u[1]*v[2] - u[2]*v[1];
+            record[1] = u[2]*v[0] - u[0]*v[2];
+            record[2] = u[0]*v[1] - u[1]*v[0];
+            float length = sqrtf(record[0]*record[0] + record[1]*record[1] + record[2]*record[2]);
+            for (int k = 0; k < 3; k++)
+            {
+                record[k] = length > 0.0f ? record[k] / length : 0.0f;
+            }
+
+            memcpy(pRecord, record, sizeof(record));
+            pRecord[48] = pRecord[49] = 0;
+        }
+    }, NULL, bytes);
+
+    file.close();
+    if (!written || file.fail())
+    {
+        std::cout << "Could not write " << filename << "!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Decimal text for model files, written through a cursor into buffers sized for the longest possible output.
+// Six decimals are far finer than any printer or mill resolves in millimeters.
+static const size_t MAX_FLOAT_CHARS = 24;
+static const size_t MAX_UNSIGNED_CHARS = 20;
+
+static void AppendUnsigned(char*& pOutput, unsigned long long value)
+{
+    char digits[MAX_UNSIGNED_CHARS];
+    int count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (count > 0)
+    {
+        *pOutput++ = digits[--count];
+    }
+}
+
+static void AppendFloat(char*& pOutput, float value)
+{
+    double magnitude = fabs((double)value);
+    if (!(magnitude < 1e12))
+    {
+        // Out of range for the fixed-point path (or not a number at all).
+        pOutput += sprintf(pOutput, "%.9g", value);
+        return;
+    }
+
+    unsigned long long fixed = (unsigned long long)(magnitude * 1e6 + 0.5);
+    if (value < 0.0f && fixed != 0)
+    {
+        *pOutput++ = '-';
+    }
+
+    AppendUnsigned(pOutput, fixed / 1000000);
+    unsigned int fraction = (unsigned int)(fixed % 1000000);
+    if (fraction != 0)
+    {
+        *pOutput++ = '.';
+        for (unsigned int place = 100000; fraction != 0; place /= 10)
+        {
+            *pOutput++ = (char)('0' + fraction / place);
+            fraction %= place;
+        }
+    }
+}
+
+// Text literals only, so their length is known at compile time.
+template <size_t N>
+static void AppendText(char*& pOutput, const char (&text)[N])
+{
+    memcpy(pOutput, text, N - 1);
+    pOutput += N - 1;
+}
+
+// Zip archive pieces for the 3MF package. Entries are stored uncompressed; 3MF readers accept that, and it keeps
+// writing as fast as the disk. Fields are little-endian.
+static const unsigned short ZIP_VERSION = 20;
+static const unsigned short ZIP_FLAG_DATA_DESCRIPTOR = 0x0008;
+static const unsigned short ZIP_DOS_DATE = 0x0021; // 1980-01-01, so archives of the same part are identical.
+
+struct ZipEntry
+{
+    std::string name;
+    unsigned int crc;
+    unsigned long long size;
+    unsigned long long offset;
+    bool streamed;
+};
+
+static void PutShort(std::vector<char>& output, unsigned int value)
+{
+    output.push_back((char)(value & 0xFF));
+    output.push_back((char)((value >> 8) & 0xFF));
+}
+
+static void PutInt(std::vector<char>& output, unsigned int value)
+{
+    PutShort(output, value & 0xFFFF);
+    PutShort(output, value >> 16);
+}
+
+// Local header, or central directory header when central is set. Streamed entries give their size and CRC afterwards.
+static void PutZipHeader(std::vector<char>& output, const ZipEntry& entry, bool central)
+{
+    bool deferred = entry.streamed && !central;
+    PutInt(output, central ? 0x02014B50 : 0x04034B50);
+    if (central)
+    {
+        PutShort(output, ZIP_VERSION);
+    }
+
+    PutShort(output, ZIP_VERSION);
+    PutShort(output, entry.streamed ? ZIP_FLAG_DATA_DESCRIPTOR : 0);
+    PutShort(output, 0); // Stored.
+    PutShort(output, 0);
+    PutShort(output, ZIP_DOS_DATE);
+    PutInt(output, deferred ? 0 : entry.crc);
+    PutInt(output, deferred ? 0 : (unsigned int)entry.size);
+    PutInt(output, deferred ? 0 : (unsigned int)entry.size);
+    PutShort(output, (unsigned int)entry.name.size());
+    PutShort(output, 0);
+    if (central)
+    {
+        PutShort(output, 0); // Comment, disk, internal and external attributes.
+        PutShort(output, 0);
+        PutShort(output, 0);
+        PutInt(output, 0);
+        PutInt(output, (unsigned int)entry.offset);
+    }
+
+    output.insert(output.end(), entry.name.begin(), entry.name.end());
+}
+
+static bool WriteZipEntry(std::ofstream& file, std::vector<ZipEntry>& entries, unsigned long long& bytes, const char* pName, const char* pText)
+{
+    ZipEntry entry;
+    entry.name = pName;
+    entry.size = strlen(pText);
+    entry.crc = MeshExporter::Crc32(0, pText, (size_t)entry.size);
+    entry.offset = bytes;
+    entry.streamed = false;
+
+    std::vector<char> header;
+    PutZipHeader(header, entry, false);
+    file.write(&header[0], header.size());
+    file.write(pText, entry.size);
+    bytes += header.size() + entry.size;
+    entries.push_back(entry);
+    return !file.fail();
+}
+
+static void WriteModelText(std::ofstream& file, const char* pText, unsigned int& crc, unsigned long long& bytes)
+{
+    size_t length = strlen(pText);
+    file.write(pText, length);
+    crc = MeshExporter::Crc32(crc, pText, length);
+    bytes += length;
+}
+
+static const char* CONTENT_TYPES_XML =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">\n"
+    "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>\n"
+    "<Default Extension=\"model\" ContentType=\"application/vnd.ms-package.3dmanufacturing-3dmodel+xml\"/>\n"
+    "</Types>\n";
+
+static const char* RELATIONSHIPS_XML =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<Relationships xmlns=\"http://schemas.openxmlformats.org/package/2006/relationships\">\n"
+    "<Relationship Target=\"/3D/3dmodel.model\" Id=\"rel0\" Type=\"http://schemas.microsoft.com/3dmanufacturing/2013/01/3dmodel\"/>\n"
+    "</Relationships>\n";
+
+static const char* MODEL_HEADER_XML =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<model unit=\"millimeter\" xml:lang=\"en-US\" xmlns=\"http://schemas.microsoft.com/3dmanufacturing/core/2015/02\">\n"
+    "<resources>\n"
+    "<object id=\"1\" type=\"model\">\n"
+    "<mesh>\n"
+    "<vertices>\n";
+
+static const char* MODEL_MIDDLE_XML =
+    "</vertices>\n"
+    "<triangles>\n";
+
+static const char* MODEL_FOOTER_XML =
+    "</triangles>\n"
+    "</mesh>\n"
+    "</object>\n"
+    "</resources>\n"
+    "<build>\n"
+    "<item objectid=\"1\"/>\n"
+    "</build>\n"
+    "</model>\n";
+
+bool MeshExporter::Write3mf(const Mesh& mesh, const std::string& filename) const
+{
+    std::ofstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+    {
+        std::cout << "Could not open " << filename << " for writing!" << std::endl;
+        return false;
+    }
+
+    std::vector<ZipEntry> entries;
+    unsigned long long bytes = 0;
+    bool written = WriteZipEntry(file, entries, bytes, "[Content_Types].xml", CONTENT_TYPES_XML) &&
+        WriteZipEntry(file, entries, bytes, "_rels/.rels", RELATIONSHIPS_XML);
+
+    // The model is streamed, so its size and CRC follow it in a data descriptor.
+    ZipEntry model;
+    model.name = "3D/3dmodel.model";
+    model.crc = 0;
+    model.offset = bytes;
+    model.streamed = true;
+    std::vector<char> header;
+    PutZipHeader(header, model, false);
+    file.write(&header[0], header.size());
+    bytes += header.size();
+
+    unsigned long long modelStart = bytes;
+    WriteModelText(file, MODEL_HEADER_XML, model.crc, bytes);
+    written = written && StreamBatches(file, mesh.vertices.size(), [&mesh](size_t begin, size_t end, std::vector<char>& output)
+    {
+        output.resize((end - begin) * (3*MAX_FLOAT_CHARS + 32));
+        char *pOutput = &output[0];
+        float position[3];
+        for (size_t i = begin; i < end; i++)
+        {
+            Mesh::MachinePosition(mesh.vertices[i], position);
+            AppendText(pOutput, "<vertex x=\"");
+            AppendFloat(pOutput, position[0]);
+            AppendText(pOutput, "\" y=\"");
+            AppendFloat(pOutput, position[1]);
+            AppendText(pOutput, "\" z=\"");
+            AppendFloat(pOutput, position[2]);
+            AppendText(pOutput, "\"/>\n");
+        }
+
+        output.resize(pOutput - &output[0]);
+    }, &model.crc, bytes);
+
+    WriteModelText(file, MODEL_MIDDLE_XML, model.crc, bytes);
+    written = written && StreamBatches(file, mesh.TriangleCount(), [&mesh](size_t begin, size_t end, std::vector<char>& output)
+    {
+        output.resize((end - begin) * (3*MAX_UNSIGNED_CHARS + 40));
+        char *pOutput = &output[0];
+        for (size_t i = begin; i < end; i++)
+        {
+            const unsigned int *pCorners = &mesh.indices[i*3];
+            if (pCorners[0] == pCorners[1] || pCorners[1] == pCorners[2] || pCorners[2] == pCorners[0])
+            {
+                continue;
+            }
+
+            AppendText(pOutput, "<triangle v1=\"");
+            AppendUnsigned(pOutput, pCorners[0]);
+            AppendText(pOutput, "\" v2=\"");
+            AppendUnsigned(pOutput, pCorners[1]);
+            AppendText(pOutput, "\" v3=\"");
+            AppendUnsigned(pOutput, pCorners[2]);
+            AppendText(pOutput, "\"/>\n");
+        }
+
+        output.resize(pOutput - &output[0]);
+    }, &model.crc, bytes);
+
+    WriteModelText(file, MODEL_FOOTER_XML, model.crc, bytes);
+    model.size = bytes - modelStart;
+    entries.push_back(model);
+
+    // Without Zip64 records, sizes and offsets have to fit in 32 bits.
+    if (bytes >= 0xFFFFFFFFull)
+    {
+        std::cout << "The 3MF model of " << filename << " is over 4 GB; export it as STL instead." << std::endl;
+        return false;
+    }
+
+    std::vector<char> trailer;
+    PutInt(trailer, 0x08074B50);
+    PutInt(trailer, model.crc);
+    PutInt(trailer, (unsigned int)model.size);
+    PutInt(trailer, (unsigned int)model.size);
+    bytes += trailer.size();
+
+    size_t directoryStart = trailer.size();
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        PutZipHeader(trailer, entries[i], true);
+    }
+
+    // End of central directory.
+    unsigned int directorySize = (unsigned int)(trailer.size() - directoryStart);
+    PutInt(trailer, 0x06054B50);
+    PutShort(trailer, 0);
+    PutShort(trailer, 0);
+    PutShort(trailer, (unsigned int)entries.size());
+    PutShort(trailer, (unsigned int)entries.size());
+    PutInt(trailer, directorySize);
+    PutInt(trailer, (unsigned int)bytes);
+    PutShort(trailer, 0);
+    file.write(&trailer[0], trailer.size());
+
+    file.close();
+    if (!written || file.fail())
+    {
+        std::cout << "Could not write " << filename << "!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,60 @@
+/*--------------------------------------------------------------------------
+    MeshExport.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+// Writes parts for 3D printers and CNC toolchains as binary STL or 3MF, in machine coordinates (see Mesh::MachinePosition).
+// Triangles are formatted straight from the mesh in batches on the thread pool, while the calling thread writes the
+// previous batches, so only a window of formatted output is ever in memory and large parts are limited by the disk.
+class MeshExporter
+{
+    // A formatted run of triangles (or vertices), and its CRC-32 when the output goes into a zip archive.
+    struct Batch
+    {
+        std::vector<char> data;
+        unsigned int crc;
+    };
+
+    typedef std::function<void(size_t, size_t, std::vector<char>&)> BatchFormatter;
+
+    ThreadPool *pPool;
+
+    static const size_t BATCH_SIZE = 1 << 15; // Triangles or vertices formatted per pool task.
+
+    // Formats [0, count) in batches with format(begin, end, output) and writes the results to file in order.
+    // With pCrc set, also updates the CRC-32 of everything written.
+    bool StreamBatches(std::ofstream& file, size_t count, const BatchFormatter& format, unsigned int* pCrc, unsigned long long& bytes) const;
+
+public:
+    MeshExporter(ThreadPool* pPool);
+
+    // Binary STL, with facet normals from the winding.
+    bool WriteStl(const Mesh& mesh, const std::string& filename) const;
+
+    // A 3MF package holding the mesh as one object. Triangles with repeated corners are left out, as 3MF forbids them;
+    // run meshes through MeshRepair first so printers get a closed solid.
+    bool Write3mf(const Mesh& mesh, const std::string& filename) const;
+
+    // CRC-32 (as used by zip) of data appended to a run with the given crc, and of two runs joined together.
+    static unsigned int Crc32(unsigned int crc, const char* pData, size_t length);
+    static unsigned int Crc32Combine(unsigned int firstCrc, unsigned int secondCrc, unsigned long long secondLength);
+};
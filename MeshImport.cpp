@@ -0,0 +1,1188 @@
+/*--------------------------------------------------------------------------
+    MeshImport.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "MeshImport.h"
+#include "MappedFile.h"
+#include "MeshRepair.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+// Text scanning within a chunk. Newlines end lines and are never skipped as spaces.
+static bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* SkipSpaces(const char* p, const char* pEnd)
+{
+    while (p < pEnd && IsSpace(*p))
+    {
+        p++;
+    }
+
+    return p;
+}
+
+static const char* SkipToken(const char* p, const char* pEnd)
+{
+    while (p < pEnd && !IsSpace(*p) && *p != '\n')
+    {
+        p++;
+    }
+
+    return p;
+}
+
+static const char* NextLine(const char* p, const char* pEnd)
+{
+    const char *pNewline = (const char*)memchr(p, '\n', pEnd - p);
+    return pNewline ? pNewline + 1 : pEnd;
+}
+
+// Whether a line has nothing more on it, or only a comment.
+static bool AtLineEnd(const char* p, const char* pEnd)
+{
+    return p == pEnd || *p == '\n' || *p == '#';
+}
+
+// Decimal numbers with an optional sign, fraction and exponent, without the locale and stream overhead of the standard
+// library. Returns NULL, leaving value alone, if there is no number at p.
+static const double POWERS_OF_TEN[23] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const char* ParseFloat(const char* p, const char* pEnd, float& value)
+{
+    bool negative = false;
+    if (p < pEnd && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    // Up to 19 significant digits fit the mantissa; further integer digits only scale it.
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for (; p < pEnd && *p >= '0' && *p <= '9'; p++)
+    {
+        any = true;
+        if (digits < 19)
+        {
+            mantissa = mantissa*10 + (*p - '0');
+            digits += mantissa != 0 ? 1 : 0;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+
+    if (p < pEnd && *p == '.')
+    {
+        for (p++; p < pEnd && *p >= '0' && *p <= '9'; p++)
+        {
+            any = true;
+            if (digits < 19)
+            {
+                mantissa = mantissa*10 + (*p - '0');
+                digits += mantissa != 0 ? 1 : 0;
+                exponent--;
+            }
+        }
+    }
+
+    if (!any)
+    {
+        return NULL;
+    }
+
+    if (p < pEnd && (*p == 'e' || *p == 'E'))
+    {
+        const char *pExponent = p + 1;
+        bool negativeExponent = false;
+        if (pExponent < pEnd && (*pExponent == '-' || *pExponent == '+'))
+        {
+            negativeExponent = *pExponent == '-';
+            pExponent++;
+        }
+
+        if (pExponent < pEnd && *pExponent >= '0' && *pExponent <= '9')
+        {
+            int written = 0;
+            for (; pExponent < pEnd && *pExponent >= '0' && *pExponent <= '9'; pExponent++)
+            {
+                written = std::min(written*10 + (*pExponent - '0'), 10000);
+            }
+
+            exponent += negativeExponent ? -written : written;
+            p = pExponent;
+        }
+    }
+
+    // Exact powers of ten keep common values correctly rounded.
+    double result = (double)mantissa;
+    if (exponent >= 0)
+    {
+        result *= exponent <= 22 ? POWERS_OF_TEN[exponent] : pow(10.0, exponent);
+    }
+    else
+    {
+        result /= -exponent <= 22 ? POWERS_OF_TEN[-exponent] : pow(10.0, -exponent);
+    }
+
+    value = (float)(negative ? -result : result);
+    return p;
+}
+
+static const char* ParseInteger(const char* p, const char* pEnd, long long& value)
+{
+    bool negative = false;
+    if (p < pEnd && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    if (p == pEnd || *p < '0' || *p > '9')
+    {
+        return NULL;
+    }
+
+    long long result = 0;
+    for (; p < pEnd && *p >= '0' && *p <= '9'; p++)
+    {
+        result = result*10 + (*p - '0');
+    }
+
+    value = negative ? -result : result;
+    return p;
+}
+
+// Splits text into chunks of about chunkBytes that each end after a newline. Chunk c is [starts[c], starts[c + 1]).
+static void SplitLines(const char* pData, size_t size, size_t chunkBytes, std::vector<size_t>& starts)
+{
+    starts.clear();
+    starts.push_back(0);
+    for (size_t position = chunkBytes; position < size;)
+    {
+        const char *pNewline = (const char*)memchr(pData + position, '\n', size - position);
+        if (pNewline == NULL || (size_t)(pNewline - pData) + 1 >= size)
+        {
+            break;
+        }
+
+        starts.push_back((size_t)(pNewline - pData) + 1);
+        position = starts.back() + chunkBytes;
+    }
+
+    starts.push_back(size);
+}
+
+// Where each chunk's vertices and triangles go, from the per-chunk counts. Returns the totals in the last entry.
+struct ChunkCounts
+{
+    size_t vertices;
+    size_t triangles;
+    size_t lines;
+    bool failed;
+};
+
+static ChunkCounts ChunkOffsets(std::vector<ChunkCounts>& chunks)
+{
+    ChunkCounts total = { 0, 0, 0, false };
+    for (size_t c = 0; c < chunks.size(); c++)
+    {
+        ChunkCounts counts = chunks[c];
+        chunks[c].vertices = total.vertices;
+        chunks[c].triangles = total.triangles;
+        chunks[c].lines = total.lines;
+        total.vertices += counts.vertices;
+        total.triangles += counts.triangles;
+        total.lines += counts.lines;
+        total.failed = total.failed || counts.failed;
+    }
+
+    return total;
+}
+
+// Fans a polygon's corners into triangles as they are read.
+class TriangleFan
+{
+    unsigned int *pIndices;
+    unsigned int first, previous;
+    size_t corners;
+
+public:
+    TriangleFan(unsigned int* pIndices)
+        : pIndices(pIndices), first(0), previous(0), corners(0)
+    {
+    }
+
+    void Begin()
+    {
+        corners = 0;
+    }
+
+    void Add(unsigned int index)
+    {
+        if (corners >= 2)
+        {
+            *pIndices++ = first;
+            *pIndices++ = previous;
+            *pIndices++ = index;
+        }
+        else if (corners == 0)
+        {
+            first = index;
+        }
+
+        previous = index;
+        corners++;
+    }
+
+    static size_t Triangles(size_t corners)
+    {
+        return corners >= 3 ? corners - 2 : 0;
+    }
+};
+
+MeshImporter::MeshImporter(ThreadPool* pPool)
+    : pPool(pPool)
+{
+}
+
+bool MeshImporter::Load(const std::string& filename, Mesh& mesh) const
+{
+    mesh.Clear();
+    MappedFile file;
+    if (!file.Open(filename))
+    {
+        std::cout << "Could not open " << filename << "!" << std::endl;
+        return false;
+    }
+
+    std::string extension = filename.substr(filename.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if (extension != "obj" && extension != "stl" && extension != "ply")
+    {
+        std::cout << "Unknown mesh format: " << filename << std::endl;
+        return false;
+    }
+
+    // Sizes come from the file, so a damaged or hostile one may still ask for more memory than there is.
+    bool loaded;
+    const char *pData = (const char*)file.Data();
+    try
+    {
+        if (extension == "obj")
+        {
+            loaded = LoadObj(pData, file.Size(), mesh);
+        }
+        else if (extension == "stl")
+        {
+            loaded = LoadStl(pData, file.Size(), mesh);
+        }
+        else
+        {
+            loaded = LoadPly(pData, file.Size(), mesh);
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        std::cout << "Out of memory reading " << filename << "!" << std::endl;
+        mesh.Clear();
+        return false;
+    }
+
+    // Every format can name vertices that are not there.
+    std::atomic<bool> missing(false);
+    size_t vertexCount = mesh.vertices.size();
+    ThreadPool::RunChunks(pPool, mesh.indices.size(), TRIANGLE_CHUNK * 3, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            if (mesh.indices[i] >= vertexCount)
+            {
+                missing = true;
+                return;
+            }
+        }
+    });
+
+    if (!loaded || missing)
+    {
+        std::cout << "Could not read " << filename << " as a mesh!" << std::endl;
+        mesh.Clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshImporter::LoadObj(const char* pData, size_t size, Mesh& mesh) const
+{
+    std::vector<size_t> starts;
+    SplitLines(pData, size, CHUNK_BYTES, starts);
+    size_t chunkCount = starts.size() - 1;
+
+    // Counting pass: vertices ("v") and the triangles of faces ("f"). Other lines are skipped.
+    std::vector<ChunkCounts> chunks(chunkCount);
+    ThreadPool::RunChunks(pPool, chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; c++)
+        {
+            ChunkCounts counts = { 0, 0, 0, false };
+            const char *pEnd = pData + starts[c + 1];
+            for (const char *p = pData + starts[c]; p < pEnd; p = NextLine(p, pEnd))
+            {
+                p = SkipSpaces(p, pEnd);
+                if (p + 1 < pEnd && p[0] == 'v' && IsSpace(p[1]))
+                {
+                    counts.vertices++;
+                }
+                else if (p + 1 < pEnd && p[0] == 'f' && IsSpace(p[1]))
+                {
+                    size_t corners = 0;
+                    for (const char *q = SkipSpaces(p + 1, pEnd); !AtLineEnd(q, pEnd); q = SkipSpaces(SkipToken(q, pEnd), pEnd))
+                    {
+                        corners++;
+                    }
+
+                    counts.triangles += TriangleFan::Triangles(corners);
+                }
+            }
+
+            chunks[c] = counts;
+        }
+    });
+
+    ChunkCounts total = ChunkOffsets(chunks);
+    mesh.vertices.resize(total.vertices);
+    mesh.indices.resize(total.triangles * 3);
+
+    // Parsing pass, into each chunk's own range of the mesh.
+    ThreadPool::RunChunks(pPool, chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; c++)
+        {
+            colorVertex *pVertex = mesh.vertices.empty() ? NULL : &mesh.vertices[chunks[c].vertices];
+            TriangleFan fan(mesh.indices.empty() ? NULL : &mesh.indices[chunks[c].triangles * 3]);
+            long long vertexCount = (long long)chunks[c].vertices;
+            const char *pEnd = pData + starts[c + 1];
+            for (const char *p = pData + starts[c]; p < pEnd; p = NextLine(p, pEnd))
+            {
+                p = SkipSpaces(p, pEnd);
+                if (p + 1 < pEnd && p[0] == 'v' && IsSpace(p[1]))
+                {
+                    float values[6] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+                    const char *q = p + 1;
+                    for (int i = 0; i < 3 && q; i++)
+                    {
+                        q = ParseFloat(SkipSpaces(q, pEnd), pEnd, values[i]);
+                    }
+
+                    // Several scanners and MeshLab append vertex colors; a lone fourth value is a weight instead.
+                    float color[3];
+                    const char *pColor = q;
+                    for (int i = 0; i < 3 && pColor; i++)
+                    {
+                        pColor = ParseFloat(SkipSpaces(pColor, pEnd), pEnd, color[i]);
+                    }
+
+                    if (pColor)
+                    {
+                        values[3] = color[0];
+                        values[4] = color[1];
+                        values[5] = color[2];
+                    }
+
+                    chunks[c].failed = chunks[c].failed || q == NULL;
+                    (pVertex++)->Set(values[0], values[1], values[2], values[3], values[4], values[5]);
+                    vertexCount++;
+                }
+                else if (p + 1 < pEnd && p[0] == 'f' && IsSpace(p[1]))
+                {
+                    // Corners are "v", "v/vt", "v//vn" or "v/vt/vn"; negative indices count back from the latest vertex.
+                    fan.Begin();
+                    for (const char *q = SkipSpaces(p + 1, pEnd); !AtLineEnd(q, pEnd); q = SkipSpaces(SkipToken(q, pEnd), pEnd))
+                    {
+                        long long index = 0;
+                        if (ParseInteger(q, pEnd, index) == NULL || index == 0)
+                        {
+                            chunks[c].failed = true;
+                        }
+
+                        index = index > 0 ? index - 1 : vertexCount + index;
+                        chunks[c].failed = chunks[c].failed || index < 0 || index > 0xFFFFFFFFll;
+                        fan.Add((unsigned int)index);
+                    }
+                }
+            }
+        }
+    });
+
+    for (size_t c = 0; c < chunkCount; c++)
+    {
+        if (chunks[c].failed)
+        {
+            return false;
+        }
+    }
+
+    return !mesh.indices.empty();
+}
+
+// Binary STL: an 80 byte header, a triangle count and 50 byte records of a normal, three corners and an attribute word.
+static const size_t STL_HEADER_BYTES = 84;
+static const size_t STL_RECORD_BYTES = 50;
+
+bool MeshImporter::LoadStl(const char* pData, size_t size, Mesh& mesh) const
+{
+    // ASCII files start with "solid", but so do some binary ones; the size settles it.
+    unsigned int binaryCount = 0;
+    if (size >= STL_HEADER_BYTES)
+    {
+        memcpy(&binaryCount, pData + 80, 4);
+    }
+
+    if (size >= STL_HEADER_BYTES && STL_HEADER_BYTES + (unsigned long long)binaryCount * STL_RECORD_BYTES == size)
+    {
+        mesh.vertices.resize((size_t)binaryCount * 3);
+        ThreadPool::RunChunks(pPool, binaryCount, TRIANGLE_CHUNK, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                float record[12];
+                memcpy(record, pData + STL_HEADER_BYTES + i * STL_RECORD_BYTES, sizeof(record));
+                for (int j = 0; j < 3; j++)
+                {
+                    colorVertex& vertex = mesh.vertices[i*3 + j];
+                    Mesh::PartPosition(record + 3 + j*3, vertex);
+                    vertex.r = vertex.g = vertex.b = 1.0f;
+                }
+            }
+        });
+    }
+    else
+    {
+        // ASCII: only the "vertex x y z" lines matter, three to a facet.
+        std::vector<size_t> starts;
+        SplitLines(pData, size, CHUNK_BYTES, starts);
+        size_t chunkCount = starts.size() - 1;
+        std::vector<ChunkCounts> chunks(chunkCount);
+        auto isVertexLine = [](const char* p, const char* pEnd) -> bool
+        {
+            return pEnd - p > 6 && memcmp(p, "vertex", 6) == 0 && IsSpace(p[6]);
+        };
+
+        ThreadPool::RunChunks(pPool, chunkCount, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t c = begin; c < end; c++)
+            {
+                ChunkCounts counts = { 0, 0, 0, false };
+                const char *pEnd = pData + starts[c + 1];
+                for (const char *p = pData + starts[c]; p < pEnd; p = NextLine(p, pEnd))
+                {
+                    counts.vertices += isVertexLine(SkipSpaces(p, pEnd), pEnd) ? 1 : 0;
+                }
+
+                chunks[c] = counts;
+            }
+        });
+
+        ChunkCounts total = ChunkOffsets(chunks);
+        if (total.vertices % 3 != 0)
+        {
+            return false;
+        }
+
+        mesh.vertices.resize(total.vertices);
+        ThreadPool::RunChunks(pPool, chunkCount, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t c = begin; c < end; c++)
+            {
+                colorVertex *pVertex = mesh.vertices.empty() ? NULL : &mesh.vertices[chunks[c].vertices];
+                const char *pEnd = pData + starts[c + 1];
+                for (const char *p = pData + starts[c]; p < pEnd; p = NextLine(p, pEnd))
+                {
+                    p = SkipSpaces(p, pEnd);
+                    if (!isVertexLine(p, pEnd))
+                    {
+                        continue;
+                    }
+
+                    float position[3] = { 0.0f, 0.0f, 0.0f };
+                    const char *q = p + 6;
+                    for (int i = 0; i < 3 && q; i++)
+                    {
+                        q = ParseFloat(SkipSpaces(q, pEnd), pEnd, position[i]);
+                    }
+
+                    chunks[c].failed = chunks[c].failed || q == NULL;
+                    Mesh::PartPosition(position, *pVertex);
+                    pVertex->r = pVertex->g = pVertex->b = 1.0f;
+                    pVertex++;
+                }
+            }
+        });
+
+        for (size_t c = 0; c < chunkCount; c++)
+        {
+            if (chunks[c].failed)
+            {
+                return false;
+            }
+        }
+    }
+
+    if (mesh.vertices.empty())
+    {
+        return false;
+    }
+
+    // Facets only share corners by value.
+    mesh.indices.resize(mesh.vertices.size());
+    ThreadPool::RunChunks(pPool, mesh.indices.size(), TRIANGLE_CHUNK * 3, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            mesh.indices[i] = (unsigned int)i;
+        }
+    });
+
+    MeshRepair repair(pPool);
+    repair.Weld(mesh);
+    return true;
+}
+
+// PLY headers declare elements, each a count of records with scalar or list properties, as text or in either byte order.
+enum PlyType
+{
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64,
+    PLY_UNKNOWN
+};
+
+static const size_t PLY_TYPE_BYTES[PLY_UNKNOWN] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+static PlyType ParsePlyType(const std::string& name)
+{
+    static const char *NAMES[PLY_UNKNOWN][2] =
+    {
+        { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+        { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" }
+    };
+
+    for (int type = 0; type < PLY_UNKNOWN; type++)
+    {
+        if (name == NAMES[type][0] || name == NAMES[type][1])
+        {
+            return (PlyType)type;
+        }
+    }
+
+    return PLY_UNKNOWN;
+}
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;
+    PlyType countType; // Lists only.
+    bool isList;
+};
+
+struct PlyElement
+{
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> properties;
+
+    // Bytes per binary record, or 0 if lists make it vary.
+    size_t FixedBytes() const
+    {
+        size_t bytes = 0;
+        for (size_t i = 0; i < properties.size(); i++)
+        {
+            if (properties[i].isList)
+            {
+                return 0;
+            }
+
+            bytes += PLY_TYPE_BYTES[properties[i].type];
+        }
+
+        return bytes;
+    }
+
+    // Fewest bytes a binary record can take, with every list empty.
+    size_t MinimumBytes() const
+    {
+        size_t bytes = 0;
+        for (size_t i = 0; i < properties.size(); i++)
+        {
+            bytes += PLY_TYPE_BYTES[properties[i].isList ? properties[i].countType : properties[i].type];
+        }
+
+        return bytes;
+    }
+
+    int Find(const char* pName) const
+    {
+        for (size_t i = 0; i < properties.size(); i++)
+        {
+            if (properties[i].name == pName)
+            {
+                return (int)i;
+            }
+        }
+
+        return -1;
+    }
+};
+
+static double ReadPlyScalar(const char* p, PlyType type, bool swap)
+{
+    unsigned char bytes[8];
+    size_t size = PLY_TYPE_BYTES[type];
+    memcpy(bytes, p, size);
+    if (swap)
+    {
+        std::reverse(bytes, bytes + size);
+    }
+
+    switch (type)
+    {
+    case PLY_INT8: { signed char value; memcpy(&value, bytes, 1); return value; }
+    case PLY_UINT8: return bytes[0];
+    case PLY_INT16: { short value; memcpy(&value, bytes, 2); return value; }
+    case PLY_UINT16: { unsigned short value; memcpy(&value, bytes, 2); return value; }
+    case PLY_INT32: { int value; memcpy(&value, bytes, 4); return value; }
+    case PLY_UINT32: { unsigned int value; memcpy(&value, bytes, 4); return value; }
+    case PLY_FLOAT32: { float value; memcpy(&value, bytes, 4); return value; }
+    case PLY_FLOAT64:
+    default: { double value; memcpy(&value, bytes, 8); return value; }
+    }
+}
+
+// Negative or fractional indices become out-of-range ones, which Load rejects.
+static unsigned int PlyIndex(double value)
+{
+    return value >= 0.0 && value < 4294967295.0 ? (unsigned int)value : 0xFFFFFFFFu;
+}
+
+// Which vertex properties hold the position and color, and how colors scale to [0, 1].
+struct PlyVertexLayout
+{
+    int properties[6]; // x, y, z, red, green, blue
+    float colorScale[3];
+
+    PlyVertexLayout(const PlyElement& element)
+    {
+        static const char *NAMES[6] = { "x", "y", "z", "red", "green", "blue" };
+        for (int i = 0; i < 6; i++)
+        {
+            properties[i] = element.Find(NAMES[i]);
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            int color = properties[i + 3];
+            bool integer = color >= 0 && element.properties[color].type < PLY_FLOAT32;
+            colorScale[i] = integer ? (float)(1.0 / (ldexp(1.0, 8 * (int)PLY_TYPE_BYTES[element.properties[color].type]) - 1.0)) : 1.0f;
+        }
+    }
+
+    bool Valid() const
+    {
+        return properties[0] >= 0 && properties[1] >= 0 && properties[2] >= 0;
+    }
+
+    // values holds every property of the record, in order.
+    void Set(const double* values, colorVertex& vertex) const
+    {
+        float position[3] = { (float)values[properties[0]], (float)values[properties[1]], (float)values[properties[2]] };
+        Mesh::PartPosition(position, vertex);
+        vertex.r = properties[3] >= 0 ? (float)values[properties[3]] * colorScale[0] : 1.0f;
+        vertex.g = properties[4] >= 0 ? (float)values[properties[4]] * colorScale[1] : 1.0f;
+        vertex.b = properties[5] >= 0 ? (float)values[properties[5]] * colorScale[2] : 1.0f;
+    }
+};
+
+// Reads the header up to and including "end_header". Returns the number of header bytes, or 0 if it is not valid.
+static size_t ParsePlyHeader(const char* pData, size_t size, bool& ascii, bool& swap, std::vector<PlyElement>& elements)
+{
+    const char *pEnd = pData + size;
+    if (size < 4 || memcmp(pData, "ply", 3) != 0)
+    {
+        return 0;
+    }
+
+    bool formatKnown = false;
+    for (const char *p = NextLine(pData, pEnd); p < pEnd; p = NextLine(p, pEnd))
+    {
+        std::vector<std::string> tokens;
+        for (const char *q = SkipSpaces(p, pEnd); q < pEnd && *q != '\n'; q = SkipSpaces(q, pEnd))
+        {
+            const char *pToken = q;
+            q = SkipToken(q, pEnd);
+            tokens.push_back(std::string(pToken, q));
+        }
+
+        if (tokens.empty() || tokens[0] == "comment" || tokens[0] == "obj_info")
+        {
+            continue;
+        }
+        else if (tokens[0] == "end_header")
+        {
+            return formatKnown ? (size_t)(NextLine(p, pEnd) - pData) : 0;
+        }
+        else if (tokens[0] == "format" && tokens.size() >= 2)
+        {
+            // Everything here is little-endian; only big-endian files need their bytes swapped.
+            formatKnown = tokens[1] == "ascii" || tokens[1] == "binary_little_endian" || tokens[1] == "binary_big_endian";
+            ascii = tokens[1] == "ascii";
+            swap = tokens[1] == "binary_big_endian";
+        }
+        else if (tokens[0] == "element" && tokens.size() >= 3)
+        {
+            PlyElement element;
+            element.name = tokens[1];
+            element.count = (size_t)strtoull(tokens[2].c_str(), NULL, 10);
+            elements.push_back(element);
+        }
+        else if (tokens[0] == "property" && !elements.empty())
+        {
+            PlyProperty property;
+            property.isList = tokens.size() >= 5 && tokens[1] == "list";
+            property.countType = property.isList ? ParsePlyType(tokens[2]) : PLY_UNKNOWN;
+            property.type = ParsePlyType(tokens[property.isList ? 3 : 1]);
+            property.name = tokens.back();
+            if (tokens.size() < 3 || property.type == PLY_UNKNOWN || (property.isList && property.countType == PLY_UNKNOWN))
+            {
+                return 0;
+            }
+
+            elements.back().properties.push_back(property);
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+// Whether the body can hold every record the header declares: in binary, each at least its smallest size, and in ASCII
+// each a line of at least one byte. Counts come straight from the file, so this runs before anything is sized by them.
+static bool PlyCountsFit(const std::vector<PlyElement>& elements, bool ascii, size_t bodyBytes)
+{
+    size_t remaining = bodyBytes;
+    for (size_t e = 0; e < elements.size(); e++)
+    {
+        size_t recordBytes = ascii ? 1 : elements[e].MinimumBytes();
+        if (recordBytes == 0)
+        {
+            continue;
+        }
+
+        if (elements[e].count > remaining / recordBytes)
+        {
+            return false;
+        }
+
+        remaining -= elements[e].count * recordBytes;
+    }
+
+    return true;
+}
+
+// Walks one binary record of a variable-sized element, appending the fan of the index list (if listIndex is one).
+// Returns NULL if the record runs past the end of the file.
+static const char* ReadBinaryPlyRecord(const char* p, const char* pEnd, const PlyElement& element, int listIndex, bool swap,
+    std::vector<unsigned int>& indices)
+{
+    for (size_t i = 0; i < element.properties.size(); i++)
+    {
+        const PlyProperty& property = element.properties[i];
+        size_t itemBytes = PLY_TYPE_BYTES[property.type];
+        if (!property.isList)
+        {
+            p += itemBytes;
+            if (p > pEnd)
+            {
+                return NULL;
+            }
+
+            continue;
+        }
+
+        size_t countBytes = PLY_TYPE_BYTES[property.countType];
+        if ((size_t)(pEnd - p) < countBytes)
+        {
+            return NULL;
+        }
+
+        double count = ReadPlyScalar(p, property.countType, swap);
+        p += countBytes;
+        if (count < 0.0 || count > (double)((pEnd - p) / itemBytes))
+        {
+            return NULL;
+        }
+
+        size_t corners = (size_t)count;
+        if ((int)i == listIndex)
+        {
+            for (size_t k = 2; k < corners; k++)
+            {
+                indices.push_back(PlyIndex(ReadPlyScalar(p, property.type, swap)));
+                indices.push_back(PlyIndex(ReadPlyScalar(p + (k - 1) * itemBytes, property.type, swap)));
+                indices.push_back(PlyIndex(ReadPlyScalar(p + k * itemBytes, property.type, swap)));
+            }
+        }
+
+        p += corners * itemBytes;
+    }
+
+    return p;
+}
+
+// Parses one ASCII record: scalars into pValues (if given), indexed by property, and the index list's corners into pFan
+// (if given). corners is the index list's length. Returns NULL if the line does not match the element.
+static const char* ParseAsciiPlyRecord(const char* p, const char* pEnd, const PlyElement& element, int listIndex,
+    double* pValues, TriangleFan* pFan, size_t& corners)
+{
+    corners = 0;
+    for (size_t i = 0; i < element.properties.size() && p; i++)
+    {
+        p = SkipSpaces(p, pEnd);
+        if (!element.properties[i].isList)
+        {
+            float value = 0.0f;
+            p = ParseFloat(p, pEnd, value);
+            if (pValues)
+            {
+                pValues[i] = value;
+            }
+
+            continue;
+        }
+
+        long long count = 0;
+        p = ParseInteger(p, pEnd, count);
+        if (p == NULL || count < 0)
+        {
+            return NULL;
+        }
+
+        bool indexList = (int)i == listIndex;
+        corners = indexList ? (size_t)count : corners;
+        if (indexList && pFan)
+        {
+            pFan->Begin();
+        }
+
+        for (long long k = 0; k < count && p; k++)
+        {
+            long long index = 0;
+            p = ParseInteger(SkipSpaces(p, pEnd), pEnd, index);
+            if (indexList && pFan)
+            {
+                pFan->Add(index >= 0 && index <= 0xFFFFFFFFll ? (unsigned int)index : 0xFFFFFFFFu);
+            }
+        }
+    }
+
+    return p;
+}
+
+bool MeshImporter::LoadPly(const char* pData, size_t size, Mesh& mesh) const
+{
+    bool ascii = false, swap = false;
+    std::vector<PlyElement> elements;
+    size_t headerBytes = ParsePlyHeader(pData, size, ascii, swap, elements);
+    if (headerBytes == 0 || !PlyCountsFit(elements, ascii, size - headerBytes))
+    {
+        return false;
+    }
+
+    int vertexElement = -1, faceElement = -1;
+    for (size_t e = 0; e < elements.size(); e++)
+    {
+        vertexElement = elements[e].name == "vertex" ? (int)e : vertexElement;
+        faceElement = elements[e].name == "face" ? (int)e : faceElement;
+    }
+
+    if (vertexElement < 0 || faceElement < 0 || !PlyVertexLayout(elements[vertexElement]).Valid())
+    {
+        return false;
+    }
+
+    const PlyElement& faces = elements[faceElement];
+    int listIndex = faces.Find("vertex_indices");
+    listIndex = listIndex >= 0 ? listIndex : faces.Find("vertex_index");
+    if (listIndex < 0 || !faces.properties[listIndex].isList)
+    {
+        return false;
+    }
+
+    PlyVertexLayout layout(elements[vertexElement]);
+    mesh.vertices.resize(elements[vertexElement].count);
+    const char *pBody = pData + headerBytes, *pEnd = pData + size;
+    if (!ascii)
+    {
+        const char *p = pBody;
+        for (size_t e = 0; e < elements.size(); e++)
+        {
+            const PlyElement& element = elements[e];
+            size_t recordBytes = element.FixedBytes();
+            if (recordBytes != 0 && element.count > (size_t)(pEnd - p) / recordBytes)
+            {
+                return false;
+            }
+
+            if ((int)e == vertexElement)
+            {
+                // Fixed-size records, so every vertex can be read at once.
+                if (recordBytes == 0)
+                {
+                    return false;
+                }
+
+                std::vector<size_t> offsets(element.properties.size());
+                for (size_t i = 1; i < offsets.size(); i++)
+                {
+                    offsets[i] = offsets[i - 1] + PLY_TYPE_BYTES[element.properties[i - 1].type];
+                }
+
+                ThreadPool::RunChunks(pPool, element.count, TRIANGLE_CHUNK, [&](size_t begin, size_t end)
+                {
+                    std::vector<double> values(element.properties.size());
+                    for (size_t v = begin; v < end; v++)
+                    {
+                        const char *pRecord = p + v * recordBytes;
+                        for (size_t i = 0; i < values.size(); i++)
+                        {
+                            values[i] = ReadPlyScalar(pRecord + offsets[i], element.properties[i].type, swap);
+                        }
+
+                        layout.Set(&values[0], mesh.vertices[v]);
+                    }
+                });
+
+                p += element.count * recordBytes;
+            }
+            else if ((int)e == faceElement)
+            {
+                // Almost every file is all triangles, with the index list the only list. Those records are fixed-size too.
+                const PlyProperty& list = element.properties[listIndex];
+                size_t itemBytes = PLY_TYPE_BYTES[list.type], countBytes = PLY_TYPE_BYTES[list.countType];
+                size_t listOffset = 0, triangleBytes = countBytes + 3 * itemBytes;
+                bool onlyList = true;
+                for (size_t i = 0; i < element.properties.size(); i++)
+                {
+                    onlyList = onlyList && ((int)i == listIndex || !element.properties[i].isList);
+                    listOffset += (int)i < listIndex ? PLY_TYPE_BYTES[element.properties[i].type] : 0;
+                    triangleBytes += (int)i != listIndex ? PLY_TYPE_BYTES[element.properties[i].type] : 0;
+                }
+
+                std::atomic<bool> triangles(onlyList && element.count <= (size_t)(pEnd - p) / triangleBytes);
+                if (triangles)
+                {
+                    ThreadPool::RunChunks(pPool, element.count, TRIANGLE_CHUNK, [&](size_t begin, size_t end)
+                    {
+                        for (size_t f = begin; f < end && triangles; f++)
+                        {
+                            if (ReadPlyScalar(p + f * triangleBytes + listOffset, list.countType, swap) != 3.0)
+                            {
+                                triangles = false;
+                            }
+                        }
+                    });
+                }
+
+                if (triangles)
+                {
+                    mesh.indices.resize(element.count * 3);
+                    ThreadPool::RunChunks(pPool, element.count, TRIANGLE_CHUNK, [&](size_t begin, size_t end)
+                    {
+                        for (size_t f = begin; f < end; f++)
+                        {
+                            const char *pList = p + f * triangleBytes + listOffset + countBytes;
+                            for (int k = 0; k < 3; k++)
+                            {
+                                mesh.indices[f*3 + k] = PlyIndex(ReadPlyScalar(pList + k * itemBytes, list.type, swap));
+                            }
+                        }
+                    });
+
+                    p += element.count * triangleBytes;
+                }
+                else
+                {
+                    // Mixed polygons: each record's size depends on the ones before it.
+                    for (size_t f = 0; f < element.count && p; f++)
+                    {
+                        p = ReadBinaryPlyRecord(p, pEnd, element, listIndex, swap, mesh.indices);
+                    }
+                }
+            }
+            else if (recordBytes != 0)
+            {
+                p += element.count * recordBytes;
+            }
+            else
+            {
+                std::vector<unsigned int> unused;
+                for (size_t r = 0; r < element.count && p; r++)
+                {
+                    p = ReadBinaryPlyRecord(p, pEnd, element, -1, swap, unused);
+                }
+            }
+
+            if (p == NULL)
+            {
+                return false;
+            }
+        }
+
+        return !mesh.indices.empty();
+    }
+
+    // ASCII records are one to a line, so each chunk's line count places its lines among the elements.
+    std::vector<size_t> starts;
+    SplitLines(pBody, size - headerBytes, CHUNK_BYTES, starts);
+    size_t chunkCount = starts.size() - 1;
+    std::vector<ChunkCounts> chunks(chunkCount);
+    ThreadPool::RunChunks(pPool, chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; c++)
+        {
+            ChunkCounts counts = { 0, 0, 0, false };
+            const char *pChunkEnd = pBody + starts[c + 1];
+            for (const char *p = pBody + starts[c]; p < pChunkEnd; p = NextLine(p, pChunkEnd))
+            {
+                counts.lines++;
+            }
+
+            chunks[c] = counts;
+        }
+    });
+
+    std::vector<size_t> firstLines(elements.size() + 1, 0);
+    for (size_t e = 0; e < elements.size(); e++)
+    {
+        firstLines[e + 1] = firstLines[e] + elements[e].count;
+    }
+
+    ChunkCounts total = ChunkOffsets(chunks);
+    if (total.lines < firstLines.back())
+    {
+        return false;
+    }
+
+    // Calls func(line, pLine, pLineEnd) for each vertex or face line of chunk c.
+    size_t vertexFirst = firstLines[vertexElement], vertexEnd = firstLines[vertexElement + 1];
+    size_t faceFirst = firstLines[faceElement], faceEnd = firstLines[faceElement + 1];
+    auto forEachLine = [&](size_t c, const std::function<void(size_t, const char*, const char*)>& func)
+    {
+        size_t line = chunks[c].lines;
+        const char *pChunkEnd = pBody + starts[c + 1];
+        for (const char *p = pBody + starts[c]; p < pChunkEnd; line++)
+        {
+            const char *pNext = NextLine(p, pChunkEnd);
+            if ((line >= vertexFirst && line < vertexEnd) || (line >= faceFirst && line < faceEnd))
+            {
+                func(line, p, pNext);
+            }
+
+            p = pNext;
+        }
+    };
+
+    ThreadPool::RunChunks(pPool, chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; c++)
+        {
+            size_t triangles = 0;
+            forEachLine(c, [&](size_t line, const char* p, const char* pLineEnd)
+            {
+                size_t corners = 0;
+                if (line >= faceFirst && line < faceEnd && ParseAsciiPlyRecord(p, pLineEnd, faces, listIndex, NULL, NULL, corners) == NULL)
+                {
+                    chunks[c].failed = true;
+                }
+
+                triangles += TriangleFan::Triangles(corners);
+            });
+
+            chunks[c].triangles = triangles;
+        }
+    });
+
+    total = ChunkOffsets(chunks);
+    if (total.failed)
+    {
+        return false;
+    }
+
+    mesh.indices.resize(total.triangles * 3);
+    ThreadPool::RunChunks(pPool, chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        std::vector<double> values(elements[vertexElement].properties.size());
+        for (size_t c = begin; c < end; c++)
+        {
+            TriangleFan fan(mesh.indices.empty() ? NULL : &mesh.indices[chunks[c].triangles * 3]);
+            forEachLine(c, [&](size_t line, const char* p, const char* pLineEnd)
+            {
+                size_t corners = 0;
+                bool vertex = line >= vertexFirst && line < vertexEnd;
+                if (vertex && ParseAsciiPlyRecord(p, pLineEnd, elements[vertexElement], -1, &values[0], NULL, corners))
+                {
+                    layout.Set(&values[0], mesh.vertices[line - vertexFirst]);
+                }
+                else if (vertex || ParseAsciiPlyRecord(p, pLineEnd, faces, listIndex, NULL, &fan, corners) == NULL)
+                {
+                    chunks[c].failed = true;
+                }
+            });
+        }
+    });
+
+    for (size_t c = 0; c < chunkCount; c++)
+    {
+        if (chunks[c].failed)
+        {
+            return false;
+        }
+    }
+
+    return !mesh.indices.empty();
+}
@@ -0,0 +1,46 @@
+/*--------------------------------------------------------------------------
+    MeshImport.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+// Loads parts from other tools as indexed meshes: Wavefront OBJ, binary or ASCII STL, and ASCII or binary PLY.
+// Files are memory-mapped and split into chunks that are parsed in parallel straight into the mesh arrays: a counting
+// pass sizes each chunk's share of the vertices and triangles, and a second pass fills them in at those offsets.
+// STL and PLY are read as Z-up machine coordinates in millimeters, as MeshExporter writes them, and OBJ as Y-up like the
+// editor. Polygons are fan-triangulated, and parts are white unless the file has vertex colors.
+class MeshImporter
+{
+    ThreadPool *pPool;
+
+    static const size_t CHUNK_BYTES = 1 << 22;
+    static const size_t TRIANGLE_CHUNK = 1 << 16;
+
+    bool LoadObj(const char* pData, size_t size, Mesh& mesh) const;
+    bool LoadStl(const char* pData, size_t size, Mesh& mesh) const;
+    bool LoadPly(const char* pData, size_t size, Mesh& mesh) const;
+
+public:
+    MeshImporter(ThreadPool* pPool);
+
+    // Picks the format from the file extension. STL triangles, which carry no indices, are welded (see MeshRepair).
+    bool Load(const std::string& filename, Mesh& mesh) const;
+};
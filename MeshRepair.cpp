@@ -0,0 +1,1547 @@
+/*--------------------------------------------------------------------------
+    MeshRepair.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "MeshRepair.h"
+#include "Predicates.h"
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+
+// Number of vertices or triangles handed to a worker at once.
+static const size_t REPAIR_CHUNK = 16384;
+
+MeshRepair::MeshRepair(ThreadPool* pPool)
+    : pPool(pPool), weldTolerance(0.0f)
+{
+}
+
+void MeshRepair::SetWeldTolerance(float tolerance)
+{
+    weldTolerance = std::max(tolerance, 0.0f);
+}
+
+static const float* Position(const Mesh& mesh, unsigned int vertex)
+{
+    return &mesh.vertices[vertex].x;
+}
+
+// Groups items into buckets: the items of bucket b end up in entries[start[b]] to entries[start[b + 1] - 1].
+// Counting and filling run in parallel with atomic counters, so items within a bucket come out in no particular
+// order; callers only use the buckets in ways that don't depend on it.
+template <typename BucketFunction>
+static void BuildBuckets(ThreadPool* pPool, size_t itemCount, size_t bucketCount, BucketFunction bucketOf,
+    std::vector<unsigned int>& start, std::vector<unsigned int>& entries)
+{
+    std::unique_ptr<std::atomic<unsigned int>[]> counters(new std::atomic<unsigned int>[bucketCount]);
+    ThreadPool::RunChunks(pPool, bucketCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t b = begin; b < end; b++)
+        {
+            counters[b].store(0, std::memory_order_relaxed);
+        }
+    });
+
+    ThreadPool::RunChunks(pPool, itemCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            counters[bucketOf(i)].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    // The counters become fill cursors.
+    start.resize(bucketCount + 1);
+    unsigned int total = 0;
+    for (size_t b = 0; b < bucketCount; b++)
+    {
+        start[b] = total;
+        total += counters[b].load(std::memory_order_relaxed);
+        counters[b].store(start[b], std::memory_order_relaxed);
+    }
+
+    start[bucketCount] = total;
+    entries.resize(itemCount);
+    ThreadPool::RunChunks(pPool, itemCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            entries[counters[bucketOf(i)].fetch_add(1, std::memory_order_relaxed)] = (unsigned int)i;
+        }
+    });
+}
+
+static bool IsCollapsed(const unsigned int* pTriangle)
+{
+    return pTriangle[0] == pTriangle[1] || pTriangle[1] == pTriangle[2] || pTriangle[2] == pTriangle[0];
+}
+
+void MeshRepair::FindNeighbors(const Mesh& mesh, std::vector<int>& neighbors) const
+{
+    FindNeighbors(pPool, mesh.indices, mesh.vertices.size(), false, neighbors);
+}
+
+void MeshRepair::FindNeighbors(ThreadPool* pPool, const std::vector<unsigned int>& indices, size_t vertexCount, bool skipCollapsed,
+    std::vector<int>& neighbors)
+{
+    // Sides are grouped by edge: bucketed by the edge's lower vertex, then sorted by the other one, so the work per
+    // vertex grows with its valence times its logarithm rather than its square. Vertex order keeps the buckets close
+    // to the triangles that fill them.
+    size_t sideCount = indices.size();
+    auto lowerOf = [&](size_t side) -> unsigned int
+    {
+        return std::min(indices[side], indices[side - side % 3 + (side + 1) % 3]);
+    };
+
+    auto upperOf = [&](size_t side) -> unsigned int
+    {
+        return std::max(indices[side], indices[side - side % 3 + (side + 1) % 3]);
+    };
+
+    std::vector<unsigned int> start, sides;
+    BuildBuckets(pPool, sideCount, vertexCount, lowerOf, start, sides);
+
+    neighbors.resize(sideCount);
+    ThreadPool::RunChunks(pPool, vertexCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t vertex = begin; vertex < end; vertex++)
+        {
+            // Sides of the same triangle end up next to each other within an edge's run.
+            std::sort(sides.begin() + start[vertex], sides.begin() + start[vertex + 1], [&](unsigned int a, unsigned int b)
+            {
+                unsigned int upperA = upperOf(a), upperB = upperOf(b);
+                return upperA < upperB || (upperA == upperB && a < b);
+            });
+
+            for (unsigned int run = start[vertex]; run < start[vertex + 1];)
+            {
+                unsigned int runEnd = run + 1;
+                while (runEnd < start[vertex + 1] && upperOf(sides[runEnd]) == upperOf(sides[run]))
+                {
+                    runEnd++;
+                }
+
+                // An edge joining two triangles makes them neighbors; any more and it is non-manifold.
+                unsigned int first = 0, second = 0, triangles = 0;
+                for (unsigned int k = run; k < runEnd; k++)
+                {
+                    unsigned int t = sides[k] / 3;
+                    if ((skipCollapsed && IsCollapsed(&indices[t*3])) || (triangles > 0 && t == (triangles == 1 ? first : second)))
+                    {
+                        continue;
+                    }
+
+                    first = triangles == 0 ? t : first;
+                    second = triangles == 1 ? t : second;
+                    triangles++;
+                }
+
+                for (unsigned int k = run; k < runEnd; k++)
+                {
+                    unsigned int t = sides[k] / 3;
+                    int neighbor = triangles > 2 ? (int)NON_MANIFOLD : (triangles == 2 ? (int)(t == first ? second : first) : (int)NO_NEIGHBOR);
+                    neighbors[sides[k]] = (skipCollapsed && IsCollapsed(&indices[t*3])) ? (int)NO_NEIGHBOR : neighbor;
+                }
+
+                run = runEnd;
+            }
+        }
+    });
+}
+
+// Cells are grouped into blocks of 16^3. Blocks are hashed, while the cells within a block keep neighboring buckets
+// in Morton order, so vertices that are close in the mesh also count, fill and search buckets close in memory.
+static const int CELL_BLOCK_BITS = 4;
+static const int MIN_BUCKET_BITS = 3 * CELL_BLOCK_BITS + 1;
+static const unsigned int MORTON_SPREAD[16] = { 0, 1, 8, 9, 64, 65, 72, 73, 512, 513, 520, 521, 576, 577, 584, 585 };
+
+// Bucket of integer cell coordinates (each under 2^21), out of 2^bucketBits.
+static unsigned int CellBucket(const int cell[3], int bucketBits)
+{
+    unsigned long long block = (unsigned long long)(cell[0] >> CELL_BLOCK_BITS) | ((unsigned long long)(cell[1] >> CELL_BLOCK_BITS) << 21)
+        | ((unsigned long long)(cell[2] >> CELL_BLOCK_BITS) << 42);
+    unsigned int inBlock = MORTON_SPREAD[cell[0] & 15] | (MORTON_SPREAD[cell[1] & 15] << 1) | (MORTON_SPREAD[cell[2] & 15] << 2);
+    return (unsigned int)((block * 0x9E3779B97F4A7C15ull) >> (64 - bucketBits + 3 * CELL_BLOCK_BITS)) << (3 * CELL_BLOCK_BITS) | inBlock;
+}
+
+size_t MeshRepair::Weld(Mesh& mesh) const
+{
+    return Weld(mesh, NULL);
+}
+
+size_t MeshRepair::Weld(Mesh& mesh, std::vector<int>* pNeighbors) const
+{
+    if (pNeighbors)
+    {
+        pNeighbors->clear();
+    }
+
+    size_t vertexCount = mesh.vertices.size();
+    if (vertexCount == 0)
+    {
+        return 0;
+    }
+
+    // Bounds, reduced per chunk.
+    size_t chunkCount = (vertexCount + REPAIR_CHUNK - 1) / REPAIR_CHUNK;
+    std::vector<float> chunkBounds(chunkCount * 6);
+    ThreadPool::RunChunks(pPool, vertexCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        float *pBounds = &chunkBounds[(begin / REPAIR_CHUNK) * 6];
+        for (int i = 0; i < 3; i++)
+        {
+            pBounds[i] = pBounds[i + 3] = Position(mesh, (unsigned int)begin)[i];
+        }
+
+        for (size_t v = begin; v < end; v++)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                pBounds[i] = std::min(pBounds[i], Position(mesh, (unsigned int)v)[i]);
+                pBounds[i + 3] = std::max(pBounds[i + 3], Position(mesh, (unsigned int)v)[i]);
+            }
+        }
+    });
+
+    float min[3], max[3];
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = chunkBounds[i];
+        max[i] = chunkBounds[i + 3];
+        for (size_t c = 1; c < chunkCount; c++)
+        {
+            min[i] = std::min(min[i], chunkBounds[c*6 + i]);
+            max[i] = std::max(max[i], chunkBounds[c*6 + i + 3]);
+        }
+    }
+
+    float extent = std::max(max[0] - min[0], std::max(max[1] - min[1], max[2] - min[2]));
+    float diagonal = sqrtf((max[0] - min[0])*(max[0] - min[0]) + (max[1] - min[1])*(max[1] - min[1]) + (max[2] - min[2])*(max[2] - min[2]));
+    float tolerance = weldTolerance > 0.0f ? weldTolerance : 1e-6f * diagonal;
+
+    // Cells are sized to hold a few vertices each. A vertex only has to look into the neighboring cells
+    // across faces it is within the tolerance of, so most lookups stay within a single cell.
+    float cellSize = std::max(2.0f * tolerance, extent / sqrtf((float)vertexCount));
+    cellSize = std::max(cellSize, extent / (float)(1 << 20));
+    if (cellSize <= 0.0f)
+    {
+        cellSize = 1.0f;
+    }
+
+    // Cells are hashed into buckets; vertices from colliding cells are filtered out by the distance test anyway.
+    // Cell coordinates start at 1 so the neighbors of boundary cells still have valid coordinates.
+    int bucketBits = MIN_BUCKET_BITS;
+    while (((size_t)1 << bucketBits) < vertexCount)
+    {
+        bucketBits++;
+    }
+
+    float cellScale = 1.0f / cellSize;
+    std::vector<unsigned int> vertexBuckets(vertexCount);
+    ThreadPool::RunChunks(pPool, vertexCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t v = begin; v < end; v++)
+        {
+            int cell[3];
+            for (int i = 0; i < 3; i++)
+            {
+                cell[i] = 1 + (int)((Position(mesh, (unsigned int)v)[i] - min[i]) * cellScale);
+            }
+
+            vertexBuckets[v] = CellBucket(cell, bucketBits);
+        }
+    });
+
+    std::vector<unsigned int> bucketStart, bucketEntries;
+    BuildBuckets(pPool, vertexCount, (size_t)1 << bucketBits, [&](size_t v) { return vertexBuckets[v]; }, bucketStart, bucketEntries);
+
+    // Every vertex points at the lowest-numbered vertex within the tolerance, which is order-independent.
+    std::vector<unsigned int> representative(vertexCount);
+    float toleranceSquared = tolerance * tolerance;
+    ThreadPool::RunChunks(pPool, vertexCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t v = begin; v < end; v++)
+        {
+            const float *pPosition = Position(mesh, (unsigned int)v);
+            int cell[3], side[3];
+            for (int i = 0; i < 3; i++)
+            {
+                // A little slack covers rounding differences from the scaling that picked the cell.
+                cell[i] = 1 + (int)((pPosition[i] - min[i]) * cellScale);
+                float offset = (pPosition[i] - min[i]) - (float)(cell[i] - 1) * cellSize;
+                float reach = tolerance + cellSize * (1.0f / 4096.0f);
+                side[i] = offset <= reach ? -1 : (cellSize - offset <= reach ? 1 : 0);
+            }
+
+            unsigned int best = (unsigned int)v;
+            for (int corner = 0; corner < 8; corner++)
+            {
+                if (((corner & 1) && side[0] == 0) || ((corner & 2) && side[1] == 0) || ((corner & 4) && side[2] == 0))
+                {
+                    continue;
+                }
+
+                int neighbor[3];
+                for (int i = 0; i < 3; i++)
+                {
+                    neighbor[i] = cell[i] + (((corner >> i) & 1) ? side[i] : 0);
+                }
+
+                unsigned int bucket = corner == 0 ? vertexBuckets[v] : CellBucket(neighbor, bucketBits);
+                for (unsigned int k = bucketStart[bucket]; k < bucketStart[bucket + 1]; k++)
+                {
+                    unsigned int other = bucketEntries[k];
+                    if (other >= best)
+                    {
+                        continue;
+                    }
+
+                    const float *pOther = Position(mesh, other);
+                    float dx = pOther[0] - pPosition[0], dy = pOther[1] - pPosition[1], dz = pOther[2] - pPosition[2];
+                    if (dx*dx + dy*dy + dz*dz <= toleranceSquared)
+                    {
+                        best = other;
+                    }
+                }
+            }
+
+            representative[v] = best;
+        }
+    });
+
+    // Follow chains (a within tolerance of b within tolerance of c) down to a vertex that represents itself.
+    std::vector<unsigned int> roots(vertexCount);
+    ThreadPool::RunChunks(pPool, vertexCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t v = begin; v < end; v++)
+        {
+            unsigned int root = representative[v];
+            while (representative[root] != root)
+            {
+                root = representative[root];
+            }
+
+            roots[v] = root;
+        }
+    });
+
+    std::vector<unsigned char> merged(vertexCount, 0);
+    bool anyMerged = false;
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        if (roots[v] != v)
+        {
+            merged[roots[v]] = 1;
+            anyMerged = true;
+        }
+    }
+
+    // Coincident vertices can belong to separate sheets that only touch, as where boolean results meet along a
+    // face. Merging those would put more than two triangles on an edge, so such groups are left unwelded.
+    if (anyMerged)
+    {
+        std::vector<unsigned int> welded(mesh.indices.size());
+        ThreadPool::RunChunks(pPool, welded.size(), REPAIR_CHUNK, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                welded[i] = roots[mesh.indices[i]];
+            }
+        });
+
+        std::vector<int> neighbors;
+        FindNeighbors(pPool, welded, vertexCount, true, neighbors);
+        std::vector<unsigned char> rejected(vertexCount, 0);
+        bool anyRejected = false;
+        for (size_t side = 0; side < neighbors.size(); side++)
+        {
+            if (neighbors[side] == NON_MANIFOLD)
+            {
+                unsigned int u = welded[side], v = welded[side - side % 3 + (side + 1) % 3];
+                rejected[u] = merged[u];
+                rejected[v] = merged[v];
+                anyRejected = anyRejected || merged[u] || merged[v];
+            }
+        }
+
+        // Adjacency is by triangle, so it still holds after compaction as long as every weld went ahead.
+        if (pNeighbors && !anyRejected)
+        {
+            pNeighbors->swap(neighbors);
+        }
+
+        ThreadPool::RunChunks(pPool, vertexCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+        {
+            for (size_t v = begin; v < end; v++)
+            {
+                roots[v] = rejected[roots[v]] ? (unsigned int)v : roots[v];
+            }
+        });
+    }
+
+    // Compact the vertices that represent themselves, in their original order.
+    std::vector<size_t> chunkKept(chunkCount + 1, 0);
+    ThreadPool::RunChunks(pPool, vertexCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        size_t kept = 0;
+        for (size_t v = begin; v < end; v++)
+        {
+            kept += (roots[v] == v) ? 1 : 0;
+        }
+
+        chunkKept[begin / REPAIR_CHUNK + 1] = kept;
+    });
+
+    for (size_t c = 0; c < chunkCount; c++)
+    {
+        chunkKept[c + 1] += chunkKept[c];
+    }
+
+    size_t keptCount = chunkKept[chunkCount];
+    std::vector<colorVertex> keptVertices(keptCount);
+    std::vector<unsigned int> remap(vertexCount);
+    ThreadPool::RunChunks(pPool, vertexCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        size_t next = chunkKept[begin / REPAIR_CHUNK];
+        for (size_t v = begin; v < end; v++)
+        {
+            if (roots[v] == v)
+            {
+                keptVertices[next] = mesh.vertices[v];
+                remap[v] = (unsigned int)next++;
+            }
+        }
+    });
+
+    // Roots are numbered before the vertices merged into them, but may sit in another chunk.
+    ThreadPool::RunChunks(pPool, vertexCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t v = begin; v < end; v++)
+        {
+            if (roots[v] != v)
+            {
+                remap[v] = remap[roots[v]];
+            }
+        }
+    });
+
+    ThreadPool::RunChunks(pPool, mesh.indices.size(), REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            mesh.indices[i] = remap[mesh.indices[i]];
+        }
+    });
+
+    mesh.vertices.swap(keptVertices);
+    return vertexCount - keptCount;
+}
+
+enum TriangleStatus
+{
+    TRIANGLE_KEEP,
+    TRIANGLE_DROP,
+    TRIANGLE_SPLIT_NEIGHBOR
+};
+
+static unsigned long long EdgeKey(unsigned int from, unsigned int to)
+{
+    return ((unsigned long long)from << 32) | to;
+}
+
+// For a triangle with collinear corners, finds the corner lying between the other two.
+static int MiddleCorner(const Mesh& mesh, const unsigned int* pTriangle)
+{
+    const float *p[3] = { Position(mesh, pTriangle[0]), Position(mesh, pTriangle[1]), Position(mesh, pTriangle[2]) };
+    int axis = 0;
+    float bestExtent = -1.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        float extent = std::max(p[0][i], std::max(p[1][i], p[2][i])) - std::min(p[0][i], std::min(p[1][i], p[2][i]));
+        if (extent > bestExtent)
+        {
+            bestExtent = extent;
+            axis = i;
+        }
+    }
+
+    for (int c = 0; c < 3; c++)
+    {
+        float value = p[c][axis], a = p[(c + 1) % 3][axis], b = p[(c + 2) % 3][axis];
+        if ((value > a && value < b) || (value < a && value > b))
+        {
+            return c;
+        }
+    }
+
+    return 0;
+}
+
+size_t MeshRepair::RemoveDegenerates(Mesh& mesh) const
+{
+    size_t triangleCount = mesh.TriangleCount();
+    std::vector<unsigned char> status(triangleCount);
+    ThreadPool::RunChunks(pPool, triangleCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t t = begin; t < end; t++)
+        {
+            const unsigned int *pTriangle = &mesh.indices[t*3];
+            const float *a = Position(mesh, pTriangle[0]), *b = Position(mesh, pTriangle[1]), *c = Position(mesh, pTriangle[2]);
+            if (!Predicates::IsDegenerate(a, b, c))
+            {
+                status[t] = TRIANGLE_KEEP;
+                continue;
+            }
+
+            // Collapsed triangles can simply go. A sliver whose corners are distinct but collinear leaves a crack
+            // along its long edge, which is closed by splitting the triangle across that edge at the middle corner.
+            bool coincident = pTriangle[0] == pTriangle[1] || pTriangle[1] == pTriangle[2] || pTriangle[2] == pTriangle[0]
+                || std::equal(a, a + 3, b) || std::equal(b, b + 3, c) || std::equal(c, c + 3, a);
+            status[t] = coincident ? TRIANGLE_DROP : TRIANGLE_SPLIT_NEIGHBOR;
+        }
+    });
+
+    // Slivers are rare, so their neighbors are found with a targeted scan rather than full adjacency.
+    std::unordered_map<unsigned long long, size_t> wantedEdges;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (status[t] == TRIANGLE_SPLIT_NEIGHBOR)
+        {
+            const unsigned int *pTriangle = &mesh.indices[t*3];
+            int middle = MiddleCorner(mesh, pTriangle);
+            wantedEdges[EdgeKey(pTriangle[(middle + 2) % 3], pTriangle[(middle + 1) % 3])] = t;
+        }
+    }
+
+    std::unordered_map<unsigned long long, size_t> edgeOwners;
+    if (!wantedEdges.empty())
+    {
+        size_t chunkCount = (triangleCount + REPAIR_CHUNK - 1) / REPAIR_CHUNK;
+        std::vector<std::vector<std::pair<unsigned long long, size_t>>> chunkMatches(chunkCount);
+        ThreadPool::RunChunks(pPool, triangleCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+        {
+            std::vector<std::pair<unsigned long long, size_t>>& matches = chunkMatches[begin / REPAIR_CHUNK];
+            for (size_t t = begin; t < end; t++)
+            {
+                for (int e = 0; e < 3; e++)
+                {
+                    unsigned long long key = EdgeKey(mesh.indices[t*3 + e], mesh.indices[t*3 + (e + 1) % 3]);
+                    if (status[t] == TRIANGLE_KEEP && wantedEdges.find(key) != wantedEdges.end())
+                    {
+                        matches.push_back(std::make_pair(key, t));
+                    }
+                }
+            }
+        });
+
+        // Edges owned by more than one triangle are non-manifold and left alone.
+        for (size_t c = 0; c < chunkCount; c++)
+        {
+            for (size_t i = 0; i < chunkMatches[c].size(); i++)
+            {
+                std::pair<std::unordered_map<unsigned long long, size_t>::iterator, bool> inserted = edgeOwners.insert(chunkMatches[c][i]);
+                if (!inserted.second)
+                {
+                    inserted.first->second = triangleCount;
+                }
+            }
+        }
+    }
+
+    std::vector<unsigned int> added;
+    std::vector<bool> changed(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (status[t] != TRIANGLE_SPLIT_NEIGHBOR)
+        {
+            continue;
+        }
+
+        status[t] = TRIANGLE_DROP;
+        const unsigned int *pTriangle = &mesh.indices[t*3];
+        int middle = MiddleCorner(mesh, pTriangle);
+        unsigned int m = pTriangle[middle], p = pTriangle[(middle + 2) % 3], q = pTriangle[(middle + 1) % 3];
+        std::unordered_map<unsigned long long, size_t>::const_iterator owner = edgeOwners.find(EdgeKey(p, q));
+        if (owner == edgeOwners.end() || owner->second == triangleCount || changed[owner->second])
+        {
+            continue;
+        }
+
+        // The neighbor (p, q, d) becomes (p, m, d) and (m, q, d).
+        size_t neighbor = owner->second;
+        unsigned int *pNeighbor = &mesh.indices[neighbor*3];
+        int edgeStart = pNeighbor[0] == p ? 0 : (pNeighbor[1] == p ? 1 : 2);
+        unsigned int d = pNeighbor[(edgeStart + 2) % 3];
+        pNeighbor[0] = p;
+        pNeighbor[1] = m;
+        pNeighbor[2] = d;
+        added.push_back(m);
+        added.push_back(q);
+        added.push_back(d);
+        changed[neighbor] = true;
+    }
+
+    size_t kept = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (status[t] != TRIANGLE_DROP)
+        {
+            std::copy(mesh.indices.begin() + t*3, mesh.indices.begin() + t*3 + 3, mesh.indices.begin() + kept*3);
+            kept++;
+        }
+    }
+
+    mesh.indices.resize(kept * 3);
+    mesh.indices.insert(mesh.indices.end(), added.begin(), added.end());
+    return triangleCount - kept;
+}
+
+size_t MeshRepair::SplitNonManifold(Mesh& mesh) const
+{
+    std::vector<int> neighbors;
+    FindNeighbors(mesh, neighbors);
+    return SplitNonManifold(mesh, neighbors);
+}
+
+// Scores a pairing of triangles a and b, which follow each other counterclockwise around an edge running from
+// its lower to its upper vertex. Pairs must wind opposite ways along the edge; those enclosing a solid wedge
+// between them, rather than empty space, are preferred, so touching solids come apart instead of joining.
+static int PairScore(bool forwardA, bool forwardB)
+{
+    return forwardA == forwardB ? 0 : (forwardB ? 2 : 1);
+}
+
+// Replaces the non-manifold entries of neighbors with partners across the same edge where it can, returning how many
+// non-manifold sides there were.
+size_t MeshRepair::PairNonManifold(const Mesh& mesh, std::vector<int>& neighbors) const
+{
+    // Non-manifold sides, keyed by edge so each edge's sides end up next to each other once sorted.
+    typedef std::pair<unsigned long long, unsigned int> EdgeSide;
+    size_t sideCount = neighbors.size();
+    std::vector<std::vector<EdgeSide>> chunkSides((sideCount + REPAIR_CHUNK - 1) / REPAIR_CHUNK);
+    ThreadPool::RunChunks(pPool, sideCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        std::vector<EdgeSide>& sides = chunkSides[begin / REPAIR_CHUNK];
+        for (size_t side = begin; side < end; side++)
+        {
+            if (neighbors[side] == NON_MANIFOLD)
+            {
+                unsigned int u = mesh.indices[side], v = mesh.indices[side - side % 3 + (side + 1) % 3];
+                sides.push_back(std::make_pair(EdgeKey(std::min(u, v), std::max(u, v)), (unsigned int)side));
+            }
+        }
+    });
+
+    std::vector<EdgeSide> sides;
+    ConcatenateChunks(chunkSides, sides);
+    std::sort(sides.begin(), sides.end());
+    std::vector<unsigned int> edgeStarts;
+    for (size_t i = 0; i < sides.size(); i++)
+    {
+        if (i == 0 || sides[i].first != sides[i - 1].first)
+        {
+            edgeStarts.push_back((unsigned int)i);
+        }
+    }
+
+    edgeStarts.push_back((unsigned int)sides.size());
+
+    // The triangles around an edge are sorted by the angle of their third corner about it, and paired up with
+    // whichever of the two ways of taking neighbors in turn scores best. A triangle left over, or with no
+    // suitable partner, stays non-manifold.
+    ThreadPool::RunChunks(pPool, edgeStarts.size() - 1, 256, [&](size_t begin, size_t end)
+    {
+        struct AroundEdge
+        {
+            double angle;
+            bool forward; // Runs from the lower vertex to the upper one.
+            unsigned int side;
+
+            bool operator<(const AroundEdge& other) const
+            {
+                // Coincident triangles go forward one first, leaving the empty wedge between them.
+                return angle < other.angle || (angle == other.angle && (forward > other.forward || (forward == other.forward && side < other.side)));
+            }
+        };
+
+        std::vector<AroundEdge> around;
+        for (size_t edge = begin; edge < end; edge++)
+        {
+            unsigned int first = edgeStarts[edge], count = edgeStarts[edge + 1] - first;
+            unsigned int lower = (unsigned int)(sides[first].first >> 32), upper = (unsigned int)sides[first].first;
+            const float *pLower = Position(mesh, lower), *pUpper = Position(mesh, upper);
+            double axis[3] = { (double)pUpper[0] - pLower[0], (double)pUpper[1] - pLower[1], (double)pUpper[2] - pLower[2] };
+            double axisLength = sqrt(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]);
+
+            // Angles are measured from the first triangle, in a frame perpendicular to the edge.
+            double frame[2][3];
+            around.resize(count);
+            bool repeated = false;
+            for (unsigned int k = 0; k < count; k++)
+            {
+                unsigned int side = sides[first + k].second;
+                const float *pThird = Position(mesh, mesh.indices[side - side % 3 + (side + 2) % 3]);
+                double offset[3] = { (double)pThird[0] - pLower[0], (double)pThird[1] - pLower[1], (double)pThird[2] - pLower[2] };
+                double along = (offset[0]*axis[0] + offset[1]*axis[1] + offset[2]*axis[2]) / (axisLength * axisLength);
+                for (int i = 0; i < 3; i++)
+                {
+                    offset[i] -= along * axis[i];
+                }
+
+                if (k == 0)
+                {
+                    std::copy(offset, offset + 3, frame[0]);
+                    frame[1][0] = (axis[1]*offset[2] - axis[2]*offset[1]) / axisLength;
+                    frame[1][1] = (axis[2]*offset[0] - axis[0]*offset[2]) / axisLength;
+                    frame[1][2] = (axis[0]*offset[1] - axis[1]*offset[0]) / axisLength;
+                }
+
+                around[k].angle = atan2(offset[0]*frame[1][0] + offset[1]*frame[1][1] + offset[2]*frame[1][2],
+                    offset[0]*frame[0][0] + offset[1]*frame[0][1] + offset[2]*frame[0][2]);
+                around[k].forward = mesh.indices[side] == lower;
+                around[k].side = side;
+                repeated = repeated || (k > 0 && side / 3 == sides[first + k - 1].second / 3);
+            }
+
+            if (repeated || axisLength == 0.0)
+            {
+                continue;
+            }
+
+            std::sort(around.begin(), around.end());
+            unsigned int bestStart = 0;
+            int bestScore = -1;
+            // With an odd count, every start is tried, as it also picks the triangle left over.
+            for (unsigned int start = 0; start < (count % 2 == 0 ? 2 : count); start++)
+            {
+                int score = 0;
+                for (unsigned int k = 0; k + 1 < count; k += 2)
+                {
+                    score += PairScore(around[(start + k) % count].forward, around[(start + k + 1) % count].forward);
+                }
+
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestStart = start;
+                }
+            }
+
+            for (unsigned int k = 0; k + 1 < count; k += 2)
+            {
+                const AroundEdge& a = around[(bestStart + k) % count];
+                const AroundEdge& b = around[(bestStart + k + 1) % count];
+                if (PairScore(a.forward, b.forward) != 0)
+                {
+                    neighbors[a.side] = (int)(b.side / 3);
+                    neighbors[b.side] = (int)(a.side / 3);
+                }
+            }
+        }
+
+        });
+
+    return sides.size();
+}
+
+// Marks corners not yet assigned to a fan around their vertex.
+static const unsigned int NO_FAN = 0xFFFFFFFF;
+
+// Gives every fan of triangles around a vertex after the first its own copy of the vertex. Fans are joined across
+// sides with a neighbor, so non-manifold sides become boundaries.
+size_t MeshRepair::SplitFans(Mesh& mesh, const std::vector<int>& neighbors) const
+{
+    size_t vertexCount = mesh.vertices.size();
+    std::vector<unsigned int> start, corners;
+    BuildBuckets(pPool, mesh.indices.size(), vertexCount, [&](size_t i) { return mesh.indices[i]; }, start, corners);
+
+    // Copies are counted per vertex and per chunk, so the chunks can place theirs without a serial pass over
+    // every vertex.
+    size_t chunkCount = (vertexCount + REPAIR_CHUNK - 1) / REPAIR_CHUNK;
+    std::vector<unsigned int> fans(mesh.indices.size()), extraCopies(vertexCount);
+    std::vector<size_t> chunkCopies(chunkCount + 1, 0);
+    ThreadPool::RunChunks(pPool, vertexCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        std::vector<unsigned int> parents, stack;
+        size_t copies = 0;
+        for (size_t vertex = begin; vertex < end; vertex++)
+        {
+            // Corners are sorted so the corner of a neighboring triangle can be found by binary search.
+            unsigned int first = start[vertex], count = start[vertex + 1] - first;
+            std::sort(corners.begin() + first, corners.begin() + first + count);
+            parents.assign(count, NO_FAN);
+            unsigned int fanCount = 0;
+            for (unsigned int seed = 0; seed < count; seed++)
+            {
+                if (parents[seed] != NO_FAN)
+                {
+                    continue;
+                }
+
+                parents[seed] = fanCount;
+                stack.assign(1, seed);
+                while (!stack.empty())
+                {
+                    unsigned int corner = corners[first + stack.back()];
+                    stack.pop_back();
+
+                    // The two sides of a triangle that touch its corner at this vertex.
+                    int across[2] = { neighbors[corner], neighbors[corner - corner % 3 + (corner + 2) % 3] };
+                    for (int k = 0; k < 2; k++)
+                    {
+                        if (across[k] < 0)
+                        {
+                            continue;
+                        }
+
+                        std::vector<unsigned int>::const_iterator match =
+                            std::lower_bound(corners.begin() + first, corners.begin() + first + count, (unsigned int)across[k] * 3);
+                        for (; match != corners.begin() + first + count && *match / 3 == (unsigned int)across[k]; ++match)
+                        {
+                            unsigned int other = (unsigned int)(match - corners.begin()) - first;
+                            if (parents[other] == NO_FAN)
+                            {
+                                parents[other] = fanCount;
+                                stack.push_back(other);
+                            }
+                        }
+                    }
+                }
+
+                fanCount++;
+            }
+
+            for (unsigned int k = 0; k < count; k++)
+            {
+                fans[corners[first + k]] = parents[k];
+            }
+
+            extraCopies[vertex] = fanCount > 1 ? fanCount - 1 : 0;
+            copies += extraCopies[vertex];
+        }
+
+        chunkCopies[begin / REPAIR_CHUNK + 1] = copies;
+    });
+
+    for (size_t chunk = 0; chunk < chunkCount; chunk++)
+    {
+        chunkCopies[chunk + 1] += chunkCopies[chunk];
+    }
+
+    size_t splitCount = chunkCopies[chunkCount];
+    if (splitCount == 0)
+    {
+        return 0;
+    }
+
+    // Copies are appended in vertex order, so the result does not depend on thread timing.
+    mesh.vertices.resize(vertexCount + splitCount);
+    ThreadPool::RunChunks(pPool, vertexCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        size_t copyBase = vertexCount + chunkCopies[begin / REPAIR_CHUNK];
+        for (size_t vertex = begin; vertex < end; vertex++)
+        {
+            for (size_t copy = copyBase; copy < copyBase + extraCopies[vertex]; copy++)
+            {
+                mesh.vertices[copy] = mesh.vertices[vertex];
+            }
+
+            for (unsigned int k = start[vertex]; k < start[vertex + 1]; k++)
+            {
+                unsigned int fan = fans[corners[k]];
+                if (fan != 0)
+                {
+                    mesh.indices[corners[k]] = (unsigned int)(copyBase + fan - 1);
+                }
+            }
+
+            copyBase += extraCopies[vertex];
+        }
+    });
+
+    return splitCount;
+}
+
+size_t MeshRepair::SplitNonManifold(Mesh& mesh, std::vector<int>& neighbors) const
+{
+    // Where surfaces meet along non-manifold edges, their triangles are first paired up across each edge. The
+    // triangles around a vertex then fall into fans joined by manifold edges and those pairs, and every fan after
+    // the first gets its own vertex. That leaves each pair with an edge of its own, so the touching surfaces come
+    // apart without opening any holes. Meshes without such edges are left alone.
+    if (PairNonManifold(mesh, neighbors) == 0)
+    {
+        return 0;
+    }
+
+    size_t splitCount = SplitFans(mesh, neighbors);
+    FindNeighbors(mesh, neighbors);
+
+    // Surfaces that cross each other right at an edge can leave a pair sharing both vertices with another. Those
+    // edges are slit open instead, leaving holes for FillHoles.
+    if (std::find(neighbors.begin(), neighbors.end(), (int)NON_MANIFOLD) != neighbors.end())
+    {
+        size_t slitCount = SplitFans(mesh, neighbors);
+        if (slitCount != 0)
+        {
+            splitCount += slitCount;
+            FindNeighbors(mesh, neighbors);
+        }
+    }
+
+    return splitCount;
+}
+
+size_t MeshRepair::FillHoles(Mesh& mesh) const
+{
+    std::vector<int> neighbors;
+    FindNeighbors(mesh, neighbors);
+    return FillHoles(mesh, neighbors);
+}
+
+size_t MeshRepair::FillHoles(Mesh& mesh, const std::vector<int>& neighbors) const
+{
+
+    // Boundary edges, listed against both of their vertices so loops can be walked regardless of winding.
+    std::vector<std::pair<unsigned int, unsigned int>> vertexEdges;
+    for (size_t i = 0; i < neighbors.size(); i++)
+    {
+        if (neighbors[i] == NO_NEIGHBOR)
+        {
+            unsigned int u = mesh.indices[i], v = mesh.indices[i - i % 3 + (i + 1) % 3];
+            vertexEdges.push_back(std::make_pair(u, (unsigned int)i));
+            vertexEdges.push_back(std::make_pair(v, (unsigned int)i));
+        }
+    }
+
+    if (vertexEdges.empty())
+    {
+        return 0;
+    }
+
+    std::sort(vertexEdges.begin(), vertexEdges.end());
+    std::vector<bool> used(neighbors.size(), false);
+    size_t holeCount = 0;
+    for (size_t s = 0; s < vertexEdges.size(); s++)
+    {
+        unsigned int startEdge = vertexEdges[s].second;
+        if (used[startEdge])
+        {
+            continue;
+        }
+
+        // Walk from edge to edge until returning to the start vertex.
+        std::vector<unsigned int> loopEdges, loopVertices;
+        unsigned int startVertex = mesh.indices[startEdge];
+        unsigned int edge = startEdge, vertex = startVertex;
+        bool closed = false;
+        while (true)
+        {
+            used[edge] = true;
+            loopEdges.push_back(edge);
+            loopVertices.push_back(vertex);
+            unsigned int u = mesh.indices[edge], v = mesh.indices[edge - edge % 3 + (edge + 1) % 3];
+            vertex = (vertex == u) ? v : u;
+            if (vertex == startVertex)
+            {
+                closed = true;
+                break;
+            }
+
+            std::vector<std::pair<unsigned int, unsigned int>>::const_iterator candidate =
+                std::lower_bound(vertexEdges.begin(), vertexEdges.end(), std::make_pair(vertex, 0u));
+            while (candidate != vertexEdges.end() && candidate->first == vertex && used[candidate->second])
+            {
+                ++candidate;
+            }
+
+            if (candidate == vertexEdges.end() || candidate->first != vertex)
+            {
+                break;
+            }
+
+            edge = candidate->second;
+        }
+
+        if (!closed || loopEdges.size() < 3)
+        {
+            continue;
+        }
+
+        // Triangles winding against the triangle on the other side of each boundary edge.
+        // Small holes get a single triangle, larger ones a fan around a new vertex at the loop's center.
+        unsigned int apex;
+        if (loopEdges.size() == 3)
+        {
+            apex = loopVertices[2];
+            if (Predicates::IsDegenerate(Position(mesh, loopVertices[0]), Position(mesh, loopVertices[1]), Position(mesh, loopVertices[2])))
+            {
+                continue;
+            }
+        }
+        else
+        {
+            colorVertex center;
+            center.Set(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+            for (size_t i = 0; i < loopVertices.size(); i++)
+            {
+                const colorVertex& corner = mesh.vertices[loopVertices[i]];
+                center.Set(center.x + corner.x, center.y + corner.y, center.z + corner.z, center.r + corner.r, center.g + corner.g, center.b + corner.b);
+            }
+
+            float scale = 1.0f / (float)loopVertices.size();
+            center.Set(center.x*scale, center.y*scale, center.z*scale, center.r*scale, center.g*scale, center.b*scale);
+            apex = (unsigned int)mesh.vertices.size();
+            mesh.vertices.push_back(center);
+        }
+
+        for (size_t i = 0; i < loopEdges.size(); i++)
+        {
+            unsigned int u = mesh.indices[loopEdges[i]], v = mesh.indices[loopEdges[i] - loopEdges[i] % 3 + (loopEdges[i] + 1) % 3];
+            if (u == apex || v == apex)
+            {
+                continue;
+            }
+
+            mesh.indices.push_back(v);
+            mesh.indices.push_back(u);
+            mesh.indices.push_back(apex);
+        }
+
+        holeCount++;
+    }
+
+    return holeCount;
+}
+
+// Nested shells are found by casting a fixed ray, skewed so it rarely grazes axis-aligned edges.
+static const double DIRECTION[3] = { 0.5377, 0.6983, 0.4726 };
+
+// Counts crossings of the ray from origin with a triangle. Double precision is plenty here,
+// as an occasional miscount only affects which way a nested shell faces.
+static bool RayCrosses(const float origin[3], const float* a, const float* b, const float* c)
+{
+    double e1[3], e2[3], s[3];
+    for (int i = 0; i < 3; i++)
+    {
+        e1[i] = (double)b[i] - a[i];
+        e2[i] = (double)c[i] - a[i];
+        s[i] = (double)origin[i] - a[i];
+    }
+
+    double p[3] = { DIRECTION[1]*e2[2] - DIRECTION[2]*e2[1], DIRECTION[2]*e2[0] - DIRECTION[0]*e2[2], DIRECTION[0]*e2[1] - DIRECTION[1]*e2[0] };
+    double det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+    if (det == 0.0)
+    {
+        return false;
+    }
+
+    double u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2]) / det;
+    if (u < 0.0 || u > 1.0)
+    {
+        return false;
+    }
+
+    double q[3] = { s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0] };
+    double v = (DIRECTION[0]*q[0] + DIRECTION[1]*q[1] + DIRECTION[2]*q[2]) / det;
+    double distance = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2]) / det;
+    return v >= 0.0 && u + v <= 1.0 && distance > 0.0;
+}
+
+// Union-find forest shared between threads, in which each triangle also knows whether its winding agrees with
+// its parent's. Links are packed as parent * 2 + parity, which limits meshes to 2^31 triangles. Roots are always
+// the smallest member, since sets are only ever linked under the smaller root.
+// Returns the root of x's set, packed with the parity of x relative to it.
+static unsigned int FindRoot(std::atomic<unsigned int>* pLinks, unsigned int x)
+{
+    unsigned int parity = 0;
+    while (true)
+    {
+        unsigned int link = pLinks[x].load();
+        unsigned int parent = link >> 1;
+        if (parent == x)
+        {
+            return x*2 + parity;
+        }
+
+        // Path halving; a failed exchange only means another thread already shortened the path. Either way the
+        // parity to the grandparent stays the same.
+        unsigned int parentLink = pLinks[parent].load();
+        unsigned int grandparent = parentLink >> 1;
+        unsigned int grandparentParity = (link ^ parentLink) & 1;
+        if (grandparent != parent)
+        {
+            pLinks[x].compare_exchange_weak(link, grandparent*2 + grandparentParity);
+        }
+
+        parity ^= grandparentParity;
+        x = grandparent;
+    }
+}
+
+// Joins the sets of a and b, with parity 1 if their windings disagree. Once in the same set, a pair that doesn't
+// fit the parities already there is ignored; only a non-orientable surface has such pairs.
+static void Unite(std::atomic<unsigned int>* pLinks, unsigned int a, unsigned int b, unsigned int parity)
+{
+    while (true)
+    {
+        unsigned int rootA = FindRoot(pLinks, a), rootB = FindRoot(pLinks, b);
+        unsigned int linkParity = (rootA ^ rootB ^ parity) & 1;
+        rootA >>= 1;
+        rootB >>= 1;
+        if (rootA == rootB)
+        {
+            return;
+        }
+        else if (rootA < rootB)
+        {
+            std::swap(rootA, rootB);
+        }
+
+        unsigned int expected = rootA*2;
+        if (pLinks[rootA].compare_exchange_strong(expected, rootB*2 + linkParity))
+        {
+            return;
+        }
+    }
+}
+
+// Signed volume, flips and extent of one component's triangles within a chunk.
+struct ComponentSums
+{
+    unsigned int component;
+    double volume;
+    size_t flips, size;
+    bool closed;
+    float bounds[6];
+};
+
+size_t MeshRepair::Orient(Mesh& mesh) const
+{
+    std::vector<int> neighbors;
+    FindNeighbors(mesh, neighbors);
+    return Orient(mesh, neighbors);
+}
+
+size_t MeshRepair::Orient(Mesh& mesh, const std::vector<int>& neighbors) const
+{
+    // Label connected components, recording for each triangle whether it has to flip to agree with its component's
+    // root: neighbors that traverse their shared edge in the same direction are joined with odd parity. Non-manifold
+    // edges are never crossed, as the triangles around them can't all agree with each other.
+    size_t triangleCount = mesh.TriangleCount();
+    std::unique_ptr<std::atomic<unsigned int>[]> links(new std::atomic<unsigned int>[triangleCount]);
+    ThreadPool::RunChunks(pPool, triangleCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t t = begin; t < end; t++)
+        {
+            links[t].store((unsigned int)t*2);
+        }
+    });
+
+    ThreadPool::RunChunks(pPool, triangleCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t t = begin; t < end; t++)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                int neighbor = neighbors[t*3 + e];
+                if (neighbor > (int)t)
+                {
+                    unsigned int u = mesh.indices[t*3 + e];
+                    const unsigned int *pNeighbor = &mesh.indices[neighbor*3];
+                    int at = pNeighbor[0] == u ? 0 : (pNeighbor[1] == u ? 1 : 2);
+                    bool sameDirection = pNeighbor[(at + 1) % 3] == mesh.indices[t*3 + (e + 1) % 3];
+                    Unite(links.get(), (unsigned int)t, (unsigned int)neighbor, sameDirection ? 1 : 0);
+                }
+            }
+        }
+    });
+
+    std::vector<unsigned int> roots(triangleCount);
+    std::vector<unsigned char> flip(triangleCount);
+    ThreadPool::RunChunks(pPool, triangleCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t t = begin; t < end; t++)
+        {
+            unsigned int root = FindRoot(links.get(), (unsigned int)t);
+            roots[t] = root >> 1;
+            flip[t] = (unsigned char)(root & 1);
+        }
+    });
+
+    links.reset();
+    std::vector<unsigned int> componentOf(triangleCount), componentRoots;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (roots[t] == t)
+        {
+            componentRoots.push_back((unsigned int)t);
+        }
+
+        componentOf[t] = (unsigned int)componentRoots.size() - 1;
+    }
+
+    // Roots already hold their numbers and are only read here.
+    ThreadPool::RunChunks(pPool, triangleCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t t = begin; t < end; t++)
+        {
+            if (roots[t] != t)
+            {
+                componentOf[t] = componentOf[roots[t]];
+            }
+        }
+    });
+
+    size_t componentCount = componentRoots.size();
+
+    // Each chunk sums the signed volume of the runs of triangles it holds from each component. Volumes are taken
+    // relative to a point on the shell, which keeps the sums well conditioned far from the origin. The chunks'
+    // sums are then added up in order, so the totals don't depend on thread timing.
+    size_t chunkCount = (triangleCount + REPAIR_CHUNK - 1) / REPAIR_CHUNK;
+    std::vector<std::vector<ComponentSums>> chunkSums(chunkCount);
+    ThreadPool::RunChunks(pPool, triangleCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        std::vector<ComponentSums>& sums = chunkSums[begin / REPAIR_CHUNK];
+        for (size_t t = begin; t < end; t++)
+        {
+            unsigned int c = componentOf[t];
+            const float *pOrigin = Position(mesh, mesh.indices[componentRoots[c]*3]);
+            if (sums.empty() || sums.back().component != c)
+            {
+                ComponentSums run;
+                run.component = c;
+                run.volume = 0.0;
+                run.flips = 0;
+                run.size = 0;
+                run.closed = true;
+                std::copy(pOrigin, pOrigin + 3, run.bounds);
+                std::copy(pOrigin, pOrigin + 3, run.bounds + 3);
+                sums.push_back(run);
+            }
+
+            ComponentSums& run = sums.back();
+            double corners[3][3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                const float *pPosition = Position(mesh, mesh.indices[t*3 + corner]);
+                for (int i = 0; i < 3; i++)
+                {
+                    corners[corner][i] = (double)pPosition[i] - pOrigin[i];
+                    run.bounds[i] = std::min(run.bounds[i], pPosition[i]);
+                    run.bounds[i + 3] = std::max(run.bounds[i + 3], pPosition[i]);
+                }
+
+                run.closed = run.closed && neighbors[t*3 + corner] >= 0;
+            }
+
+            double determinant = corners[0][0] * (corners[1][1]*corners[2][2] - corners[1][2]*corners[2][1])
+                - corners[0][1] * (corners[1][0]*corners[2][2] - corners[1][2]*corners[2][0])
+                + corners[0][2] * (corners[1][0]*corners[2][1] - corners[1][1]*corners[2][0]);
+            run.volume += flip[t] ? -determinant : determinant;
+            run.flips += flip[t];
+            run.size++;
+        }
+    });
+
+    std::vector<unsigned char> closed(componentCount, 1);
+    std::vector<size_t> flipCounts(componentCount, 0), sizes(componentCount, 0);
+    std::vector<double> volumes(componentCount, 0.0);
+    std::vector<float> bounds(componentCount * 6);
+    for (size_t c = 0; c < componentCount; c++)
+    {
+        const float *pOrigin = Position(mesh, mesh.indices[componentRoots[c]*3]);
+        std::copy(pOrigin, pOrigin + 3, &bounds[c*6]);
+        std::copy(pOrigin, pOrigin + 3, &bounds[c*6 + 3]);
+    }
+
+    for (size_t chunk = 0; chunk < chunkCount; chunk++)
+    {
+        for (size_t k = 0; k < chunkSums[chunk].size(); k++)
+        {
+            const ComponentSums& run = chunkSums[chunk][k];
+            float *pBounds = &bounds[run.component*6];
+            for (int i = 0; i < 3; i++)
+            {
+                pBounds[i] = std::min(pBounds[i], run.bounds[i]);
+                pBounds[i + 3] = std::max(pBounds[i + 3], run.bounds[i + 3]);
+            }
+
+            volumes[run.component] += run.volume;
+            flipCounts[run.component] += run.flips;
+            sizes[run.component] += run.size;
+            closed[run.component] = closed[run.component] && run.closed;
+        }
+    }
+
+    // Only closed shells have an inside. Open or non-manifold fragments have no volume to go by, so they keep the
+    // winding most of their triangles already had.
+    std::vector<unsigned char> flipComponent(componentCount);
+    std::vector<unsigned int> shells;
+    for (size_t c = 0; c < componentCount; c++)
+    {
+        if (closed[c])
+        {
+            shells.push_back((unsigned int)c);
+        }
+
+        flipComponent[c] = closed[c] ? (volumes[c] < 0.0 ? 1 : 0) : (2*flipCounts[c] > sizes[c] ? 1 : 0);
+    }
+
+    // Shells nested an odd number of times inside other shells bound a cavity, so they should face inward. The ray
+    // from a shell can only cross triangles whose projection along it covers the ray's origin, so triangles are
+    // binned by their projected bounds in a grid across the ray and each ray only tests its own cell.
+    if (shells.size() > 1)
+    {
+        const double AXIS_U[3] = { DIRECTION[1], -DIRECTION[0], 0.0 };
+        const double AXIS_V[3] = { DIRECTION[0]*DIRECTION[2], DIRECTION[1]*DIRECTION[2], -DIRECTION[0]*DIRECTION[0] - DIRECTION[1]*DIRECTION[1] };
+        auto project = [&](const float* pPosition, const double* pAxis) -> float
+        {
+            return (float)(pPosition[0]*pAxis[0] + pPosition[1]*pAxis[1] + pPosition[2]*pAxis[2]);
+        };
+
+        std::vector<unsigned int> shellTriangles;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            if (closed[componentOf[t]])
+            {
+                shellTriangles.push_back((unsigned int)t);
+            }
+        }
+
+        size_t shellTriangleCount = shellTriangles.size();
+        std::vector<float> projected(shellTriangleCount * 4);
+        ThreadPool::RunChunks(pPool, shellTriangleCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                float *pBounds = &projected[i*4];
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    const float *pPosition = Position(mesh, mesh.indices[shellTriangles[i]*3 + corner]);
+                    float u = project(pPosition, AXIS_U), v = project(pPosition, AXIS_V);
+                    pBounds[0] = corner == 0 ? u : std::min(pBounds[0], u);
+                    pBounds[1] = corner == 0 ? v : std::min(pBounds[1], v);
+                    pBounds[2] = corner == 0 ? u : std::max(pBounds[2], u);
+                    pBounds[3] = corner == 0 ? v : std::max(pBounds[3], v);
+                }
+            }
+        });
+
+        float gridMin[2] = { projected[0], projected[1] }, gridMax[2] = { projected[2], projected[3] };
+        for (size_t i = 1; i < shellTriangleCount; i++)
+        {
+            gridMin[0] = std::min(gridMin[0], projected[i*4]);
+            gridMin[1] = std::min(gridMin[1], projected[i*4 + 1]);
+            gridMax[0] = std::max(gridMax[0], projected[i*4 + 2]);
+            gridMax[1] = std::max(gridMax[1], projected[i*4 + 3]);
+        }
+
+        int gridSize = std::max(1, std::min(4096, (int)sqrtf((float)shellTriangleCount)));
+        float cellScale[2];
+        for (int i = 0; i < 2; i++)
+        {
+            cellScale[i] = gridMax[i] > gridMin[i] ? (float)gridSize / (gridMax[i] - gridMin[i]) : 0.0f;
+        }
+
+        auto cellOf = [&](float value, int axis) -> int
+        {
+            return std::max(0, std::min(gridSize - 1, (int)((value - gridMin[axis]) * cellScale[axis])));
+        };
+
+        // Counted, then filled, like BuildBuckets but with a triangle in every cell its bounds touch.
+        size_t cellCount = (size_t)gridSize * gridSize;
+        std::vector<unsigned int> cellStart(cellCount + 1, 0), cursors(cellCount, 0), cellTriangles;
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (size_t i = 0; i < shellTriangleCount; i++)
+            {
+                const float *pBounds = &projected[i*4];
+                for (int y = cellOf(pBounds[1], 1); y <= cellOf(pBounds[3], 1); y++)
+                {
+                    for (int x = cellOf(pBounds[0], 0); x <= cellOf(pBounds[2], 0); x++)
+                    {
+                        unsigned int& cursor = cursors[(size_t)y*gridSize + x];
+                        if (pass == 1)
+                        {
+                            cellTriangles[cursor] = shellTriangles[i];
+                        }
+
+                        cursor++;
+                    }
+                }
+            }
+
+            for (size_t cell = 0; pass == 0 && cell < cellCount; cell++)
+            {
+                cellStart[cell + 1] = cellStart[cell] + cursors[cell];
+                cursors[cell] = cellStart[cell];
+            }
+
+            cellTriangles.resize(cellStart[cellCount]);
+        }
+
+        ThreadPool::RunChunks(pPool, shells.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t s = begin; s < end; s++)
+            {
+                unsigned int c = shells[s];
+                const float *pCorner = Position(mesh, mesh.indices[componentRoots[c]*3]);
+                float u = project(pCorner, AXIS_U), v = project(pCorner, AXIS_V);
+                if (u < gridMin[0] || u > gridMax[0] || v < gridMin[1] || v > gridMax[1])
+                {
+                    continue;
+                }
+
+                size_t cell = (size_t)cellOf(v, 1)*gridSize + cellOf(u, 0);
+                int crossings = 0;
+                for (unsigned int k = cellStart[cell]; k < cellStart[cell + 1]; k++)
+                {
+                    unsigned int t = cellTriangles[k];
+                    const float *pBounds = &bounds[componentOf[t]*6];
+                    if (componentOf[t] == c || pCorner[0] < pBounds[0] || pCorner[1] < pBounds[1] || pCorner[2] < pBounds[2]
+                        || pCorner[0] > pBounds[3] || pCorner[1] > pBounds[4] || pCorner[2] > pBounds[5])
+                    {
+                        continue;
+                    }
+
+                    const unsigned int *pTriangle = &mesh.indices[t*3];
+                    if (RayCrosses(pCorner, Position(mesh, pTriangle[0]), Position(mesh, pTriangle[1]), Position(mesh, pTriangle[2])))
+                    {
+                        crossings++;
+                    }
+                }
+
+                bool inward = (crossings % 2) == 1;
+                flipComponent[c] = (volumes[c] < 0.0) != inward ? 1 : 0;
+            }
+        });
+    }
+
+    std::vector<size_t> chunkFlips(chunkCount, 0);
+    ThreadPool::RunChunks(pPool, triangleCount, REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        size_t flipped = 0;
+        for (size_t t = begin; t < end; t++)
+        {
+            if (flip[t] != flipComponent[componentOf[t]])
+            {
+                std::swap(mesh.indices[t*3 + 1], mesh.indices[t*3 + 2]);
+                flipped++;
+            }
+        }
+
+        chunkFlips[begin / REPAIR_CHUNK] = flipped;
+    });
+
+    size_t flippedCount = 0;
+    for (size_t c = 0; c < chunkCount; c++)
+    {
+        flippedCount += chunkFlips[c];
+    }
+
+    return flippedCount;
+}
+
+void MeshRepair::Repair(Mesh& mesh, Report& report) const
+{
+    // Welding finds the adjacency of its result, which stays valid unless triangles are then removed.
+    std::vector<int> neighbors;
+    report.weldedVertices = Weld(mesh, &neighbors);
+    report.removedTriangles = RemoveDegenerates(mesh);
+    if (neighbors.empty() || report.removedTriangles != 0)
+    {
+        FindNeighbors(mesh, neighbors);
+    }
+
+    // Holes are filled before orienting so the patches get their winding from the same pass as everything else.
+    // Splitting leaves the adjacency of its result, so it only has to be rebuilt where patches were added.
+    report.splitVertices = SplitNonManifold(mesh, neighbors);
+    report.filledHoles = FillHoles(mesh, neighbors);
+    if (report.filledHoles != 0)
+    {
+        FindNeighbors(mesh, neighbors);
+    }
+
+    report.flippedTriangles = Orient(mesh, neighbors);
+}
+
+bool MeshRepair::Validity::IsManifold() const
+{
+    return nonManifoldSides == 0 && misorientedSides == 0;
+}
+
+bool MeshRepair::Validity::IsWatertight() const
+{
+    return IsManifold() && boundarySides == 0;
+}
+
+void MeshRepair::Validate(const Mesh& mesh, Validity& validity) const
+{
+    std::vector<int> neighbors;
+    FindNeighbors(mesh, neighbors);
+
+    std::atomic<size_t> boundary(0), nonManifold(0), misoriented(0), degenerate(0);
+    const std::vector<unsigned int>& indices = mesh.indices;
+    ThreadPool::RunChunks(pPool, mesh.TriangleCount(), REPAIR_CHUNK, [&](size_t begin, size_t end)
+    {
+        size_t chunkBoundary = 0, chunkNonManifold = 0, chunkMisoriented = 0, chunkDegenerate = 0;
+        for (size_t t = begin; t < end; t++)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                int neighbor = neighbors[t*3 + e];
+                if (neighbor == NO_NEIGHBOR)
+                {
+                    chunkBoundary++;
+                }
+                else if (neighbor == NON_MANIFOLD)
+                {
+                    chunkNonManifold++;
+                }
+                else
+                {
+                    // Consistent winding traverses the shared edge u -> v here and v -> u in the neighbor.
+                    unsigned int u = indices[t*3 + e], v = indices[t*3 + (e + 1) % 3];
+                    const unsigned int *pOther = &indices[neighbor*3];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        if (pOther[k] == u && pOther[(k + 1) % 3] == v)
+                        {
+                            chunkMisoriented++;
+                        }
+                    }
+                }
+            }
+
+            if (Predicates::IsDegenerate(Position(mesh, indices[t*3]), Position(mesh, indices[t*3 + 1]), Position(mesh, indices[t*3 + 2])))
+            {
+                chunkDegenerate++;
+            }
+        }
+
+        boundary += chunkBoundary;
+        nonManifold += chunkNonManifold;
+        misoriented += chunkMisoriented;
+        degenerate += chunkDegenerate;
+    });
+
+    validity.boundarySides = boundary;
+    validity.nonManifoldSides = nonManifold;
+    validity.misorientedSides = misoriented;
+    validity.degenerateTriangles = degenerate;
+}
@@ -0,0 +1,91 @@
+/*--------------------------------------------------------------------------
+    MeshRepair.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+// Cleans up imported or boolean-generated meshes so they render with back-face culling and behave as closed solids:
+// welds duplicate vertices, removes zero-area triangles, separates surfaces that only touch, closes holes and gives
+// every shell outward-facing winding.
+class MeshRepair
+{
+public:
+    struct Report
+    {
+        size_t weldedVertices;
+        size_t removedTriangles;
+        size_t splitVertices;
+        size_t filledHoles;
+        size_t flippedTriangles;
+    };
+
+    // Defects of a mesh as a closed solid. Edge counts are per triangle side.
+    struct Validity
+    {
+        size_t boundarySides;       // Sides with no triangle across them (holes).
+        size_t nonManifoldSides;    // Sides on edges shared by more than two triangles.
+        size_t misorientedSides;    // Sides whose neighbor runs along the edge in the same direction.
+        size_t degenerateTriangles;
+
+        // Every edge joins at most two consistently wound triangles.
+        bool IsManifold() const;
+
+        // Manifold with no holes, so it bounds a volume.
+        bool IsWatertight() const;
+    };
+
+private:
+    ThreadPool *pPool;
+    float weldTolerance;
+
+    // Entry 3*t + e is the triangle across the edge from corner e to corner e + 1 of triangle t.
+    static const int NO_NEIGHBOR = -1;
+    static const int NON_MANIFOLD = -2;
+    void FindNeighbors(const Mesh& mesh, std::vector<int>& neighbors) const;
+    static void FindNeighbors(ThreadPool* pPool, const std::vector<unsigned int>& indices, size_t vertexCount, bool skipCollapsed,
+        std::vector<int>& neighbors);
+    size_t Weld(Mesh& mesh, std::vector<int>* pNeighbors) const;
+    size_t PairNonManifold(const Mesh& mesh, std::vector<int>& neighbors) const;
+    size_t SplitFans(Mesh& mesh, const std::vector<int>& neighbors) const;
+    size_t SplitNonManifold(Mesh& mesh, std::vector<int>& neighbors) const;
+    size_t FillHoles(Mesh& mesh, const std::vector<int>& neighbors) const;
+    size_t Orient(Mesh& mesh, const std::vector<int>& neighbors) const;
+
+public:
+    MeshRepair(ThreadPool* pPool);
+
+    // Vertices closer than this are merged, unless that would put more than two triangles on an edge. 0 (the default)
+    // picks a millionth of the mesh's bounding diagonal.
+    void SetWeldTolerance(float tolerance);
+
+    // Each step returns how many vertices or triangles it merged, removed, split off, filled or flipped.
+    size_t Weld(Mesh& mesh) const;
+    size_t RemoveDegenerates(Mesh& mesh) const;
+    size_t SplitNonManifold(Mesh& mesh) const;
+    size_t FillHoles(Mesh& mesh) const;
+    size_t Orient(Mesh& mesh) const;
+
+    // Runs all of the above, in order.
+    void Repair(Mesh& mesh, Report& report) const;
+
+    // Checks a mesh without changing it. Vertices are compared by index, so unwelded meshes report seams as holes.
+    void Validate(const Mesh& mesh, Validity& validity) const;
+};
@@ -0,0 +1,306 @@
+/*--------------------------------------------------------------------------
+    MeshSlicer.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "MeshSlicer.h"
+#include <algorithm>
+
+float Contour::SignedArea() const
+{
+    size_t count = PointCount();
+    double area = 0.0;
+    for (size_t i = 0, j = count - 1; i < count; j = i++)
+    {
+        area += (double)points[j*2]*points[i*2 + 1] - (double)points[i*2]*points[j*2 + 1];
+    }
+
+    return (float)(0.5 * area);
+}
+
+// Edges are identified by their vertex pair, the same from both triangles that share them.
+static unsigned long long EdgeKey(unsigned int a, unsigned int b)
+{
+    return a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+}
+
+// Where an edge crosses the plane at z, computed from the lower-indexed end so both triangles would get the same point.
+static void EdgePoint(const std::vector<float>& positions, unsigned int a, unsigned int b, float z, float& x, float& y)
+{
+    if (a > b)
+    {
+        std::swap(a, b);
+    }
+
+    const float *pA = &positions[a*3], *pB = &positions[b*3];
+    float t = (z - pA[2]) / (pB[2] - pA[2]);
+    x = pA[0] + t*(pB[0] - pA[0]);
+    y = pA[1] + t*(pB[1] - pA[1]);
+}
+
+// Index of the lowest plane above z. Corners at or above a plane count as above it, so a triangle crosses the planes
+// from FirstPlaneAbove(zMin) to FirstPlaneAbove(zMax) - 1.
+static int FirstPlaneAbove(const std::vector<float>& planes, float bottom, float layerHeight, float z)
+{
+    int count = (int)planes.size();
+    int i = std::max(0, std::min(count, (int)floorf((z - bottom) / layerHeight - 0.5f) + 1));
+    while (i < count && planes[i] <= z)
+    {
+        i++;
+    }
+
+    while (i > 0 && planes[i - 1] > z)
+    {
+        i--;
+    }
+
+    return i;
+}
+
+MeshSlicer::MeshSlicer(ThreadPool* pPool)
+    : pPool(pPool)
+{
+}
+
+void MeshSlicer::SliceLayerTriangles(const std::vector<float>& positions, const Mesh& mesh, const unsigned int* pTriangles, size_t triangleCount,
+    SliceLayer& layer) const
+{
+    // One segment per crossing triangle, running from where the surface goes below the plane to where it comes back
+    // up. With outward-facing triangles that keeps the solid on the left.
+    struct Segment
+    {
+        unsigned long long startEdge, endEdge;
+        float x, y; // Start point.
+    };
+
+    std::vector<Segment> segments;
+    segments.reserve(triangleCount);
+    for (size_t i = 0; i < triangleCount; i++)
+    {
+        const unsigned int *pCorners = &mesh.indices[pTriangles[i]*3];
+        bool above[3];
+        for (int k = 0; k < 3; k++)
+        {
+            above[k] = positions[pCorners[k]*3 + 2] >= layer.z;
+        }
+
+        int down = -1, up = -1;
+        for (int k = 0; k < 3; k++)
+        {
+            int next = (k + 1) % 3;
+            if (above[k] && !above[next])
+            {
+                down = k;
+            }
+            else if (!above[k] && above[next])
+            {
+                up = k;
+            }
+        }
+
+        if (down < 0 || up < 0)
+        {
+            continue;
+        }
+
+        Segment segment;
+        segment.startEdge = EdgeKey(pCorners[down], pCorners[(down + 1) % 3]);
+        segment.endEdge = EdgeKey(pCorners[up], pCorners[(up + 1) % 3]);
+        EdgePoint(positions, pCorners[down], pCorners[(down + 1) % 3], layer.z, segment.x, segment.y);
+        segments.push_back(segment);
+    }
+
+    // Each segment continues with the one starting on the edge it ends on.
+    std::vector<std::pair<unsigned long long, unsigned int>> starts(segments.size());
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        starts[i] = std::make_pair(segments[i].startEdge, (unsigned int)i);
+    }
+
+    std::sort(starts.begin(), starts.end());
+    std::vector<bool> used(segments.size(), false);
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        Contour contour;
+        size_t current = i;
+        while (!used[current])
+        {
+            used[current] = true;
+            const Segment& segment = segments[current];
+            size_t count = contour.points.size();
+            if (count == 0 || contour.points[count - 2] != segment.x || contour.points[count - 1] != segment.y)
+            {
+                contour.points.push_back(segment.x);
+                contour.points.push_back(segment.y);
+            }
+
+            // Non-manifold edges start several segments; any unused one will do.
+            std::vector<std::pair<unsigned long long, unsigned int>>::const_iterator next =
+                std::lower_bound(starts.begin(), starts.end(), std::make_pair(segment.endEdge, 0u));
+            while (next != starts.end() && next->first == segment.endEdge && used[next->second])
+            {
+                next++;
+            }
+
+            if (next == starts.end() || next->first != segment.endEdge)
+            {
+                break;
+            }
+
+            current = next->second;
+        }
+
+        // The chain may have come back around onto its own first point.
+        size_t count = contour.points.size();
+        if (count >= 4 && contour.points[0] == contour.points[count - 2] && contour.points[1] == contour.points[count - 1])
+        {
+            contour.points.resize(count - 2);
+        }
+
+        if (contour.PointCount() >= 3)
+        {
+            layer.contours.push_back(Contour());
+            layer.contours.back().points.swap(contour.points);
+        }
+    }
+}
+
+void MeshSlicer::Slice(const Mesh& mesh, float layerHeight, std::vector<SliceLayer>& layers) const
+{
+    layers.clear();
+    size_t triangleCount = mesh.TriangleCount();
+    if (triangleCount == 0 || !(layerHeight > 0.0f))
+    {
+        return;
+    }
+
+    // Machine positions, converted once rather than at every triangle corner.
+    std::vector<float> positions(mesh.vertices.size() * 3);
+    ThreadPool::RunChunks(pPool, mesh.vertices.size(), TRIANGLE_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            Mesh::MachinePosition(mesh.vertices[i], &positions[i*3]);
+        }
+    });
+
+    float bottom = std::numeric_limits<float>::max(), top = -std::numeric_limits<float>::max();
+    for (size_t i = 0; i < mesh.indices.size(); i++)
+    {
+        float z = positions[mesh.indices[i]*3 + 2];
+        bottom = std::min(bottom, z);
+        top = std::max(top, z);
+    }
+
+    // Rounding can leave the top plane above the mesh, where it would only make an empty layer.
+    size_t layerCount = (size_t)ceilf((top - bottom) / layerHeight);
+    while (layerCount > 0 && bottom + ((float)layerCount - 0.5f) * layerHeight > top)
+    {
+        layerCount--;
+    }
+
+    std::vector<float> planes(layerCount);
+    layers.resize(layerCount);
+    for (size_t i = 0; i < layerCount; i++)
+    {
+        planes[i] = layers[i].z = bottom + ((float)i + 0.5f) * layerHeight;
+    }
+
+    if (layerCount == 0)
+    {
+        return;
+    }
+
+    // Counting sort of triangles into the layers they cross. Each chunk of triangles counts its crossings per layer,
+    // which then become that chunk's write positions in every layer's bucket, so buckets keep triangle order.
+    std::vector<int> firstLayer(triangleCount), endLayer(triangleCount);
+    size_t chunkCount = (triangleCount + TRIANGLE_CHUNK - 1) / TRIANGLE_CHUNK;
+    std::vector<std::vector<size_t>> chunkOffsets(chunkCount);
+    ThreadPool::RunChunks(pPool, chunkCount, 1, [&](size_t beginChunk, size_t endChunk)
+    {
+        for (size_t chunk = beginChunk; chunk < endChunk; chunk++)
+        {
+            // Crossing counts as differences between consecutive layers, then summed.
+            std::vector<size_t>& counts = chunkOffsets[chunk];
+            counts.assign(layerCount + 1, 0);
+            size_t end = std::min(triangleCount, (chunk + 1) * TRIANGLE_CHUNK);
+            for (size_t i = chunk * TRIANGLE_CHUNK; i < end; i++)
+            {
+                float zMin = std::numeric_limits<float>::max(), zMax = -std::numeric_limits<float>::max();
+                for (int k = 0; k < 3; k++)
+                {
+                    float z = positions[mesh.indices[i*3 + k]*3 + 2];
+                    zMin = std::min(zMin, z);
+                    zMax = std::max(zMax, z);
+                }
+
+                firstLayer[i] = FirstPlaneAbove(planes, bottom, layerHeight, zMin);
+                endLayer[i] = FirstPlaneAbove(planes, bottom, layerHeight, zMax);
+                if (firstLayer[i] < endLayer[i])
+                {
+                    counts[firstLayer[i]]++;
+                    counts[endLayer[i]]--;
+                }
+            }
+
+            for (size_t layer = 1; layer < layerCount; layer++)
+            {
+                counts[layer] += counts[layer - 1];
+            }
+        }
+    });
+
+    std::vector<size_t> layerStarts(layerCount + 1, 0);
+    for (size_t layer = 0; layer < layerCount; layer++)
+    {
+        size_t offset = layerStarts[layer];
+        for (size_t chunk = 0; chunk < chunkCount; chunk++)
+        {
+            size_t count = chunkOffsets[chunk][layer];
+            chunkOffsets[chunk][layer] = offset;
+            offset += count;
+        }
+
+        layerStarts[layer + 1] = offset;
+    }
+
+    std::vector<unsigned int> buckets(layerStarts[layerCount]);
+    ThreadPool::RunChunks(pPool, chunkCount, 1, [&](size_t beginChunk, size_t endChunk)
+    {
+        for (size_t chunk = beginChunk; chunk < endChunk; chunk++)
+        {
+            std::vector<size_t>& offsets = chunkOffsets[chunk];
+            size_t end = std::min(triangleCount, (chunk + 1) * TRIANGLE_CHUNK);
+            for (size_t i = chunk * TRIANGLE_CHUNK; i < end; i++)
+            {
+                for (int layer = firstLayer[i]; layer < endLayer[i]; layer++)
+                {
+                    buckets[offsets[layer]++] = (unsigned int)i;
+                }
+            }
+        }
+    });
+
+    ThreadPool::RunChunks(pPool, layerCount, LAYER_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t layer = begin; layer < end; layer++)
+        {
+            size_t count = layerStarts[layer + 1] - layerStarts[layer];
+            SliceLayerTriangles(positions, mesh, count == 0 ? NULL : &buckets[layerStarts[layer]], count, layers[layer]);
+        }
+    });
+}
@@ -0,0 +1,66 @@
+/*--------------------------------------------------------------------------
+    MeshSlicer.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+// A closed polygon in a layer, in machine x and y (see Mesh::MachinePosition). The last point joins back to the first.
+// Seen from above, outer boundaries run counter-clockwise and holes clockwise.
+struct Contour
+{
+    std::vector<float> points; // x, y pairs.
+
+    size_t PointCount() const
+    {
+        return points.size() / 2;
+    }
+
+    // Positive for counter-clockwise contours.
+    float SignedArea() const;
+};
+
+struct SliceLayer
+{
+    float z;
+    std::vector<Contour> contours;
+};
+
+// Cuts a closed mesh into horizontal layers for printing and milling.
+// Triangles are counting-sorted into the layers their Z range crosses, so each layer only looks at the triangles that
+// reach it, and layers are then intersected and linked into contours in parallel.
+class MeshSlicer
+{
+    ThreadPool *pPool;
+
+    static const size_t TRIANGLE_CHUNK = 1 << 14;
+    static const size_t LAYER_CHUNK = 4;
+
+    void SliceLayerTriangles(const std::vector<float>& positions, const Mesh& mesh, const unsigned int* pTriangles, size_t triangleCount,
+        SliceLayer& layer) const;
+
+public:
+    MeshSlicer(ThreadPool* pPool);
+
+    // Slices through the middle of each layerHeight thick layer from the bottom of the mesh to its top.
+    // Segments are joined through the mesh edges they cross, so the mesh should be welded (see MeshRepair).
+    // Chains that do not close, from holes in the mesh, are closed with a straight jump.
+    void Slice(const Mesh& mesh, float layerHeight, std::vector<SliceLayer>& layers) const;
+};
@@ -0,0 +1,469 @@
+/*--------------------------------------------------------------------------
+    Predicates.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "Predicates.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+// Half an ulp of 1.0, and the value used to split a double into two 26-bit halves.
+static const double EPSILON = 1.1102230246251565e-16;
+static const double SPLITTER = 134217729.0;
+
+// Error bounds for the plain floating-point evaluations (Shewchuk, table of bounds 'A').
+static const double ORIENT2D_BOUND = (3.0 + 16.0 * EPSILON) * EPSILON;
+static const double ORIENT3D_BOUND = (7.0 + 56.0 * EPSILON) * EPSILON;
+
+#ifdef RCSG_PREDICATE_STATISTICS
+static std::atomic<unsigned long long> callCount(0);
+static std::atomic<unsigned long long> exactCount(0);
+#define COUNT_CALL() callCount.fetch_add(1, std::memory_order_relaxed)
+#define COUNT_EXACT() exactCount.fetch_add(1, std::memory_order_relaxed)
+#else
+#define COUNT_CALL()
+#define COUNT_EXACT()
+#endif
+
+// A floating-point expansion: an exact sum of non-overlapping doubles, in increasing order of magnitude.
+// Sized for the largest intermediate result of the exact 3D orientation test.
+struct Expansion
+{
+    int length;
+    double terms[192];
+};
+
+// x + y == a + b exactly.
+static inline void TwoSum(double a, double b, double& x, double& y)
+{
+    x = a + b;
+    double bVirtual = x - a;
+    double aVirtual = x - bVirtual;
+    y = (a - aVirtual) + (b - bVirtual);
+}
+
+// x + y == a - b exactly.
+static inline void TwoDiff(double a, double b, double& x, double& y)
+{
+    x = a - b;
+    double bVirtual = a - x;
+    double aVirtual = x + bVirtual;
+    y = (a - aVirtual) + (bVirtual - b);
+}
+
+static inline void Split(double a, double& high, double& low)
+{
+    double c = SPLITTER * a;
+    high = c - (c - a);
+    low = a - high;
+}
+
+// x + y == a * b exactly.
+static inline void TwoProduct(double a, double b, double& x, double& y)
+{
+    x = a * b;
+    double aHigh, aLow, bHigh, bLow;
+    Split(a, aHigh, aLow);
+    Split(b, bHigh, bLow);
+    double error = x - aHigh * bHigh;
+    error -= aLow * bHigh;
+    error -= aHigh * bLow;
+    y = aLow * bLow - error;
+}
+
+// result = e + b, dropping zero terms.
+static void GrowExpansion(const Expansion& e, double b, Expansion& result)
+{
+    int length = 0;
+    double q = b;
+    for (int i = 0; i < e.length; i++)
+    {
+        double sum, error;
+        TwoSum(q, e.terms[i], sum, error);
+        q = sum;
+        if (error != 0.0)
+        {
+            result.terms[length++] = error;
+        }
+    }
+
+    if (q != 0.0 || length == 0)
+    {
+        result.terms[length++] = q;
+    }
+
+    result.length = length;
+}
+
+// result = e + f. Quadratic, but the exact path is rare and the expansions are short.
+static void SumExpansions(const Expansion& e, const Expansion& f, Expansion& result)
+{
+    Expansion scratch;
+    result = e;
+    for (int i = 0; i < f.length; i++)
+    {
+        GrowExpansion(result, f.terms[i], scratch);
+        result.length = scratch.length;
+        std::copy(scratch.terms, scratch.terms + scratch.length, result.terms);
+    }
+}
+
+// result = e * b, dropping zero terms.
+static void ScaleExpansion(const Expansion& e, double b, Expansion& result)
+{
+    int length = 0;
+    double q, error;
+    TwoProduct(e.terms[0], b, q, error);
+    if (error != 0.0)
+    {
+        result.terms[length++] = error;
+    }
+
+    for (int i = 1; i < e.length; i++)
+    {
+        double productHigh, productLow, sum;
+        TwoProduct(e.terms[i], b, productHigh, productLow);
+        TwoSum(q, productLow, sum, error);
+        if (error != 0.0)
+        {
+            result.terms[length++] = error;
+        }
+
+        TwoSum(productHigh, sum, q, error);
+        if (error != 0.0)
+        {
+            result.terms[length++] = error;
+        }
+    }
+
+    if (q != 0.0 || length == 0)
+    {
+        result.terms[length++] = q;
+    }
+
+    result.length = length;
+}
+
+static void MultiplyExpansions(const Expansion& e, const Expansion& f, Expansion& result)
+{
+    Expansion term, sum;
+    result.length = 1;
+    result.terms[0] = 0.0;
+    for (int i = 0; i < f.length; i++)
+    {
+        ScaleExpansion(e, f.terms[i], term);
+        SumExpansions(result, term, sum);
+        result = sum;
+    }
+}
+
+static void Negate(Expansion& e)
+{
+    for (int i = 0; i < e.length; i++)
+    {
+        e.terms[i] = -e.terms[i];
+    }
+}
+
+// Exact a - b as a two-term expansion.
+static void Difference(double a, double b, Expansion& result)
+{
+    double x, y;
+    TwoDiff(a, b, x, y);
+    result.length = 2;
+    result.terms[0] = y;
+    result.terms[1] = x;
+}
+
+// e * f - g * h, exactly.
+static void CrossTerm(const Expansion& e, const Expansion& f, const Expansion& g, const Expansion& h, Expansion& result)
+{
+    Expansion left, right;
+    MultiplyExpansions(e, f, left);
+    MultiplyExpansions(g, h, right);
+    Negate(right);
+    SumExpansions(left, right, result);
+}
+
+// The largest term of a zero-eliminated expansion carries its sign.
+static double Estimate(const Expansion& e)
+{
+    return e.terms[e.length - 1];
+}
+
+static double Orient2dExact(const double a[2], const double b[2], const double c[2])
+{
+    Expansion acx, acy, bcx, bcy, det;
+    Difference(a[0], c[0], acx);
+    Difference(a[1], c[1], acy);
+    Difference(b[0], c[0], bcx);
+    Difference(b[1], c[1], bcy);
+    CrossTerm(acx, bcy, acy, bcx, det);
+    return Estimate(det);
+}
+
+static double Orient3dExact(const double a[3], const double b[3], const double c[3], const double d[3])
+{
+    Expansion ad[3], bd[3], cd[3];
+    for (int i = 0; i < 3; i++)
+    {
+        Difference(a[i], d[i], ad[i]);
+        Difference(b[i], d[i], bd[i]);
+        Difference(c[i], d[i], cd[i]);
+    }
+
+    // adz * (bdx*cdy - cdx*bdy) + bdz * (cdx*ady - adx*cdy) + cdz * (adx*bdy - bdx*ady)
+    Expansion minor, term, partial, det;
+    CrossTerm(bd[0], cd[1], cd[0], bd[1], minor);
+    MultiplyExpansions(minor, ad[2], det);
+
+    CrossTerm(cd[0], ad[1], ad[0], cd[1], minor);
+    MultiplyExpansions(minor, bd[2], term);
+    SumExpansions(det, term, partial);
+
+    CrossTerm(ad[0], bd[1], bd[0], ad[1], minor);
+    MultiplyExpansions(minor, cd[2], term);
+    SumExpansions(partial, term, det);
+    return Estimate(det);
+}
+
+double Predicates::Orient2d(const double a[2], const double b[2], const double c[2])
+{
+    COUNT_CALL();
+    double detLeft = (a[0] - c[0]) * (b[1] - c[1]);
+    double detRight = (a[1] - c[1]) * (b[0] - c[0]);
+    double det = detLeft - detRight;
+
+    // Opposite signs (or a zero) can't cancel, so the sign is already right.
+    if ((detLeft > 0.0 && detRight <= 0.0) || (detLeft < 0.0 && detRight >= 0.0) || detLeft == 0.0)
+    {
+        return det;
+    }
+
+    double bound = ORIENT2D_BOUND * (fabs(detLeft) + fabs(detRight));
+    if (det >= bound || -det >= bound)
+    {
+        return det;
+    }
+
+    COUNT_EXACT();
+    return Orient2dExact(a, b, c);
+}
+
+double Predicates::Orient3d(const double a[3], const double b[3], const double c[3], const double d[3])
+{
+    COUNT_CALL();
+    double adx = a[0] - d[0], ady = a[1] - d[1], adz = a[2] - d[2];
+    double bdx = b[0] - d[0], bdy = b[1] - d[1], bdz = b[2] - d[2];
+    double cdx = c[0] - d[0], cdy = c[1] - d[1], cdz = c[2] - d[2];
+
+    double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+    double cdxady = cdx * ady, adxcdy = adx * cdy;
+    double adxbdy = adx * bdy, bdxady = bdx * ady;
+    double det = adz * (bdxcdy - cdxbdy) + bdz * (cdxady - adxcdy) + cdz * (adxbdy - bdxady);
+
+    double permanent = (fabs(bdxcdy) + fabs(cdxbdy)) * fabs(adz)
+        + (fabs(cdxady) + fabs(adxcdy)) * fabs(bdz)
+        + (fabs(adxbdy) + fabs(bdxady)) * fabs(cdz);
+    double bound = ORIENT3D_BOUND * permanent;
+    if (det > bound || -det > bound)
+    {
+        return det;
+    }
+
+    COUNT_EXACT();
+    return Orient3dExact(a, b, c, d);
+}
+
+double Predicates::Orient3d(const float a[3], const float b[3], const float c[3], const float d[3])
+{
+    double ad[3] = { a[0], a[1], a[2] }, bd[3] = { b[0], b[1], b[2] };
+    double cd[3] = { c[0], c[1], c[2] }, dd[3] = { d[0], d[1], d[2] };
+    return Orient3d(ad, bd, cd, dd);
+}
+
+// Drops coordinate 'axis' of a 3D point.
+static void Project(const double point[3], int axis, double result[2])
+{
+    result[0] = point[axis == 0 ? 1 : 0];
+    result[1] = point[axis == 2 ? 1 : 2];
+}
+
+bool Predicates::IsDegenerate(const double a[3], const double b[3], const double c[3])
+{
+    // Collinear in 3D exactly when collinear in all three axis-aligned projections.
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double pa[2], pb[2], pc[2];
+        Project(a, axis, pa);
+        Project(b, axis, pb);
+        Project(c, axis, pc);
+        if (Orient2d(pa, pb, pc) != 0.0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Predicates::IsDegenerate(const float a[3], const float b[3], const float c[3])
+{
+    double ad[3] = { a[0], a[1], a[2] }, bd[3] = { b[0], b[1], b[2] }, cd[3] = { c[0], c[1], c[2] };
+    return IsDegenerate(ad, bd, cd);
+}
+
+static int Sign(double value)
+{
+    return value > 0.0 ? 1 : (value < 0.0 ? -1 : 0);
+}
+
+// True if collinear point p lies within the bounding box of segment ab.
+static bool WithinSegment(const double a[2], const double b[2], const double p[2])
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (p[i] < std::min(a[i], b[i]) || p[i] > std::max(a[i], b[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool SegmentsIntersect2d(const double a[2], const double b[2], const double c[2], const double d[2])
+{
+    int abc = Sign(Predicates::Orient2d(a, b, c)), abd = Sign(Predicates::Orient2d(a, b, d));
+    int cda = Sign(Predicates::Orient2d(c, d, a)), cdb = Sign(Predicates::Orient2d(c, d, b));
+    if (abc * abd < 0 && cda * cdb < 0)
+    {
+        return true;
+    }
+
+    return (abc == 0 && WithinSegment(a, b, c)) || (abd == 0 && WithinSegment(a, b, d))
+        || (cda == 0 && WithinSegment(c, d, a)) || (cdb == 0 && WithinSegment(c, d, b));
+}
+
+// Point-in-closed-triangle test, for either winding.
+static bool PointInTriangle2d(const double p[2], const double a[2], const double b[2], const double c[2])
+{
+    int s1 = Sign(Predicates::Orient2d(a, b, p)), s2 = Sign(Predicates::Orient2d(b, c, p)), s3 = Sign(Predicates::Orient2d(c, a, p));
+    return (s1 >= 0 && s2 >= 0 && s3 >= 0) || (s1 <= 0 && s2 <= 0 && s3 <= 0);
+}
+
+// Picks a projection axis in which the triangle keeps its area, so 2D tests stay equivalent to 3D ones.
+static int ProjectionAxis(const double a[3], const double b[3], const double c[3])
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        double pa[2], pb[2], pc[2];
+        Project(a, axis, pa);
+        Project(b, axis, pb);
+        Project(c, axis, pc);
+        if (Predicates::Orient2d(pa, pb, pc) != 0.0)
+        {
+            return axis;
+        }
+    }
+
+    return 2;
+}
+
+// Segment ab against triangle pqr, where everything lies in one plane.
+static bool SegmentTriangleCoplanar(const double a[3], const double b[3], const double p[3], const double q[3], const double r[3])
+{
+    int axis = ProjectionAxis(p, q, r);
+    double pa[2], pb[2], pp[2], pq[2], pr[2];
+    Project(a, axis, pa);
+    Project(b, axis, pb);
+    Project(p, axis, pp);
+    Project(q, axis, pq);
+    Project(r, axis, pr);
+    return PointInTriangle2d(pa, pp, pq, pr) || SegmentsIntersect2d(pa, pb, pp, pq)
+        || SegmentsIntersect2d(pa, pb, pq, pr) || SegmentsIntersect2d(pa, pb, pr, pp);
+}
+
+// Closed segment ab against closed triangle pqr.
+static bool SegmentTriangle(const double a[3], const double b[3], const double p[3], const double q[3], const double r[3])
+{
+    int sa = Sign(Predicates::Orient3d(p, q, r, a)), sb = Sign(Predicates::Orient3d(p, q, r, b));
+    if (sa * sb > 0)
+    {
+        return false;
+    }
+    else if (sa == 0 && sb == 0)
+    {
+        return SegmentTriangleCoplanar(a, b, p, q, r);
+    }
+
+    // The segment crosses the plane; it hits the triangle if the line through it passes inside all three edges.
+    int s1 = Sign(Predicates::Orient3d(a, b, p, q)), s2 = Sign(Predicates::Orient3d(a, b, q, r)), s3 = Sign(Predicates::Orient3d(a, b, r, p));
+    return (s1 >= 0 && s2 >= 0 && s3 >= 0) || (s1 <= 0 && s2 <= 0 && s3 <= 0);
+}
+
+bool Predicates::TrianglesIntersect(const double p1[3], const double p2[3], const double p3[3], const double q1[3], const double q2[3], const double q3[3])
+{
+    // Reject early when one triangle lies strictly to one side of the other's plane.
+    int s1 = Sign(Orient3d(p1, p2, p3, q1)), s2 = Sign(Orient3d(p1, p2, p3, q2)), s3 = Sign(Orient3d(p1, p2, p3, q3));
+    if ((s1 > 0 && s2 > 0 && s3 > 0) || (s1 < 0 && s2 < 0 && s3 < 0))
+    {
+        return false;
+    }
+
+    int t1 = Sign(Orient3d(q1, q2, q3, p1)), t2 = Sign(Orient3d(q1, q2, q3, p2)), t3 = Sign(Orient3d(q1, q2, q3, p3));
+    if ((t1 > 0 && t2 > 0 && t3 > 0) || (t1 < 0 && t2 < 0 && t3 < 0))
+    {
+        return false;
+    }
+
+    // Two triangles meet exactly when an edge of one touches the other. For coplanar triangles, one may also
+    // contain the other entirely, which the edge tests catch through their point-in-triangle checks.
+    const double* p[3] = { p1, p2, p3 };
+    const double* q[3] = { q1, q2, q3 };
+    for (int i = 0; i < 3; i++)
+    {
+        if (SegmentTriangle(p[i], p[(i + 1) % 3], q1, q2, q3) || SegmentTriangle(q[i], q[(i + 1) % 3], p1, p2, p3))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+Predicates::Statistics Predicates::GetStatistics()
+{
+    Statistics statistics;
+#ifdef RCSG_PREDICATE_STATISTICS
+    statistics.calls = callCount.load();
+    statistics.exactEvaluations = exactCount.load();
+#else
+    statistics.calls = 0;
+    statistics.exactEvaluations = 0;
+#endif
+    return statistics;
+}
+
+void Predicates::ResetStatistics()
+{
+#ifdef RCSG_PREDICATE_STATISTICS
+    callCount.store(0);
+    exactCount.store(0);
+#endif
+}
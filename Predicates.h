@@ -0,0 +1,55 @@
+/*--------------------------------------------------------------------------
+    Predicates.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+
+// Geometric predicates whose signs are always correct, after Shewchuk's adaptive-precision predicates.
+// Each predicate first evaluates in plain double arithmetic with a forward error bound; only when the result
+// is too close to zero to trust is it recomputed exactly with floating-point expansions, which is rare.
+// Assumes IEEE double arithmetic without extended x87 precision (the default with SSE2 code generation).
+//
+// Define RCSG_PREDICATE_STATISTICS to count how often the fast filter decides the result.
+class Predicates
+{
+public:
+    struct Statistics
+    {
+        unsigned long long calls;
+        unsigned long long exactEvaluations;
+    };
+
+    // Positive if a, b, c are in counter-clockwise order, negative if clockwise, zero if collinear.
+    static double Orient2d(const double a[2], const double b[2], const double c[2]);
+
+    // Positive if d lies below the plane through a, b, c, where "below" is the side from which a, b, c appear clockwise.
+    // Negative if above, zero if coplanar. The magnitude approximates six times the tetrahedron volume.
+    static double Orient3d(const double a[3], const double b[3], const double c[3], const double d[3]);
+    static double Orient3d(const float a[3], const float b[3], const float c[3], const float d[3]);
+
+    // True if the triangle has zero area (its corners are collinear or coincide).
+    static bool IsDegenerate(const double a[3], const double b[3], const double c[3]);
+    static bool IsDegenerate(const float a[3], const float b[3], const float c[3]);
+
+    // True if the closed triangles share at least one point, including touching at an edge or corner.
+    static bool TrianglesIntersect(const double p1[3], const double p2[3], const double p3[3], const double q1[3], const double q2[3], const double q3[3]);
+
+    static Statistics GetStatistics();
+    static void ResetStatistics();
+};
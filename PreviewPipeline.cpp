@@ -0,0 +1,101 @@
+/*--------------------------------------------------------------------------
+    PreviewPipeline.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "PreviewPipeline.h"
+#include "Profiler.h"
+#include "SdfEvaluator.h"
+#include "SdfMesher.h"
+
+PreviewPipeline::PreviewPipeline(ThreadPool* pPool, int coarseDepth, int fineDepth)
+    : pPool(pPool), coarseDepth(coarseDepth), fineDepth(fineDepth)
+{
+}
+
+PreviewPipeline::~PreviewPipeline()
+{
+    // The job only touches its own shared state, so it is safe to abandon once cancelled.
+    if (pCurrentJob)
+    {
+        pCurrentJob->cancelled = true;
+    }
+}
+
+void PreviewPipeline::Submit(const CsgNode& root, Mesh& coarseMesh)
+{
+    if (pCurrentJob)
+    {
+        pCurrentJob->cancelled = true;
+    }
+
+    // The evaluator is a snapshot of the tree, so the tree can keep changing while the job runs.
+    std::shared_ptr<SdfEvaluator> pSdf(new SdfEvaluator(root));
+
+    SdfMesher coarseMesher(coarseDepth, pPool);
+    coarseMesher.Contour(*pSdf, coarseMesh);
+
+    std::shared_ptr<Job> pJob(new Job());
+    pJob->cancelled = false;
+    pJob->finished = false;
+    pCurrentJob = pJob;
+
+    int depth = fineDepth;
+    ThreadPool *pJobPool = pPool;
+    std::function<void()> refine = [pJob, pSdf, depth, pJobPool]()
+    {
+        if (pJob->cancelled)
+        {
+            return;
+        }
+
+        ProfileScope scope("Fine mesh");
+        SdfMesher fineMesher(depth, pJobPool);
+        fineMesher.SetCancelFlag(&pJob->cancelled);
+        if (fineMesher.Contour(*pSdf, pJob->mesh))
+        {
+            pJob->finished = true;
+        }
+    };
+
+    if (pPool != NULL)
+    {
+        pPool->Enqueue(refine);
+    }
+    else
+    {
+        refine();
+    }
+}
+
+bool PreviewPipeline::TakeFineMesh(Mesh& fineMesh)
+{
+    if (!pCurrentJob || !pCurrentJob->finished)
+    {
+        return false;
+    }
+
+    fineMesh.vertices.swap(pCurrentJob->mesh.vertices);
+    fineMesh.indices.swap(pCurrentJob->mesh.indices);
+    pCurrentJob.reset();
+    return true;
+}
+
+bool PreviewPipeline::IsRefining() const
+{
+    return pCurrentJob && !pCurrentJob->finished;
+}
@@ -0,0 +1,54 @@
+/*--------------------------------------------------------------------------
+    PreviewPipeline.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "CsgTree.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+// Two-tier CSG evaluation so the editor never waits on a full-quality result.
+// Every edit produces a coarse mesh right away, and a background job computes the fine mesh that replaces it.
+// Submitting a new edit cancels the job for the previous one so stale work stops using cores.
+class PreviewPipeline
+{
+    struct Job
+    {
+        std::atomic<bool> cancelled;
+        std::atomic<bool> finished;
+        Mesh mesh;
+    };
+
+    ThreadPool *pPool;
+    int coarseDepth, fineDepth;
+    std::shared_ptr<Job> pCurrentJob;
+
+public:
+    // Depths are octree levels for the two tiers, see SdfMesher.
+    PreviewPipeline(ThreadPool* pPool, int coarseDepth, int fineDepth);
+    ~PreviewPipeline();
+
+    // Synchronously meshes the coarse tier into coarseMesh and starts refining in the background.
+    void Submit(const CsgNode& root, Mesh& coarseMesh);
+
+    // Returns true, once, when the fine mesh for the latest submission is ready.
+    bool TakeFineMesh(Mesh& fineMesh);
+
+    bool IsRefining() const;
+};
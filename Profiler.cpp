@@ -0,0 +1,507 @@
+/*--------------------------------------------------------------------------
+    Profiler.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "Profiler.h"
+#include "GLManager.h"
+#include "ShaderCache.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <iomanip>
+
+Profiler *Profiler::m_pProfiler;
+
+// Nesting of the open CPU scopes on this thread.
+static THREAD_LOCAL int scopeDepth = 0;
+
+// Overlay layout, in pixels.
+static const float OVERLAY_MARGIN = 8.0f;
+static const float OVERLAY_BAR_WIDTH = 2.0f;        // One CPU and one GPU bar per frame.
+static const float OVERLAY_PIXELS_PER_MS = 6.0f;
+
+// Scopes are colored by name, so a scope keeps its color across frames and in the printed summary.
+static const int PALETTE_SIZE = 8;
+static const float PALETTE[PALETTE_SIZE][3] =
+{
+    { 0.9f, 0.3f, 0.3f }, { 0.3f, 0.8f, 0.3f }, { 0.3f, 0.5f, 1.0f }, { 0.9f, 0.9f, 0.3f },
+    { 0.9f, 0.3f, 0.9f }, { 0.3f, 0.9f, 0.9f }, { 1.0f, 0.6f, 0.2f }, { 0.8f, 0.8f, 0.8f }
+};
+static const char* PALETTE_NAMES[PALETTE_SIZE] = { "red", "green", "blue", "yellow", "magenta", "cyan", "orange", "white" };
+
+static int PaletteIndex(const char* pName)
+{
+    unsigned int hash = 2166136261u;
+    for (const char* pChar = pName; *pChar != '\0'; pChar++)
+    {
+        hash = (hash ^ (unsigned char)*pChar) * 16777619u;
+    }
+
+    return (int)(hash % PALETTE_SIZE);
+}
+
+Profiler::Profiler()
+    : frame(0), records(FRAME_HISTORY), gpuScopeOpen(false), overlayVisible(false), overlayVao(0), overlayBuffer(0)
+{
+    startTime = glfwGetTime();
+    records[0].frame = 0;
+    records[0].start = 0.0;
+    records[0].duration = 0.0;
+
+    glGenQueries(QUERY_LATENCY * MAX_GPU_SCOPES, &queries[0][0]);
+    for (int i = 0; i < QUERY_LATENCY; i++)
+    {
+        pendingCount[i] = 0;
+    }
+
+    // Position (normalized device coordinates) and color.
+    glGenVertexArrays(1, &overlayVao);
+    glBindVertexArray(overlayVao);
+    glGenBuffers(1, &overlayBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, overlayBuffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (GLvoid*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (GLvoid*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    ShaderCache::GetCache()->Request("profileOverlay");
+}
+
+Profiler::~Profiler()
+{
+    glDeleteQueries(QUERY_LATENCY * MAX_GPU_SCOPES, &queries[0][0]);
+    glDeleteBuffers(1, &overlayBuffer);
+    glDeleteVertexArrays(1, &overlayVao);
+}
+
+double Profiler::Now() const
+{
+    return glfwGetTime() - startTime;
+}
+
+Profiler::FrameRecord& Profiler::Record(unsigned long long frame)
+{
+    return records[frame % FRAME_HISTORY];
+}
+
+// Reads back the queries of a set, waiting for any still in flight.
+void Profiler::CollectQueries(int set)
+{
+    for (int i = 0; i < pendingCount[set]; i++)
+    {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[set][i], GL_QUERY_RESULT, &nanoseconds);
+
+        // The record may have been recycled if the history is shorter than the latency.
+        const PendingQuery& query = pending[set][i];
+        FrameRecord& record = Record(query.frame);
+        if (record.frame == query.frame && query.event < record.events.size())
+        {
+            record.events[query.event].duration = (double)nanoseconds * 1e-9;
+        }
+    }
+
+    pendingCount[set] = 0;
+}
+
+void Profiler::BeginFrame()
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    Record(frame).start = Now();
+}
+
+void Profiler::EndFrame()
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    FrameRecord& record = Record(frame);
+    record.duration = Now() - record.start;
+
+    // The next record starts collecting scopes right away, as workers may close theirs before BeginFrame.
+    frame++;
+    FrameRecord& next = Record(frame);
+    next.frame = frame;
+    next.start = Now();
+    next.duration = 0.0;
+    next.events.clear();
+
+    // Frees the query set for the next frame. Its results are QUERY_LATENCY frames old, so this rarely waits.
+    CollectQueries((int)(frame % QUERY_LATENCY));
+}
+
+void Profiler::AddCpuEvent(const char* pName, int depth, double start, double end)
+{
+    ThreadPool *pPool = ThreadPool::GetPool();
+    int worker = pPool != NULL ? pPool->WorkerIndex() : -1;
+
+    Event event;
+    event.pName = pName;
+    event.gpu = false;
+    event.track = (unsigned int)(worker + 1);
+    event.depth = depth;
+    event.start = start;
+    event.duration = end - start;
+
+    std::lock_guard<std::mutex> lock(recordMutex);
+    Record(frame).events.push_back(event);
+}
+
+int Profiler::BeginGpuEvent(const char* pName)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    int set = (int)(frame % QUERY_LATENCY);
+    if (gpuScopeOpen || pendingCount[set] == MAX_GPU_SCOPES)
+    {
+        return -1;
+    }
+
+    Event event;
+    event.pName = pName;
+    event.gpu = true;
+    event.track = 0;
+    event.depth = 0;
+    event.start = Now();
+    event.duration = -1.0;
+
+    FrameRecord& record = Record(frame);
+    int query = pendingCount[set]++;
+    pending[set][query].frame = frame;
+    pending[set][query].event = record.events.size();
+    record.events.push_back(event);
+
+    gpuScopeOpen = true;
+    glBeginQuery(GL_TIME_ELAPSED, queries[set][query]);
+    return query;
+}
+
+void Profiler::EndGpuEvent(int query)
+{
+    if (query >= 0)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuScopeOpen = false;
+    }
+}
+
+const Profiler::FrameRecord* Profiler::CompletedFrame(int age) const
+{
+    if (age < 0 || age >= FRAME_HISTORY - 1 || (unsigned long long)age >= frame)
+    {
+        return NULL;
+    }
+
+    return &records[(frame - 1 - age) % FRAME_HISTORY];
+}
+
+void Profiler::PrintSummary()
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+
+    // Totals per scope name and kind, in order of first appearance.
+    struct Total
+    {
+        std::string name;
+        bool gpu;
+        double seconds;
+        int count;
+    };
+
+    std::vector<Total> totals;
+    int frames = 0;
+    double frameSeconds = 0.0;
+    for (int age = FRAME_HISTORY - 2; age >= 0; age--)
+    {
+        const FrameRecord *pRecord = CompletedFrame(age);
+        if (pRecord == NULL)
+        {
+            continue;
+        }
+
+        frames++;
+        frameSeconds += pRecord->duration;
+        for (size_t i = 0; i < pRecord->events.size(); i++)
+        {
+            const Event& event = pRecord->events[i];
+            if (event.duration < 0.0)
+            {
+                continue;
+            }
+
+            size_t total = 0;
+            while (total < totals.size() && (totals[total].gpu != event.gpu || totals[total].name != event.pName))
+            {
+                total++;
+            }
+
+            if (total == totals.size())
+            {
+                Total newTotal = { event.pName, event.gpu, 0.0, 0 };
+                totals.push_back(newTotal);
+            }
+
+            totals[total].seconds += event.duration;
+            totals[total].count++;
+        }
+    }
+
+    if (frames == 0)
+    {
+        return;
+    }
+
+    std::cout << "Profile of the last " << frames << " frames, " << std::fixed << std::setprecision(3)
+        << 1000.0 * frameSeconds / frames << " ms per frame:" << std::endl;
+    for (size_t i = 0; i < totals.size(); i++)
+    {
+        std::cout << "  " << (totals[i].gpu ? "GPU " : "CPU ") << totals[i].name << " (" << PALETTE_NAMES[PaletteIndex(totals[i].name.c_str())]
+            << "): " << 1000.0 * totals[i].seconds / frames << " ms per frame, " << totals[i].count << " calls" << std::endl;
+    }
+
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+void Profiler::SetOverlayVisible(bool visible)
+{
+    overlayVisible = visible;
+}
+
+bool Profiler::OverlayVisible() const
+{
+    return overlayVisible;
+}
+
+void Profiler::AddRectangle(float left, float bottom, float right, float top, const float color[3], int width, int height)
+{
+    float x0 = 2.0f * left / (float)width - 1.0f, x1 = 2.0f * right / (float)width - 1.0f;
+    float y0 = 2.0f * bottom / (float)height - 1.0f, y1 = 2.0f * top / (float)height - 1.0f;
+    float corners[6][2] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y0 }, { x1, y1 }, { x0, y1 } };
+    for (int i = 0; i < 6; i++)
+    {
+        overlayVertices.push_back(corners[i][0]);
+        overlayVertices.push_back(corners[i][1]);
+        overlayVertices.insert(overlayVertices.end(), color, color + 3);
+    }
+}
+
+void Profiler::DrawOverlay(int width, int height)
+{
+    if (!overlayVisible || width <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    static const float BACKGROUND[3] = { 0.1f, 0.1f, 0.1f };
+    static const float FRAME_COLOR[3] = { 0.35f, 0.35f, 0.35f };
+    static const float BUDGET_COLOR[3] = { 1.0f, 1.0f, 1.0f };
+
+    float budgetHeight = OVERLAY_PIXELS_PER_MS * 1000.0f / (float)GLManager::FPS_TARGET;
+    float graphHeight = 2.0f * budgetHeight;
+    float graphWidth = 2.0f * OVERLAY_BAR_WIDTH * (FRAME_HISTORY - 1);
+
+    overlayVertices.clear();
+    AddRectangle(OVERLAY_MARGIN, OVERLAY_MARGIN, OVERLAY_MARGIN + graphWidth, OVERLAY_MARGIN + graphHeight, BACKGROUND, width, height);
+
+    {
+        std::lock_guard<std::mutex> lock(recordMutex);
+
+        // Oldest frame on the left. Each frame gets its total CPU time with the render thread's scopes stacked on top,
+        // and beside it the stacked GPU scopes.
+        for (int age = FRAME_HISTORY - 2; age >= 0; age--)
+        {
+            const FrameRecord *pRecord = CompletedFrame(age);
+            if (pRecord == NULL)
+            {
+                continue;
+            }
+
+            float left = OVERLAY_MARGIN + 2.0f * OVERLAY_BAR_WIDTH * (FRAME_HISTORY - 2 - age);
+            float frameTop = std::min(graphHeight, OVERLAY_PIXELS_PER_MS * 1000.0f * (float)pRecord->duration);
+            AddRectangle(left, OVERLAY_MARGIN, left + OVERLAY_BAR_WIDTH, OVERLAY_MARGIN + frameTop, FRAME_COLOR, width, height);
+
+            float cpuStack = 0.0f, gpuStack = 0.0f;
+            for (size_t i = 0; i < pRecord->events.size(); i++)
+            {
+                const Event& event = pRecord->events[i];
+                if (event.duration < 0.0 || event.depth != 0 || (!event.gpu && event.track != 0))
+                {
+                    continue;
+                }
+
+                float& stack = event.gpu ? gpuStack : cpuStack;
+                float barLeft = event.gpu ? left + OVERLAY_BAR_WIDTH : left;
+                float top = std::min(graphHeight, stack + OVERLAY_PIXELS_PER_MS * 1000.0f * (float)event.duration);
+                if (top > stack)
+                {
+                    AddRectangle(barLeft, OVERLAY_MARGIN + stack, barLeft + OVERLAY_BAR_WIDTH, OVERLAY_MARGIN + top,
+                        PALETTE[PaletteIndex(event.pName)], width, height);
+                }
+
+                stack = top;
+            }
+        }
+    }
+
+    AddRectangle(OVERLAY_MARGIN, OVERLAY_MARGIN + budgetHeight, OVERLAY_MARGIN + graphWidth, OVERLAY_MARGIN + budgetHeight + 1.0f,
+        BUDGET_COLOR, width, height);
+
+    glBindVertexArray(overlayVao);
+    glBindBuffer(GL_ARRAY_BUFFER, overlayBuffer);
+    glBufferData(GL_ARRAY_BUFFER, overlayVertices.size() * sizeof(float), &overlayVertices[0], GL_STREAM_DRAW);
+
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(ShaderCache::GetCache()->GetProgram("profileOverlay"));
+    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(overlayVertices.size() / 5));
+    if (depthTest)
+    {
+        glEnable(GL_DEPTH_TEST);
+    }
+}
+
+// Names are code literals, but are escaped anyway so the output is always valid JSON.
+static std::string JsonString(const std::string& text)
+{
+    std::string result = "\"";
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        if (text[i] == '"' || text[i] == '\\')
+        {
+            result += '\\';
+        }
+
+        result += text[i];
+    }
+
+    return result + "\"";
+}
+
+bool Profiler::ExportTrace(const std::string& filename)
+{
+    std::ofstream file(filename.c_str());
+    if (!file)
+    {
+        std::cout << "Could not write the profile trace to " << filename << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(recordMutex);
+
+    // CPU tracks are threads of process 0; GPU scopes get a process of their own.
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}}," << std::endl;
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GPU\"}}," << std::endl;
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"Render thread\"}}";
+    ThreadPool *pPool = ThreadPool::GetPool();
+    unsigned int workers = pPool != NULL ? pPool->ThreadCount() : 0;
+    for (unsigned int i = 0; i < workers; i++)
+    {
+        file << "," << std::endl << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << (i + 1) << ",\"args\":{\"name\":\"Worker " << i << "\"}}";
+    }
+
+    // Microseconds, as Chrome expects.
+    file << std::fixed << std::setprecision(3);
+    for (int age = FRAME_HISTORY - 2; age >= 0; age--)
+    {
+        const FrameRecord *pRecord = CompletedFrame(age);
+        if (pRecord == NULL)
+        {
+            continue;
+        }
+
+        file << "," << std::endl << "{\"name\":\"Frame " << pRecord->frame << "\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":"
+            << 1e6 * pRecord->start << ",\"dur\":" << 1e6 * pRecord->duration << "}";
+        for (size_t i = 0; i < pRecord->events.size(); i++)
+        {
+            const Event& event = pRecord->events[i];
+            if (event.duration < 0.0)
+            {
+                continue;
+            }
+
+            file << "," << std::endl << "{\"name\":" << JsonString(event.pName) << ",\"cat\":\"" << (event.gpu ? "gpu" : "cpu")
+                << "\",\"ph\":\"X\",\"pid\":" << (event.gpu ? 1 : 0) << ",\"tid\":" << event.track
+                << ",\"ts\":" << 1e6 * event.start << ",\"dur\":" << 1e6 * event.duration << "}";
+        }
+    }
+
+    file << std::endl << "]}" << std::endl;
+    std::cout << "Wrote the profile trace to " << filename << std::endl;
+    return true;
+}
+
+bool Profiler::Initialize()
+{
+    m_pProfiler = new Profiler();
+    return true;
+}
+
+Profiler* Profiler::GetProfiler()
+{
+    return m_pProfiler;
+}
+
+bool Profiler::Deinitialize()
+{
+    delete m_pProfiler;
+    m_pProfiler = NULL;
+    return true;
+}
+
+ProfileScope::ProfileScope(const char* pName)
+    : pName(NULL), start(0.0), depth(0)
+{
+    Profiler *pProfiler = Profiler::GetProfiler();
+    if (pProfiler != NULL)
+    {
+        this->pName = pName;
+        start = pProfiler->Now();
+        depth = scopeDepth++;
+    }
+}
+
+ProfileScope::~ProfileScope()
+{
+    if (pName == NULL)
+    {
+        return;
+    }
+
+    scopeDepth--;
+    Profiler *pProfiler = Profiler::GetProfiler();
+    if (pProfiler != NULL)
+    {
+        pProfiler->AddCpuEvent(pName, depth, start, pProfiler->Now());
+    }
+}
+
+GpuProfileScope::GpuProfileScope(const char* pName)
+    : query(-1)
+{
+    Profiler *pProfiler = Profiler::GetProfiler();
+    if (pProfiler != NULL)
+    {
+        query = pProfiler->BeginGpuEvent(pName);
+    }
+}
+
+GpuProfileScope::~GpuProfileScope()
+{
+    Profiler *pProfiler = Profiler::GetProfiler();
+    if (pProfiler != NULL)
+    {
+        pProfiler->EndGpuEvent(query);
+    }
+}
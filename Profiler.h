@@ -0,0 +1,138 @@
+/*--------------------------------------------------------------------------
+    Profiler.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include <mutex>
+
+// Times named scopes of each frame on the CPU (any thread) and on the GPU (GL_TIME_ELAPSED queries around passes),
+// keeping the last FRAME_HISTORY frames. The records can be drawn as an overlay or exported as a Chrome trace.
+// GPU results are read back QUERY_LATENCY frames late so the queries never stall the pipeline.
+// Timing is skipped entirely when the profiler is not initialized.
+class Profiler
+{
+public:
+    struct Event
+    {
+        const char *pName;  // Not copied; string literals in practice.
+        bool gpu;
+        unsigned int track; // 0 for the render thread, 1 + worker index for shared pool workers.
+        int depth;          // Nesting within the track.
+        double start;       // Seconds since initialization. GPU events use the time their commands were issued.
+        double duration;    // Seconds. Negative while a GPU result is pending, or if it was lost.
+    };
+
+    struct FrameRecord
+    {
+        unsigned long long frame;
+        double start, duration;
+        std::vector<Event> events;
+    };
+
+    static const int FRAME_HISTORY = 240;
+    static const int QUERY_LATENCY = 4;
+    static const int MAX_GPU_SCOPES = 16; // Per frame; further GPU scopes are not timed.
+
+private:
+    static Profiler *m_pProfiler;
+
+    struct PendingQuery
+    {
+        unsigned long long frame;
+        size_t event;
+    };
+
+    double startTime;
+    unsigned long long frame;
+    std::vector<FrameRecord> records; // Ring indexed by frame % FRAME_HISTORY.
+    std::mutex recordMutex;
+
+    GLuint queries[QUERY_LATENCY][MAX_GPU_SCOPES];
+    PendingQuery pending[QUERY_LATENCY][MAX_GPU_SCOPES];
+    int pendingCount[QUERY_LATENCY];
+    bool gpuScopeOpen;
+
+    // Overlay geometry, rebuilt each time it is drawn.
+    bool overlayVisible;
+    GLuint overlayVao, overlayBuffer;
+    std::vector<float> overlayVertices;
+
+    Profiler();
+    ~Profiler();
+
+    FrameRecord& Record(unsigned long long frame);
+    void CollectQueries(int set);
+    void AddRectangle(float left, float bottom, float right, float top, const float color[3], int width, int height);
+
+public:
+    // Seconds since initialization.
+    double Now() const;
+
+    // Brackets a frame on the render thread. Scopes closed outside a frame count toward the next one.
+    void BeginFrame();
+    void EndFrame();
+
+    // Used by ProfileScope and GpuProfileScope.
+    void AddCpuEvent(const char* pName, int depth, double start, double end);
+    int BeginGpuEvent(const char* pName);
+    void EndGpuEvent(int query);
+
+    // A completed frame, age frames before the last one ended (0 is the most recent), or NULL if it was not recorded.
+    const FrameRecord* CompletedFrame(int age) const;
+
+    // Averages each named scope over the recorded frames and prints them to the console.
+    void PrintSummary();
+
+    void SetOverlayVisible(bool visible);
+    bool OverlayVisible() const;
+
+    // Draws the recorded frames as stacked CPU and GPU bars along the bottom of the screen.
+    // The render thread's top-level scopes are stacked in order; a line marks the frame budget.
+    void DrawOverlay(int width, int height);
+
+    // Writes the recorded frames as Chrome trace events (chrome://tracing, Perfetto).
+    bool ExportTrace(const std::string& filename);
+
+    // Requires a current OpenGL context.
+    static bool Initialize();
+    static Profiler* GetProfiler();
+    static bool Deinitialize();
+};
+
+// Times the enclosing block on the CPU.
+class ProfileScope
+{
+    const char *pName;
+    double start;
+    int depth;
+
+public:
+    ProfileScope(const char* pName);
+    ~ProfileScope();
+};
+
+// Times the GL commands issued in the enclosing block. GPU scopes cannot nest; inner ones are ignored.
+class GpuProfileScope
+{
+    int query;
+
+public:
+    GpuProfileScope(const char* pName);
+    ~GpuProfileScope();
+};
@@ -19,8 +19,16 @@
 #include "stdafx.h"
 #include "Rcsgedit.h"
 #include "GLManager.h"
+#include "FrameArena.h"
 #include "InputSystem.h"
+#include "MeshExport.h"
+#include "MeshImport.h"
+#include "Profiler.h"
+#include "ToolpathGenerator.h"
+#include "ShaderCache.h"
+#include "ThreadPool.h"
 #include "Vertex.h"
+#include <algorithm>
 
 // OpenGL libraries
 #pragma comment(lib, "opengl32")
@@ -34,7 +42,12 @@
 
 const char* Rcsgedit::NAME = "RCSG-Edit v1.0";
 
+// Triplanar texture repeats per unit on the edited part.
+static const float PART_TEXTURE_SCALE = 2.0f;
+
 Rcsgedit::Rcsgedit()
+    : renderVariants("render"), meshFeatures(SHADER_TRIPLANAR), importOffset(1.5f), imageCsgAvailable(false), overlayKeyDown(false),
+      traceKeyDown(false), exportKeyDown(false), toolpathKeyDown(false)
 {}
 
 // Performs OpenGL window initialization.
@@ -142,25 +155,142 @@ bool Rcsgedit::ApplicationSetup()
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(colorVertex), (GLvoid*)offsetof(colorVertex, r));
     glEnableVertexAttribArray(1);
 
-    boringProgram = GLManager::GetManager()->CompileShaderProgram("render");
-    mv_location = glGetUniformLocation(boringProgram, "mv_matrix");
-    proj_location = glGetUniformLocation(boringProgram, "proj_matrix");
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    indexCount = 0;
+
+    // Every program starts compiling now and is only waited on at first draw.
+    ShaderCache::Initialize("shaders", "shadercache", pWindow);
+    // Only the variants that get drawn are compiled; generated meshes have neither normals nor texture coordinates,
+    // so they are textured by triplanar mapping, or left untextured until their material's texture is ready.
+    renderVariants.Request(meshFeatures);
+    renderVariants.Request(meshFeatures & ~SHADER_TRIPLANAR);
+
+    // F3 shows the frame time overlay, F4 writes a trace of the recorded frames. F5 exports the part, F6 its toolpaths.
+    Profiler::Initialize();
+
+    // Per-frame and per-draw shader data.
+    pUniformRing.reset(new BufferRing(GL_UNIFORM_BUFFER, UNIFORM_RING_SIZE));
+    if (!pUniformRing->Initialize())
+    {
+        std::cout << "Failed to create the uniform buffer ring!" << std::endl;
+        return false;
+    }
+
+    pRenderQueue.reset(new RenderQueue(pUniformRing.get()));
+
+    // Encoded textures are cached on disk like shader binaries.
+    pTextures.reset(new TextureManager("texturecache"));
+    if (!pTextures->Initialize())
+    {
+        return false;
+    }
+
+    pStreamer.reset(new TextureStreamer(pTextures.get(), TEXTURE_BUDGET));
+
+    pAssembly.reset(new AssemblyRenderer(pUniformRing.get()));
+    if (!pAssembly->Initialize())
+    {
+        pAssembly.reset();
+    }
+
+    pCsgRenderer.reset(new ImageCsgRenderer(pUniformRing.get()));
+    if (!pCsgRenderer->Initialize(GLManager::GetManager()->width, GLManager::GetManager()->height))
+    {
+        std::cout << "Failed to initialize image-space CSG rendering!" << std::endl;
+        return false;
+    }
+
+    ThreadPool::Initialize();
+    FrameArena::Initialize(FRAME_ARENA_SIZE);
+
+    // The example part's material, baked on the pool as the part needs it.
+    const float lightWood[3] = { 0.78f, 0.6f, 0.4f }, darkWood[3] = { 0.45f, 0.3f, 0.16f };
+    pStreamer->Register(0, MaterialGraph::Wood(lightWood, darkWood, 12.0f, 1));
+
+    // Example part: a drilled plate with a filleted boss, previewed through its distance field.
+    pCsgRoot = CsgNode::Combine(CSG_UNION,
+        CsgNode::Box(gm::vec3(0.0f, 0.0f, 0.0f), gm::vec3(1.0f, 0.1f, 0.6f), gm::vec3(0.6f, 0.6f, 0.65f)),
+        CsgNode::Cylinder(gm::vec3(0.0f, 0.3f, 0.0f), 0.3f, 0.3f, gm::vec3(0.8f, 0.5f, 0.2f)), 0.1f);
+    pCsgRoot = CsgNode::Combine(CSG_DIFFERENCE, std::move(pCsgRoot),
+        CsgNode::Cylinder(gm::vec3(-0.7f, 0.0f, 0.0f), 0.15f, 0.5f, gm::vec3(0.0f, 0.0f, 0.0f)), 0.0f);
+    pCsgRoot = CsgNode::Combine(CSG_DIFFERENCE, std::move(pCsgRoot),
+        CsgNode::Cylinder(gm::vec3(0.7f, 0.0f, 0.0f), 0.15f, 0.5f, gm::vec3(0.0f, 0.0f, 0.0f)), 0.0f);
+
+    pPreview.reset(new PreviewPipeline(ThreadPool::GetPool(), 5, 8));
+    CsgTreeEdited();
 
     return true;
 }
 
+bool Rcsgedit::ImportPart(const std::string& filename)
+{
+    if (!pAssembly)
+    {
+        std::cout << "Cannot show " << filename << " without multi-draw indirect support!" << std::endl;
+        return false;
+    }
+
+    Mesh mesh;
+    MeshImporter importer(ThreadPool::GetPool());
+    if (!importer.Load(filename, mesh))
+    {
+        return false;
+    }
+
+    float min[3], max[3];
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = max[i] = (&mesh.vertices[0].x)[i];
+    }
+
+    for (size_t v = 1; v < mesh.vertices.size(); v++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            min[i] = std::min(min[i], (&mesh.vertices[v].x)[i]);
+            max[i] = std::max(max[i], (&mesh.vertices[v].x)[i]);
+        }
+    }
+
+    // Parts sit on the ground plane in a row along x, centered in z, with a tenth of their width between them.
+    float transform[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    transform[12] = importOffset - min[0];
+    transform[13] = -min[1];
+    transform[14] = -0.5f * (min[2] + max[2]);
+    importOffset += 1.1f * (max[0] - min[0]);
+
+    pAssembly->AddInstance(pAssembly->AddPart(mesh), transform);
+    std::cout << "Imported " << mesh.TriangleCount() << " triangles from " << filename << "." << std::endl;
+    return true;
+}
+
 Rcsgedit::~Rcsgedit()
 {
     // Application shutdown.
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(1, &pointBuffer);
-
-    glDeleteProgram(boringProgram);
+    glDeleteBuffers(1, &indexBuffer);
+
+    pCsgRenderer.reset();
+    pAssembly.reset();
+    pStreamer.reset();
+    pTextures.reset();
+    pRenderQueue.reset();
+    pUniformRing.reset();
+
+    // Cancel any background meshing before the pool waits on it. The pool is joined while the profiler is still
+    // alive, as a cancelled job only stops at its next check and still closes its profile scope.
+    pPreview.reset();
+    ThreadPool::Deinitialize();
+    Profiler::Deinitialize();
+    ShaderCache::Deinitialize();
 
     // Close down GLFW
     glfwDestroyWindow(pWindow);
     glfwTerminate();
 
+    FrameArena::Deinitialize();
 }
 
 // Sets up the drawing viewport so we don't get a weird squished display.
@@ -171,98 +301,301 @@ void Rcsgedit::SetupViewport()
     aspect = (float)pM->width/ (float)pM->height;
     proj_matrix = gm::Perspective(GLManager::FOV_Y, aspect, GLManager::NEAR_PLANE, GLManager::FAR_PLANE);
     glViewport(0, 0, pM->width, pM->height);
+
+    if (pCsgRenderer)
+    {
+        pCsgRenderer->Resize(pM->width, pM->height);
+    }
 }
 
-void Rcsgedit::Render(double currentTime)
+// Replaces the displayed geometry.
+void Rcsgedit::UploadMesh(const Mesh& mesh)
 {
-    // Drop in the OpenGL data (every-single-frame) just to verify that I still know how to do this.
-    colorVertex *pVertices = new colorVertex[36];
-    pVertices[0].Set(-0.25f,  0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[1].Set(-0.25f, -0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[2].Set(0.25f, -0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-        
-    pVertices[3].Set(0.25f, -0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[4].Set(0.25f,  0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[5].Set(-0.25f,  0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-
-    pVertices[6].Set(0.25f, -0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[7].Set(0.25f, -0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[8].Set(0.25f,  0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-
-    pVertices[9].Set(0.25f, -0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[10].Set(0.25f,  0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[11].Set(0.25f,  0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-
-    pVertices[12].Set(0.25f, -0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[13].Set(-0.25f, -0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[14].Set(0.25f,  0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-
-    pVertices[15].Set(-0.25f, -0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[16].Set(-0.25f,  0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[17].Set(0.25f,  0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-
-    pVertices[18].Set(-0.25f, -0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[19].Set(-0.25f, -0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[20].Set(-0.25f,  0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-
-    pVertices[21].Set(-0.25f, -0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[22].Set(-0.25f,  0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[23].Set(-0.25f,  0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-
-    pVertices[24].Set(-0.25f, -0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[25].Set(0.25f, -0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[26].Set(0.25f, -0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-
-    pVertices[27].Set(0.25f, -0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[28].Set(-0.25f, -0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[29].Set(-0.25f, -0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-
-    pVertices[30].Set(-0.25f,  0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[31].Set(0.25f,  0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[32].Set(0.25f,  0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-
-    pVertices[33].Set(0.25f,  0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[34].Set(-0.25f,  0.25f,  0.25f, 0.25f,  0.25f, 0.25f);
-    pVertices[35].Set(-0.25f,  0.25f, -0.25f, 0.25f,  0.25f, 0.25f);
-    vertexCount = 36;
-    glBufferData(GL_ARRAY_BUFFER, vertexCount*sizeof(colorVertex), pVertices, GL_DYNAMIC_DRAW);
-
-    delete [] pVertices;
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, pointBuffer);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size()*sizeof(colorVertex), mesh.vertices.empty() ? NULL : &mesh.vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size()*sizeof(unsigned int), mesh.indices.empty() ? NULL : &mesh.indices[0], GL_STATIC_DRAW);
+    indexCount = (GLsizei)mesh.indices.size();
+}
 
+// Shows a coarse mesh of the edited tree immediately; the fine mesh follows from the background.
+void Rcsgedit::CsgTreeEdited()
+{
+    pPreview->Submit(*pCsgRoot, partMesh);
+    UploadMesh(partMesh);
+
+    imageCsgAvailable = pCsgRenderer->SetTree(*pCsgRoot);
+
+    // Bounding sphere, for how large the part appears on screen.
+    float min[3], max[3];
+    pCsgRoot->Bounds(min, max);
+    partRadius = 0.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        partCenter[i] = 0.5f * (min[i] + max[i]);
+        partRadius += 0.25f * (max[i] - min[i]) * (max[i] - min[i]);
+    }
+
+    partRadius = sqrtf(partRadius);
+}
+
+// Camera and model rotation at a point in time.
+void Rcsgedit::FrameMatrices(double time, gm::mat4& projection, gm::mat4& modelView)
+{
     lookAt = gm::Lookat(gm::vec3(0, 0, 0), gm::vec3(0, 0, 6), gm::vec3(0, 1, 0));
-    glUseProgram(boringProgram);
+    projection = proj_matrix*lookAt;
+    modelView = gm::Rotate((float)time/5.0f, gm::vec3(0.0f, 1.0f, 0.0f));
+}
 
+void Rcsgedit::Render(double currentTime)
+{
     const GLfloat  color[] = {0, 0, 0, 1};
     const GLfloat  one = 1.0f;
     glClearBufferfv(GL_COLOR, 0, color);
     glClearBufferfv(GL_DEPTH, 0, &one);
 
-    gm::mat4 result = proj_matrix*lookAt;
-    glUniformMatrix4fv(proj_location, 1, GL_FALSE, result);
+    gm::mat4 result, mv_matrix;
+    FrameMatrices(currentTime, result, mv_matrix);
 
-    for (int i = 0; i < 1; i++)
+    // The coarse mesh is only shown if the tree cannot be drawn in image space.
+    if (pPreview->IsRefining() && imageCsgAvailable)
+    {
+        ProfileScope scope("Image CSG");
+        GpuProfileScope gpuScope("Image CSG");
+        pCsgRenderer->Render(result, mv_matrix);
+    }
+    else
     {
-        for (int j = 0; j < 1; j++)
+        ProfileScope scope("Part");
+        GpuProfileScope gpuScope("Part");
+
+        DrawPacket packet;
+        packet.vao = vao;
+        packet.texture = 0;
+        packet.textureLayer = 0;
+        packet.textureScale = PART_TEXTURE_SCALE;
+        packet.indexCount = indexCount;
+        packet.material = 0;
+
+        // The material's texture is streamed in at the detail the part is seen at. With triplanar mapping the
+        // texture repeats across the part, so each repeat covers a fraction of the part's size on screen.
+        unsigned int features = meshFeatures;
+        TextureSlot slot;
+        if (features & (SHADER_TEXTURED | SHADER_TRIPLANAR))
         {
-            for (int k = 0; k < 1; k++)
+            gm::mat4 view = lookAt*mv_matrix;
+            float viewCenter[3];
+            for (int i = 0; i < 3; i++)
+            {
+                viewCenter[i] = view[0][i]*partCenter[0] + view[1][i]*partCenter[1] + view[2][i]*partCenter[2] + view[3][i];
+            }
+
+            float pixels = TextureStreamer::ProjectedSize(proj_matrix, viewCenter, partRadius, GLManager::GetManager()->height);
+            if (features & SHADER_TRIPLANAR)
+            {
+                pixels /= 2.0f*partRadius*PART_TEXTURE_SCALE;
+            }
+
+            pStreamer->RequestSize(packet.material, pixels);
+
+            // Until the material's first levels arrive the part is drawn untextured.
+            if (pTextures->GetSlot(packet.material, slot))
             {
-                gm::mat4 mv_matrix = gm::Rotate((float)currentTime/5.0f, gm::vec3(0.0f, 1.0f, 0.0f));
-                glUniformMatrix4fv(mv_location, 1, GL_FALSE, mv_matrix);
-                glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, 100);
+                packet.texture = slot.texture;
+                packet.textureLayer = slot.layer;
             }
+            else
+            {
+                features &= ~(SHADER_TEXTURED | SHADER_TRIPLANAR);
+            }
+        }
+
+        // Waits for the shader the first time it is drawn with.
+        boringProgram = renderVariants.Get(features);
+
+        // The previewed part is centered on the origin, so it sorts at a fixed depth.
+        packet.key = RenderQueue::MakeKey(RENDER_PASS_OPAQUE, boringProgram, 0, vao, 0.5f);
+        packet.program = boringProgram;
+
+        const float* pModelView = mv_matrix;
+        std::copy(pModelView, pModelView + 16, packet.modelView);
+        pRenderQueue->Push(packet);
+
+        pRenderQueue->Submit(result);
+    }
+
+    // Placed parts, culled while the previous frame was submitted. Drawn last, as the image-space
+    // preview replaces the whole color buffer.
+    if (pAssembly)
+    {
+        ProfileScope scope("Assembly");
+        GpuProfileScope gpuScope("Assembly");
+        pAssembly->Draw(result, mv_matrix);
+    }
+}
+
+// Toggles the profiler overlay and writes traces on key presses.
+void Rcsgedit::HandleProfilerKeys()
+{
+    Profiler *pProfiler = Profiler::GetProfiler();
+    bool overlayKey = glfwGetKey(pWindow, GLFW_KEY_F3) == GLFW_PRESS;
+    if (overlayKey && !overlayKeyDown)
+    {
+        pProfiler->SetOverlayVisible(!pProfiler->OverlayVisible());
+        if (pProfiler->OverlayVisible())
+        {
+            pProfiler->PrintSummary();
+            PrintRenderStatistics();
+        }
+    }
+
+    bool traceKey = glfwGetKey(pWindow, GLFW_KEY_F4) == GLFW_PRESS;
+    if (traceKey && !traceKeyDown)
+    {
+        pProfiler->PrintSummary();
+        PrintRenderStatistics();
+        pProfiler->ExportTrace("profile.json");
+    }
+
+    overlayKeyDown = overlayKey;
+    traceKeyDown = traceKey;
+}
+
+// How well the last frame's draws batched, printed with the profile summary.
+void Rcsgedit::PrintRenderStatistics() const
+{
+    const RenderQueue::Statistics& statistics = pRenderQueue->GetStatistics();
+    std::cout << "Render queue: " << statistics.draws << " draws, " << statistics.programSwitches << " program switches, "
+        << statistics.bufferBinds << " buffer binds, " << statistics.textureBinds << " texture binds" << std::endl;
+    if (pAssembly)
+    {
+        const AssemblyRenderer::Statistics& assembly = pAssembly->GetStatistics();
+        std::cout << "Assembly: " << assembly.visibleInstances << " visible instances in " << assembly.commands << " commands, "
+            << assembly.apiCalls << " API calls, " << assembly.streamedBytes << " bytes streamed" << std::endl;
+    }
+}
+
+// Writes the part for printing, or toolpaths for milling it, on key presses.
+void Rcsgedit::HandleExportKeys()
+{
+    bool exportKey = glfwGetKey(pWindow, GLFW_KEY_F5) == GLFW_PRESS;
+    bool toolpathKey = glfwGetKey(pWindow, GLFW_KEY_F6) == GLFW_PRESS;
+    if (((exportKey && !exportKeyDown) || (toolpathKey && !toolpathKeyDown)) && pPreview->IsRefining())
+    {
+        std::cout << "Exporting the coarse preview; the fine mesh is not ready yet." << std::endl;
+    }
+
+    if (exportKey && !exportKeyDown)
+    {
+        MeshExporter exporter(ThreadPool::GetPool());
+        if (exporter.WriteStl(partMesh, "part.stl") && exporter.Write3mf(partMesh, "part.3mf"))
+        {
+            std::cout << "Wrote " << partMesh.TriangleCount() << " triangles to part.stl and part.3mf." << std::endl;
+        }
+    }
+
+    if (toolpathKey && !toolpathKeyDown && pToolpathJob)
+    {
+        std::cout << "Still generating the previous toolpaths." << std::endl;
+    }
+    else if (toolpathKey && !toolpathKeyDown)
+    {
+        std::shared_ptr<ToolpathJob> pJob(new ToolpathJob());
+        pJob->finished = false;
+        pJob->mesh = partMesh;
+        pJob->layerCount = 0;
+        pJob->written = false;
+        pToolpathJob = pJob;
+
+        ThreadPool *pPool = ThreadPool::GetPool();
+        pPool->Enqueue([pJob, pPool]()
+        {
+            ProfileScope scope("Toolpaths");
+            ToolpathGenerator generator(pPool, ToolpathSettings());
+            std::vector<ToolpathLayer> toolpath;
+            generator.Generate(pJob->mesh, toolpath);
+            pJob->layerCount = toolpath.size();
+            pJob->written = generator.WriteGcode(toolpath, "part.nc");
+            pJob->finished = true;
+        });
+    }
+
+    // Reported from the frame loop once the job is done.
+    if (pToolpathJob && pToolpathJob->finished)
+    {
+        if (pToolpathJob->written)
+        {
+            std::cout << "Wrote " << pToolpathJob->layerCount << " layers of toolpaths to part.nc." << std::endl;
         }
+
+        pToolpathJob.reset();
     }
+
+    exportKeyDown = exportKey;
+    toolpathKeyDown = toolpathKey;
 }
 
 bool Rcsgedit::RenderLoop()
 {
     double timeDelta = 1.0f/(double)GLManager::FPS_TARGET;
     double lastTime = (double)glfwGetTime();
+    double frameTime = lastTime;
+    gm::mat4 projection, modelView;
+    if (pAssembly)
+    {
+        FrameMatrices(frameTime, projection, modelView);
+        pAssembly->BeginCull(ThreadPool::GetPool(), projection, modelView);
+    }
+
+    Profiler *pProfiler = Profiler::GetProfiler();
     while (GLManager::GetManager()->running)
     {
+        pProfiler->BeginFrame();
+
+        // Pick up edited shaders.
+        {
+            ProfileScope scope("Shader reload");
+            ShaderCache::GetCache()->Update();
+        }
+
+        // Swap in the full-quality preview once it is ready.
+        if (pPreview->TakeFineMesh(partMesh))
+        {
+            ProfileScope scope("Upload");
+            UploadMesh(partMesh);
+        }
+
+        // Culling of the next frame, at its predicted time, overlaps submitting this one.
+        double nextFrameTime = frameTime + std::max(timeDelta, 1.0/(double)GLManager::FPS_TARGET);
+        if (pAssembly)
+        {
+            ProfileScope scope("Wait for cull");
+            pAssembly->FinishCull();
+        }
+
+        // Nothing allocated during the last frame is in use any more.
+        FrameArena::ResetAll();
+        if (pAssembly)
+        {
+            FrameMatrices(nextFrameTime, projection, modelView);
+            pAssembly->BeginCull(ThreadPool::GetPool(), projection, modelView);
+        }
+
         // Draw and swap buffers
-        Render(glfwGetTime());
-        glfwSwapBuffers(pWindow);
+        pUniformRing->BeginFrame();
+        Render(frameTime);
+        pUniformRing->EndFrame();
+        {
+            ProfileScope scope("Texture streaming");
+            pStreamer->Update();
+        }
+
+        pProfiler->DrawOverlay(GLManager::GetManager()->width, GLManager::GetManager()->height);
+        {
+            ProfileScope scope("Swap");
+            glfwSwapBuffers(pWindow);
+        }
        
         // Handle events.
         glfwPollEvents();
@@ -271,6 +604,9 @@ bool Rcsgedit::RenderLoop()
             GLManager::GetManager()->running = false;
         }
 
+        HandleProfilerKeys();
+        HandleExportKeys();
+
         if (InputSystem::ResizeEvent(GLManager::GetManager()->width, GLManager::GetManager()->height))
         {
             SetupViewport();
@@ -279,6 +615,8 @@ bool Rcsgedit::RenderLoop()
         // Update timer and try to sleep for the FPS Target.
         timeDelta = (double)glfwGetTime() - lastTime;
         lastTime  = (double)glfwGetTime();
+        frameTime = nextFrameTime;
+        pProfiler->EndFrame();
 
         std::chrono::milliseconds sleepTime ((int)(1.0/(double)GLManager::FPS_TARGET - 1000*timeDelta));
         if (sleepTime > std::chrono::milliseconds(0))
@@ -304,6 +642,13 @@ int main(int argc, char* argv [])
             std::cout << std::endl << "Error initializing Rcsg-edit!" << std::endl;
             break;
         }
+
+        // Meshes named on the command line are placed beside the example part.
+        for (int i = 1; i < argc; i++)
+        {
+            rcsgEdit->ImportPart(argv[i]);
+        }
+
         runStatus = rcsgEdit->RenderLoop();
     } while (false);
 
@@ -19,6 +19,16 @@
 #pragma once
 
 #include "stdafx.h"
+#include "AssemblyRenderer.h"
+#include "BufferRing.h"
+#include "CsgTree.h"
+#include "ImageCsgRenderer.h"
+#include "Mesh.h"
+#include "PreviewPipeline.h"
+#include "RenderQueue.h"
+#include "ShaderCache.h"
+#include "TextureManager.h"
+#include "TextureStreamer.h"
 
 // Main program entry point
 // This program is structured around the game model, with a continually-updating display.
@@ -30,25 +40,73 @@ class Rcsgedit
     gm::mat4 proj_matrix, lookAt;
 
     // Application drawing data
+    ShaderVariants renderVariants;
+    unsigned int meshFeatures; // Shader features the displayed mesh needs.
     GLuint boringProgram;
     GLuint vao;
     
     // Veretx information
     GLuint pointBuffer;
-    GLsizei vertexCount;
+    GLuint indexBuffer;
+    GLsizei indexCount;
+    static const int UNIFORM_RING_SIZE = 1 << 22; // Bytes of uniform data a frame can stream.
+    static const int FRAME_ARENA_SIZE = 1 << 20;  // Initial per-thread transient memory; grows to fit.
+    static const int TEXTURE_BUDGET = 256 << 20;  // Bytes of streamed texture levels kept resident.
+    std::unique_ptr<BufferRing> pUniformRing;
+    std::unique_ptr<RenderQueue> pRenderQueue;
 
-    // Transfered to the shader program.
-    GLint mv_location, proj_location;
+    // Material textures, packed into a few array textures and streamed in by on-screen size.
+    std::unique_ptr<TextureManager> pTextures;
+    std::unique_ptr<TextureStreamer> pStreamer;
+
+    // The part being edited and its previewed surface.
+    std::unique_ptr<CsgNode> pCsgRoot;
+    std::unique_ptr<PreviewPipeline> pPreview;
+    Mesh partMesh; // Latest preview mesh, kept for export.
+    float partCenter[3], partRadius;
+
+    // Placed parts, culled on the thread pool one frame ahead of drawing. NULL without multi-draw indirect.
+    std::unique_ptr<AssemblyRenderer> pAssembly;
+    float importOffset; // Where along x the next imported part goes.
+
+    // Draws the tree straight from its primitives while the preview mesh is refined.
+    std::unique_ptr<ImageCsgRenderer> pCsgRenderer;
+    bool imageCsgAvailable;
+
+    // Toolpaths are generated on the pool from a copy of the part, as large parts take a while.
+    struct ToolpathJob
+    {
+        std::atomic<bool> finished;
+        Mesh mesh;
+        size_t layerCount;
+        bool written;
+    };
+
+    std::shared_ptr<ToolpathJob> pToolpathJob;
+
+    // Profiler key states, to act once per press.
+    bool overlayKeyDown, traceKeyDown;
+    bool exportKeyDown, toolpathKeyDown;
     
     void SetupViewport();
     bool WindowInitialization();
+    void UploadMesh(const Mesh& mesh);
+    void CsgTreeEdited();
+    void FrameMatrices(double time, gm::mat4& projection, gm::mat4& modelView);
     void Render(double);
+    void HandleProfilerKeys();
+    void PrintRenderStatistics() const;
+    void HandleExportKeys();
 
 public:
     static const char* NAME;
 
     Rcsgedit();
     bool ApplicationSetup();
+
+    // Loads an OBJ, STL or PLY file and places it in the assembly beside the previous parts.
+    bool ImportPart(const std::string& filename);
+
     bool RenderLoop();
     ~Rcsgedit();
 };
\ No newline at end of file
@@ -0,0 +1,387 @@
+/*--------------------------------------------------------------------------
+    RenderBenchmark.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "AssemblyRenderer.h"
+#include "Benchmark.h"
+#include "BufferRing.h"
+#include "CsgTree.h"
+#include "FrameArena.h"
+#include "GLManager.h"
+#include "ShaderCache.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// Headless rendering benchmark. Draws procedurally generated assemblies along a scripted camera path into an
+// offscreen framebuffer and writes frame time percentiles, draw counts and memory use as JSON.
+//
+//   Rcsg-bench [--frames N] [--case parts,depth]... [--output file.json]
+//
+// Without --case, the canned assemblies of 1k, 10k and 100k parts are run at shallow and deep nesting.
+// Scenes and camera paths are generated from fixed seeds, so runs are comparable between versions and machines.
+
+// OpenGL libraries
+#pragma comment(lib, "opengl32")
+#pragma comment(lib, "lib/glfw3dll.lib")
+
+#ifndef _DEBUG
+#pragma comment(lib, "lib/glew32.lib")
+#else
+#pragma comment(lib, "lib/glew32d.lib")
+#endif
+
+static const int BENCHMARK_WIDTH = 1280, BENCHMARK_HEIGHT = 720;
+static const int DEFAULT_FRAMES = 600;
+static const int WARMUP_FRAMES = 30; // Not measured; covers shader compilation and the first geometry upload.
+static const int UNIFORM_RING_SIZE = 1 << 22;
+static const int FRAME_ARENA_SIZE = 1 << 20;
+static const float LOD_DISTANCE = 40.0f;
+
+struct BenchmarkCase
+{
+    int parts;
+    int depth; // Levels of groups above the parts; 0 places every part at the root.
+};
+
+static const int CANNED_CASE_COUNT = 6;
+static const BenchmarkCase CANNED_CASES[CANNED_CASE_COUNT] =
+{
+    { 1000, 1 }, { 1000, 3 }, { 10000, 1 }, { 10000, 4 }, { 100000, 2 }, { 100000, 5 }
+};
+
+struct CaseResult
+{
+    BenchmarkCase benchmarkCase;
+    size_t nodes;
+    std::vector<double> frameTimes, cullTimes, drawTimes;
+    double visibleInstances, commands, apiCalls; // Per-frame averages.
+    size_t maxStreamedBytes, geometryBytes, frameArenaBytes, peakMemory;
+};
+
+// Creates a hidden window for its context; nothing is ever shown or swapped.
+static GLFWwindow* CreateContext()
+{
+    if (!glfwInit())
+    {
+        std::cout << "GLFW initialization failure!" << std::endl;
+        return NULL;
+    }
+
+    glfwDefaultWindowHints();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, GLManager::OPENGL_MAJOR);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, GLManager::OPENGL_MINOR);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+
+    GLFWwindow *pWindow = glfwCreateWindow(BENCHMARK_WIDTH, BENCHMARK_HEIGHT, "Rcsg-bench", NULL, NULL);
+    if (pWindow == NULL)
+    {
+        std::cout << "GLFW window creation failure!" << std::endl;
+        return NULL;
+    }
+
+    glfwMakeContextCurrent(pWindow);
+    glewExperimental = GL_TRUE;
+    GLenum err = glewInit();
+    if (err != GLEW_OK)
+    {
+        std::cout << "GLEW initialization failure: " << glewGetErrorString(err) << std::endl;
+        return NULL;
+    }
+
+    return pWindow;
+}
+
+// Fixed-size render target, so results do not depend on the desktop or window manager.
+static bool CreateRenderTarget(GLuint& framebuffer, GLuint renderbuffers[2])
+{
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+// A small part library: each primitive at full detail, drawing a coarse version beyond LOD_DISTANCE.
+static void AddParts(AssemblyRenderer& assembly, std::vector<int>& parts)
+{
+    std::unique_ptr<CsgNode> primitives[3];
+    primitives[0] = CsgNode::Sphere(gm::vec3(0.0f, 0.0f, 0.0f), 0.5f, gm::vec3(0.8f, 0.3f, 0.3f));
+    primitives[1] = CsgNode::Box(gm::vec3(0.0f, 0.0f, 0.0f), gm::vec3(0.5f, 0.3f, 0.4f), gm::vec3(0.3f, 0.6f, 0.8f));
+    primitives[2] = CsgNode::Cylinder(gm::vec3(0.0f, 0.0f, 0.0f), 0.3f, 0.6f, gm::vec3(0.6f, 0.6f, 0.3f));
+
+    Mesh mesh;
+    for (int i = 0; i < 3; i++)
+    {
+        primitives[i]->Tessellate(32, mesh);
+        int fine = assembly.AddPart(mesh);
+        primitives[i]->Tessellate(8, mesh);
+        int coarse = assembly.AddPart(mesh);
+
+        assembly.SetLod(fine, coarse, LOD_DISTANCE);
+        parts.push_back(fine);
+    }
+}
+
+// Spreads count parts over groups nested 'levels' deep below parent, within a cube of the given half-size.
+static void AddGroups(AssemblyRenderer& assembly, const std::vector<int>& parts, int parent, int count, int levels, int branching,
+    float halfSize, BenchmarkRandom& random)
+{
+    if (levels == 0)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            gm::vec3 position(random.Range(-halfSize, halfSize), random.Range(-halfSize, halfSize), random.Range(-halfSize, halfSize));
+            float angle = random.Range(0.0f, 6.2831853f);
+            float scale = random.Range(0.5f, 1.5f);
+            gm::mat4 transform = gm::Translate(position) * gm::Rotate(angle, gm::vec3(0.0f, 1.0f, 0.0f)) * gm::Scale(gm::vec3(scale, scale, scale));
+            assembly.AddInstance(parts[random.Next() % parts.size()], transform, parent);
+        }
+
+        return;
+    }
+
+    // Children share the parent's volume, so every level of a case covers the same space.
+    int children = std::min(branching, count);
+    float childHalfSize = halfSize / powf((float)children, 1.0f / 3.0f);
+    for (int i = 0; i < children; i++)
+    {
+        int childCount = count / children + (i < count % children ? 1 : 0);
+        float spread = halfSize - childHalfSize;
+        gm::vec3 position(random.Range(-spread, spread), random.Range(-spread, spread), random.Range(-spread, spread));
+        gm::mat4 transform = gm::Translate(position);
+        int group = assembly.AddGroup(transform, parent);
+        AddGroups(assembly, parts, group, childCount, levels - 1, branching, childHalfSize, random);
+    }
+}
+
+// Half-size of the cube an assembly of this many parts fills, at about one part per 8 cubic units.
+static float AssemblyHalfSize(int parts)
+{
+    return powf((float)parts, 1.0f / 3.0f);
+}
+
+// Builds a case's assembly; the same case always produces the same scene.
+static void BuildAssembly(AssemblyRenderer& assembly, const BenchmarkCase& benchmarkCase)
+{
+    assembly.Clear();
+    std::vector<int> parts;
+    AddParts(assembly, parts);
+
+    // Enough groups per level for the deepest level to hold a similar number of parts.
+    int branching = std::max(2, (int)ceilf(powf((float)benchmarkCase.parts, 1.0f / (float)(benchmarkCase.depth + 1))));
+    BenchmarkRandom random(1234567u + (unsigned int)benchmarkCase.parts * 31u + (unsigned int)benchmarkCase.depth);
+    AddGroups(assembly, parts, -1, benchmarkCase.parts, benchmarkCase.depth, branching, AssemblyHalfSize(benchmarkCase.parts), random);
+}
+
+// The camera path at t in [0, 1): an orbit that swoops from well outside the assembly to skimming its center and back,
+// so each run sees everything from fully visible to heavily culled.
+static void CameraAt(float t, float halfSize, gm::mat4& projection)
+{
+    const float PI = 3.141592653589f;
+    float swoop = sinf(PI * t);
+    float distance = halfSize * (3.0f - 2.7f * swoop * swoop);
+    float angle = 2.0f * PI * t;
+    gm::vec3 camera(distance * cosf(angle), halfSize * 0.5f * sinf(2.0f * angle), distance * sinf(angle));
+
+    gm::mat4 perspective = gm::Perspective(GLManager::FOV_Y, (float)BENCHMARK_WIDTH / (float)BENCHMARK_HEIGHT, GLManager::NEAR_PLANE, GLManager::FAR_PLANE);
+    gm::mat4 lookAt = gm::Lookat(gm::vec3(0.0f, 0.0f, 0.0f), camera, gm::vec3(0.0f, 1.0f, 0.0f));
+    projection = perspective * lookAt;
+}
+
+static void RunCase(AssemblyRenderer& assembly, BufferRing& uniformRing, const BenchmarkCase& benchmarkCase, int frames, CaseResult& result)
+{
+    BuildAssembly(assembly, benchmarkCase);
+    result.benchmarkCase = benchmarkCase;
+    result.nodes = assembly.NodeCount();
+    result.visibleInstances = result.commands = result.apiCalls = 0.0;
+    result.maxStreamedBytes = 0;
+
+    // The assembly is placed in world space, so the part of the transform applied before the instances is the identity.
+    gm::mat4 view = gm::Scale(gm::vec3(1.0f, 1.0f, 1.0f));
+    gm::mat4 projection;
+    float halfSize = AssemblyHalfSize(benchmarkCase.parts);
+    const GLfloat color[] = { 0, 0, 0, 1 };
+    const GLfloat one = 1.0f;
+    for (int frame = -WARMUP_FRAMES; frame < frames; frame++)
+    {
+        CameraAt((float)std::max(frame, 0) / (float)frames, halfSize, projection);
+
+        // Culling runs on the pool, drawing waits for the GPU so each frame is measured in full.
+        double start = Benchmark::Now();
+        uniformRing.BeginFrame();
+        assembly.Cull(ThreadPool::GetPool(), projection, view);
+        double culled = Benchmark::Now();
+
+        glClearBufferfv(GL_COLOR, 0, color);
+        glClearBufferfv(GL_DEPTH, 0, &one);
+        assembly.Draw(projection, view);
+        uniformRing.EndFrame();
+        glFinish();
+        double end = Benchmark::Now();
+        FrameArena::ResetAll();
+
+        if (frame < 0)
+        {
+            continue;
+        }
+
+        result.frameTimes.push_back(end - start);
+        result.cullTimes.push_back(culled - start);
+        result.drawTimes.push_back(end - culled);
+
+        const AssemblyRenderer::Statistics& statistics = assembly.GetStatistics();
+        result.visibleInstances += (double)statistics.visibleInstances / (double)frames;
+        result.commands += (double)statistics.commands / (double)frames;
+        result.apiCalls += (double)statistics.apiCalls / (double)frames;
+        result.maxStreamedBytes = std::max(result.maxStreamedBytes, statistics.streamedBytes);
+    }
+
+    result.geometryBytes = assembly.GeometryBytes();
+    result.frameArenaBytes = FrameArena::TotalHighWater();
+    result.peakMemory = Benchmark::PeakMemory();
+}
+
+static void WriteResults(std::ostream& output, const std::vector<CaseResult>& results, int frames)
+{
+    output << "{" << std::endl;
+    output << "  \"benchmark\": \"render\"," << std::endl;
+    output << "  \"renderer\": " << Benchmark::JsonString((const char*)glGetString(GL_RENDERER)) << "," << std::endl;
+    output << "  \"width\": " << BENCHMARK_WIDTH << ", \"height\": " << BENCHMARK_HEIGHT << ", \"frames\": " << frames
+        << ", \"threads\": " << ThreadPool::GetPool()->ThreadCount() << "," << std::endl;
+    output << "  \"cases\": [" << std::endl;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const CaseResult& result = results[i];
+        output << "    {\"parts\": " << result.benchmarkCase.parts << ", \"depth\": " << result.benchmarkCase.depth << ", \"nodes\": " << result.nodes << "," << std::endl;
+        output << "     ";
+        Benchmark::WriteSummary(output, "frameMs", Benchmark::Summarize(result.frameTimes), 1000.0);
+        output << "," << std::endl << "     ";
+        Benchmark::WriteSummary(output, "cullMs", Benchmark::Summarize(result.cullTimes), 1000.0);
+        output << "," << std::endl << "     ";
+        Benchmark::WriteSummary(output, "drawMs", Benchmark::Summarize(result.drawTimes), 1000.0);
+        output << "," << std::endl;
+        output << "     \"visibleInstances\": " << result.visibleInstances << ", \"drawCommands\": " << result.commands
+            << ", \"apiCalls\": " << result.apiCalls << "," << std::endl;
+        output << "     \"geometryBytes\": " << result.geometryBytes << ", \"maxStreamedBytes\": " << result.maxStreamedBytes
+            << ", \"frameArenaBytes\": " << result.frameArenaBytes << ", \"peakMemoryBytes\": " << result.peakMemory << "}"
+            << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+
+    output << "  ]" << std::endl << "}" << std::endl;
+}
+
+int main(int argc, char* argv [])
+{
+    int frames = DEFAULT_FRAMES;
+    std::string outputFile = "render-benchmark.json";
+    std::vector<BenchmarkCase> cases;
+    for (int i = 1; i < argc; i++)
+    {
+        BenchmarkCase benchmarkCase;
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            outputFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--case") == 0 && i + 1 < argc && sscanf(argv[++i], "%d,%d", &benchmarkCase.parts, &benchmarkCase.depth) == 2
+            && benchmarkCase.parts > 0 && benchmarkCase.depth >= 0)
+        {
+            cases.push_back(benchmarkCase);
+        }
+        else
+        {
+            std::cout << "Usage: " << argv[0] << " [--frames N] [--case parts,depth]... [--output file.json]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (cases.empty())
+    {
+        cases.assign(CANNED_CASES, CANNED_CASES + CANNED_CASE_COUNT);
+    }
+
+    GLManager::Initialize(50.0f, 0.1f, 1000.0f, false, BENCHMARK_WIDTH, BENCHMARK_HEIGHT, "Rcsg-bench");
+    GLFWwindow *pWindow = CreateContext();
+    GLuint framebuffer, renderbuffers[2];
+    if (pWindow == NULL || !CreateRenderTarget(framebuffer, renderbuffers))
+    {
+        std::cout << "Failed to create an offscreen OpenGL context!" << std::endl;
+        return 1;
+    }
+
+    glViewport(0, 0, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    glEnable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+
+    ShaderCache::Initialize("shaders", "shadercache", pWindow);
+    ThreadPool::Initialize();
+    FrameArena::Initialize(FRAME_ARENA_SIZE);
+
+    int status = 0;
+    {
+        BufferRing uniformRing(GL_UNIFORM_BUFFER, UNIFORM_RING_SIZE);
+        AssemblyRenderer assembly(&uniformRing);
+        if (!uniformRing.Initialize() || !assembly.Initialize())
+        {
+            std::cout << "Assembly rendering is not supported on this system!" << std::endl;
+            status = 1;
+        }
+        else
+        {
+            std::vector<CaseResult> results(cases.size());
+            for (size_t i = 0; i < cases.size(); i++)
+            {
+                std::cout << "Rendering " << cases[i].parts << " parts at depth " << cases[i].depth << "..." << std::endl;
+                RunCase(assembly, uniformRing, cases[i], frames, results[i]);
+            }
+
+            std::ofstream output(outputFile.c_str());
+            WriteResults(output, results, frames);
+            WriteResults(std::cout, results, frames);
+            if (!output)
+            {
+                std::cout << "Could not write the results to " << outputFile << std::endl;
+                status = 1;
+            }
+        }
+    }
+
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(2, renderbuffers);
+    ShaderCache::Deinitialize();
+    ThreadPool::Deinitialize();
+    FrameArena::Deinitialize();
+    glfwDestroyWindow(pWindow);
+    glfwTerminate();
+    GLManager::Deinitialize();
+    return status;
+}
@@ -0,0 +1,171 @@
+/*--------------------------------------------------------------------------
+    RenderQueue.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "RenderQueue.h"
+#include "Profiler.h"
+#include "UniformBlocks.h"
+#include <algorithm>
+
+RenderQueue::RenderQueue(BufferRing* pUniformRing)
+    : pUniformRing(pUniformRing)
+{
+    statistics.draws = 0;
+    statistics.programSwitches = 0;
+    statistics.bufferBinds = 0;
+    statistics.textureBinds = 0;
+}
+
+unsigned long long RenderQueue::MakeKey(RenderPass pass, GLuint program, GLuint material, GLuint mesh, float depth)
+{
+    depth = std::min(std::max(depth, 0.0f), 1.0f);
+    if (pass == RENDER_PASS_TRANSPARENT)
+    {
+        depth = 1.0f - depth;
+    }
+
+    const unsigned long long ID_MASK = 0xFFF;
+    unsigned long long quantizedDepth = (unsigned long long)(depth * (float)0xFFFFFF);
+    return ((unsigned long long)pass << 60) | ((program & ID_MASK) << 48) | ((material & ID_MASK) << 36) | ((mesh & ID_MASK) << 24) | quantizedDepth;
+}
+
+void RenderQueue::Push(const DrawPacket& packet)
+{
+    packets.push_back(packet);
+}
+
+// LSD radix sort on bytes. Stable, and bytes that are equal across all keys (usually the pass and
+// high id bits) are skipped, so a typical frame takes only a few passes.
+void RenderQueue::Sort()
+{
+    ProfileScope scope("Sort");
+    entries.resize(packets.size());
+    unsigned long long differingBits = 0;
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        entries[i].key = packets[i].key;
+        entries[i].packet = (unsigned int)i;
+        differingBits |= packets[i].key ^ packets[0].key;
+    }
+
+    sortBuffer.resize(entries.size());
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        if (((differingBits >> shift) & 0xFF) == 0)
+        {
+            continue;
+        }
+
+        size_t offsets[256] = { 0 };
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            offsets[(entries[i].key >> shift) & 0xFF]++;
+        }
+
+        size_t total = 0;
+        for (int bucket = 0; bucket < 256; bucket++)
+        {
+            size_t count = offsets[bucket];
+            offsets[bucket] = total;
+            total += count;
+        }
+
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            sortBuffer[offsets[(entries[i].key >> shift) & 0xFF]++] = entries[i];
+        }
+
+        entries.swap(sortBuffer);
+    }
+}
+
+void RenderQueue::Submit(const float projection[16])
+{
+    statistics.draws = 0;
+    statistics.programSwitches = 0;
+    statistics.bufferBinds = 0;
+    statistics.textureBinds = 0;
+    if (packets.empty())
+    {
+        return;
+    }
+
+    Sort();
+
+    FrameBlock frameBlock;
+    std::copy(projection, projection + 16, frameBlock.projection);
+    GLintptr frameOffset = pUniformRing->Write(&frameBlock, sizeof(frameBlock));
+    if (frameOffset < 0)
+    {
+        packets.clear();
+        return;
+    }
+
+    pUniformRing->Bind(FRAME_BLOCK_BINDING, frameOffset, sizeof(frameBlock));
+
+    // Bindings left by other rendering are unknown, so the first packet always binds everything.
+    GLuint program = 0, vao = 0, texture = 0;
+    bool first = true;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const DrawPacket& packet = packets[entries[i].packet];
+        ObjectBlock objectBlock;
+        objectBlock.Set(packet.modelView, packet.material);
+        objectBlock.textureLayer = packet.textureLayer;
+        objectBlock.textureScale = packet.textureScale;
+        GLintptr objectOffset = pUniformRing->Write(&objectBlock, sizeof(objectBlock));
+        if (objectOffset < 0)
+        {
+            break;
+        }
+
+        if (first || packet.program != program)
+        {
+            program = packet.program;
+            glUseProgram(program);
+            statistics.programSwitches++;
+        }
+
+        if (first || packet.vao != vao)
+        {
+            vao = packet.vao;
+            glBindVertexArray(vao);
+            statistics.bufferBinds++;
+        }
+
+        if (packet.texture != 0 && (first || packet.texture != texture))
+        {
+            texture = packet.texture;
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+            statistics.textureBinds++;
+        }
+
+        first = false;
+        pUniformRing->Bind(OBJECT_BLOCK_BINDING, objectOffset, sizeof(objectBlock));
+        glDrawElements(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, 0);
+        statistics.draws++;
+    }
+
+    packets.clear();
+}
+
+const RenderQueue::Statistics& RenderQueue::GetStatistics() const
+{
+    return statistics;
+}
@@ -0,0 +1,89 @@
+/*--------------------------------------------------------------------------
+    RenderQueue.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "BufferRing.h"
+
+enum RenderPass
+{
+    RENDER_PASS_OPAQUE,      // Front to back, so early depth testing rejects hidden fragments.
+    RENDER_PASS_TRANSPARENT, // Back to front, for correct blending.
+    RENDER_PASS_OVERLAY
+};
+
+// One draw call with everything needed to issue it.
+struct DrawPacket
+{
+    unsigned long long key; // See RenderQueue::MakeKey.
+    GLuint program;
+    GLuint vao;
+    GLuint texture;         // Array texture bound to unit 0, or 0 for untextured materials.
+    unsigned int textureLayer;
+    float textureScale;     // Triplanar texture repeats per unit.
+    GLsizei indexCount;
+    unsigned int material;
+    float modelView[16];
+};
+
+// Collects the frame's draw packets and submits them sorted by a 64-bit key, so draws sharing a program,
+// material and mesh end up next to each other and redundant bindings are skipped.
+// Per-draw data goes through the uniform ring, so a draw costs one range bind rather than uniform updates.
+class RenderQueue
+{
+public:
+    struct Statistics
+    {
+        unsigned int draws;
+        unsigned int programSwitches;
+        unsigned int bufferBinds;
+        unsigned int textureBinds;
+    };
+
+private:
+    // Keys are sorted together with the index of their packet, so packets are never moved.
+    struct SortEntry
+    {
+        unsigned long long key;
+        unsigned int packet;
+    };
+
+    BufferRing *pUniformRing;
+    std::vector<DrawPacket> packets;
+    std::vector<SortEntry> entries, sortBuffer;
+    Statistics statistics;
+
+    void Sort();
+
+public:
+    RenderQueue(BufferRing* pUniformRing);
+
+    // Packs the sort key, most significant first: pass (4 bits), program (12), material (12), mesh (12), depth (24).
+    // Ids are truncated GL names, which only affects grouping. Depth is in [0, 1], near to far.
+    static unsigned long long MakeKey(RenderPass pass, GLuint program, GLuint material, GLuint mesh, float depth);
+
+    // Adds a draw to this frame. The packet's key must be filled in.
+    void Push(const DrawPacket& packet);
+
+    // Sorts and issues every pushed draw, then empties the queue.
+    void Submit(const float projection[16]);
+
+    // Counters of the last Submit.
+    const Statistics& GetStatistics() const;
+};
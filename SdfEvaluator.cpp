@@ -0,0 +1,340 @@
+/*--------------------------------------------------------------------------
+    SdfEvaluator.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "SdfEvaluator.h"
+#include <algorithm>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define SDF_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+SdfEvaluator::SdfEvaluator(const CsgNode& root)
+    : stackDepth(0)
+{
+    Compile(root, 0);
+    root.Bounds(boundsMin, boundsMax);
+}
+
+// Appends the node in postfix order, tracking how deep the evaluation stack gets.
+void SdfEvaluator::Compile(const CsgNode& node, int depth)
+{
+    Instruction instruction;
+    instruction.isPrimitive = node.isPrimitive;
+    instruction.primitive = node.primitive;
+    instruction.operation = node.operation;
+    instruction.blendRadius = node.blendRadius;
+    for (int i = 0; i < 3; i++)
+    {
+        instruction.center[i] = node.center[i];
+        instruction.size[i] = node.size[i];
+        instruction.color[i] = node.color[i];
+    }
+
+    if (node.isPrimitive)
+    {
+        stackDepth = std::max(stackDepth, depth + 1);
+    }
+    else
+    {
+        Compile(*node.pLeft, depth);
+        Compile(*node.pRight, depth + 1);
+    }
+
+    program.push_back(instruction);
+}
+
+void SdfEvaluator::Bounds(float min[3], float max[3]) const
+{
+    for (int i = 0; i < 3; i++)
+    {
+        min[i] = boundsMin[i];
+        max[i] = boundsMax[i];
+    }
+}
+
+// Scalar distance functions, used for single points and when SIMD is unavailable.
+static float PrimitiveDistance(CsgPrimitive primitive, const float center[3], const float size[3], float x, float y, float z)
+{
+    float dx = x - center[0];
+    float dy = y - center[1];
+    float dz = z - center[2];
+    switch (primitive)
+    {
+    case CSG_SPHERE:
+        return sqrtf(dx*dx + dy*dy + dz*dz) - size[0];
+    case CSG_BOX:
+    {
+        float qx = fabsf(dx) - size[0];
+        float qy = fabsf(dy) - size[1];
+        float qz = fabsf(dz) - size[2];
+        float ox = std::max(qx, 0.0f), oy = std::max(qy, 0.0f), oz = std::max(qz, 0.0f);
+        return sqrtf(ox*ox + oy*oy + oz*oz) + std::min(std::max(qx, std::max(qy, qz)), 0.0f);
+    }
+    case CSG_CYLINDER:
+    default:
+    {
+        float qr = sqrtf(dx*dx + dz*dz) - size[0];
+        float qy = fabsf(dy) - size[1];
+        float outR = std::max(qr, 0.0f), oy = std::max(qy, 0.0f);
+        return sqrtf(outR*outR + oy*oy) + std::min(std::max(qr, qy), 0.0f);
+    }
+    }
+}
+
+// Polynomial smooth minimum; h is the weight given to 'a', for blending colors.
+static float SmoothMin(float a, float b, float k, float& h)
+{
+    if (k <= 0.0f)
+    {
+        h = a < b ? 1.0f : 0.0f;
+        return std::min(a, b);
+    }
+
+    h = std::min(std::max(0.5f + 0.5f*(b - a)/k, 0.0f), 1.0f);
+    return b + (a - b)*h - k*h*(1.0f - h);
+}
+
+static float CombineDistance(CsgOperation operation, float a, float b, float k, float& h)
+{
+    switch (operation)
+    {
+    case CSG_UNION:
+        return SmoothMin(a, b, k, h);
+    case CSG_INTERSECTION:
+        return -SmoothMin(-a, -b, k, h);
+    case CSG_DIFFERENCE:
+    default:
+        return -SmoothMin(-a, b, k, h);
+    }
+}
+
+float SdfEvaluator::Evaluate(float x, float y, float z, float color[3]) const
+{
+    const int INLINE_DEPTH = 32;
+    float inlineStack[INLINE_DEPTH * 4];
+    std::vector<float> heapStack;
+    float *pStack = inlineStack;
+    if (stackDepth > INLINE_DEPTH)
+    {
+        heapStack.resize(stackDepth * 4);
+        pStack = &heapStack[0];
+    }
+
+    // Each stack entry is a distance and its color.
+    int top = 0;
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        const Instruction& instruction = program[i];
+        if (instruction.isPrimitive)
+        {
+            float *pEntry = &pStack[top*4];
+            pEntry[0] = PrimitiveDistance(instruction.primitive, instruction.center, instruction.size, x, y, z);
+            pEntry[1] = instruction.color[0];
+            pEntry[2] = instruction.color[1];
+            pEntry[3] = instruction.color[2];
+            top++;
+        }
+        else
+        {
+            top--;
+            float *pLeft = &pStack[(top - 1)*4];
+            float *pRight = &pStack[top*4];
+
+            float h;
+            pLeft[0] = CombineDistance(instruction.operation, pLeft[0], pRight[0], instruction.blendRadius, h);
+
+            // Cut faces keep the material of the part being cut.
+            if (instruction.operation != CSG_DIFFERENCE)
+            {
+                for (int j = 1; j < 4; j++)
+                {
+                    pLeft[j] = pLeft[j]*h + pRight[j]*(1.0f - h);
+                }
+            }
+        }
+    }
+
+    color[0] = pStack[1];
+    color[1] = pStack[2];
+    color[2] = pStack[3];
+    return pStack[0];
+}
+
+#ifdef SDF_USE_SSE
+static inline __m128 Abs4(__m128 v)
+{
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+static inline __m128 Negate4(__m128 v)
+{
+    return _mm_xor_ps(_mm_set1_ps(-0.0f), v);
+}
+
+static inline __m128 SmoothMin4(__m128 a, __m128 b, float k)
+{
+    if (k <= 0.0f)
+    {
+        return _mm_min_ps(a, b);
+    }
+
+    __m128 kk = _mm_set1_ps(k);
+    __m128 h = _mm_add_ps(_mm_set1_ps(0.5f), _mm_div_ps(_mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(b, a)), kk));
+    h = _mm_min_ps(_mm_max_ps(h, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    __m128 mixed = _mm_add_ps(b, _mm_mul_ps(_mm_sub_ps(a, b), h));
+    return _mm_sub_ps(mixed, _mm_mul_ps(_mm_mul_ps(kk, h), _mm_sub_ps(_mm_set1_ps(1.0f), h)));
+}
+#endif
+
+// Evaluates up to BATCH_SIZE points, using a stack of BATCH_SIZE-wide distance rows.
+// With SIMD, count must be padded to a multiple of 4.
+void SdfEvaluator::EvaluateBatch(const float* xs, const float* ys, const float* zs, float* distances, size_t count, float* pStack) const
+{
+    int top = 0;
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        const Instruction& instruction = program[i];
+        if (instruction.isPrimitive)
+        {
+            float *pRow = &pStack[top*BATCH_SIZE];
+#ifdef SDF_USE_SSE
+            __m128 cx = _mm_set1_ps(instruction.center[0]);
+            __m128 cy = _mm_set1_ps(instruction.center[1]);
+            __m128 cz = _mm_set1_ps(instruction.center[2]);
+            __m128 s0 = _mm_set1_ps(instruction.size[0]);
+            __m128 s1 = _mm_set1_ps(instruction.size[1]);
+            __m128 s2 = _mm_set1_ps(instruction.size[2]);
+            __m128 zero = _mm_setzero_ps();
+            for (size_t j = 0; j < count; j += 4)
+            {
+                __m128 dx = _mm_sub_ps(_mm_loadu_ps(&xs[j]), cx);
+                __m128 dy = _mm_sub_ps(_mm_loadu_ps(&ys[j]), cy);
+                __m128 dz = _mm_sub_ps(_mm_loadu_ps(&zs[j]), cz);
+                __m128 result;
+                if (instruction.primitive == CSG_SPHERE)
+                {
+                    __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    result = _mm_sub_ps(_mm_sqrt_ps(lengthSq), s0);
+                }
+                else if (instruction.primitive == CSG_BOX)
+                {
+                    __m128 qx = _mm_sub_ps(Abs4(dx), s0);
+                    __m128 qy = _mm_sub_ps(Abs4(dy), s1);
+                    __m128 qz = _mm_sub_ps(Abs4(dz), s2);
+                    __m128 ox = _mm_max_ps(qx, zero), oy = _mm_max_ps(qy, zero), oz = _mm_max_ps(qz, zero);
+                    __m128 outside = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)));
+                    __m128 inside = _mm_min_ps(_mm_max_ps(qx, _mm_max_ps(qy, qz)), zero);
+                    result = _mm_add_ps(outside, inside);
+                }
+                else
+                {
+                    __m128 qr = _mm_sub_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz))), s0);
+                    __m128 qy = _mm_sub_ps(Abs4(dy), s1);
+                    __m128 oR = _mm_max_ps(qr, zero), oy = _mm_max_ps(qy, zero);
+                    __m128 outside = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(oR, oR), _mm_mul_ps(oy, oy)));
+                    result = _mm_add_ps(outside, _mm_min_ps(_mm_max_ps(qr, qy), zero));
+                }
+
+                _mm_storeu_ps(&pRow[j], result);
+            }
+#else
+            for (size_t j = 0; j < count; j++)
+            {
+                pRow[j] = PrimitiveDistance(instruction.primitive, instruction.center, instruction.size, xs[j], ys[j], zs[j]);
+            }
+#endif
+            top++;
+        }
+        else
+        {
+            top--;
+            float *pLeft = &pStack[(top - 1)*BATCH_SIZE];
+            const float *pRight = &pStack[top*BATCH_SIZE];
+            float k = instruction.blendRadius;
+#ifdef SDF_USE_SSE
+            for (size_t j = 0; j < count; j += 4)
+            {
+                __m128 a = _mm_loadu_ps(&pLeft[j]);
+                __m128 b = _mm_loadu_ps(&pRight[j]);
+                __m128 result;
+                switch (instruction.operation)
+                {
+                case CSG_UNION:
+                    result = SmoothMin4(a, b, k);
+                    break;
+                case CSG_INTERSECTION:
+                    result = Negate4(SmoothMin4(Negate4(a), Negate4(b), k));
+                    break;
+                case CSG_DIFFERENCE:
+                default:
+                    result = Negate4(SmoothMin4(Negate4(a), b, k));
+                    break;
+                }
+
+                _mm_storeu_ps(&pLeft[j], result);
+            }
+#else
+            float h;
+            for (size_t j = 0; j < count; j++)
+            {
+                pLeft[j] = CombineDistance(instruction.operation, pLeft[j], pRight[j], k, h);
+            }
+#endif
+        }
+    }
+
+    for (size_t j = 0; j < count; j++)
+    {
+        distances[j] = pStack[j];
+    }
+}
+
+void SdfEvaluator::Evaluate(const float* xs, const float* ys, const float* zs, float* distances, size_t count) const
+{
+    std::vector<float> stack(stackDepth * BATCH_SIZE);
+    float paddedX[BATCH_SIZE] = { 0.0f }, paddedY[BATCH_SIZE] = { 0.0f }, paddedZ[BATCH_SIZE] = { 0.0f };
+    float paddedDistances[BATCH_SIZE];
+
+    size_t fullBatchEnd = count - count % BATCH_SIZE;
+    for (size_t i = 0; i < fullBatchEnd; i += BATCH_SIZE)
+    {
+        EvaluateBatch(&xs[i], &ys[i], &zs[i], &distances[i], BATCH_SIZE, &stack[0]);
+    }
+
+    // The tail is copied out so the SIMD loop can run over a padded, full-width group.
+    size_t remaining = count - fullBatchEnd;
+    if (remaining != 0)
+    {
+        size_t padded = (remaining + 3) & ~(size_t)3;
+        for (size_t j = 0; j < padded; j++)
+        {
+            size_t source = fullBatchEnd + std::min(j, remaining - 1);
+            paddedX[j] = xs[source];
+            paddedY[j] = ys[source];
+            paddedZ[j] = zs[source];
+        }
+
+        EvaluateBatch(paddedX, paddedY, paddedZ, paddedDistances, padded, &stack[0]);
+        for (size_t j = 0; j < remaining; j++)
+        {
+            distances[fullBatchEnd + j] = paddedDistances[j];
+        }
+    }
+}
@@ -0,0 +1,61 @@
+/*--------------------------------------------------------------------------
+    SdfEvaluator.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "CsgTree.h"
+
+// Signed distance representation of a CSG tree, flattened into a postfix program so that
+// batches of points can be evaluated with SIMD instead of walking the tree per point.
+// Negative distances are inside the solid. The evaluator copies everything it needs from the tree,
+// so it can keep being used on worker threads while the tree is edited.
+class SdfEvaluator
+{
+    struct Instruction
+    {
+        bool isPrimitive;
+        CsgPrimitive primitive;
+        CsgOperation operation;
+        float center[3];
+        float size[3];
+        float color[3];
+        float blendRadius;
+    };
+
+    std::vector<Instruction> program;
+    int stackDepth;
+    float boundsMin[3], boundsMax[3];
+
+    void Compile(const CsgNode& node, int depth);
+    void EvaluateBatch(const float* xs, const float* ys, const float* zs, float* distances, size_t count, float* pStack) const;
+
+public:
+    // Points are evaluated in groups of this size; a multiple of the SIMD width.
+    static const int BATCH_SIZE = 64;
+
+    SdfEvaluator(const CsgNode& root);
+
+    // Evaluates count points given as separate coordinate arrays. Thread-safe.
+    void Evaluate(const float* xs, const float* ys, const float* zs, float* distances, size_t count) const;
+
+    // Evaluates a single point, also returning the color of the material forming the surface there.
+    float Evaluate(float x, float y, float z, float color[3]) const;
+
+    void Bounds(float min[3], float max[3]) const;
+};
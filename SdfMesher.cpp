@@ -0,0 +1,494 @@
+/*--------------------------------------------------------------------------
+    SdfMesher.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "SdfMesher.h"
+#include "Predicates.h"
+#include <algorithm>
+
+// Cell corners are numbered with x in bit 0, y in bit 1 and z in bit 2.
+static const int EDGE_CORNERS[12][2] =
+{
+    { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 }, // X edges
+    { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 }, // Y edges
+    { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }  // Z edges
+};
+
+// Work is split into chunks of this many cells.
+static const size_t CELL_CHUNK = 512;
+
+SdfMesher::SdfMesher(int maxDepth, ThreadPool* pPool)
+    : maxDepth(std::min(std::max(maxDepth, 1), 20)), regularization(0.05f), pPool(pPool), pCancelled(NULL)
+{
+}
+
+void SdfMesher::SetRegularization(float regularization)
+{
+    this->regularization = regularization;
+}
+
+void SdfMesher::SetCancelFlag(const std::atomic<bool>* pCancelled)
+{
+    this->pCancelled = pCancelled;
+}
+
+bool SdfMesher::IsCancelled() const
+{
+    return pCancelled != NULL && pCancelled->load();
+}
+
+SdfMesher::CellKey SdfMesher::PackKey(unsigned int i, unsigned int j, unsigned int k)
+{
+    return (CellKey)i | ((CellKey)j << 21) | ((CellKey)k << 42);
+}
+
+void SdfMesher::UnpackKey(CellKey key, unsigned int& i, unsigned int& j, unsigned int& k)
+{
+    const CellKey mask = (1 << 21) - 1;
+    i = (unsigned int)(key & mask);
+    j = (unsigned int)((key >> 21) & mask);
+    k = (unsigned int)((key >> 42) & mask);
+}
+
+// Descends the octree one level at a time, keeping only children whose center distance is small
+// enough that the surface may pass through them. The distance changes no faster than the distance
+// travelled, so a cell farther from the surface than its half-diagonal cannot contain any of it.
+void SdfMesher::FindSurfaceCells(const SdfEvaluator& sdf, const float origin[3], float rootSize, std::vector<CellKey>& cells) const
+{
+    cells.clear();
+    cells.push_back(PackKey(0, 0, 0));
+
+    for (int level = 1; level <= maxDepth && !cells.empty() && !IsCancelled(); level++)
+    {
+        float cellSize = rootSize / (float)(1 << level);
+        float keepDistance = cellSize * 0.8661f + cellSize * 0.01f; // Half-diagonal plus slack for float error.
+
+        size_t chunkCount = (cells.size() + CELL_CHUNK - 1) / CELL_CHUNK;
+        std::vector<std::vector<CellKey>> chunkResults(chunkCount);
+        ThreadPool::RunChunks(pPool, cells.size(), CELL_CHUNK, [&](size_t begin, size_t end)
+        {
+            if (IsCancelled())
+            {
+                return;
+            }
+
+            size_t childCount = (end - begin) * 8;
+            std::vector<float> xs(childCount), ys(childCount), zs(childCount), distances(childCount);
+            std::vector<CellKey> childKeys(childCount);
+            for (size_t c = begin; c < end; c++)
+            {
+                unsigned int i, j, k;
+                UnpackKey(cells[c], i, j, k);
+                for (int child = 0; child < 8; child++)
+                {
+                    unsigned int ci = i*2 + (child & 1);
+                    unsigned int cj = j*2 + ((child >> 1) & 1);
+                    unsigned int ck = k*2 + ((child >> 2) & 1);
+
+                    size_t index = (c - begin)*8 + child;
+                    childKeys[index] = PackKey(ci, cj, ck);
+                    xs[index] = origin[0] + ((float)ci + 0.5f) * cellSize;
+                    ys[index] = origin[1] + ((float)cj + 0.5f) * cellSize;
+                    zs[index] = origin[2] + ((float)ck + 0.5f) * cellSize;
+                }
+            }
+
+            sdf.Evaluate(&xs[0], &ys[0], &zs[0], &distances[0], childCount);
+
+            std::vector<CellKey>& kept = chunkResults[begin / CELL_CHUNK];
+            for (size_t index = 0; index < childCount; index++)
+            {
+                if (fabsf(distances[index]) <= keepDistance)
+                {
+                    kept.push_back(childKeys[index]);
+                }
+            }
+        });
+
+        ConcatenateChunks(chunkResults, cells);
+    }
+
+    std::sort(cells.begin(), cells.end());
+}
+
+// Places the cell's vertex at the minimizer of the quadratic error function built from the edge crossings and
+// their normals, which keeps sharp CSG edges and corners sharp. Regularization toward the mass point keeps
+// flat and cylindrical regions stable. Returns false if the cell has no surface crossings.
+bool SdfMesher::SolveVertex(const float cellMin[3], float cellSize, const float* crossings, const float* normals, int crossingCount, float vertex[3]) const
+{
+    if (crossingCount == 0)
+    {
+        return false;
+    }
+
+    double mass[3] = { 0, 0, 0 };
+    for (int c = 0; c < crossingCount; c++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            mass[axis] += crossings[c*3 + axis];
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        mass[axis] /= crossingCount;
+    }
+
+    // Normal equations, solved relative to the mass point for better conditioning.
+    double reg = regularization * crossingCount;
+    double a[3][3] = { { reg, 0, 0 }, { 0, reg, 0 }, { 0, 0, reg } };
+    double b[3] = { 0, 0, 0 };
+    for (int c = 0; c < crossingCount; c++)
+    {
+        const float *pN = &normals[c*3];
+        double offset = pN[0]*(crossings[c*3] - mass[0]) + pN[1]*(crossings[c*3 + 1] - mass[1]) + pN[2]*(crossings[c*3 + 2] - mass[2]);
+        for (int row = 0; row < 3; row++)
+        {
+            for (int col = 0; col < 3; col++)
+            {
+                a[row][col] += pN[row]*pN[col];
+            }
+
+            b[row] += pN[row]*offset;
+        }
+    }
+
+    double det = a[0][0]*(a[1][1]*a[2][2] - a[1][2]*a[2][1])
+               - a[0][1]*(a[1][0]*a[2][2] - a[1][2]*a[2][0])
+               + a[0][2]*(a[1][0]*a[2][1] - a[1][1]*a[2][0]);
+
+    double solution[3] = { 0, 0, 0 };
+    if (fabs(det) > 1e-12)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            // Cramer's rule: replace one column with b.
+            double m[3][3];
+            for (int row = 0; row < 3; row++)
+            {
+                for (int col = 0; col < 3; col++)
+                {
+                    m[row][col] = (col == axis) ? b[row] : a[row][col];
+                }
+            }
+
+            double detAxis = m[0][0]*(m[1][1]*m[2][2] - m[1][2]*m[2][1])
+                           - m[0][1]*(m[1][0]*m[2][2] - m[1][2]*m[2][0])
+                           + m[0][2]*(m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+            solution[axis] = detAxis / det;
+        }
+    }
+
+    // Vertices that escape their cell make folded triangles, so fall back to the mass point.
+    bool inside = true;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        vertex[axis] = (float)(mass[axis] + solution[axis]);
+        float slack = cellSize * 0.01f;
+        if (vertex[axis] < cellMin[axis] - slack || vertex[axis] > cellMin[axis] + cellSize + slack)
+        {
+            inside = false;
+        }
+    }
+
+    if (!inside)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            vertex[axis] = (float)mass[axis];
+        }
+    }
+
+    return true;
+}
+
+bool SdfMesher::Contour(const SdfEvaluator& sdf, Mesh& result) const
+{
+    result.Clear();
+
+    float boundsMin[3], boundsMax[3];
+    sdf.Bounds(boundsMin, boundsMax);
+    float extent = 0.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (boundsMax[axis] <= boundsMin[axis])
+        {
+            return true; // Empty solid.
+        }
+
+        extent = std::max(extent, boundsMax[axis] - boundsMin[axis]);
+    }
+
+    // Pad so the surface stays a few cells away from the root boundary, where faces could not be closed.
+    int gridSize = 1 << maxDepth;
+    float rootSize = extent * (1.0f + 8.0f / (float)gridSize) + 1e-4f;
+    float cellSize = rootSize / (float)gridSize;
+    float origin[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        origin[axis] = 0.5f*(boundsMin[axis] + boundsMax[axis]) - 0.5f*rootSize;
+    }
+
+    std::vector<CellKey> cells;
+    FindSurfaceCells(sdf, origin, rootSize, cells);
+    if (IsCancelled())
+    {
+        return false;
+    }
+
+    // Evaluate cell corners and place one vertex in every cell the surface crosses.
+    std::vector<float> cornerValues(cells.size() * 8);
+    std::vector<float> cellVertices(cells.size() * 3);
+    std::vector<int> vertexIndices(cells.size(), -1);
+    ThreadPool::RunChunks(pPool, cells.size(), CELL_CHUNK, [&](size_t begin, size_t end)
+    {
+        if (IsCancelled())
+        {
+            return;
+        }
+
+        size_t cornerCount = (end - begin) * 8;
+        std::vector<float> xs(cornerCount), ys(cornerCount), zs(cornerCount);
+        for (size_t c = begin; c < end; c++)
+        {
+            unsigned int i, j, k;
+            UnpackKey(cells[c], i, j, k);
+            for (int corner = 0; corner < 8; corner++)
+            {
+                size_t index = (c - begin)*8 + corner;
+                xs[index] = origin[0] + (float)(i + (corner & 1)) * cellSize;
+                ys[index] = origin[1] + (float)(j + ((corner >> 1) & 1)) * cellSize;
+                zs[index] = origin[2] + (float)(k + ((corner >> 2) & 1)) * cellSize;
+            }
+        }
+
+        sdf.Evaluate(&xs[0], &ys[0], &zs[0], &cornerValues[begin*8], cornerCount);
+
+        // Find edge crossings by linear interpolation.
+        std::vector<float> crossings;
+        std::vector<int> crossingCounts(end - begin, 0);
+        for (size_t c = begin; c < end; c++)
+        {
+            const float *pValues = &cornerValues[c*8];
+            for (int edge = 0; edge < 12; edge++)
+            {
+                int c0 = EDGE_CORNERS[edge][0], c1 = EDGE_CORNERS[edge][1];
+                if ((pValues[c0] < 0.0f) == (pValues[c1] < 0.0f))
+                {
+                    continue;
+                }
+
+                float t = pValues[c0] / (pValues[c0] - pValues[c1]);
+                size_t i0 = (c - begin)*8 + c0, i1 = (c - begin)*8 + c1;
+                crossings.push_back(xs[i0] + t*(xs[i1] - xs[i0]));
+                crossings.push_back(ys[i0] + t*(ys[i1] - ys[i0]));
+                crossings.push_back(zs[i0] + t*(zs[i1] - zs[i0]));
+                crossingCounts[c - begin]++;
+            }
+        }
+
+        // Normals from central differences, all evaluated as one batch.
+        size_t crossingCount = crossings.size() / 3;
+        if (crossingCount == 0)
+        {
+            return;
+        }
+
+        float step = cellSize * 0.05f;
+        std::vector<float> gx(crossingCount*6), gy(crossingCount*6), gz(crossingCount*6), gd(crossingCount*6);
+        for (size_t n = 0; n < crossingCount; n++)
+        {
+            for (int sample = 0; sample < 6; sample++)
+            {
+                float offset = (sample & 1) ? -step : step;
+                int axis = sample / 2;
+                gx[n*6 + sample] = crossings[n*3] + (axis == 0 ? offset : 0.0f);
+                gy[n*6 + sample] = crossings[n*3 + 1] + (axis == 1 ? offset : 0.0f);
+                gz[n*6 + sample] = crossings[n*3 + 2] + (axis == 2 ? offset : 0.0f);
+            }
+        }
+
+        sdf.Evaluate(&gx[0], &gy[0], &gz[0], &gd[0], crossingCount*6);
+
+        std::vector<float> normals(crossingCount*3);
+        for (size_t n = 0; n < crossingCount; n++)
+        {
+            float nx = gd[n*6] - gd[n*6 + 1];
+            float ny = gd[n*6 + 2] - gd[n*6 + 3];
+            float nz = gd[n*6 + 4] - gd[n*6 + 5];
+            float length = sqrtf(nx*nx + ny*ny + nz*nz);
+            if (length > 0.0f)
+            {
+                nx /= length;
+                ny /= length;
+                nz /= length;
+            }
+
+            normals[n*3] = nx;
+            normals[n*3 + 1] = ny;
+            normals[n*3 + 2] = nz;
+        }
+
+        size_t firstCrossing = 0;
+        for (size_t c = begin; c < end; c++)
+        {
+            int count = crossingCounts[c - begin];
+            unsigned int i, j, k;
+            UnpackKey(cells[c], i, j, k);
+            float cellMin[3] = { origin[0] + i*cellSize, origin[1] + j*cellSize, origin[2] + k*cellSize };
+            if (SolveVertex(cellMin, cellSize, count ? &crossings[firstCrossing*3] : NULL,
+                count ? &normals[firstCrossing*3] : NULL, count, &cellVertices[c*3]))
+            {
+                vertexIndices[c] = 0;
+            }
+
+            firstCrossing += count;
+        }
+    });
+
+    if (IsCancelled())
+    {
+        return false;
+    }
+
+    // Number the vertices in cell order.
+    int vertexCount = 0;
+    for (size_t c = 0; c < cells.size(); c++)
+    {
+        if (vertexIndices[c] == 0)
+        {
+            vertexIndices[c] = vertexCount++;
+        }
+    }
+
+    result.vertices.resize(vertexCount);
+    ThreadPool::RunChunks(pPool, cells.size(), CELL_CHUNK, [&](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; c++)
+        {
+            if (vertexIndices[c] >= 0)
+            {
+                const float *pVertex = &cellVertices[c*3];
+                float color[3];
+                sdf.Evaluate(pVertex[0], pVertex[1], pVertex[2], color);
+                result.vertices[vertexIndices[c]].Set(pVertex[0], pVertex[1], pVertex[2], color[0], color[1], color[2]);
+            }
+        }
+    });
+
+    // Each cell emits a quad for every crossed edge leaving its minimum corner, connecting the four cells around that edge.
+    size_t chunkCount = (cells.size() + CELL_CHUNK - 1) / CELL_CHUNK;
+    std::vector<std::vector<unsigned int>> chunkIndices(chunkCount);
+    ThreadPool::RunChunks(pPool, cells.size(), CELL_CHUNK, [&](size_t begin, size_t end)
+    {
+        if (IsCancelled())
+        {
+            return;
+        }
+
+        std::vector<unsigned int>& indices = chunkIndices[begin / CELL_CHUNK];
+        for (size_t c = begin; c < end; c++)
+        {
+            if (vertexIndices[c] < 0)
+            {
+                continue;
+            }
+
+            unsigned int cell[3];
+            UnpackKey(cells[c], cell[0], cell[1], cell[2]);
+            const float *pValues = &cornerValues[c*8];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                bool startInside = pValues[0] < 0.0f;
+                if (startInside == (pValues[1 << axis] < 0.0f))
+                {
+                    continue;
+                }
+
+                // Walk the cells around the edge counter-clockwise when looking down the axis.
+                int b = (axis + 1) % 3, d = (axis + 2) % 3;
+                static const int OFFSETS[4][2] = { { 0, 0 }, { -1, 0 }, { -1, -1 }, { 0, -1 } };
+                int quad[4];
+                bool complete = true;
+                for (int n = 0; n < 4 && complete; n++)
+                {
+                    unsigned int neighbor[3] = { cell[0], cell[1], cell[2] };
+                    if ((int)neighbor[b] + OFFSETS[n][0] < 0 || (int)neighbor[d] + OFFSETS[n][1] < 0)
+                    {
+                        complete = false;
+                        break;
+                    }
+
+                    neighbor[b] += OFFSETS[n][0];
+                    neighbor[d] += OFFSETS[n][1];
+                    CellKey key = PackKey(neighbor[0], neighbor[1], neighbor[2]);
+                    std::vector<CellKey>::const_iterator found = std::lower_bound(cells.begin(), cells.end(), key);
+                    if (found == cells.end() || *found != key || vertexIndices[found - cells.begin()] < 0)
+                    {
+                        complete = false;
+                        break;
+                    }
+
+                    quad[n] = vertexIndices[found - cells.begin()];
+                }
+
+                if (!complete)
+                {
+                    continue;
+                }
+
+                // The outward normal points from inside to outside along the edge.
+                if (!startInside)
+                {
+                    std::swap(quad[1], quad[3]);
+                }
+
+                // Split along the other diagonal if this one would leave a zero-area sliver. The test is exact,
+                // so the same quad always splits the same way regardless of rounding.
+                int first = 0;
+                const float *pCorners[4];
+                for (int n = 0; n < 4; n++)
+                {
+                    pCorners[n] = &result.vertices[quad[n]].x;
+                }
+
+                if (Predicates::IsDegenerate(pCorners[0], pCorners[1], pCorners[2]) || Predicates::IsDegenerate(pCorners[0], pCorners[2], pCorners[3]))
+                {
+                    first = 1;
+                }
+
+                indices.push_back(quad[first]);
+                indices.push_back(quad[first + 1]);
+                indices.push_back(quad[first + 2]);
+                indices.push_back(quad[first]);
+                indices.push_back(quad[first + 2]);
+                indices.push_back(quad[(first + 3) % 4]);
+            }
+        }
+    });
+
+    if (IsCancelled())
+    {
+        result.Clear();
+        return false;
+    }
+
+    ConcatenateChunks(chunkIndices, result.indices);
+    return true;
+}
@@ -0,0 +1,56 @@
+/*--------------------------------------------------------------------------
+    SdfMesher.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "Mesh.h"
+#include "SdfEvaluator.h"
+#include "ThreadPool.h"
+
+// Converts a signed distance field into a triangle mesh with dual contouring.
+// Sampling is octree-adaptive: only cells that the distance bound says may contain the surface are refined,
+// so the cost scales with surface area instead of volume.
+class SdfMesher
+{
+    int maxDepth;
+    float regularization;
+    ThreadPool *pPool;
+    const std::atomic<bool> *pCancelled;
+
+    typedef unsigned long long CellKey;
+    static CellKey PackKey(unsigned int i, unsigned int j, unsigned int k);
+    static void UnpackKey(CellKey key, unsigned int& i, unsigned int& j, unsigned int& k);
+
+    bool IsCancelled() const;
+    void FindSurfaceCells(const SdfEvaluator& sdf, const float origin[3], float rootSize, std::vector<CellKey>& cells) const;
+    bool SolveVertex(const float cellMin[3], float cellSize, const float* crossings, const float* normals, int crossingCount, float vertex[3]) const;
+
+public:
+    // The finest cells are 1/2^maxDepth of the (padded) bounds on their longest axis.
+    SdfMesher(int maxDepth, ThreadPool* pPool);
+
+    // Weight pulling vertices toward the average edge crossing when sharp-feature placement is ill-conditioned.
+    void SetRegularization(float regularization);
+
+    // Flag polled between chunks of work; once set, Contour stops early. NULL disables cancellation.
+    void SetCancelFlag(const std::atomic<bool>* pCancelled);
+
+    // Meshes the zero isosurface, replacing the contents of result. Returns false (with an empty result) if cancelled.
+    bool Contour(const SdfEvaluator& sdf, Mesh& result) const;
+};
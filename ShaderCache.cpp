@@ -0,0 +1,672 @@
+/*--------------------------------------------------------------------------
+    ShaderCache.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "ShaderCache.h"
+#include "GLManager.h"
+#include <algorithm>
+#include <iomanip>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+ShaderCache *ShaderCache::m_pCache;
+
+// Identifies binary cache files, followed by the binary format and length.
+static const unsigned int BINARY_MAGIC = 0x42534352; // "RCSB"
+
+// Defined in specialized sources for each ShaderFeature bit, in bit order.
+static const char* FEATURE_DEFINES[SHADER_FEATURE_COUNT] = { "TEXTURED", "NORMALS", "INSTANCED", "TRIPLANAR" };
+
+// KHR_parallel_shader_compile postdates the GLEW we build against.
+typedef void (GLAPIENTRY *MaxShaderCompilerThreadsFunc)(GLuint count);
+static const GLenum COMPLETION_STATUS = 0x91B1;
+
+ShaderCache::ShaderCache(const std::string& shaderDirectory, const std::string& binaryDirectory, GLFWwindow* pShareWindow)
+    : shaderDirectory(shaderDirectory), binaryDirectory(binaryDirectory), parallelCompile(false),
+      pWorkerWindow(NULL), workerStopping(false)
+{
+    // Binaries are only valid for the driver that produced them.
+    std::stringstream signature;
+    signature << glGetString(GL_VENDOR) << "|" << glGetString(GL_RENDERER) << "|" << glGetString(GL_VERSION);
+    driverSignature = signature.str();
+
+    GLint formatCount = 0;
+    if (GLEW_ARB_get_program_binary)
+    {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    }
+
+    binariesSupported = formatCount > 0;
+    if (binariesSupported)
+    {
+#ifdef _WIN32
+        _mkdir(binaryDirectory.c_str());
+#else
+        mkdir(binaryDirectory.c_str(), 0755);
+#endif
+    }
+
+    // Prefer the driver's compiler threads; they need no second context.
+    MaxShaderCompilerThreadsFunc maxCompilerThreads = NULL;
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+    {
+        maxCompilerThreads = (MaxShaderCompilerThreadsFunc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    }
+    else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+    {
+        maxCompilerThreads = (MaxShaderCompilerThreadsFunc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    }
+
+    if (maxCompilerThreads != NULL)
+    {
+        // All ones lets the driver pick its own limit.
+        maxCompilerThreads(0xFFFFFFFF);
+        parallelCompile = true;
+    }
+    else if (pShareWindow != NULL)
+    {
+        // Windows can only be created on the main thread; the worker just makes the context current.
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        pWorkerWindow = glfwCreateWindow(1, 1, "", NULL, pShareWindow);
+        glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+        if (pWorkerWindow != NULL)
+        {
+            workerThread = std::thread(&ShaderCache::WorkerLoop, this);
+        }
+        else
+        {
+            std::cout << "Could not create a shader compilation context, compiling on the main thread." << std::endl;
+        }
+    }
+
+    watcher.Start(shaderDirectory);
+}
+
+ShaderCache::~ShaderCache()
+{
+    watcher.Stop();
+    if (pWorkerWindow != NULL)
+    {
+        // Queued builds are abandoned; their programs are deleted below anyway.
+        {
+            std::lock_guard<std::mutex> lock(workerMutex);
+            workerStopping = true;
+        }
+
+        workerSignal.notify_one();
+        workerThread.join();
+        glfwDestroyWindow(pWorkerWindow);
+    }
+
+    for (std::map<ProgramKey, Program>::iterator iter = programs.begin(); iter != programs.end(); ++iter)
+    {
+        if (iter->second.pPending && parallelCompile)
+        {
+            glDeleteShader(iter->second.pPending->vertexShader);
+            glDeleteShader(iter->second.pPending->fragmentShader);
+        }
+
+        if (iter->second.pReload)
+        {
+            if (parallelCompile)
+            {
+                glDeleteShader(iter->second.pReload->vertexShader);
+                glDeleteShader(iter->second.pReload->fragmentShader);
+            }
+
+            glDeleteProgram(iter->second.pReload->program);
+        }
+
+        glDeleteProgram(iter->second.id);
+    }
+}
+
+bool ShaderCache::LoadSources(const ProgramKey& key, std::string& vsSource, std::string& fsSource) const
+{
+    std::string vsFilename = shaderDirectory + "/" + key.first + ".vs";
+    std::string fsFilename = shaderDirectory + "/" + key.first + ".fs";
+    GLManager *pM = GLManager::GetManager();
+    if (!pM->LoadString(vsFilename, vsSource))
+    {
+        std::cout << "Could not load vertex shader " << vsFilename << "!" << std::endl;
+        return false;
+    }
+
+    if (!pM->LoadString(fsFilename, fsSource))
+    {
+        std::cout << "Could not load fragment shader " << fsFilename << "!" << std::endl;
+        return false;
+    }
+
+    vsSource = Specialize(vsSource, key.second);
+    fsSource = Specialize(fsSource, key.second);
+    return true;
+}
+
+// 64-bit FNV-1a over the driver and both sources.
+unsigned long long ShaderCache::Hash(const std::string& vsSource, const std::string& fsSource) const
+{
+    const std::string* parts[3] = { &driverSignature, &vsSource, &fsSource };
+    unsigned long long hash = 14695981039346656037ull;
+    for (int i = 0; i < 3; i++)
+    {
+        for (size_t j = 0; j < parts[i]->size(); j++)
+        {
+            hash = (hash ^ (unsigned char)(*parts[i])[j]) * 1099511628211ull;
+        }
+
+        // Separator, so moving text between stages changes the hash.
+        hash = (hash ^ 0xFF) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+std::string ShaderCache::BinaryFilename(unsigned long long hash) const
+{
+    std::stringstream filename;
+    filename << binaryDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+    return filename.str();
+}
+
+bool ShaderCache::LoadBinary(GLuint program, unsigned long long hash) const
+{
+    if (!binariesSupported)
+    {
+        return false;
+    }
+
+    std::ifstream file(BinaryFilename(hash).c_str(), std::ios::binary);
+    unsigned int header[3];
+    if (!file || !file.read((char*)header, sizeof(header)) || header[0] != BINARY_MAGIC)
+    {
+        return false;
+    }
+
+    std::vector<char> binary(header[2]);
+    if (binary.empty() || !file.read(&binary[0], binary.size()))
+    {
+        return false;
+    }
+
+    // Drivers may reject binaries after an update even with the same version string; the caller then compiles.
+    glProgramBinary(program, (GLenum)header[1], &binary[0], (GLsizei)binary.size());
+    GLint linkStatus;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+    return linkStatus != 0;
+}
+
+void ShaderCache::SaveBinary(GLuint program, unsigned long long hash) const
+{
+    if (!binariesSupported)
+    {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, &length, &format, &binary[0]);
+
+    std::ofstream file(BinaryFilename(hash).c_str(), std::ios::binary);
+    unsigned int header[3] = { BINARY_MAGIC, (unsigned int)format, (unsigned int)length };
+    file.write((const char*)header, sizeof(header));
+    file.write(&binary[0], length);
+}
+
+// Replaces target's executable with source's, without compiling anything again.
+bool ShaderCache::CopyProgram(GLuint source, GLuint target) const
+{
+    if (!binariesSupported)
+    {
+        return false;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(source, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return false;
+    }
+
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(source, length, &length, &format, &binary[0]);
+    glProgramBinary(target, format, &binary[0], length);
+    GLint linkStatus;
+    glGetProgramiv(target, GL_LINK_STATUS, &linkStatus);
+    return linkStatus != 0;
+}
+
+// Starts building the sources into program, on whichever path this driver supports.
+std::shared_ptr<ShaderCache::CompileJob> ShaderCache::StartBuild(GLuint program, const std::string& name, const std::string& vsSource,
+    const std::string& fsSource, unsigned long long hash)
+{
+    if (binariesSupported)
+    {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    std::shared_ptr<CompileJob> pJob(new CompileJob());
+    pJob->program = program;
+    pJob->name = name;
+    pJob->vsSource = vsSource;
+    pJob->fsSource = fsSource;
+    pJob->hash = hash;
+    pJob->vertexShader = 0;
+    pJob->fragmentShader = 0;
+    pJob->done = false;
+    pJob->success = false;
+
+    if (parallelCompile)
+    {
+        StartParallelBuild(*pJob);
+    }
+    else if (pWorkerWindow != NULL)
+    {
+        {
+            std::lock_guard<std::mutex> lock(workerMutex);
+            workerJobs.push_back(pJob);
+        }
+
+        workerSignal.notify_one();
+    }
+    else
+    {
+        RunJob(*pJob);
+        pJob->done = true;
+    }
+
+    return pJob;
+}
+
+// Issues the compile and link without querying anything, so the driver can work on it in the background.
+void ShaderCache::StartParallelBuild(CompileJob& job)
+{
+    const char* pVsSource = job.vsSource.c_str();
+    const char* pFsSource = job.fsSource.c_str();
+    job.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(job.vertexShader, 1, &pVsSource, NULL);
+    glCompileShader(job.vertexShader);
+
+    job.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(job.fragmentShader, 1, &pFsSource, NULL);
+    glCompileShader(job.fragmentShader);
+
+    glAttachShader(job.program, job.vertexShader);
+    glAttachShader(job.program, job.fragmentShader);
+    glLinkProgram(job.program);
+}
+
+bool ShaderCache::FinishParallelBuild(CompileJob& job)
+{
+    // Blocks until the driver is done with this program.
+    GLint linkStatus;
+    glGetProgramiv(job.program, GL_LINK_STATUS, &linkStatus);
+    if (!linkStatus)
+    {
+        char buffer[1024];
+        GLint len;
+        GLuint stages[2] = { job.vertexShader, job.fragmentShader };
+        const char* extensions[2] = { ".vs", ".fs" };
+        bool compiled = true;
+        for (int i = 0; i < 2; i++)
+        {
+            GLint compileStatus;
+            glGetShaderiv(stages[i], GL_COMPILE_STATUS, &compileStatus);
+            if (!compileStatus)
+            {
+                glGetShaderInfoLog(stages[i], 1024, &len, buffer);
+                std::cout << std::endl << "Error compiling " << job.name << extensions[i] << ": " << buffer << std::endl;
+                compiled = false;
+            }
+        }
+
+        if (compiled)
+        {
+            glGetProgramInfoLog(job.program, 1024, &len, buffer);
+            std::cout << "Error linking " << job.name << ": " << buffer << std::endl;
+        }
+    }
+
+    glDetachShader(job.program, job.vertexShader);
+    glDetachShader(job.program, job.fragmentShader);
+    glDeleteShader(job.vertexShader);
+    glDeleteShader(job.fragmentShader);
+
+    if (linkStatus)
+    {
+        SaveBinary(job.program, job.hash);
+    }
+
+    return linkStatus != 0;
+}
+
+// Synchronous build, on whichever thread has a context current.
+void ShaderCache::RunJob(CompileJob& job)
+{
+    job.success = GLManager::GetManager()->LinkShaderProgram(job.program, job.vsSource, job.fsSource, job.name);
+    if (job.success)
+    {
+        SaveBinary(job.program, job.hash);
+    }
+}
+
+void ShaderCache::WorkerLoop()
+{
+    glfwMakeContextCurrent(pWorkerWindow);
+    while (true)
+    {
+        std::shared_ptr<CompileJob> pJob;
+        {
+            std::unique_lock<std::mutex> lock(workerMutex);
+            while (!workerStopping && workerJobs.empty())
+            {
+                workerSignal.wait(lock);
+            }
+
+            if (workerStopping)
+            {
+                break;
+            }
+
+            pJob = workerJobs.front();
+            workerJobs.pop_front();
+        }
+
+        RunJob(*pJob);
+
+        // The main context may only use the program once this context's commands have completed.
+        glFinish();
+        {
+            std::lock_guard<std::mutex> lock(workerMutex);
+            pJob->done = true;
+        }
+
+        workerFinished.notify_all();
+    }
+
+    glfwMakeContextCurrent(NULL);
+}
+
+// Whether a build has finished, without waiting for it.
+bool ShaderCache::IsDone(CompileJob& job)
+{
+    if (parallelCompile)
+    {
+        GLint complete;
+        glGetProgramiv(job.program, COMPLETION_STATUS, &complete);
+        return complete != 0;
+    }
+
+    std::lock_guard<std::mutex> lock(workerMutex);
+    return job.done;
+}
+
+// Waits for a build and returns whether it linked.
+bool ShaderCache::Wait(const std::shared_ptr<CompileJob>& pJob)
+{
+    if (parallelCompile)
+    {
+        pJob->success = FinishParallelBuild(*pJob);
+    }
+    else
+    {
+        std::unique_lock<std::mutex> lock(workerMutex);
+        std::deque<std::shared_ptr<CompileJob>>::iterator queued = std::find(workerJobs.begin(), workerJobs.end(), pJob);
+        if (queued != workerJobs.end())
+        {
+            // Not started yet; building it here beats waiting behind the rest of the queue.
+            workerJobs.erase(queued);
+            lock.unlock();
+            RunJob(*pJob);
+        }
+        else
+        {
+            while (!pJob->done)
+            {
+                workerFinished.wait(lock);
+            }
+        }
+    }
+
+    return pJob->success;
+}
+
+// Waits for a program's pending build, if any, and records the result.
+void ShaderCache::Finish(Program& program)
+{
+    if (!program.pPending)
+    {
+        return;
+    }
+
+    std::shared_ptr<CompileJob> pJob = program.pPending;
+    program.pPending.reset();
+    if (Wait(pJob))
+    {
+        program.hash = pJob->hash;
+        program.vsSource = pJob->vsSource;
+        program.fsSource = pJob->fsSource;
+    }
+}
+
+// Moves a finished reload into the program's own object.
+void ShaderCache::FinishReload(Program& program)
+{
+    std::shared_ptr<CompileJob> pJob = program.pReload;
+    program.pReload.reset();
+    if (Wait(pJob))
+    {
+        // Copying the linked binary is immediate; drivers without binaries link the now known-good sources again.
+        if (CopyProgram(pJob->program, program.id)
+            || GLManager::GetManager()->LinkShaderProgram(program.id, pJob->vsSource, pJob->fsSource, pJob->name))
+        {
+            program.hash = pJob->hash;
+            program.vsSource = pJob->vsSource;
+            program.fsSource = pJob->fsSource;
+            std::cout << "Reloaded shader program " << pJob->name << "." << std::endl;
+        }
+    }
+
+    glDeleteProgram(pJob->program);
+}
+
+GLuint ShaderCache::Request(const std::string& name, unsigned int features)
+{
+    ProgramKey key(name, features);
+    std::map<ProgramKey, Program>::iterator existing = programs.find(key);
+    if (existing != programs.end())
+    {
+        return existing->second.id;
+    }
+
+    Program& program = programs[key];
+    program.id = glCreateProgram();
+    program.hash = 0;
+
+    std::string vsSource, fsSource;
+    if (!LoadSources(key, vsSource, fsSource))
+    {
+        return program.id;
+    }
+
+    unsigned long long hash = Hash(vsSource, fsSource);
+    if (LoadBinary(program.id, hash))
+    {
+        program.hash = hash;
+        program.vsSource = vsSource;
+        program.fsSource = fsSource;
+        return program.id;
+    }
+
+    program.pPending = StartBuild(program.id, VariantName(name, features), vsSource, fsSource, hash);
+    return program.id;
+}
+
+GLuint ShaderCache::GetProgram(const std::string& name, unsigned int features)
+{
+    GLuint id = Request(name, features);
+    Finish(programs[ProgramKey(name, features)]);
+    return id;
+}
+
+void ShaderCache::Update()
+{
+    // Rebuilds go into separate program objects, so the old programs keep drawing until their replacements link.
+    for (std::map<ProgramKey, Program>::iterator iter = programs.begin(); iter != programs.end(); ++iter)
+    {
+        if (iter->second.pReload && IsDone(*iter->second.pReload))
+        {
+            FinishReload(iter->second);
+        }
+    }
+
+    // The watcher doesn't say which file changed, but rehashing a few sources is cheap.
+    if (watcher.TakeChanged())
+    {
+        for (std::map<ProgramKey, Program>::iterator iter = programs.begin(); iter != programs.end(); ++iter)
+        {
+            Program& program = iter->second;
+            Finish(program);
+
+            std::string vsSource, fsSource;
+            if (!LoadSources(iter->first, vsSource, fsSource))
+            {
+                continue;
+            }
+
+            unsigned long long hash = Hash(vsSource, fsSource);
+            if (hash == program.hash || (program.pReload && hash == program.pReload->hash))
+            {
+                continue;
+            }
+
+            // A reload of sources that have since changed again is only waited for, not used.
+            if (program.pReload)
+            {
+                Wait(program.pReload);
+                glDeleteProgram(program.pReload->program);
+                program.pReload.reset();
+            }
+
+            program.pReload = StartBuild(glCreateProgram(), VariantName(iter->first.first, iter->first.second), vsSource, fsSource, hash);
+        }
+    }
+}
+
+bool ShaderCache::Initialize(const std::string& shaderDirectory, const std::string& binaryDirectory, GLFWwindow* pShareWindow)
+{
+    m_pCache = new ShaderCache(shaderDirectory, binaryDirectory, pShareWindow);
+    return true;
+}
+
+ShaderCache* ShaderCache::GetCache()
+{
+    return m_pCache;
+}
+
+bool ShaderCache::Deinitialize()
+{
+    delete m_pCache;
+    m_pCache = NULL;
+    return true;
+}
+
+std::string ShaderCache::Specialize(const std::string& source, unsigned int features)
+{
+    if (features == 0)
+    {
+        return source;
+    }
+
+    std::stringstream defines;
+    for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+    {
+        if (features & (1 << i))
+        {
+            defines << "#define " << FEATURE_DEFINES[i] << "\n";
+        }
+    }
+
+    // #version has to stay first. Without one, the defines can simply go on top.
+    size_t version = source.find("#version");
+    if (version == std::string::npos)
+    {
+        return defines.str() + source;
+    }
+
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == std::string::npos)
+    {
+        return source + "\n" + defines.str();
+    }
+
+    // Keeps compiler errors pointing at the line numbers of the file.
+    size_t versionLine = std::count(source.begin(), source.begin() + lineEnd, '\n') + 1;
+    defines << "#line " << versionLine + 1 << "\n";
+    return source.substr(0, lineEnd + 1) + defines.str() + source.substr(lineEnd + 1);
+}
+
+std::string ShaderCache::VariantName(const std::string& name, unsigned int features)
+{
+    std::string variantName = name;
+    for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+    {
+        if (features & (1 << i))
+        {
+            variantName += std::string("+") + FEATURE_DEFINES[i];
+        }
+    }
+
+    return variantName;
+}
+
+ShaderVariants::ShaderVariants(const std::string& name)
+    : name(name)
+{
+    for (int i = 0; i < SHADER_VARIANT_COUNT; i++)
+    {
+        programs[i] = 0;
+    }
+}
+
+void ShaderVariants::Request(unsigned int features)
+{
+    ShaderCache::GetCache()->Request(name, features);
+}
+
+GLuint ShaderVariants::Get(unsigned int features)
+{
+    if (programs[features] == 0)
+    {
+        programs[features] = ShaderCache::GetCache()->GetProgram(name, features);
+    }
+
+    return programs[features];
+}
@@ -0,0 +1,155 @@
+/*--------------------------------------------------------------------------
+    ShaderCache.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "DirectoryWatcher.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Optional features a shader pair can be specialized for. Each set bit adds a #define of the same name
+// (without the prefix) to both stages, so variants differ at compile time instead of branching per pixel.
+enum ShaderFeature
+{
+    SHADER_TEXTURED = 0x1,  // Texture coordinates (location 3) and a material texture array.
+    SHADER_NORMALS = 0x2,   // Vertex normals (location 2) instead of face normals from derivatives.
+    SHADER_INSTANCED = 0x4, // Per-instance model matrix (locations 4-7).
+    SHADER_TRIPLANAR = 0x8  // Material texture projected along the part's axes, for meshes without texture coordinates.
+};
+
+static const int SHADER_FEATURE_COUNT = 4;
+static const int SHADER_VARIANT_COUNT = 1 << SHADER_FEATURE_COUNT;
+
+// Owns every shader program, built from <name>.vs and <name>.fs in the shader directory.
+// Repeated requests for a program share one GL object. Linked binaries are saved to disk keyed by a hash of the
+// sources and the driver, so later runs skip compilation entirely. Edited shader files are picked up on Update()
+// and rebuilt in the background like any other build; the old program stays in use until the new one has linked,
+// and is then replaced within the same program object, so callers can keep their ids.
+//
+// Programs that miss the binary cache are compiled asynchronously: with the driver's own compiler threads when
+// KHR/ARB_parallel_shader_compile is available, otherwise on a worker thread with a hidden shared context.
+// Request() starts a build without waiting; GetProgram() only blocks if that build hasn't finished yet.
+// Each feature mask of a pair is its own program, built the first time it is asked for.
+class ShaderCache
+{
+    // Shader pair name and feature mask.
+    typedef std::pair<std::string, unsigned int> ProgramKey;
+
+    // A build in flight.
+    struct CompileJob
+    {
+        GLuint program;
+        std::string name, vsSource, fsSource;
+        unsigned long long hash;
+
+        // Parallel-compile builds keep their stages until the link result is collected.
+        GLuint vertexShader, fragmentShader;
+
+        // Worker builds report back through these, under workerMutex.
+        bool done, success;
+    };
+
+    struct Program
+    {
+        GLuint id;
+        unsigned long long hash;
+        std::string vsSource, fsSource; // As last linked successfully.
+        std::shared_ptr<CompileJob> pPending;
+        std::shared_ptr<CompileJob> pReload; // Builds edited sources into a separate program object.
+    };
+
+    static ShaderCache *m_pCache;
+
+    std::string shaderDirectory, binaryDirectory;
+    std::string driverSignature;
+    bool binariesSupported;
+    bool parallelCompile;
+    std::map<ProgramKey, Program> programs;
+    DirectoryWatcher watcher;
+
+    // Fallback compile worker and its hidden context.
+    GLFWwindow *pWorkerWindow;
+    std::thread workerThread;
+    std::deque<std::shared_ptr<CompileJob>> workerJobs;
+    std::mutex workerMutex;
+    std::condition_variable workerSignal, workerFinished;
+    bool workerStopping;
+
+    bool LoadSources(const ProgramKey& key, std::string& vsSource, std::string& fsSource) const;
+    unsigned long long Hash(const std::string& vsSource, const std::string& fsSource) const;
+    std::string BinaryFilename(unsigned long long hash) const;
+    bool LoadBinary(GLuint program, unsigned long long hash) const;
+    void SaveBinary(GLuint program, unsigned long long hash) const;
+    bool CopyProgram(GLuint source, GLuint target) const;
+
+    std::shared_ptr<CompileJob> StartBuild(GLuint program, const std::string& name, const std::string& vsSource,
+        const std::string& fsSource, unsigned long long hash);
+    void StartParallelBuild(CompileJob& job);
+    bool FinishParallelBuild(CompileJob& job);
+    void RunJob(CompileJob& job);
+    void WorkerLoop();
+    bool IsDone(CompileJob& job);
+    bool Wait(const std::shared_ptr<CompileJob>& pJob);
+    void Finish(Program& program);
+    void FinishReload(Program& program);
+
+public:
+    // pShareWindow's context is shared with the fallback compile worker; NULL compiles synchronously instead.
+    ShaderCache(const std::string& shaderDirectory, const std::string& binaryDirectory, GLFWwindow* pShareWindow);
+    ~ShaderCache();
+
+    // Starts building the named shader pair if it isn't already, returning its (possibly not yet linked) id.
+    GLuint Request(const std::string& name, unsigned int features = 0);
+
+    // Returns the program for the named shader pair, waiting for its build to finish if needed.
+    GLuint GetProgram(const std::string& name, unsigned int features = 0);
+
+    // Starts rebuilding programs whose files changed on disk, and swaps in the rebuilds that have finished without
+    // waiting for the rest. Must be called on the thread owning the GL context, typically once a frame.
+    // Shaders bind their resources by explicit location, so nothing needs to be queried again after a reload.
+    void Update();
+
+    // Shared cache. Must be deinitialized while the GL context is still current.
+    static bool Initialize(const std::string& shaderDirectory, const std::string& binaryDirectory, GLFWwindow* pShareWindow);
+    static ShaderCache* GetCache();
+    static bool Deinitialize();
+
+    // Adds the defines for the feature mask right after the #version line.
+    static std::string Specialize(const std::string& source, unsigned int features);
+
+    // Name used in logs, such as "render+TEXTURED+NORMALS".
+    static std::string VariantName(const std::string& name, unsigned int features);
+};
+
+// The variants of one shader pair, indexed by feature mask so picking one at draw time is an array lookup.
+class ShaderVariants
+{
+    std::string name;
+    GLuint programs[SHADER_VARIANT_COUNT]; // 0 until first fetched.
+
+public:
+    ShaderVariants(const std::string& name);
+
+    // Starts compiling a variant that is going to be drawn with, such as the features of a newly loaded model.
+    void Request(unsigned int features);
+
+    // Returns a variant, compiling or waiting for it the first time.
+    GLuint Get(unsigned int features);
+};
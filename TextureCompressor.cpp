@@ -0,0 +1,298 @@
+/*--------------------------------------------------------------------------
+    TextureCompressor.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "TextureCompressor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+GLenum TextureCompressor::InternalFormat(TextureFormat format)
+{
+    switch (format)
+    {
+    case TEXTURE_BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TEXTURE_BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case TEXTURE_RGBA8:
+    default:
+        return GL_RGBA8;
+    }
+}
+
+bool TextureCompressor::IsCompressed(TextureFormat format)
+{
+    return format != TEXTURE_RGBA8;
+}
+
+int TextureCompressor::LevelCount(int size)
+{
+    int levels = 1;
+    while ((size >> levels) > 0)
+    {
+        levels++;
+    }
+
+    return levels;
+}
+
+size_t TextureCompressor::LevelBytes(TextureFormat format, int size)
+{
+    if (!IsCompressed(format))
+    {
+        return (size_t)size * size * 4;
+    }
+
+    size_t blocks = (size_t)((size + 3) / 4);
+    return blocks * blocks * (format == TEXTURE_BC1 ? 8 : 16);
+}
+
+size_t TextureCompressor::ChainBytes(TextureFormat format, int size, int levels)
+{
+    size_t bytes = 0;
+    for (int level = 0; level < levels; level++)
+    {
+        bytes += LevelBytes(format, std::max(size >> level, 1));
+    }
+
+    return bytes;
+}
+
+TextureFormat TextureCompressor::ChooseFormat(int size, const unsigned char* pRgba)
+{
+    for (size_t i = 0; i < (size_t)size * size; i++)
+    {
+        if (pRgba[i * 4 + 3] != 255)
+        {
+            return TEXTURE_BC3;
+        }
+    }
+
+    return TEXTURE_BC1;
+}
+
+static unsigned short PackRgb565(const float color[3])
+{
+    int r = (int)(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int)(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int)(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRgb565(unsigned short packed, int color[3])
+{
+    color[0] = ((packed >> 11) & 31) * 255 / 31;
+    color[1] = ((packed >> 5) & 63) * 255 / 63;
+    color[2] = (packed & 31) * 255 / 31;
+}
+
+void TextureCompressor::CompressColorBlock(const unsigned char block[64], unsigned char* pOutput)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            mean[c] += block[i * 4 + c] / 16.0f;
+        }
+    }
+
+    float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }; // rr, rg, rb, gg, gb, bb
+    for (int i = 0; i < 16; i++)
+    {
+        float d[3] = { block[i * 4] - mean[0], block[i * 4 + 1] - mean[1], block[i * 4 + 2] - mean[2] };
+        covariance[0] += d[0] * d[0];
+        covariance[1] += d[0] * d[1];
+        covariance[2] += d[0] * d[2];
+        covariance[3] += d[1] * d[1];
+        covariance[4] += d[1] * d[2];
+        covariance[5] += d[2] * d[2];
+    }
+
+    // A few power iterations find the principal axis well enough for 4 palette entries.
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 4; iteration++)
+    {
+        float next[3] =
+        {
+            covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+            covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+            covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+        };
+
+        float length = std::max(std::max(std::fabs(next[0]), std::fabs(next[1])), std::fabs(next[2]));
+        if (length < 1e-6f)
+        {
+            break;
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    float minT = 0.0f, maxT = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = ((block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2])
+            / (axisLength * axisLength);
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+
+    float maxColor[3], minColor[3];
+    for (int c = 0; c < 3; c++)
+    {
+        maxColor[c] = mean[c] + axis[c] * maxT;
+        minColor[c] = mean[c] + axis[c] * minT;
+    }
+
+    // The first endpoint must be the larger for the four-color mode.
+    unsigned short endpoint0 = PackRgb565(maxColor), endpoint1 = PackRgb565(minColor);
+    if (endpoint0 < endpoint1)
+    {
+        std::swap(endpoint0, endpoint1);
+    }
+
+    unsigned int indices = 0;
+    if (endpoint0 != endpoint1)
+    {
+        int palette[4][3];
+        UnpackRgb565(endpoint0, palette[0]);
+        UnpackRgb565(endpoint1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestDistance = std::numeric_limits<int>::max();
+            for (int p = 0; p < 4; p++)
+            {
+                int distance = 0;
+                for (int c = 0; c < 3; c++)
+                {
+                    int d = block[i * 4 + c] - palette[p][c];
+                    distance += d * d;
+                }
+
+                if (distance < bestDistance)
+                {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+
+            indices |= (unsigned int)best << (2 * i);
+        }
+    }
+
+    pOutput[0] = (unsigned char)(endpoint0 & 0xFF);
+    pOutput[1] = (unsigned char)(endpoint0 >> 8);
+    pOutput[2] = (unsigned char)(endpoint1 & 0xFF);
+    pOutput[3] = (unsigned char)(endpoint1 >> 8);
+    for (int i = 0; i < 4; i++)
+    {
+        pOutput[4 + i] = (unsigned char)(indices >> (8 * i));
+    }
+}
+
+void TextureCompressor::CompressAlphaBlock(const unsigned char block[64], unsigned char* pOutput)
+{
+    int minAlpha = 255, maxAlpha = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        minAlpha = std::min(minAlpha, (int)block[i * 4 + 3]);
+        maxAlpha = std::max(maxAlpha, (int)block[i * 4 + 3]);
+    }
+
+    // Eight-value mode: both endpoints, then six steps from the first to the second.
+    unsigned long long indices = 0;
+    if (maxAlpha != minAlpha)
+    {
+        int palette[8] = { maxAlpha, minAlpha };
+        for (int step = 1; step < 7; step++)
+        {
+            palette[step + 1] = ((7 - step) * maxAlpha + step * minAlpha) / 7;
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestDistance = 256;
+            for (int p = 0; p < 8; p++)
+            {
+                int distance = std::abs(block[i * 4 + 3] - palette[p]);
+                if (distance < bestDistance)
+                {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+
+            indices |= (unsigned long long)best << (3 * i);
+        }
+    }
+
+    pOutput[0] = (unsigned char)maxAlpha;
+    pOutput[1] = (unsigned char)minAlpha;
+    for (int i = 0; i < 6; i++)
+    {
+        pOutput[2 + i] = (unsigned char)(indices >> (8 * i));
+    }
+}
+
+void TextureCompressor::Compress(TextureFormat format, int size, const unsigned char* pRgba, unsigned char* pOutput, ThreadPool* pPool)
+{
+    if (!IsCompressed(format))
+    {
+        memcpy(pOutput, pRgba, LevelBytes(format, size));
+        return;
+    }
+
+    int blocksWide = (size + 3) / 4;
+    size_t blockBytes = format == TEXTURE_BC1 ? 8 : 16;
+    ThreadPool::RunChunks(pPool, (size_t)blocksWide, 4, [&](size_t begin, size_t end)
+    {
+        unsigned char block[64];
+        for (size_t blockY = begin; blockY < end; blockY++)
+        {
+            for (int blockX = 0; blockX < blocksWide; blockX++)
+            {
+                for (int i = 0; i < 16; i++)
+                {
+                    int x = std::min(blockX * 4 + (i & 3), size - 1), y = std::min((int)blockY * 4 + (i >> 2), size - 1);
+                    memcpy(block + i * 4, pRgba + ((size_t)y * size + x) * 4, 4);
+                }
+
+                unsigned char* pBlock = pOutput + (blockY * blocksWide + blockX) * blockBytes;
+                if (format == TEXTURE_BC3)
+                {
+                    CompressAlphaBlock(block, pBlock);
+                    pBlock += 8;
+                }
+
+                CompressColorBlock(block, pBlock);
+            }
+        }
+    });
+}
@@ -0,0 +1,57 @@
+/*--------------------------------------------------------------------------
+    TextureCompressor.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+// Texel storage of a material texture.
+enum TextureFormat
+{
+    TEXTURE_RGBA8, // Uncompressed, for drivers without S3TC.
+    TEXTURE_BC1,   // 4 bits per texel, opaque.
+    TEXTURE_BC3    // 8 bits per texel, with an interpolated alpha block.
+};
+
+// Software encoder for the BC1 and BC3 (DXT1/DXT5) block formats. Each 4x4 block gets endpoints along the principal
+// axis of its colors, which is close to what offline tools produce at a fraction of their cost.
+// Levels are square, with rows stored bottom first like every other GL upload.
+class TextureCompressor
+{
+    static void CompressColorBlock(const unsigned char block[64], unsigned char* pOutput);
+    static void CompressAlphaBlock(const unsigned char block[64], unsigned char* pOutput);
+
+public:
+    static GLenum InternalFormat(TextureFormat format);
+    static bool IsCompressed(TextureFormat format);
+
+    // Number of levels in a full mip chain, down to 1x1.
+    static int LevelCount(int size);
+
+    // Bytes of one square level, and of a chain of levels starting at 'size'.
+    static size_t LevelBytes(TextureFormat format, int size);
+    static size_t ChainBytes(TextureFormat format, int size, int levels);
+
+    // BC3 if any texel is translucent, BC1 otherwise.
+    static TextureFormat ChooseFormat(int size, const unsigned char* pRgba);
+
+    // Encodes a square RGBA8 level into pOutput, which holds LevelBytes(format, size). Rows of blocks are split
+    // across pPool, which may be NULL. Levels smaller than a block repeat their edge texels.
+    static void Compress(TextureFormat format, int size, const unsigned char* pRgba, unsigned char* pOutput, ThreadPool* pPool);
+};
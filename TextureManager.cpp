@@ -0,0 +1,676 @@
+/*--------------------------------------------------------------------------
+    TextureManager.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "TextureManager.h"
+#include "GLManager.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Identifies texture cache files. Bump the version whenever the encoding or resampling changes.
+static const unsigned int CACHE_MAGIC = 0x54534352; // "RCST"
+static const unsigned int CACHE_VERSION = 1;
+
+// Precedes the mip chain in a cache file.
+struct CacheHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int format;
+    unsigned int size;
+    unsigned int levels;
+    unsigned int chainBytes;
+};
+
+TextureManager::TextureManager(const std::string& cacheDirectory)
+    : maxLayers(256), anisotropy(1.0f), compressionSupported(false), cacheDirectory(cacheDirectory)
+{
+    if (!cacheDirectory.empty())
+    {
+#ifdef _WIN32
+        _mkdir(cacheDirectory.c_str());
+#else
+        mkdir(cacheDirectory.c_str(), 0755);
+#endif
+    }
+}
+
+TextureManager::~TextureManager()
+{
+    for (size_t i = 0; i < arrays.size(); i++)
+    {
+        glDeleteTextures(1, &arrays[i].texture);
+    }
+}
+
+bool TextureManager::Initialize()
+{
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    if (maxLayers < 1)
+    {
+        std::cout << "Array textures are not supported!" << std::endl;
+        return false;
+    }
+
+    if (GLEW_EXT_texture_filter_anisotropic)
+    {
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy);
+        anisotropy = std::min(anisotropy, 8.0f);
+    }
+
+    // Otherwise textures stay RGBA8, which still skips decoding and resampling when cached.
+    compressionSupported = GLEW_EXT_texture_compression_s3tc != 0;
+    return true;
+}
+
+GLuint TextureManager::CreateArray(int size, TextureFormat format, int levels, unsigned int capacity) const
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    GLenum internalFormat = TextureCompressor::InternalFormat(format);
+    if (GLEW_ARB_texture_storage)
+    {
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, internalFormat, size, size, capacity);
+    }
+    else
+    {
+        for (int level = 0; level < levels; level++)
+        {
+            int levelSize = std::max(size >> level, 1);
+            if (TextureCompressor::IsCompressed(format))
+            {
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, levelSize, levelSize, capacity, 0,
+                    (GLsizei)(TextureCompressor::LevelBytes(format, levelSize) * capacity), NULL);
+            }
+            else
+            {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, levelSize, levelSize, capacity, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            }
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    if (anisotropy > 1.0f)
+    {
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+    }
+
+    return texture;
+}
+
+bool TextureManager::Grow(TextureArray& array)
+{
+    unsigned int capacity = std::min(array.capacity * 2, (unsigned int)maxLayers);
+    if (capacity <= array.capacity || !GLEW_ARB_copy_image)
+    {
+        return false;
+    }
+
+    GLuint texture = CreateArray(array.size, array.format, array.levels, capacity);
+    for (int level = 0; level < array.levels; level++)
+    {
+        int levelSize = std::max(array.size >> level, 1);
+        glCopyImageSubData(array.texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+            texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, levelSize, levelSize, array.used);
+    }
+
+    glDeleteTextures(1, &array.texture);
+    array.texture = texture;
+    array.capacity = capacity;
+    return true;
+}
+
+size_t TextureManager::AllocateLayer(int size, TextureFormat format, unsigned int& layer)
+{
+    for (size_t i = 0; i < arrays.size(); i++)
+    {
+        TextureArray& array = arrays[i];
+        if (array.size != size || array.format != format)
+        {
+            continue;
+        }
+
+        if (!array.freeLayers.empty())
+        {
+            layer = array.freeLayers.back();
+            array.freeLayers.pop_back();
+            return i;
+        }
+
+        if (array.used < array.capacity || Grow(array))
+        {
+            layer = array.used++;
+            return i;
+        }
+    }
+
+    TextureArray array;
+    array.format = format;
+    array.size = size;
+    array.levels = TextureCompressor::LevelCount(size);
+
+    array.capacity = std::min((unsigned int)INITIAL_LAYERS, (unsigned int)maxLayers);
+    array.used = 1;
+    array.texture = CreateArray(size, format, array.levels, array.capacity);
+    arrays.push_back(array);
+
+    layer = 0;
+    return arrays.size() - 1;
+}
+
+void TextureManager::ReleaseLayer(const MaterialTexture& material)
+{
+    arrays[material.array].freeLayers.push_back(material.layer);
+}
+
+void TextureManager::Resample(int width, int height, const unsigned char* pRgba, int size, std::vector<unsigned char>& result)
+{
+    result.resize((size_t)size * size * 4);
+    if (width >= size && height >= size)
+    {
+        // Shrinking: average the source pixels each target pixel covers.
+        for (int y = 0; y < size; y++)
+        {
+            int y0 = y * height / size, y1 = std::max((y + 1) * height / size, y0 + 1);
+            for (int x = 0; x < size; x++)
+            {
+                int x0 = x * width / size, x1 = std::max((x + 1) * width / size, x0 + 1);
+                unsigned int sum[4] = { 0, 0, 0, 0 };
+                for (int sy = y0; sy < y1; sy++)
+                {
+                    const unsigned char* pRow = pRgba + ((size_t)sy * width + x0) * 4;
+                    for (int sx = 0; sx < (x1 - x0) * 4; sx++)
+                    {
+                        sum[sx & 3] += pRow[sx];
+                    }
+                }
+
+                unsigned int count = (unsigned int)((y1 - y0) * (x1 - x0));
+                for (int c = 0; c < 4; c++)
+                {
+                    result[((size_t)y * size + x) * 4 + c] = (unsigned char)((sum[c] + count / 2) / count);
+                }
+            }
+        }
+
+        return;
+    }
+
+    // Enlarging: bilinear between pixel centers, clamped at the edges.
+    for (int y = 0; y < size; y++)
+    {
+        float sy = std::max(((float)y + 0.5f) * (float)height / (float)size - 0.5f, 0.0f);
+        int y0 = std::min((int)sy, height - 1), y1 = std::min(y0 + 1, height - 1);
+        float fy = sy - (float)y0;
+        for (int x = 0; x < size; x++)
+        {
+            float sx = std::max(((float)x + 0.5f) * (float)width / (float)size - 0.5f, 0.0f);
+            int x0 = std::min((int)sx, width - 1), x1 = std::min(x0 + 1, width - 1);
+            float fx = sx - (float)x0;
+            for (int c = 0; c < 4; c++)
+            {
+                float top = (1.0f - fx) * pRgba[((size_t)y0 * width + x0) * 4 + c] + fx * pRgba[((size_t)y0 * width + x1) * 4 + c];
+                float bottom = (1.0f - fx) * pRgba[((size_t)y1 * width + x0) * 4 + c] + fx * pRgba[((size_t)y1 * width + x1) * 4 + c];
+                result[((size_t)y * size + x) * 4 + c] = (unsigned char)((1.0f - fy) * top + fy * bottom + 0.5f);
+            }
+        }
+    }
+}
+
+void TextureManager::Downsample(int size, const unsigned char* pRgba, std::vector<unsigned char>& result)
+{
+    int half = std::max(size / 2, 1);
+    result.resize((size_t)half * half * 4);
+    for (int y = 0; y < half; y++)
+    {
+        const unsigned char* pRow0 = pRgba + (size_t)(2 * y) * size * 4;
+        const unsigned char* pRow1 = pRgba + (size_t)std::min(2 * y + 1, size - 1) * size * 4;
+        for (int x = 0; x < half; x++)
+        {
+            int x0 = 2 * x * 4, x1 = std::min(2 * x + 1, size - 1) * 4;
+            for (int c = 0; c < 4; c++)
+            {
+                unsigned int sum = pRow0[x0 + c] + pRow0[x1 + c] + pRow1[x0 + c] + pRow1[x1 + c];
+                result[((size_t)y * half + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+void TextureManager::BuildChain(int width, int height, const unsigned char* pRgba, int& size, TextureFormat& format,
+    std::vector<unsigned char>& chain) const
+{
+    // Round up so detail isn't lost, unless that goes past the largest size.
+    size = MIN_SIZE;
+    while (size < std::max(width, height) && size < GLManager::TEXTURE_WH)
+    {
+        size *= 2;
+    }
+
+    std::vector<unsigned char> level, nextLevel;
+    const unsigned char* pLevel = pRgba;
+    if (width != size || height != size)
+    {
+        Resample(width, height, pRgba, size, level);
+        pLevel = &level[0];
+    }
+
+    format = compressionSupported ? TextureCompressor::ChooseFormat(size, pLevel) : TEXTURE_RGBA8;
+    int levels = TextureCompressor::LevelCount(size);
+
+    chain.resize(TextureCompressor::ChainBytes(format, size, levels));
+    size_t offset = 0;
+    for (int i = 0; i < levels; i++)
+    {
+        int levelSize = std::max(size >> i, 1);
+        TextureCompressor::Compress(format, levelSize, pLevel, &chain[offset], ThreadPool::GetPool());
+        offset += TextureCompressor::LevelBytes(format, levelSize);
+        if (i + 1 < levels)
+        {
+            Downsample(levelSize, pLevel, nextLevel);
+            level.swap(nextLevel);
+            pLevel = &level[0];
+        }
+    }
+}
+
+void TextureManager::Upload(unsigned int material, int size, TextureFormat format, const unsigned char* pChain)
+{
+    // A replacement of the same size and format reuses its layer.
+    MaterialTexture slot;
+    std::map<unsigned int, MaterialTexture>::iterator existing = materials.find(material);
+    if (existing != materials.end() && arrays[existing->second.array].size == size && arrays[existing->second.array].format == format)
+    {
+        slot = existing->second;
+    }
+    else
+    {
+        if (existing != materials.end())
+        {
+            ReleaseLayer(existing->second);
+        }
+
+        slot.array = AllocateLayer(size, format, slot.layer);
+        materials[material] = slot;
+    }
+
+    const TextureArray& array = arrays[slot.array];
+    GLenum internalFormat = TextureCompressor::InternalFormat(format);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int i = 0; i < array.levels; i++)
+    {
+        int levelSize = std::max(size >> i, 1);
+        size_t levelBytes = TextureCompressor::LevelBytes(format, levelSize);
+        if (TextureCompressor::IsCompressed(format))
+        {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, slot.layer, levelSize, levelSize, 1, internalFormat, (GLsizei)levelBytes, pChain);
+        }
+        else
+        {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, slot.layer, levelSize, levelSize, 1, GL_RGBA, GL_UNSIGNED_BYTE, pChain);
+        }
+
+        pChain += levelBytes;
+    }
+}
+
+bool TextureManager::SetTexture(unsigned int material, int width, int height, const unsigned char* pRgba)
+{
+    if (width <= 0 || height <= 0 || pRgba == NULL)
+    {
+        std::cout << "Texture for material " << material << " has no pixels!" << std::endl;
+        return false;
+    }
+
+    int size;
+    TextureFormat format;
+    std::vector<unsigned char> chain;
+    BuildChain(width, height, pRgba, size, format, chain);
+    Upload(material, size, format, &chain[0]);
+    return true;
+}
+
+std::string TextureManager::CacheFilename(unsigned long long hash) const
+{
+    std::stringstream filename;
+    filename << cacheDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << hash << ".tex";
+    return filename.str();
+}
+
+bool TextureManager::WriteChain(const std::string& cacheFilename, const TextureChain& chain)
+{
+    size_t chainBytes = TextureCompressor::ChainBytes(chain.format, chain.size, chain.levels);
+    CacheHeader header = { CACHE_MAGIC, CACHE_VERSION, (unsigned int)chain.format, (unsigned int)chain.size,
+        (unsigned int)chain.levels, (unsigned int)chainBytes };
+
+    // A half-written file fails the length check next time and is simply rebuilt.
+    std::ofstream file(cacheFilename.c_str(), std::ios::binary);
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)chain.pData, chainBytes);
+    return !file.fail();
+}
+
+bool TextureManager::ReadChain(const MappedFile& file, TextureChain& chain) const
+{
+    if (file.Data() == NULL || file.Size() < sizeof(CacheHeader))
+    {
+        return false;
+    }
+
+    CacheHeader header;
+    memcpy(&header, file.Data(), sizeof(header));
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.format > TEXTURE_BC3
+        || header.size < (unsigned int)MIN_SIZE || header.size > (unsigned int)GLManager::TEXTURE_WH)
+    {
+        return false;
+    }
+
+    chain.format = (TextureFormat)header.format;
+    chain.size = (int)header.size;
+    chain.levels = TextureCompressor::LevelCount(chain.size);
+
+    chain.pData = file.Data() + sizeof(CacheHeader);
+    return (chain.format == TEXTURE_RGBA8 || compressionSupported) && header.levels == (unsigned int)chain.levels
+        && header.chainBytes == TextureCompressor::ChainBytes(chain.format, chain.size, chain.levels)
+        && file.Size() >= sizeof(CacheHeader) + header.chainBytes;
+}
+
+bool TextureManager::PrepareEntry(unsigned long long contentHash, const TextureSource& source, std::string& cacheFilename) const
+{
+    // 64-bit FNV-1a over everything that changes the encoding, then the content.
+    unsigned int settings[3] = { CACHE_VERSION, (unsigned int)compressionSupported, (unsigned int)GLManager::TEXTURE_WH };
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(settings); i++)
+    {
+        hash = (hash ^ ((const unsigned char*)settings)[i]) * 1099511628211ull;
+    }
+
+    for (size_t i = 0; i < sizeof(contentHash); i++)
+    {
+        hash = (hash ^ ((const unsigned char*)&contentHash)[i]) * 1099511628211ull;
+    }
+
+    cacheFilename = CacheFilename(hash);
+    MappedFile cached;
+    TextureChain chain;
+    if (cached.Open(cacheFilename) && ReadChain(cached, chain))
+    {
+        return true;
+    }
+
+    cached.Close();
+    int width, height;
+    std::vector<unsigned char> rgba, encoded;
+    if (!source(width, height, rgba))
+    {
+        return false;
+    }
+
+    BuildChain(width, height, &rgba[0], chain.size, chain.format, encoded);
+    chain.levels = TextureCompressor::LevelCount(chain.size);
+    chain.pData = &encoded[0];
+    if (!WriteChain(cacheFilename, chain))
+    {
+        std::cout << "Could not write texture cache entry " << cacheFilename << "!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool TextureManager::PrepareTexture(const std::string& filename, std::string& cacheFilename) const
+{
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+    {
+        std::cout << "Could not open texture " << filename << "!" << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+
+    return PrepareEntry(hash, [&](int& width, int& height, std::vector<unsigned char>& rgba)
+    {
+        return DecodeTga(data, filename, width, height, rgba);
+    }, cacheFilename);
+}
+
+bool TextureManager::LoadTexture(unsigned int material, const std::string& filename)
+{
+    if (cacheDirectory.empty())
+    {
+        int width, height;
+        std::vector<unsigned char> rgba;
+        return LoadTga(filename, width, height, rgba) && SetTexture(material, width, height, &rgba[0]);
+    }
+
+    // Freshly encoded entries are mapped too; they are still in the file cache.
+    std::string cacheFilename;
+    MappedFile cached;
+    TextureChain chain;
+    if (!PrepareTexture(filename, cacheFilename) || !cached.Open(cacheFilename) || !ReadChain(cached, chain))
+    {
+        return false;
+    }
+
+    SetChain(material, chain, chain.size);
+    return true;
+}
+
+void TextureManager::SetChain(unsigned int material, const TextureChain& chain, int maxSize)
+{
+    int level = 0;
+    while (level + 1 < chain.levels && (chain.size >> level) > maxSize)
+    {
+        level++;
+    }
+
+    Upload(material, std::max(chain.size >> level, 1), chain.format, chain.pData + TextureCompressor::ChainBytes(chain.format, chain.size, level));
+}
+
+int TextureManager::TextureSize(unsigned int material) const
+{
+    std::map<unsigned int, MaterialTexture>::const_iterator existing = materials.find(material);
+    return existing == materials.end() ? 0 : arrays[existing->second.array].size;
+}
+
+void TextureManager::RemoveTexture(unsigned int material)
+{
+    std::map<unsigned int, MaterialTexture>::iterator existing = materials.find(material);
+    if (existing != materials.end())
+    {
+        ReleaseLayer(existing->second);
+        materials.erase(existing);
+    }
+}
+
+bool TextureManager::GetSlot(unsigned int material, TextureSlot& slot) const
+{
+    std::map<unsigned int, MaterialTexture>::const_iterator existing = materials.find(material);
+    if (existing == materials.end())
+    {
+        return false;
+    }
+
+    slot.texture = arrays[existing->second.array].texture;
+    slot.layer = existing->second.layer;
+    return true;
+}
+
+size_t TextureManager::ArrayCount() const
+{
+    return arrays.size();
+}
+
+size_t TextureManager::MemoryBytes() const
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < arrays.size(); i++)
+    {
+        bytes += TextureCompressor::ChainBytes(arrays[i].format, arrays[i].size, arrays[i].levels) * arrays[i].capacity;
+    }
+
+    return bytes;
+}
+
+bool TextureManager::LoadTga(const std::string& filename, int& width, int& height, std::vector<unsigned char>& rgba)
+{
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+    {
+        std::cout << "Could not open texture " << filename << "!" << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return DecodeTga(data, filename, width, height, rgba);
+}
+
+bool TextureManager::DecodeTga(const std::vector<unsigned char>& data, const std::string& filename, int& width, int& height,
+    std::vector<unsigned char>& rgba)
+{
+    if (data.size() < 18)
+    {
+        std::cout << "Texture " << filename << " is too short to be a TGA file!" << std::endl;
+        return false;
+    }
+
+    // Header fields are little-endian.
+    int idLength = data[0], colorMapType = data[1], imageType = data[2];
+    int colorMapLength = data[5] | (data[6] << 8), colorMapEntryBits = data[7];
+    width = data[12] | (data[13] << 8);
+    height = data[14] | (data[15] << 8);
+    int bitsPerPixel = data[16], descriptor = data[17];
+
+    bool rle = imageType == 10 || imageType == 11;
+    bool gray = imageType == 3 || imageType == 11;
+    if ((imageType != 2 && imageType != 3 && !rle) || (gray ? bitsPerPixel != 8 : bitsPerPixel != 24 && bitsPerPixel != 32)
+        || width == 0 || height == 0)
+    {
+        std::cout << "Texture " << filename << " is not an uncompressed or RLE true-color or grayscale TGA file!" << std::endl;
+        return false;
+    }
+
+    size_t offset = 18 + idLength + (colorMapType == 1 ? colorMapLength * ((colorMapEntryBits + 7) / 8) : 0);
+    int bytesPerPixel = bitsPerPixel / 8;
+    size_t pixelCount = (size_t)width * height;
+    rgba.resize(pixelCount * 4);
+
+    // Pixels are stored as BGR(A) or a single gray value.
+    size_t pixel = 0;
+    bool truncated = false;
+    while (pixel < pixelCount && !truncated)
+    {
+        size_t run = 1;
+        bool repeated = false;
+        if (rle)
+        {
+            if (offset >= data.size())
+            {
+                truncated = true;
+                break;
+            }
+
+            run = (data[offset] & 0x7F) + 1;
+            repeated = (data[offset] & 0x80) != 0;
+            offset++;
+        }
+
+        run = std::min(run, pixelCount - pixel);
+        for (size_t i = 0; i < run; i++, pixel++)
+        {
+            if (offset + bytesPerPixel > data.size())
+            {
+                truncated = true;
+                break;
+            }
+
+            const unsigned char* pSource = &data[offset];
+            unsigned char* pTarget = &rgba[pixel * 4];
+            if (gray)
+            {
+                pTarget[0] = pTarget[1] = pTarget[2] = pSource[0];
+                pTarget[3] = 255;
+            }
+            else
+            {
+                pTarget[0] = pSource[2];
+                pTarget[1] = pSource[1];
+                pTarget[2] = pSource[0];
+                pTarget[3] = bytesPerPixel == 4 ? pSource[3] : 255;
+            }
+
+            // A repeated run holds one pixel value.
+            if (!repeated || i + 1 == run)
+            {
+                offset += bytesPerPixel;
+            }
+        }
+    }
+
+    if (truncated)
+    {
+        std::cout << "Texture " << filename << " is truncated!" << std::endl;
+        return false;
+    }
+
+    // Bit 4 of the descriptor puts the origin on the right, bit 5 at the top.
+    if (descriptor & 0x10)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width / 2; x++)
+            {
+                std::swap_ranges(&rgba[((size_t)y * width + x) * 4], &rgba[((size_t)y * width + x) * 4] + 4,
+                    &rgba[((size_t)y * width + width - 1 - x) * 4]);
+            }
+        }
+    }
+
+    if (descriptor & 0x20)
+    {
+        for (int y = 0; y < height / 2; y++)
+        {
+            std::swap_ranges(rgba.begin() + (size_t)y * width * 4, rgba.begin() + (size_t)(y + 1) * width * 4,
+                rgba.begin() + (size_t)(height - 1 - y) * width * 4);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,148 @@
+/*--------------------------------------------------------------------------
+    TextureManager.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "TextureCompressor.h"
+#include <functional>
+#include <map>
+
+class MappedFile;
+
+// Produces RGBA8 pixels, bottom row first, for a cache entry that has to be built.
+typedef std::function<bool(int& width, int& height, std::vector<unsigned char>& rgba)> TextureSource;
+
+// Where a material's texture lives: a layer of a GL_TEXTURE_2D_ARRAY.
+struct TextureSlot
+{
+    GLuint texture;
+    unsigned int layer;
+};
+
+// An encoded mip chain, largest level first. Any tail of it, from some level down, is a chain itself.
+struct TextureChain
+{
+    TextureFormat format;
+    int size;
+    int levels;
+    const unsigned char *pData;
+};
+
+// Packs material textures into array textures, one set per power-of-two size, so parts with different materials
+// share a handful of bindings and can be drawn together. Textures are resampled to a square power of two no larger
+// than GLManager::TEXTURE_WH and get a full box-filtered mip chain. Arrays start small and double as they fill,
+// copying their layers on the GPU; without ARB_copy_image a full array is left as is and another one is started.
+//
+// With S3TC support, textures are stored as BC1 or BC3, a quarter or half of their RGBA8 size. Files are only
+// decoded, resampled and compressed on first load: the finished mip chain is written to the cache directory under a
+// hash of the file's contents, and later loads map that file and upload straight from the mapping.
+class TextureManager
+{
+    static const int MIN_SIZE = 16;       // Smaller textures are scaled up to this.
+    static const int INITIAL_LAYERS = 4;
+
+    struct TextureArray
+    {
+        GLuint texture;
+        TextureFormat format;
+        int size;
+        int levels;
+        unsigned int capacity, used;
+        std::vector<unsigned int> freeLayers;
+    };
+
+    struct MaterialTexture
+    {
+        size_t array;
+        unsigned int layer;
+    };
+
+    std::vector<TextureArray> arrays;
+    std::map<unsigned int, MaterialTexture> materials;
+    GLint maxLayers;
+    float anisotropy;
+    bool compressionSupported;
+    std::string cacheDirectory;
+
+    // Finds or makes room for a layer of the given size and format, returning its array.
+    size_t AllocateLayer(int size, TextureFormat format, unsigned int& layer);
+    bool Grow(TextureArray& array);
+    GLuint CreateArray(int size, TextureFormat format, int levels, unsigned int capacity) const;
+    void ReleaseLayer(const MaterialTexture& material);
+
+    // Places a finished mip chain, as laid out by BuildChain, in the material's layer.
+    void Upload(unsigned int material, int size, TextureFormat format, const unsigned char* pChain);
+
+    // Resamples pixels to the layer size and encodes every mip level into one buffer, largest first.
+    void BuildChain(int width, int height, const unsigned char* pRgba, int& size, TextureFormat& format, std::vector<unsigned char>& chain) const;
+
+    std::string CacheFilename(unsigned long long hash) const;
+    static bool WriteChain(const std::string& cacheFilename, const TextureChain& chain);
+
+    // Box filtering when shrinking, bilinear when enlarging, of RGBA8 pixels to a square.
+    static void Resample(int width, int height, const unsigned char* pRgba, int size, std::vector<unsigned char>& result);
+
+    // Halves a square RGBA8 level with a box filter.
+    static void Downsample(int size, const unsigned char* pRgba, std::vector<unsigned char>& result);
+
+public:
+    // An empty cache directory disables the disk cache.
+    TextureManager(const std::string& cacheDirectory);
+    ~TextureManager();
+
+    bool Initialize();
+
+    // Sets a material's texture from RGBA8 pixels, bottom row first, replacing any it had.
+    bool SetTexture(unsigned int material, int width, int height, const unsigned char* pRgba);
+
+    // Sets a material's texture from a TGA file, or from its cached encoding.
+    bool LoadTexture(unsigned int material, const std::string& filename);
+
+    void RemoveTexture(unsigned int material);
+
+    // Makes sure the cache has an entry for some content, building and encoding it from the source if needed, and
+    // returns the entry's path. Touches no GL state, so it can run on a loader thread. Needs a cache directory.
+    bool PrepareEntry(unsigned long long contentHash, const TextureSource& source, std::string& cacheFilename) const;
+
+    // PrepareEntry for a TGA file, keyed by the file's contents.
+    bool PrepareTexture(const std::string& filename, std::string& cacheFilename) const;
+
+    // Validates a mapped cache entry and points the chain into the mapping.
+    bool ReadChain(const MappedFile& file, TextureChain& chain) const;
+
+    // Sets a material's texture from the levels of a chain no larger than maxSize.
+    void SetChain(unsigned int material, const TextureChain& chain, int maxSize);
+
+    // Size of the largest level of a material's texture, or 0 if it has none.
+    int TextureSize(unsigned int material) const;
+
+    // False if the material has no texture. Slots can move when textures are added, so look them up per frame.
+    bool GetSlot(unsigned int material, TextureSlot& slot) const;
+
+    // Number of array textures, and so of distinct bindings textured draws need.
+    size_t ArrayCount() const;
+
+    // GPU memory held by the arrays, including unused layers.
+    size_t MemoryBytes() const;
+
+    // Reads uncompressed or run-length encoded true-color and grayscale TGA files into RGBA8, bottom row first.
+    static bool LoadTga(const std::string& filename, int& width, int& height, std::vector<unsigned char>& rgba);
+    // As LoadTga, for a file already read into memory. The filename is only used in messages.
+    static bool DecodeTga(const std::vector<unsigned char>& data, const std::string& filename, int& width, int& height, std::vector<unsigned char>& rgba);
+};
@@ -0,0 +1,362 @@
+/*--------------------------------------------------------------------------
+    TextureStreamer.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "TextureStreamer.h"
+#include "GLManager.h"
+#include <algorithm>
+
+TextureStreamer::TextureStreamer(TextureManager* pTextures, size_t budgetBytes)
+    : pTextures(pTextures), budgetBytes(budgetBytes), residentBytes(0), loadingBytes(0), stopping(false)
+{
+    loaderThread = std::thread(&TextureStreamer::LoaderLoop, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        stopping = true;
+    }
+
+    jobAvailable.notify_all();
+    loaderThread.join();
+}
+
+void TextureStreamer::LoaderLoop()
+{
+    while (true)
+    {
+        LoadJob job;
+        {
+            std::unique_lock<std::mutex> lock(loaderMutex);
+            while (!stopping && jobs.empty())
+            {
+                jobAvailable.wait(lock);
+            }
+
+            if (stopping)
+            {
+                return;
+            }
+
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        // The texture's chain is only replaced on the GL thread when a job for it finishes, and it has one at a time.
+        StreamedTexture& texture = *job.pTexture;
+        if (job.size == 0 || (texture.pGraph && texture.chain.size < job.size))
+        {
+            std::string cacheFilename;
+            bool prepared;
+            if (texture.pGraph)
+            {
+                int size = job.size == 0 ? COARSE_SIZE : job.size;
+                const MaterialGraph& graph = *texture.pGraph;
+                prepared = pTextures->PrepareEntry((graph.Hash() ^ (unsigned long long)size) * 1099511628211ull,
+                    [&](int& width, int& height, std::vector<unsigned char>& rgba) -> bool
+                    {
+                        width = height = size;
+                        graph.Bake(size, rgba, ThreadPool::GetPool());
+                        return true;
+                    }, cacheFilename);
+            }
+            else
+            {
+                prepared = pTextures->PrepareTexture(texture.filename, cacheFilename);
+            }
+
+            job.pFile = std::make_shared<MappedFile>();
+            job.success = prepared && job.pFile->Open(cacheFilename) && pTextures->ReadChain(*job.pFile, job.chain);
+        }
+        else
+        {
+            // Touching a byte of every page of the new levels faults them in here rather than in the upload.
+            const TextureChain& chain = texture.chain;
+            int level = 0;
+            while (level + 1 < chain.levels && (chain.size >> level) > job.size)
+            {
+                level++;
+            }
+
+            size_t begin = TextureCompressor::ChainBytes(chain.format, chain.size, level);
+            size_t end = begin + TextureCompressor::LevelBytes(chain.format, std::max(chain.size >> level, 1));
+            volatile unsigned char sum = 0;
+            for (size_t offset = begin; offset < end; offset += 4096)
+            {
+                sum += chain.pData[offset];
+            }
+
+            job.success = true;
+        }
+
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        finished.push_back(job);
+    }
+}
+
+void TextureStreamer::Queue(unsigned int material, const std::shared_ptr<StreamedTexture>& pTexture, int size)
+{
+    LoadJob job;
+    job.material = material;
+    job.pTexture = pTexture;
+    job.size = size;
+    job.success = false;
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        jobs.push_back(job);
+    }
+
+    jobAvailable.notify_one();
+}
+
+void TextureStreamer::Register(unsigned int material, const std::string& filename)
+{
+    Unregister(material);
+
+    std::shared_ptr<StreamedTexture> pTexture = std::make_shared<StreamedTexture>();
+    pTexture->filename = filename;
+    pTexture->fullSize = 0;
+    pTexture->ready = false;
+    pTexture->residentSize = 0;
+    pTexture->wantedSize = COARSE_SIZE;
+    pTexture->loadingSize = 0;
+    textures[material] = pTexture;
+    Queue(material, pTexture, 0);
+}
+
+void TextureStreamer::Register(unsigned int material, const MaterialGraph& graph)
+{
+    Unregister(material);
+
+    std::shared_ptr<StreamedTexture> pTexture = std::make_shared<StreamedTexture>();
+    pTexture->filename = "procedural material";
+    pTexture->pGraph = std::make_shared<MaterialGraph>(graph);
+    pTexture->fullSize = 0;
+    pTexture->ready = false;
+    pTexture->residentSize = 0;
+    pTexture->wantedSize = COARSE_SIZE;
+    pTexture->loadingSize = 0;
+    textures[material] = pTexture;
+    Queue(material, pTexture, 0);
+}
+
+void TextureStreamer::Unregister(unsigned int material)
+{
+    std::map<unsigned int, std::shared_ptr<StreamedTexture>>::iterator existing = textures.find(material);
+    if (existing == textures.end())
+    {
+        return;
+    }
+
+    // Loads in flight keep the texture alive, and are dropped when they finish.
+    StreamedTexture& texture = *existing->second;
+    if (texture.residentSize != 0)
+    {
+        residentBytes -= LevelBytes(texture, texture.residentSize);
+        pTextures->RemoveTexture(material);
+    }
+
+    if (texture.loadingSize != 0)
+    {
+        loadingBytes -= LevelBytes(texture, texture.loadingSize) - LevelBytes(texture, texture.residentSize);
+    }
+
+    textures.erase(existing);
+}
+
+void TextureStreamer::SetBudget(size_t budgetBytes)
+{
+    this->budgetBytes = budgetBytes;
+}
+
+size_t TextureStreamer::ResidentBytes() const
+{
+    return residentBytes;
+}
+
+size_t TextureStreamer::LevelBytes(const StreamedTexture& texture, int size) const
+{
+    size = std::min(size, texture.fullSize);
+    return TextureCompressor::ChainBytes(texture.chain.format, size, TextureCompressor::LevelCount(size));
+}
+
+void TextureStreamer::MakeResident(unsigned int material, StreamedTexture& texture, int size)
+{
+    if (texture.residentSize != 0)
+    {
+        residentBytes -= LevelBytes(texture, texture.residentSize);
+    }
+
+    pTextures->SetChain(material, texture.chain, size);
+    texture.residentSize = pTextures->TextureSize(material);
+    residentBytes += LevelBytes(texture, texture.residentSize);
+}
+
+void TextureStreamer::RequestSize(unsigned int material, float pixels)
+{
+    std::map<unsigned int, std::shared_ptr<StreamedTexture>>::iterator existing = textures.find(material);
+    if (existing == textures.end())
+    {
+        return;
+    }
+
+    // A texel per pixel is enough; the next power of two up keeps it sharp.
+    int size = COARSE_SIZE;
+    while ((float)size < pixels && size < GLManager::TEXTURE_WH)
+    {
+        size *= 2;
+    }
+
+    existing->second->wantedSize = std::max(existing->second->wantedSize, size);
+}
+
+bool TextureStreamer::MakeRoom(size_t needed)
+{
+    if (residentBytes + loadingBytes + needed <= budgetBytes)
+    {
+        return true;
+    }
+
+    // Most oversized first.
+    std::vector<std::pair<float, unsigned int>> candidates;
+    for (std::map<unsigned int, std::shared_ptr<StreamedTexture>>::iterator iter = textures.begin(); iter != textures.end(); ++iter)
+    {
+        const StreamedTexture& texture = *iter->second;
+        if (texture.ready && texture.loadingSize == 0 && texture.residentSize > texture.wantedSize)
+        {
+            candidates.push_back(std::make_pair((float)texture.residentSize / (float)texture.wantedSize, iter->first));
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+    for (size_t i = candidates.size(); i > 0 && residentBytes + loadingBytes + needed > budgetBytes; i--)
+    {
+        StreamedTexture& texture = *textures[candidates[i - 1].second];
+        MakeResident(candidates[i - 1].second, texture, texture.wantedSize);
+    }
+
+    return residentBytes + loadingBytes + needed <= budgetBytes;
+}
+
+void TextureStreamer::Update()
+{
+    std::vector<LoadJob> done;
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        done.swap(finished);
+    }
+
+    size_t uploadedBytes = 0;
+    for (size_t i = 0; i < done.size(); i++)
+    {
+        LoadJob& job = done[i];
+        std::map<unsigned int, std::shared_ptr<StreamedTexture>>::iterator existing = textures.find(job.material);
+        if (existing == textures.end() || existing->second != job.pTexture)
+        {
+            continue;
+        }
+
+        StreamedTexture& texture = *job.pTexture;
+        if (job.pFile && job.success)
+        {
+            texture.pFile = job.pFile;
+            texture.chain = job.chain;
+        }
+
+        if (job.size == 0)
+        {
+            if (!job.success)
+            {
+                std::cout << "Could not stream texture " << texture.filename << "!" << std::endl;
+                continue;
+            }
+
+            // Coarse levels are always resident, budget or not.
+            texture.fullSize = texture.pGraph ? GLManager::TEXTURE_WH : texture.chain.size;
+            texture.ready = true;
+            MakeResident(job.material, texture, COARSE_SIZE);
+            uploadedBytes += LevelBytes(texture, texture.residentSize);
+            continue;
+        }
+
+        // Loads that would go over the upload limit are dropped, and requested again later from warm pages.
+        loadingBytes -= LevelBytes(texture, texture.loadingSize) - LevelBytes(texture, texture.residentSize);
+        texture.loadingSize = 0;
+        if (!job.success)
+        {
+            std::cout << "Could not stream texture " << texture.filename << " at " << job.size << "x" << job.size << "!" << std::endl;
+            texture.fullSize = texture.residentSize;
+            continue;
+        }
+
+        size_t bytes = LevelBytes(texture, job.size);
+        if (uploadedBytes + bytes <= (size_t)MAX_UPLOAD_BYTES || uploadedBytes == 0)
+        {
+            MakeResident(job.material, texture, job.size);
+            uploadedBytes += bytes;
+        }
+    }
+
+    // Finer levels for the textures furthest below the size they are seen at.
+    std::vector<std::pair<float, unsigned int>> upgrades;
+    for (std::map<unsigned int, std::shared_ptr<StreamedTexture>>::iterator iter = textures.begin(); iter != textures.end(); ++iter)
+    {
+        const StreamedTexture& texture = *iter->second;
+        if (texture.ready && texture.loadingSize == 0 && texture.residentSize < std::min(texture.wantedSize, texture.fullSize))
+        {
+            upgrades.push_back(std::make_pair((float)texture.wantedSize / (float)texture.residentSize, iter->first));
+        }
+    }
+
+    std::sort(upgrades.begin(), upgrades.end());
+    for (size_t i = upgrades.size(); i > 0; i--)
+    {
+        unsigned int material = upgrades[i - 1].second;
+        std::shared_ptr<StreamedTexture> pTexture = textures[material];
+        int size = pTexture->residentSize * 2;
+        size_t cost = LevelBytes(*pTexture, size) - LevelBytes(*pTexture, pTexture->residentSize);
+        if (!MakeRoom(cost))
+        {
+            break;
+        }
+
+        pTexture->loadingSize = size;
+        loadingBytes += cost;
+        Queue(material, pTexture, size);
+    }
+
+    // Rebuilt by the next frame's requests.
+    for (std::map<unsigned int, std::shared_ptr<StreamedTexture>>::iterator iter = textures.begin(); iter != textures.end(); ++iter)
+    {
+        iter->second->wantedSize = COARSE_SIZE;
+    }
+}
+
+float TextureStreamer::ProjectedSize(const gm::mat4& projection, const float viewCenter[3], float radius, int viewportHeight)
+{
+    // The camera looks down -Z. Spheres reaching the camera plane could cover the whole view.
+    float distance = -viewCenter[2];
+    if (distance <= radius)
+    {
+        return (float)viewportHeight;
+    }
+
+    return radius * projection[1][1] * (float)viewportHeight / distance;
+}
@@ -0,0 +1,115 @@
+/*--------------------------------------------------------------------------
+    TextureStreamer.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "MappedFile.h"
+#include "MaterialGraph.h"
+#include "TextureManager.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Keeps material textures resident at the detail they are seen at. Registered textures are encoded into the texture
+// cache on a loader thread and first uploaded at COARSE_SIZE. Each frame the renderer reports how large materials
+// appear on screen; finer levels are then paged in from the mapped cache entry on the loader thread and uploaded on a
+// later Update, one level at a time and largest shortfall first, while resident textures fit in the budget. When room
+// is needed, textures seen smaller than they are resident drop back to the size they are seen at.
+//
+// Procedural materials are baked on the loader thread instead, at each size as it is first needed. Bakes go through
+// the texture cache keyed by the graph's hash, so a material is only ever baked once per size.
+//
+// The budget covers the levels textures hold. Layers freed by a texture changing size stay allocated in
+// TextureManager's arrays and are reused by the next texture of that size.
+class TextureStreamer
+{
+public:
+    static const int COARSE_SIZE = 64;
+    static const int MAX_UPLOAD_BYTES = 8 << 20; // Per Update, to keep streaming from causing hitches.
+
+private:
+    struct StreamedTexture
+    {
+        std::string filename;
+        std::shared_ptr<MaterialGraph> pGraph; // Baked instead of loading a file, if set.
+        std::shared_ptr<MappedFile> pFile;     // The cache entry the chain points into.
+        TextureChain chain;
+        int fullSize;      // Largest size the texture can have.
+        bool ready;
+        int residentSize;  // 0 until the coarse levels are uploaded.
+        int wantedSize;
+        int loadingSize;   // Size being paged in, or 0.
+    };
+
+    // Preparing a registered texture (size 0), or bringing in its levels up to a size.
+    struct LoadJob
+    {
+        unsigned int material;
+        std::shared_ptr<StreamedTexture> pTexture;
+        int size;
+        bool success;
+        std::shared_ptr<MappedFile> pFile; // A new cache entry and its chain, when one was prepared or baked.
+        TextureChain chain;
+    };
+
+    TextureManager *pTextures;
+    size_t budgetBytes, residentBytes, loadingBytes;
+    std::map<unsigned int, std::shared_ptr<StreamedTexture>> textures;
+
+    std::thread loaderThread;
+    std::mutex loaderMutex;
+    std::condition_variable jobAvailable;
+    std::deque<LoadJob> jobs;
+    std::vector<LoadJob> finished;
+    bool stopping;
+
+    void LoaderLoop();
+    void Queue(unsigned int material, const std::shared_ptr<StreamedTexture>& pTexture, int size);
+
+    // Bytes of the levels a texture holds when its largest is at most 'size'.
+    size_t LevelBytes(const StreamedTexture& texture, int size) const;
+    void MakeResident(unsigned int material, StreamedTexture& texture, int size);
+
+    // Shrinks textures seen smaller than they are resident until 'needed' more bytes fit in the budget.
+    bool MakeRoom(size_t needed);
+
+public:
+    TextureStreamer(TextureManager* pTextures, size_t budgetBytes);
+    ~TextureStreamer();
+
+    // Starts streaming a material's texture from a TGA file.
+    void Register(unsigned int material, const std::string& filename);
+
+    // Starts streaming a procedural material, baked as needed.
+    void Register(unsigned int material, const MaterialGraph& graph);
+    void Unregister(unsigned int material);
+
+    void SetBudget(size_t budgetBytes);
+    size_t ResidentBytes() const;
+
+    // Reports that a material is drawn about this many pixels across. Call before Update; materials not
+    // reported in a frame are wanted at COARSE_SIZE.
+    void RequestSize(unsigned int material, float pixels);
+
+    // Uploads finished loads and starts new ones. Call once per frame on the GL thread.
+    void Update();
+
+    // Approximate on-screen diameter in pixels of a sphere centered at a view-space position.
+    static float ProjectedSize(const gm::mat4& projection, const float viewCenter[3], float radius, int viewportHeight);
+};
@@ -0,0 +1,290 @@
+/*--------------------------------------------------------------------------
+    ThreadPool.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool *ThreadPool::m_pPool;
+
+// Slots in the task ring. ParallelFor queues at most one helper per worker, so this only fills up when
+// many one-off tasks are queued at once.
+static const size_t TASK_CAPACITY = 4096;
+
+// The pool and index of the worker running on this thread.
+static THREAD_LOCAL const ThreadPool *pCurrentPool = NULL;
+static THREAD_LOCAL int currentWorker = -1;
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+    : tasks(TASK_CAPACITY), firstTask(0), taskCount(0), stopping(false)
+{
+    for (unsigned int i = 0; i < threadCount; i++)
+    {
+        workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        stopping = true;
+    }
+
+    taskAvailable.notify_all();
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+void ThreadPool::WorkerLoop(unsigned int index)
+{
+    pCurrentPool = this;
+    currentWorker = (int)index;
+    while (true)
+    {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(taskMutex);
+            while (!stopping && taskCount == 0)
+            {
+                taskAvailable.wait(lock);
+            }
+
+            if (stopping && taskCount == 0)
+            {
+                return;
+            }
+
+            task = tasks[firstTask];
+            firstTask = (firstTask + 1) % tasks.size();
+            taskCount--;
+        }
+
+        spaceAvailable.notify_one();
+        if (task.pRun != NULL)
+        {
+            task.pRun(task.pContext);
+        }
+    }
+}
+
+unsigned int ThreadPool::ThreadCount() const
+{
+    return (unsigned int)workers.size();
+}
+
+int ThreadPool::WorkerIndex() const
+{
+    return pCurrentPool == this ? currentWorker : -1;
+}
+
+bool ThreadPool::TryPush(void (*pRun)(void*), void* pContext)
+{
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        if (taskCount == tasks.size())
+        {
+            return false;
+        }
+
+        Task& task = tasks[(firstTask + taskCount) % tasks.size()];
+        task.pRun = pRun;
+        task.pContext = pContext;
+        taskCount++;
+    }
+
+    taskAvailable.notify_one();
+    return true;
+}
+
+void ThreadPool::Enqueue(void (*pRun)(void*), void* pContext)
+{
+    while (!TryPush(pRun, pContext))
+    {
+        // Waiting on a full queue from a worker could deadlock the pool.
+        if (WorkerIndex() >= 0)
+        {
+            pRun(pContext);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(taskMutex);
+        while (taskCount == tasks.size())
+        {
+            spaceAvailable.wait(lock);
+        }
+    }
+}
+
+size_t ThreadPool::Cancel(void (*pRun)(void*), void* pContext)
+{
+    std::lock_guard<std::mutex> lock(taskMutex);
+    size_t cancelled = 0;
+    for (size_t i = 0; i < taskCount; i++)
+    {
+        Task& task = tasks[(firstTask + i) % tasks.size()];
+        if (task.pRun == pRun && task.pContext == pContext)
+        {
+            task.pRun = NULL;
+            cancelled++;
+        }
+    }
+
+    return cancelled;
+}
+
+void ThreadPool::RunFunction(void* pTask)
+{
+    std::function<void()> *pFunction = (std::function<void()>*)pTask;
+    (*pFunction)();
+    delete pFunction;
+}
+
+void ThreadPool::Enqueue(std::function<void()> task)
+{
+    Enqueue(&ThreadPool::RunFunction, new std::function<void()>(task));
+}
+
+// Bookkeeping for a single ParallelFor call, kept on the caller's stack. Helpers that start after all chunks
+// are claimed simply exit.
+struct ParallelForState
+{
+    std::atomic<size_t> nextChunk;
+    std::atomic<size_t> chunksDone;
+    size_t helpersDone; // Guarded by the pool's doneMutex.
+    size_t chunkCount;
+    size_t count;
+    size_t chunkSize;
+    const std::function<void(size_t, size_t)> *pFunc; // Owned by the caller, which waits for every claimed chunk.
+
+    std::mutex *pDoneMutex;
+    std::condition_variable *pDoneCondition;
+
+    void Notify()
+    {
+        std::lock_guard<std::mutex> lock(*pDoneMutex);
+        pDoneCondition->notify_all();
+    }
+
+    // Claims and runs chunks until none are left.
+    void Run()
+    {
+        size_t chunk;
+        while ((chunk = nextChunk++) < chunkCount)
+        {
+            size_t begin = chunk * chunkSize;
+            size_t end = std::min(begin + chunkSize, count);
+            (*pFunc)(begin, end);
+
+            if (++chunksDone == chunkCount)
+            {
+                Notify();
+            }
+        }
+    }
+};
+
+void ThreadPool::RunHelper(void* pState)
+{
+    ParallelForState *pForState = (ParallelForState*)pState;
+    pForState->Run();
+
+    // The caller's stack frame holds the state, so this must be the helper's last touch of it.
+    std::lock_guard<std::mutex> lock(*pForState->pDoneMutex);
+    pForState->helpersDone++;
+    pForState->pDoneCondition->notify_all();
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t)>& func)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    chunkSize = std::max(chunkSize, (size_t)1);
+    size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    if (chunkCount == 1 || workers.empty())
+    {
+        func(0, count);
+        return;
+    }
+
+    ParallelForState state;
+    state.nextChunk = 0;
+    state.chunksDone = 0;
+    state.helpersDone = 0;
+    state.chunkCount = chunkCount;
+    state.count = count;
+    state.chunkSize = chunkSize;
+    state.pFunc = &func;
+    state.pDoneMutex = &doneMutex;
+    state.pDoneCondition = &doneCondition;
+
+    // The caller takes one share of the work itself, so helpers that don't fit in the queue are skipped.
+    size_t helpers = std::min((size_t)workers.size(), chunkCount - 1);
+    size_t queued = 0;
+    while (queued < helpers && TryPush(&ThreadPool::RunHelper, &state))
+    {
+        queued++;
+    }
+
+    state.Run();
+
+    // Helpers still in the queue are taken back, so none can touch the state after this returns.
+    size_t started = queued - Cancel(&ThreadPool::RunHelper, &state);
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    while (state.chunksDone != chunkCount || state.helpersDone != started)
+    {
+        doneCondition.wait(lock);
+    }
+}
+
+void ThreadPool::RunChunks(ThreadPool* pPool, size_t count, size_t chunkSize, const std::function<void(size_t, size_t)>& func)
+{
+    if (pPool != NULL)
+    {
+        pPool->ParallelFor(count, chunkSize, func);
+    }
+    else if (count != 0)
+    {
+        func(0, count);
+    }
+}
+
+bool ThreadPool::Initialize()
+{
+    unsigned int threadCount = std::thread::hardware_concurrency();
+    m_pPool = new ThreadPool(threadCount > 1 ? threadCount - 1 : 1);
+    return true;
+}
+
+ThreadPool* ThreadPool::GetPool()
+{
+    return m_pPool;
+}
+
+bool ThreadPool::Deinitialize()
+{
+    delete m_pPool;
+    m_pPool = NULL;
+    return true;
+}
@@ -0,0 +1,114 @@
+/*--------------------------------------------------------------------------
+    ThreadPool.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+// Plain thread-local storage for POD values, as VS2012 lacks thread_local.
+#ifdef _WIN32
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// Fixed-size pool of worker threads used to split CPU-heavy work (meshing, repair, etc.) across cores.
+class ThreadPool
+{
+    static ThreadPool *m_pPool;
+
+    // A queued call of pRun(pContext). Cancelled tasks keep their slot with a NULL pRun.
+    struct Task
+    {
+        void (*pRun)(void*);
+        void *pContext;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<Task> tasks; // Fixed-capacity ring, allocated once so queueing never allocates.
+    size_t firstTask;
+    size_t taskCount;
+    std::mutex taskMutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable spaceAvailable;
+    bool stopping;
+
+    // Shared by every ParallelFor call, so none has to construct its own.
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+
+    void WorkerLoop(unsigned int index);
+    bool TryPush(void (*pRun)(void*), void* pContext);
+    static void RunHelper(void* pState);
+    static void RunFunction(void* pTask);
+
+public:
+    ThreadPool(unsigned int threadCount);
+    ~ThreadPool();
+
+    // Number of worker threads (not including callers that help out in ParallelFor).
+    unsigned int ThreadCount() const;
+
+    // Index of the calling thread among this pool's workers, or -1 if it isn't one of them.
+    int WorkerIndex() const;
+
+    // Queues pRun(pContext) to run on a worker thread without allocating. If the queue is full, a worker of
+    // this pool runs the task inline and any other thread waits for space.
+    void Enqueue(void (*pRun)(void*), void* pContext);
+
+    // Removes queued calls of pRun(pContext) that no worker has started yet, returning how many there were.
+    size_t Cancel(void (*pRun)(void*), void* pContext);
+
+    // Queues a one-off task to run on a worker thread. The task is copied to the heap, so work issued every
+    // frame should use the function and context form instead.
+    void Enqueue(std::function<void()> task);
+
+    // Splits [0, count) into chunks of chunkSize and runs func(begin, end) on each, blocking until all are done.
+    // The calling thread also processes chunks, so this is safe to call from within a worker task.
+    void ParallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t)>& func);
+
+    // ParallelFor on pPool, or a single inline call when pPool is NULL.
+    static void RunChunks(ThreadPool* pPool, size_t count, size_t chunkSize, const std::function<void(size_t, size_t)>& func);
+
+    // Shared pool, sized to the hardware thread count.
+    static bool Initialize();
+    static ThreadPool* GetPool();
+    static bool Deinitialize();
+};
+
+// Appends per-chunk results in chunk order so the output does not depend on thread timing.
+template <typename T>
+void ConcatenateChunks(std::vector<std::vector<T>>& chunks, std::vector<T>& result)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        total += chunks[i].size();
+    }
+
+    result.clear();
+    result.reserve(total);
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        result.insert(result.end(), chunks[i].begin(), chunks[i].end());
+    }
+}
@@ -0,0 +1,899 @@
+/*--------------------------------------------------------------------------
+    ToolpathGenerator.cpp
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#include "stdafx.h"
+#include "ToolpathGenerator.h"
+#include <algorithm>
+#include <cstdio>
+
+ToolpathSettings::ToolpathSettings()
+    : toolDiameter(3.175f), stepDown(1.0f), stepOver(1.2f), finishAllowance(0.2f), resolution(0.05f), safeHeight(5.0f),
+      feedRate(600.0f), plungeRate(150.0f), spindleSpeed(12000)
+{
+}
+
+// Distances beyond anything on the stock, for samples with nothing to measure to.
+static const float FAR_DISTANCE = 1e20f;
+
+// Cell-centered samples covering the stock, shared by every layer.
+struct OffsetGrid
+{
+    float x0, y0, cellSize;
+    int width, height;
+
+    float X(int i) const
+    {
+        return x0 + ((float)i + 0.5f) * cellSize;
+    }
+
+    float Y(int j) const
+    {
+        return y0 + ((float)j + 0.5f) * cellSize;
+    }
+};
+
+// Where a contour crosses the center line of a grid row or column.
+struct Crossing
+{
+    float position;
+    int winding; // +1 where the contour crosses a row going up, -1 going down.
+
+    bool operator<(const Crossing& other) const
+    {
+        return position < other.position;
+    }
+};
+
+// Crossings of every row (axis 0, positions along x) or column (axis 1, positions along y) with the contours.
+static void FindCrossings(const std::vector<Contour>& contours, const OffsetGrid& grid, int axis, std::vector<std::vector<Crossing>>& lines)
+{
+    int lineCount = axis == 0 ? grid.height : grid.width;
+    float origin = axis == 0 ? grid.y0 : grid.x0;
+    lines.resize(lineCount);
+    for (int i = 0; i < lineCount; i++)
+    {
+        lines[i].clear();
+    }
+
+    // Lines whose centers lie in [low, high) of an edge, so a line through a vertex is crossed by just one of its edges.
+    auto firstLine = [&](float v) -> int
+    {
+        return std::max(0, std::min(lineCount, (int)ceilf((v - origin) / grid.cellSize - 0.5f)));
+    };
+
+    for (size_t c = 0; c < contours.size(); c++)
+    {
+        const std::vector<float>& points = contours[c].points;
+        size_t count = contours[c].PointCount();
+        for (size_t p = 0, q = count - 1; p < count; q = p++)
+        {
+            float pu = points[q*2 + axis], pv = points[q*2 + 1 - axis];
+            float qu = points[p*2 + axis], qv = points[p*2 + 1 - axis];
+            if (pv == qv)
+            {
+                continue;
+            }
+
+            int winding = qv > pv ? 1 : -1;
+            int end = firstLine(std::max(pv, qv));
+            for (int line = firstLine(std::min(pv, qv)); line < end; line++)
+            {
+                float v = origin + ((float)line + 0.5f) * grid.cellSize;
+                Crossing crossing;
+                crossing.position = pu + (v - pv) * (qu - pu) / (qv - pv);
+                crossing.winding = axis == 0 ? winding : -winding;
+                lines[line].push_back(crossing);
+            }
+        }
+    }
+
+    for (int i = 0; i < lineCount; i++)
+    {
+        std::sort(lines[i].begin(), lines[i].end());
+    }
+}
+
+// Squared distance along one line of samples to the nearest of the line's crossings, and whether each sample is
+// inside (nonzero winding).
+static void LineDistances(const std::vector<Crossing>& crossings, float origin, float cellSize, int count, float* pValues, int stride,
+    unsigned char* pInside)
+{
+    size_t next = 0;
+    int winding = 0;
+    for (int i = 0; i < count; i++)
+    {
+        float position = origin + ((float)i + 0.5f) * cellSize;
+        while (next < crossings.size() && crossings[next].position < position)
+        {
+            winding += crossings[next].winding;
+            next++;
+        }
+
+        float nearest = FAR_DISTANCE;
+        if (next > 0)
+        {
+            nearest = position - crossings[next - 1].position;
+        }
+
+        if (next < crossings.size())
+        {
+            nearest = std::min(nearest, crossings[next].position - position);
+        }
+
+        pValues[i*stride] = nearest < FAR_DISTANCE ? nearest*nearest : FAR_DISTANCE;
+        if (pInside)
+        {
+            pInside[i*stride] = winding != 0;
+        }
+    }
+}
+
+// Felzenszwalb and Huttenlocher's exact distance transform along one line: each sample becomes the smallest squared
+// distance to any sample plus that sample's own value, found from the lower envelope of the parabolas they define.
+static void DistanceTransform(float* pValues, int count, int stride, float cellSize, std::vector<int>& sites, std::vector<double>& starts,
+    std::vector<float>& input)
+{
+    input.resize(count);
+    sites.resize(count);
+    starts.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        input[i] = pValues[i*stride];
+    }
+
+    double scale = 1.0 / ((double)cellSize * cellSize);
+    int siteCount = 0;
+    for (int q = 0; q < count; q++)
+    {
+        if (input[q] >= FAR_DISTANCE)
+        {
+            continue;
+        }
+
+        // Where the new parabola drops below the last one on the envelope; that one is hidden if it had not started yet.
+        double start = -FAR_DISTANCE;
+        while (siteCount > 0)
+        {
+            int p = sites[siteCount - 1];
+            start = ((input[q] - input[p]) * scale + (double)q*q - (double)p*p) / (2.0 * (q - p));
+            if (start > starts[siteCount - 1])
+            {
+                break;
+            }
+
+            siteCount--;
+            start = -FAR_DISTANCE;
+        }
+
+        sites[siteCount] = q;
+        starts[siteCount] = start;
+        siteCount++;
+    }
+
+    if (siteCount == 0)
+    {
+        return;
+    }
+
+    int site = 0;
+    for (int i = 0; i < count; i++)
+    {
+        while (site + 1 < siteCount && starts[site + 1] < (double)i)
+        {
+            site++;
+        }
+
+        float offset = (float)(i - sites[site]) * cellSize;
+        pValues[i*stride] = offset*offset + input[sites[site]];
+    }
+}
+
+// Signed distance from each cell center to the contours, negative inside them.
+// Distances are to the contour crossings of the row and column center lines, exact along the line and combined across
+// lines by the distance transform. Taking the nearer of the row and column results leaves errors well under a cell
+// for edges of any slope.
+static void ContourDistances(const std::vector<Contour>& contours, const OffsetGrid& grid, std::vector<float>& distances,
+    std::vector<float>& scratch, std::vector<unsigned char>& inside)
+{
+    int width = grid.width, height = grid.height;
+    size_t cellCount = (size_t)width * height;
+    distances.resize(cellCount);
+    scratch.resize(cellCount);
+    inside.resize(cellCount);
+
+    std::vector<std::vector<Crossing>> lines;
+    std::vector<int> sites;
+    std::vector<double> starts;
+    std::vector<float> input;
+
+    FindCrossings(contours, grid, 0, lines);
+    for (int j = 0; j < height; j++)
+    {
+        LineDistances(lines[j], grid.x0, grid.cellSize, width, &distances[(size_t)j*width], 1, &inside[(size_t)j*width]);
+    }
+
+    for (int i = 0; i < width; i++)
+    {
+        DistanceTransform(&distances[i], height, width, grid.cellSize, sites, starts, input);
+    }
+
+    FindCrossings(contours, grid, 1, lines);
+    for (int i = 0; i < width; i++)
+    {
+        LineDistances(lines[i], grid.y0, grid.cellSize, height, &scratch[i], width, NULL);
+    }
+
+    for (int j = 0; j < height; j++)
+    {
+        DistanceTransform(&scratch[(size_t)j*width], width, 1, grid.cellSize, sites, starts, input);
+    }
+
+    for (size_t c = 0; c < cellCount; c++)
+    {
+        float distance = sqrtf(std::min(distances[c], scratch[c]));
+        distances[c] = inside[c] ? -distance : distance;
+    }
+}
+
+// Closed loops where values cross each of levelCount evenly spaced levels, by marching squares, with the region at or
+// above the level on their left. Samples beyond the grid take padValue. Squares are visited once for all levels, so the
+// cost grows with the grid plus the length of the loops rather than with the grid times the level count.
+static void ExtractLevels(const std::vector<float>& values, const OffsetGrid& grid, float firstLevel, float spacing, int levelCount,
+    float padValue, std::vector<std::vector<Contour>>& levels)
+{
+    struct Segment
+    {
+        unsigned long long startSide, endSide;
+        float x, y; // Start point.
+    };
+
+    int width = grid.width, height = grid.height;
+    auto value = [&](int i, int j) -> float
+    {
+        return (i < 0 || j < 0 || i >= width || j >= height) ? padValue : values[(size_t)j*width + i];
+    };
+
+    // Lattice sides of the padded grid: 2*index of their first corner, plus one for sides running up.
+    auto sideKey = [&](int i, int j, int vertical) -> unsigned long long
+    {
+        return ((unsigned long long)(j + 1) * (width + 2) + (i + 1)) * 2 + vertical;
+    };
+
+    std::vector<std::vector<Segment>> segments(levelCount);
+    static const int CORNER_I[4] = { 0, 1, 1, 0 };
+    static const int CORNER_J[4] = { 0, 0, 1, 1 };
+    for (int j = -1; j < height; j++)
+    {
+        for (int i = -1; i < width; i++)
+        {
+            // Corners counter-clockwise from the bottom left; side k runs from corner k to corner k + 1.
+            float corners[4];
+            float low = FAR_DISTANCE, high = -FAR_DISTANCE;
+            for (int k = 0; k < 4; k++)
+            {
+                corners[k] = value(i + CORNER_I[k], j + CORNER_J[k]);
+                low = std::min(low, corners[k]);
+                high = std::max(high, corners[k]);
+            }
+
+            // Clamped before converting, as padding can be FAR_DISTANCE.
+            float firstFloat = floorf((low - firstLevel) / spacing) + 1.0f, lastFloat = floorf((high - firstLevel) / spacing);
+            int firstIndex = firstFloat <= 0.0f ? 0 : (int)std::min(firstFloat, (float)levelCount);
+            int lastIndex = lastFloat >= (float)(levelCount - 1) ? levelCount - 1 : (int)std::max(lastFloat, -1.0f);
+            for (int index = firstIndex; index <= lastIndex; index++)
+            {
+                float level = firstLevel + (float)index * spacing;
+                bool above[4];
+                for (int k = 0; k < 4; k++)
+                {
+                    above[k] = corners[k] >= level;
+                }
+
+                unsigned long long sides[4] =
+                {
+                    sideKey(i, j, 0), sideKey(i + 1, j, 1), sideKey(i, j + 1, 0), sideKey(i, j, 1)
+                };
+
+                // Two crossings of each kind only happen on saddles, where the center decides whether the above corners
+                // connect through the square, with each loop cutting off a below corner, or are separate islands.
+                bool connected = 0.25f * (corners[0] + corners[1] + corners[2] + corners[3]) >= level;
+                for (int k = 0; k < 4; k++)
+                {
+                    int next = (k + 1) % 4;
+                    if (!above[k] || above[next])
+                    {
+                        continue;
+                    }
+
+                    // The crossing that re-enters the above region, walking on from the below corner k + 1.
+                    int end;
+                    if (above[(k + 2) % 4])
+                    {
+                        end = (connected || above[(k + 3) % 4]) ? next : (k + 3) % 4;
+                    }
+                    else
+                    {
+                        end = above[(k + 3) % 4] ? (k + 2) % 4 : (k + 3) % 4;
+                    }
+
+                    float t = (level - corners[k]) / (corners[next] - corners[k]);
+                    Segment segment;
+                    segment.startSide = sides[k];
+                    segment.endSide = sides[end];
+                    segment.x = grid.X(i + CORNER_I[k]) + t * (float)(CORNER_I[next] - CORNER_I[k]) * grid.cellSize;
+                    segment.y = grid.Y(j + CORNER_J[k]) + t * (float)(CORNER_J[next] - CORNER_J[k]) * grid.cellSize;
+                    segments[index].push_back(segment);
+                }
+            }
+        }
+    }
+
+    levels.resize(levelCount);
+    for (int index = 0; index < levelCount; index++)
+    {
+        // Each segment continues with the one starting on the side it ends on.
+        const std::vector<Segment>& levelSegments = segments[index];
+        std::vector<std::pair<unsigned long long, unsigned int>> starts(levelSegments.size());
+        for (size_t s = 0; s < levelSegments.size(); s++)
+        {
+            starts[s] = std::make_pair(levelSegments[s].startSide, (unsigned int)s);
+        }
+
+        std::sort(starts.begin(), starts.end());
+        std::vector<bool> used(levelSegments.size(), false);
+        levels[index].clear();
+        for (size_t s = 0; s < levelSegments.size(); s++)
+        {
+            Contour loop;
+            size_t current = s;
+            while (!used[current])
+            {
+                used[current] = true;
+                loop.points.push_back(levelSegments[current].x);
+                loop.points.push_back(levelSegments[current].y);
+                std::vector<std::pair<unsigned long long, unsigned int>>::const_iterator next =
+                    std::lower_bound(starts.begin(), starts.end(), std::make_pair(levelSegments[current].endSide, 0u));
+                if (next == starts.end() || next->first != levelSegments[current].endSide)
+                {
+                    break;
+                }
+
+                current = next->second;
+            }
+
+            if (loop.PointCount() >= 3)
+            {
+                levels[index].push_back(Contour());
+                levels[index].back().points.swap(loop.points);
+            }
+        }
+    }
+}
+
+// Drops points within tolerance of the straight path between the points kept around them (Douglas-Peucker), so a pass
+// is not one G-code move per grid cell.
+static void SimplifyLoop(Contour& loop, float tolerance)
+{
+    size_t count = loop.PointCount();
+    if (count <= 3)
+    {
+        return;
+    }
+
+    // The loop is split at the point farthest from its first point, and both halves are simplified as open paths.
+    const std::vector<float>& points = loop.points;
+    size_t farthest = 0;
+    float farthestDistance = -1.0f;
+    for (size_t i = 1; i < count; i++)
+    {
+        float dx = points[i*2] - points[0], dy = points[i*2 + 1] - points[1];
+        if (dx*dx + dy*dy > farthestDistance)
+        {
+            farthestDistance = dx*dx + dy*dy;
+            farthest = i;
+        }
+    }
+
+    std::vector<bool> keep(count, false);
+    keep[0] = keep[farthest] = true;
+    std::vector<std::pair<size_t, size_t>> spans;
+    spans.push_back(std::make_pair((size_t)0, farthest));
+    spans.push_back(std::make_pair(farthest, count)); // Index count is the first point again.
+    while (!spans.empty())
+    {
+        size_t first = spans.back().first, last = spans.back().second;
+        spans.pop_back();
+
+        float ax = points[first*2], ay = points[first*2 + 1];
+        float bx = points[(last % count)*2], by = points[(last % count)*2 + 1];
+        float dx = bx - ax, dy = by - ay;
+        float lengthSquared = dx*dx + dy*dy;
+        size_t worst = first;
+        float worstDistance = tolerance * tolerance;
+        for (size_t i = first + 1; i < last; i++)
+        {
+            float px = points[i*2] - ax, py = points[i*2 + 1] - ay;
+            float t = lengthSquared > 0.0f ? std::max(0.0f, std::min(1.0f, (px*dx + py*dy) / lengthSquared)) : 0.0f;
+            float ex = px - t*dx, ey = py - t*dy;
+            if (ex*ex + ey*ey > worstDistance)
+            {
+                worstDistance = ex*ex + ey*ey;
+                worst = i;
+            }
+        }
+
+        if (worst != first)
+        {
+            keep[worst] = true;
+            spans.push_back(std::make_pair(first, worst));
+            spans.push_back(std::make_pair(worst, last));
+        }
+    }
+
+    std::vector<float> kept;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (keep[i])
+        {
+            kept.push_back(points[i*2]);
+            kept.push_back(points[i*2 + 1]);
+        }
+    }
+
+    loop.points.swap(kept);
+}
+
+// Even-odd point in polygon test.
+static bool ContainsPoint(const Contour& loop, float x, float y)
+{
+    bool inside = false;
+    size_t count = loop.PointCount();
+    for (size_t i = 0, j = count - 1; i < count; j = i++)
+    {
+        float xi = loop.points[i*2], yi = loop.points[i*2 + 1];
+        float xj = loop.points[j*2], yj = loop.points[j*2 + 1];
+        if ((yi > y) != (yj > y) && x < xi + (y - yi) * (xj - xi) / (yj - yi))
+        {
+            inside = !inside;
+        }
+    }
+
+    return inside;
+}
+
+// Bilinearly interpolated grid value, clamped to the grid.
+static float SampleGrid(const std::vector<float>& values, const OffsetGrid& grid, float x, float y)
+{
+    float u = std::max(0.0f, std::min((float)(grid.width - 1), (x - grid.x0) / grid.cellSize - 0.5f));
+    float v = std::max(0.0f, std::min((float)(grid.height - 1), (y - grid.y0) / grid.cellSize - 0.5f));
+    int i = std::min((int)u, grid.width - 2), j = std::min((int)v, grid.height - 2);
+    float s = u - (float)i, t = v - (float)j;
+    const float *pRow = &values[(size_t)j*grid.width + i];
+    return (1.0f - t) * ((1.0f - s)*pRow[0] + s*pRow[1]) + t * ((1.0f - s)*pRow[grid.width] + s*pRow[grid.width + 1]);
+}
+
+// Rotates a closed loop to start at its point nearest (x, y).
+static void StartNearest(Contour& loop, float x, float y)
+{
+    size_t count = loop.PointCount(), nearest = 0;
+    float nearestDistance = FAR_DISTANCE;
+    for (size_t i = 0; i < count; i++)
+    {
+        float dx = loop.points[i*2] - x, dy = loop.points[i*2 + 1] - y;
+        if (dx*dx + dy*dy < nearestDistance)
+        {
+            nearestDistance = dx*dx + dy*dy;
+            nearest = i;
+        }
+    }
+
+    std::rotate(loop.points.begin(), loop.points.begin() + nearest*2, loop.points.end());
+}
+
+// Index of the loop in candidates (skipping used ones) with a point nearest (x, y), or -1 if all are used.
+static int NearestLoop(const std::vector<Contour*>& candidates, const std::vector<bool>& used, float x, float y)
+{
+    int nearest = -1;
+    float nearestDistance = FAR_DISTANCE;
+    for (size_t c = 0; c < candidates.size(); c++)
+    {
+        if (used[c])
+        {
+            continue;
+        }
+
+        const std::vector<float>& points = candidates[c]->points;
+        for (size_t i = 0; i < points.size(); i += 2)
+        {
+            float dx = points[i] - x, dy = points[i + 1] - y;
+            if (dx*dx + dy*dy < nearestDistance)
+            {
+                nearestDistance = dx*dx + dy*dy;
+                nearest = (int)c;
+            }
+        }
+    }
+
+    return nearest;
+}
+
+// Roughing and finishing passes of one layer, in cutting order, from the signed distance to the part at and above it.
+static void BuildLayerPasses(const std::vector<float>& distances, const OffsetGrid& grid, const ToolpathSettings& settings, ToolpathLayer& layer)
+{
+    // Clearance is how much further the tool center can move off the finishing allowance, or in from the stock edge.
+    // Its level sets are the roughing passes.
+    float radius = 0.5f * settings.toolDiameter;
+    std::vector<float> clearance(distances.size());
+    float highest = -FAR_DISTANCE;
+    for (int j = 0; j < grid.height; j++)
+    {
+        float edgeY = std::min((float)j + 0.5f, (float)(grid.height - j) - 0.5f) * grid.cellSize;
+        for (int i = 0; i < grid.width; i++)
+        {
+            float edge = std::min(edgeY, std::min((float)i + 0.5f, (float)(grid.width - i) - 0.5f) * grid.cellSize);
+            size_t c = (size_t)j*grid.width + i;
+            clearance[c] = std::min(distances[c] - radius - settings.finishAllowance, edge);
+            highest = std::max(highest, clearance[c]);
+        }
+    }
+
+    std::vector<std::vector<Contour>> roughing, finishing;
+    if (highest >= 0.0f)
+    {
+        int levelCount = (int)floorf(highest / settings.stepOver) + 1;
+        ExtractLevels(clearance, grid, 0.0f, settings.stepOver, levelCount, -0.5f * grid.cellSize, roughing);
+    }
+
+    ExtractLevels(distances, grid, radius, 1.0f, 1, FAR_DISTANCE, finishing);
+
+    // Slivers from noise in the field are dropped, and the rest simplified.
+    float tolerance = 0.25f * grid.cellSize, minimumArea = grid.cellSize * grid.cellSize;
+    for (size_t level = 0; level <= roughing.size(); level++)
+    {
+        std::vector<Contour>& loops = level < roughing.size() ? roughing[level] : finishing[0];
+        size_t kept = 0;
+        for (size_t l = 0; l < loops.size(); l++)
+        {
+            if (fabsf(loops[l].SignedArea()) >= minimumArea)
+            {
+                SimplifyLoop(loops[l], tolerance);
+                loops[kept++].points.swap(loops[l].points);
+            }
+        }
+
+        loops.resize(kept);
+    }
+
+    // Pockets are the separate areas to clear, bounded by the counter-clockwise loops of the outermost level. Each is
+    // cleared from its middle outwards a level at a time, so every pass has the one inside it already cut.
+    std::vector<Contour*> pockets;
+    std::vector<float> pocketAreas;
+    if (!roughing.empty())
+    {
+        for (size_t l = 0; l < roughing[0].size(); l++)
+        {
+            float area = roughing[0][l].SignedArea();
+            if (area > 0.0f)
+            {
+                pockets.push_back(&roughing[0][l]);
+                pocketAreas.push_back(area);
+            }
+        }
+    }
+
+    // Loops of each pocket by level; a loop belongs to the smallest pocket around it.
+    std::vector<std::vector<std::vector<Contour*>>> pocketLevels(pockets.size(), std::vector<std::vector<Contour*>>(roughing.size()));
+    for (size_t level = 0; level < roughing.size(); level++)
+    {
+        for (size_t l = 0; l < roughing[level].size(); l++)
+        {
+            Contour *pLoop = &roughing[level][l];
+            int owner = -1;
+            for (size_t p = 0; p < pockets.size(); p++)
+            {
+                if (pockets[p] == pLoop)
+                {
+                    owner = (int)p;
+                    break;
+                }
+
+                if (ContainsPoint(*pockets[p], pLoop->points[0], pLoop->points[1]) && (owner < 0 || pocketAreas[p] < pocketAreas[owner]))
+                {
+                    owner = (int)p;
+                }
+            }
+
+            if (owner >= 0)
+            {
+                pocketLevels[owner][level].push_back(pLoop);
+            }
+        }
+    }
+
+    float x = grid.x0, y = grid.y0;
+    float lastLevel = 0.0f;
+    std::vector<bool> pocketDone(pockets.size(), false);
+    for (size_t p = 0; p < pockets.size(); p++)
+    {
+        // Next pocket: the one whose innermost passes start nearest.
+        int nextPocket = -1;
+        float nextDistance = FAR_DISTANCE;
+        for (size_t q = 0; q < pockets.size(); q++)
+        {
+            for (size_t level = roughing.size(); !pocketDone[q] && level-- > 0;)
+            {
+                if (!pocketLevels[q][level].empty())
+                {
+                    const Contour *pLoop = pocketLevels[q][level][0];
+                    float dx = pLoop->points[0] - x, dy = pLoop->points[1] - y;
+                    if (dx*dx + dy*dy < nextDistance)
+                    {
+                        nextDistance = dx*dx + dy*dy;
+                        nextPocket = (int)q;
+                    }
+
+                    break;
+                }
+            }
+        }
+
+        pocketDone[nextPocket] = true;
+        bool firstInPocket = true;
+        for (size_t level = roughing.size(); level-- > 0;)
+        {
+            const std::vector<Contour*>& loops = pocketLevels[nextPocket][level];
+            std::vector<bool> used(loops.size(), false);
+            for (size_t l = 0; l < loops.size(); l++)
+            {
+                int nearest = NearestLoop(loops, used, x, y);
+                used[nearest] = true;
+
+                layer.passes.push_back(ToolpathPass());
+                ToolpathPass& pass = layer.passes.back();
+                pass.path.points.swap(loops[nearest]->points);
+                pass.finishing = false;
+                StartNearest(pass.path, x, y);
+
+                // Passes stay down for moves that keep to floor at least as cleared as the outer of the two passes.
+                float passLevel = settings.stepOver * (float)level;
+                float startX = pass.path.points[0], startY = pass.path.points[1];
+                float length = sqrtf((startX - x)*(startX - x) + (startY - y)*(startY - y));
+                int samples = (int)ceilf(2.0f * length / grid.cellSize);
+                pass.stayDown = !firstInPocket;
+                for (int s = 1; s < samples && pass.stayDown; s++)
+                {
+                    float t = (float)s / (float)samples;
+                    float sample = SampleGrid(clearance, grid, x + t*(startX - x), y + t*(startY - y));
+                    pass.stayDown = sample >= std::min(passLevel, lastLevel) - grid.cellSize;
+                }
+
+                x = startX;
+                y = startY;
+                lastLevel = passLevel;
+                firstInPocket = false;
+            }
+        }
+    }
+
+    // Walls are finished last, each from a retract.
+    std::vector<Contour*> walls;
+    for (size_t l = 0; l < finishing[0].size(); l++)
+    {
+        walls.push_back(&finishing[0][l]);
+    }
+
+    std::vector<bool> used(walls.size(), false);
+    for (size_t l = 0; l < walls.size(); l++)
+    {
+        int nearest = NearestLoop(walls, used, x, y);
+        used[nearest] = true;
+        layer.passes.push_back(ToolpathPass());
+        ToolpathPass& pass = layer.passes.back();
+        pass.path.points.swap(walls[nearest]->points);
+        pass.finishing = true;
+        pass.stayDown = false;
+        StartNearest(pass.path, x, y);
+        x = pass.path.points[0];
+        y = pass.path.points[1];
+    }
+}
+
+ToolpathGenerator::ToolpathGenerator(ThreadPool* pPool, const ToolpathSettings& settings)
+    : pPool(pPool), settings(settings)
+{
+}
+
+void ToolpathGenerator::Generate(const Mesh& mesh, std::vector<ToolpathLayer>& toolpath) const
+{
+    toolpath.clear();
+    MeshSlicer slicer(pPool);
+    std::vector<SliceLayer> slices;
+    slicer.Slice(mesh, settings.stepDown, slices);
+
+    float bounds[4] = { FAR_DISTANCE, FAR_DISTANCE, -FAR_DISTANCE, -FAR_DISTANCE };
+    for (size_t s = 0; s < slices.size(); s++)
+    {
+        for (size_t c = 0; c < slices[s].contours.size(); c++)
+        {
+            const std::vector<float>& points = slices[s].contours[c].points;
+            for (size_t i = 0; i < points.size(); i += 2)
+            {
+                bounds[0] = std::min(bounds[0], points[i]);
+                bounds[1] = std::min(bounds[1], points[i + 1]);
+                bounds[2] = std::max(bounds[2], points[i]);
+                bounds[3] = std::max(bounds[3], points[i + 1]);
+            }
+        }
+    }
+
+    if (bounds[0] > bounds[2])
+    {
+        return;
+    }
+
+    float top = -FAR_DISTANCE, position[3];
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        Mesh::MachinePosition(mesh.vertices[i], position);
+        top = std::max(top, position[2]);
+    }
+
+    float bottom = slices[0].z - 0.5f * settings.stepDown;
+
+    // The stock is the part's bounds plus a tool diameter all around, so passes can go fully around the outside.
+    float margin = settings.toolDiameter;
+    float sizeX = bounds[2] - bounds[0] + 2.0f*margin, sizeY = bounds[3] - bounds[1] + 2.0f*margin;
+    OffsetGrid grid;
+    grid.cellSize = settings.resolution;
+    if (sizeX * sizeY > (float)MAX_GRID_CELLS * grid.cellSize * grid.cellSize)
+    {
+        grid.cellSize = sqrtf(sizeX * sizeY / (float)MAX_GRID_CELLS);
+        std::cout << "Offsetting toolpaths on a " << grid.cellSize << " mm grid to fit the part in memory." << std::endl;
+    }
+
+    grid.x0 = bounds[0] - margin;
+    grid.y0 = bounds[1] - margin;
+    grid.width = std::max(2, (int)ceilf(sizeX / grid.cellSize));
+    grid.height = std::max(2, (int)ceilf(sizeY / grid.cellSize));
+    size_t cellCount = (size_t)grid.width * grid.height;
+
+    // Layers are offset in batches from the top down. A running minimum adds everything above each layer into its
+    // distances, as the tool reaching down to a layer has to stay clear of the part over it as well.
+    size_t layerCount = slices.size();
+    size_t batchSize = pPool ? std::max(1u, pPool->ThreadCount()) : 1;
+    std::vector<std::vector<float>> fields(batchSize);
+    std::vector<float> above(cellCount, FAR_DISTANCE);
+    toolpath.resize(layerCount);
+    for (size_t batchStart = 0; batchStart < layerCount; batchStart += batchSize)
+    {
+        size_t batchCount = std::min(batchSize, layerCount - batchStart);
+        ThreadPool::RunChunks(pPool, batchCount, 1, [&](size_t begin, size_t end)
+        {
+            std::vector<float> scratch;
+            std::vector<unsigned char> inside;
+            for (size_t b = begin; b < end; b++)
+            {
+                ContourDistances(slices[layerCount - 1 - (batchStart + b)].contours, grid, fields[b], scratch, inside);
+            }
+        });
+
+        ThreadPool::RunChunks(pPool, cellCount, 1 << 16, [&](size_t begin, size_t end)
+        {
+            for (size_t c = begin; c < end; c++)
+            {
+                float nearest = above[c];
+                for (size_t b = 0; b < batchCount; b++)
+                {
+                    nearest = std::min(nearest, fields[b][c]);
+                    fields[b][c] = nearest;
+                }
+
+                above[c] = nearest;
+            }
+        });
+
+        ThreadPool::RunChunks(pPool, batchCount, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t b = begin; b < end; b++)
+            {
+                size_t layer = batchStart + b;
+                toolpath[layer].z = bottom + (float)(layerCount - 1 - layer) * settings.stepDown - top;
+                BuildLayerPasses(fields[b], grid, settings, toolpath[layer]);
+            }
+        });
+    }
+}
+
+// G-code for one layer, which starts and ends at the safe height.
+static void FormatLayer(const ToolpathLayer& layer, size_t index, size_t layerCount, const ToolpathSettings& settings, std::string& text)
+{
+    char line[128];
+    sprintf(line, "(Layer %u of %u at Z%.3f)\n", (unsigned int)index + 1, (unsigned int)layerCount, layer.z);
+    text += line;
+    for (size_t p = 0; p < layer.passes.size(); p++)
+    {
+        const ToolpathPass& pass = layer.passes[p];
+        const std::vector<float>& points = pass.path.points;
+        if (pass.stayDown && p > 0)
+        {
+            sprintf(line, "G1 X%.3f Y%.3f F%.0f\n", points[0], points[1], settings.feedRate);
+            text += line;
+        }
+        else
+        {
+            if (p > 0)
+            {
+                sprintf(line, "G0 Z%.3f\n", settings.safeHeight);
+                text += line;
+            }
+
+            sprintf(line, "G0 X%.3f Y%.3f\nG1 Z%.3f F%.0f\n", points[0], points[1], layer.z, settings.plungeRate);
+            text += line;
+        }
+
+        for (size_t i = 2; i <= points.size(); i += 2)
+        {
+            size_t point = i % points.size();
+            sprintf(line, i == 2 ? "G1 X%.3f Y%.3f F%.0f\n" : "G1 X%.3f Y%.3f\n", points[point], points[point + 1], settings.feedRate);
+            text += line;
+        }
+    }
+
+    sprintf(line, "G0 Z%.3f\n", settings.safeHeight);
+    text += line;
+}
+
+bool ToolpathGenerator::WriteGcode(const std::vector<ToolpathLayer>& toolpath, const std::string& filename) const
+{
+    std::ofstream file(filename.c_str());
+    if (!file)
+    {
+        std::cout << "Could not open " << filename << " for writing!" << std::endl;
+        return false;
+    }
+
+    // Layers are formatted in parallel and written in order.
+    std::vector<std::string> layers(toolpath.size());
+    ThreadPool::RunChunks(pPool, toolpath.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            FormatLayer(toolpath[i], i, toolpath.size(), settings, layers[i]);
+        }
+    });
+
+    char line[128];
+    sprintf(line, "(%.3f mm flat end mill, Z zero at the stock top)\n", settings.toolDiameter);
+    file << "(Rcsg-editor 2.5D toolpath)\n" << line << "G21\nG90\nG17\n";
+    sprintf(line, "G0 Z%.3f\nM3 S%d\n", settings.safeHeight, settings.spindleSpeed);
+    file << line;
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        file << layers[i];
+    }
+
+    file << "M5\nM2\n";
+    file.close();
+    if (file.fail())
+    {
+        std::cout << "Could not write " << filename << "!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,75 @@
+/*--------------------------------------------------------------------------
+    ToolpathGenerator.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include "Mesh.h"
+#include "MeshSlicer.h"
+#include "ThreadPool.h"
+
+// Cutting parameters for a flat end mill, in millimeters, millimeters per minute and revolutions per minute.
+struct ToolpathSettings
+{
+    float toolDiameter;
+    float stepDown;        // Depth of each layer of passes.
+    float stepOver;        // Spacing between roughing passes, below the tool diameter.
+    float finishAllowance; // Wall stock roughing leaves for the finishing pass.
+    float resolution;      // Offset grid cell size, which bounds how closely passes follow the part.
+    float safeHeight;      // Above the stock top, for rapid moves.
+    float feedRate, plungeRate;
+    int spindleSpeed;
+
+    ToolpathSettings();
+};
+
+// One closed pass at a layer's depth, cut from its first point around and back to it.
+struct ToolpathPass
+{
+    Contour path;
+    bool finishing;
+    bool stayDown; // Reached from the previous pass by feeding across cleared floor rather than retracting.
+};
+
+struct ToolpathLayer
+{
+    float z; // Depth below the stock top.
+    std::vector<ToolpathPass> passes;
+};
+
+// 2.5D milling: the part is sliced at every step down, and each layer is cleared around everything at or above it by
+// contour-parallel roughing passes, after which the walls get a finishing pass at exactly the tool radius.
+// Offsets are level sets of a signed distance field of the layer contours, so passes split and merge around features
+// without polygon clipping. Layers are offset and linked in parallel.
+class ToolpathGenerator
+{
+    ThreadPool *pPool;
+    ToolpathSettings settings;
+
+    // Largest offset grid per layer; coarser cells are used for parts that would need more.
+    static const int MAX_GRID_CELLS = 1 << 24;
+
+public:
+    ToolpathGenerator(ThreadPool* pPool, const ToolpathSettings& settings);
+
+    // Layers run from the top down. The stock is the part's bounding box plus the tool diameter on every side.
+    void Generate(const Mesh& mesh, std::vector<ToolpathLayer>& toolpath) const;
+
+    // G-code for a spindle turning clockwise (M3), so passes are climb milled. Z zero is the stock top.
+    bool WriteGcode(const std::vector<ToolpathLayer>& toolpath, const std::string& filename) const;
+};
@@ -0,0 +1,53 @@
+/*--------------------------------------------------------------------------
+    UniformBlocks.h
+    Copyright (C) 2014 Gustave Granroth. (gus.gran@gmail.com)
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+--------------------------------------------------------------------------*/
+#pragma once
+
+#include "stdafx.h"
+#include <algorithm>
+
+// std140 layouts of the uniform blocks declared in shaders/render.vs, and their binding points.
+static const GLuint FRAME_BLOCK_BINDING = 0;
+static const GLuint OBJECT_BLOCK_BINDING = 1;
+
+// Written once per frame.
+struct FrameBlock
+{
+    float projection[16];
+};
+
+// Written once per draw.
+struct ObjectBlock
+{
+    float modelView[16];
+    float colorOverride[4]; // Replaces the vertex color when alpha is non-zero.
+    unsigned int material;
+    unsigned int textureLayer; // Layer of the bound material texture array.
+    float textureScale;        // Triplanar texture repeats per unit of part space.
+    unsigned int padding;
+
+    void Set(const float modelView[16], unsigned int material)
+    {
+        std::copy(modelView, modelView + 16, this->modelView);
+        colorOverride[0] = colorOverride[1] = colorOverride[2] = colorOverride[3] = 0.0f;
+        this->material = material;
+        textureLayer = 0;
+        textureScale = 1.0f;
+        padding = 0;
+    }
+};
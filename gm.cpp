@@ -38,18 +38,19 @@ namespace gm
     // Generates a look-at matrix
     mat4 Lookat(vec3 target, vec3 camera, vec3 up)
     {
-         vec3 forward = (target - camera).Normalize();
+        vec3 forward = (target - camera).Normalize();
         vec3 upNorm = up.Normalize();
 
-        vec3 side = forward.Cross(upNorm);
+        vec3 side = forward.Cross(upNorm).Normalize();
         vec3 upNew = side.Cross(forward);
 
+        // The basis vectors are the rows of the rotation, with the camera looking down -Z.
         mat4 result;
 
-        result[0] = vec4(side[0], side[1], side[2], 0.0f);
-        result[1] = vec4(upNew[0], upNew[1], upNew[2], 0.0f);
-        result[2] = vec4(forward[0], forward[1], forward[2], 0.0f);
-        result[3] = vec4(-camera[0], -camera[1], -camera[2], 1.0f);
+        result[0] = vec4(side[0], upNew[0], -forward[0], 0.0f);
+        result[1] = vec4(side[1], upNew[1], -forward[1], 0.0f);
+        result[2] = vec4(side[2], upNew[2], -forward[2], 0.0f);
+        result[3] = vec4(-side.Dot(camera), -upNew.Dot(camera), forward.Dot(camera), 1.0f);
 
         return result;
     }
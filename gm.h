@@ -89,11 +89,16 @@ namespace gm
             return data[i];
         }
 
+        const T& operator [] (int i) const
+        {
+            return data[i];
+        }
+
         // Default, copy, and assignmentructors
         vecX()
         {}
 
-        vecX(vecX& other)
+        vecX(const vecX& other)
         {
             for (size_t i = 0; i < length; i++)
             {
@@ -101,7 +106,7 @@ namespace gm
             }
         }
 
-        vecX& operator=(vecX& other)
+        vecX& operator=(const vecX& other)
         {
             for (size_t i = 0; i < length; i++)
             {
@@ -178,7 +183,7 @@ namespace gm
         }
 
         // Memberwise multiplication / division / addition / subtraction
-        vecX operator * (vecX other)
+        vecX operator * (const vecX& other)
         {
             vecX<T, length> result;
             for (size_t i = 0; i < length; i++)
@@ -189,7 +194,7 @@ namespace gm
             return result;
         }
         
-        vecX operator / (vecX other)
+        vecX operator / (const vecX& other)
         {
             vecX<T, length> result;
             for (size_t i = 0; i < length; i++)
@@ -200,7 +205,7 @@ namespace gm
             return result;
         }
 
-        vecX operator + (vecX other)
+        vecX operator + (const vecX& other)
         {
             vecX<T, length> result;
             for (size_t i = 0; i < length; i++)
@@ -211,7 +216,7 @@ namespace gm
             return result;
         }
 
-        vecX operator - (vecX other)
+        vecX operator - (const vecX& other)
         {
             vecX<T, length> result;
             for (size_t i = 0; i < length; i++)
@@ -236,7 +241,7 @@ namespace gm
         // Dot product
         T Dot (vecX<T, length>& other)
         {
-            T result;
+            T result = 0;
             for (size_t i = 0; i < length; i++)
             {
                 result += (data[i]*other[i]);
@@ -291,7 +296,7 @@ namespace gm
     public:
         vecT2 ()
         { }
-        vecT2 (vecX<T, 2>& other) : vecX<T, 2>(other)
+        vecT2 (const vecX<T, 2>& other) : vecX<T, 2>(other)
         { }
         vecT2(T x, T y)
         {
@@ -307,7 +312,7 @@ namespace gm
     public:
         vecT3 ()
         { }
-        vecT3 (vecX<T, 3>& other) : vecX<T, 3>(other)
+        vecT3 (const vecX<T, 3>& other) : vecX<T, 3>(other)
         { }
         vecT3(T x, T y, T z)
         {
@@ -317,12 +322,12 @@ namespace gm
         }
 
         // Cross product (defined only for 3-element vectors)
-        vecT3<T> Cross(vecX<T, 3>& other)
+        vecT3<T> Cross(const vecX<T, 3>& other)
         {
             vecT3<T> result;
-            result[0] = data[1]*other[2] - data[2]*other[1];
-            result[1] = data[2]*other[0] - data[0]*other[2];
-            result[2] = data[0]*other[1] - data[1]*other[0];
+            result[0] = this->data[1]*other[2] - this->data[2]*other[1];
+            result[1] = this->data[2]*other[0] - this->data[0]*other[2];
+            result[2] = this->data[0]*other[1] - this->data[1]*other[0];
 
             return result;
         }
@@ -335,7 +340,7 @@ namespace gm
     public:
         vecT4 ()
         { }
-        vecT4 (vecX<T, 4>& other) : vecX<T, 4>(other)
+        vecT4 (const vecX<T, 4>& other) : vecX<T, 4>(other)
         { }
         vecT4(T x, T y, T z, T w)
         {
@@ -384,7 +389,7 @@ namespace gm
         // Data access operators
         T& operator [] (int n)
         {
-            return data[i];
+            return data[n];
         }
 
         // Basic mathematical operators
@@ -443,6 +448,7 @@ namespace gm
         // Quaternion access as a rotation matrix.
         matXY<T, 4, 4> ToMatrix()
         {
+            T x = data[0], y = data[1], z = data[2], w = data[3];
             matXY<T,4,4> result;
             
             result[0][0] = T(1) - T(2) * (y*y + z*z);
@@ -450,7 +456,7 @@ namespace gm
             result[0][2] = T(2) * (x*z + y*w);
             result[0][3] = T(0);
 
-            result[1][0] = T(2) * (xy + z*w);
+            result[1][0] = T(2) * (x*y + z*w);
             result[1][1] = T(1) - T(2) * (x*x + z*z);
             result[1][2] = T(2) * (y*z - x*w);
             result[1][3] = T(0);
@@ -484,6 +490,11 @@ namespace gm
             return data[i];
         }
 
+        const vecX<T, height>& operator [] (int i) const
+        {
+            return data[i];
+        }
+
         //ructors
         matXY()
         { }
@@ -499,7 +510,7 @@ namespace gm
             }
         }
 
-        matXY(matXY& other)
+        matXY(const matXY& other)
         {
             for (int i = 0; i < width; i++)
             {
@@ -507,7 +518,7 @@ namespace gm
             }
         }
 
-        matXY& operator = (matXY<T, width, height>& other)
+        matXY& operator = (const matXY<T, width, height>& other)
         {
             for (int i = 0; i < width; i++)
             {
@@ -537,8 +548,8 @@ namespace gm
         // Addition
         matXY& operator + (matXY<T, width, height>& other)
         {
-            matXY<T, w, n> result;
-            for (int i = 0; n < width; i++)
+            matXY<T, width, height> result;
+            for (int i = 0; i < width; i++)
             {
                 result[i] = data[i] + other[i];
             }
@@ -549,9 +560,9 @@ namespace gm
         // Subtraction
         matXY& operator - (matXY<T, width, height>& other)
         {
-            matXY<T, w, n> result;
+            matXY<T, width, height> result;
 
-            for (int i = 0; n < width; i++)
+            for (int i = 0; i < width; i++)
             {
                 result[i] = data[i] - other[i];
             }
@@ -562,8 +573,8 @@ namespace gm
         // Memberwise scalar multiplication
         matXY& operator * (T other)
         {
-            matXY<T, w, n> result;
-            for (int i = 0; n < width; i++)
+            matXY<T, width, height> result;
+            for (int i = 0; i < width; i++)
             {
                 result[i] = data[i] * other;
             }
@@ -572,7 +583,7 @@ namespace gm
         }
 
         // Matrix multiplication (Handles square matrixes only)
-        matXY<T, width, height> operator * (matXY<T, width, height>& other)
+        matXY<T, width, height> operator * (const matXY<T, width, height>& other)
         {
             matXY<T, width, height> result (0);
 
@@ -629,7 +640,7 @@ namespace gm
         { }
         matT2(T clear) : matXY<T, 2, 2>(clear)
         { }
-        matT2(matXY<T, 2, 2>& other) : matXY<T, 2, 2>(other)
+        matT2(const matXY<T, 2, 2>& other) : matXY<T, 2, 2>(other)
         { }
     };
 
@@ -642,7 +653,7 @@ namespace gm
         { }
         matT4(T clear) : matXY<T, 4, 4>(clear)
         { }
-        matT4(matXY<T, 4, 4>& other) : matXY<T,4, 4>(other)
+        matT4(const matXY<T, 4, 4>& other) : matXY<T,4, 4>(other)
         { }
     };
 }
\ No newline at end of file
@@ -0,0 +1,6 @@
+#version 430 core
+
+// Depth-only pass: the far-plane depth from the vertex shader overwrites rejected candidate pixels.
+void main(void)
+{
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 430 core
+
+layout (binding = 0) uniform sampler2D candidate_depth;
+
+void main(void)
+{
+	// Copy surviving candidate depths; the accumulation depth test keeps the nearest one.
+	float depth = texelFetch(candidate_depth, ivec2(gl_FragCoord.xy), 0).r;
+	if (depth >= 1.0)
+	{
+		discard;
+	}
+
+	gl_FragDepth = depth;
+}
\ No newline at end of file
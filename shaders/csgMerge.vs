@@ -0,0 +1,8 @@
+#version 430 core
+
+void main(void)
+{
+    // One triangle covering the whole screen, on the far plane, generated from the vertex index.
+    vec2 position = vec2((gl_VertexID & 1) * 4.0 - 1.0, (gl_VertexID >> 1) * 4.0 - 1.0);
+    gl_Position = vec4(position, 1.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+#version 430 core
+
+layout (location = 0) in vec2 position; // Normalized device coordinates.
+layout (location = 1) in vec3 color;
+
+out vec3 fs_color;
+
+void main(void)
+{
+    fs_color = color;
+    gl_Position = vec4(position, 0.0, 1.0);
+}
@@ -5,9 +5,56 @@ out vec4 color;
 in VS_OUT
 {
     vec4 color;
+    vec3 worldPosition;
+#ifdef NORMALS
+    vec3 normal;
+#endif
+#ifdef TEXTURED
+    vec2 uv;
+#endif
+#if defined(TEXTURED) || defined(TRIPLANAR)
+    flat uint layer;
+#endif
+#ifdef TRIPLANAR
+    vec3 partPosition;
+#ifdef NORMALS
+    vec3 partNormal;
+#endif
+#endif
 } fs_in;
 
+#if defined(TEXTURED) || defined(TRIPLANAR)
+// Material textures share array textures; TextureManager picks the array and the layer.
+layout (binding = 0) uniform sampler2DArray material_textures;
+#endif
+
 void main(void)
 {
-	color = fs_in.color;
+#ifdef NORMALS
+	vec3 normal = normalize(fs_in.normal);
+#else
+	// Generated meshes carry no normals, so shade with the face normal from screen-space derivatives.
+	vec3 normal = normalize(cross(dFdx(fs_in.worldPosition), dFdy(fs_in.worldPosition)));
+#endif
+	float diffuse = max(dot(normal, normalize(vec3(0.4, 0.7, 0.6))), 0.0);
+
+	vec4 albedo = fs_in.color;
+#ifdef TEXTURED
+	albedo *= texture(material_textures, vec3(fs_in.uv, float(fs_in.layer)));
+#elif defined(TRIPLANAR)
+	// CSG output has no texture coordinates, and cut faces could not keep any, so the texture is projected along
+	// each part axis and blended by how squarely the surface faces it.
+#ifdef NORMALS
+	vec3 partNormal = normalize(fs_in.partNormal);
+#else
+	vec3 partNormal = normalize(cross(dFdx(fs_in.partPosition), dFdy(fs_in.partPosition)));
+#endif
+	vec3 weights = pow(abs(partNormal), vec3(4.0));
+	weights /= weights.x + weights.y + weights.z;
+	float layer = float(fs_in.layer);
+	albedo *= texture(material_textures, vec3(fs_in.partPosition.zy, layer)) * weights.x
+		+ texture(material_textures, vec3(fs_in.partPosition.xz, layer)) * weights.y
+		+ texture(material_textures, vec3(fs_in.partPosition.xy, layer)) * weights.z;
+#endif
+	color = vec4(albedo.rgb * (0.3 + 0.7 * diffuse), albedo.a);
 }
\ No newline at end of file
@@ -2,33 +2,79 @@
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 color;
+#ifdef NORMALS
+layout (location = 2) in vec3 normal;
+#endif
+#ifdef TEXTURED
+layout (location = 3) in vec2 uv;
+#endif
+#ifdef INSTANCED
+layout (location = 4) in mat4 instance_matrix; // Model transform of each instance, applied before mv_matrix.
+#endif
 
 out VS_OUT
 {
     vec4 color;
+    vec3 worldPosition;
+#ifdef NORMALS
+    vec3 normal;
+#endif
+#ifdef TEXTURED
+    vec2 uv;
+#endif
+#if defined(TEXTURED) || defined(TRIPLANAR)
+    flat uint layer;
+#endif
+#ifdef TRIPLANAR
+    vec3 partPosition; // Scaled to texture repeats, so the texture stays fixed to the part as it moves.
+#ifdef NORMALS
+    vec3 partNormal;
+#endif
+#endif
 } vs_out;
 
-uniform mat4 mv_matrix;
-uniform mat4 proj_matrix;
-
-void main(void)
+// Streamed through a BufferRing; UniformBlocks.h has the matching layouts.
+layout (std140, binding = 0) uniform FrameData
 {
-    vec4 pos = vec4(position, 1);
+    mat4 proj_matrix;
+};
 
-    // Compute where we are for this shape
-    int count = 10;
-    float spacing = 1.5;
-    int y = gl_InstanceID/count;
-    int x = gl_InstanceID - y*count;
+layout (std140, binding = 1) uniform ObjectData
+{
+    mat4 mv_matrix;
+    vec4 color_override; // Replaces the vertex color when alpha is non-zero.
+    uint material;
+    uint texture_layer;
+    float texture_scale;
+};
 
-    mat4 translateMatrix;
-    translateMatrix[0] = vec4(1.0, 0.0, 0.0, 0.0);
-    translateMatrix[1] = vec4(0.0, 1.0, 0.0, 0.0);
-    translateMatrix[2] = vec4(0.0, 0.0, 1.0, 0.0);
-    translateMatrix[3] = vec4((x - count/2)*spacing, (y - count/2)*spacing, 0.0, 1.0);
+void main(void)
+{
+#ifdef INSTANCED
+    mat4 model_view = mv_matrix * instance_matrix;
+#else
+    mat4 model_view = mv_matrix;
+#endif
 
-    gl_Position = proj_matrix * mv_matrix * translateMatrix * mv_matrix * pos;
+    vec4 pos = model_view * vec4(position, 1);
+    gl_Position = proj_matrix * pos;
     
     // Output stuff to the fragment shader
-    vs_out.color = vec4(pos.x*4, pos.y*4, pos.z*4, 1);
+    vs_out.color = color_override.a > 0.0 ? color_override : vec4(color, 1);
+    vs_out.worldPosition = pos.xyz;
+#ifdef NORMALS
+    vs_out.normal = mat3(model_view) * normal; // Transforms are rigid or uniformly scaled.
+#endif
+#ifdef TEXTURED
+    vs_out.uv = uv;
+#endif
+#if defined(TEXTURED) || defined(TRIPLANAR)
+    vs_out.layer = texture_layer;
+#endif
+#ifdef TRIPLANAR
+    vs_out.partPosition = position * texture_scale;
+#ifdef NORMALS
+    vs_out.partNormal = normal;
+#endif
+#endif
 }
\ No newline at end of file